@@ -3,10 +3,17 @@
 //    HelloWorld.cpp
 //
 // DESCRIPTION:
-//    Visits all functions in a module, prints their names and the number of
-//    arguments via stderr. Strictly speaking, this is an analysis pass (i.e.
-//    the functions are not modified). However, in order to keep things simple
-//    there's no 'print' method here (every analysis pass should implement it).
+//    Visits all functions in a module and, for every basic block, prints the
+//    variables (i.e. named allocas) that are upward-exposed (UEVAR), defined
+//    (VARKILL) and live on exit (LIVEOUT) via stderr. Strictly speaking, this
+//    is an analysis pass (i.e. the functions are not modified). However, in
+//    order to keep things simple there's no 'print' method here (every
+//    analysis pass should implement it).
+//
+//    HelloWorld is self-contained, so that it can be built out of tree on its
+//    own. The same dataflow is available to other passes as the cached
+//    Liveness analysis (see lib/Liveness.cpp), whose printer
+//    (`print<liveness>`) produces the same output.
 //
 // USAGE:
 //    New PM
@@ -16,14 +23,19 @@
 //
 // License: MIT
 //=============================================================================
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FormatVariadic.h"
-#include <map>
 #include <deque>
-#include <set>
+#include <vector>
 
 using namespace llvm;
 
@@ -36,114 +48,126 @@ namespace {
 
 
 // This method implements what the pass does
+//
+// The dataflow is solved over dense bit-vectors: every named alloca is given
+// an index and UEVar/VarKill/LiveOut are stored as one BitVector per block.
+// Blocks are seeded into the worklist in post-order (i.e. reverse RPO, which
+// is the natural order for a backward problem) and a block is never queued
+// twice.
 void visitor(Function &F) {
-        std::map<BasicBlock *, std::set<Value *>> UEVarMap;
-        std::map<BasicBlock *, std::set<Value *>> VarKillMap;
-        std::map<BasicBlock *, std::set<Value *>> LiveOutMap;
-        std::map<Value *, Value *> MemToVar;  // Maps memory locations (allocas) to variables
-
-        // Step 1: Identify allocated variables (`alloca`)
-        for (BasicBlock &BB : F) {
-            for (Instruction &I : BB) {
-                if (auto *AI = dyn_cast<AllocaInst>(&I)) {
-                    if (AI->hasName()) {
-                        MemToVar[AI] = AI;  // Map alloca to itself as the variable
-                    }
-                }
-            }
-        }
-
-        // Step 2: Compute UEVar and VarKill for each block
-        for (BasicBlock &BB : F) {
-            std::set<Value *> UEVar;
-            std::set<Value *> VarKill;
-            std::set<Value *> defined;
-
-            for (Instruction &I : BB) {
-                // Handle StoreInst: defines a variable
-                if (auto *SI = dyn_cast<StoreInst>(&I)) {
-                    Value *storedVarPtr = SI->getPointerOperand();
-                    if (MemToVar.find(storedVarPtr) != MemToVar.end()) {
-                        Value *var = MemToVar[storedVarPtr];
-                        VarKill.insert(var);
-                        defined.insert(var);
-                    }
-                    continue;
-                }
-
-                // Handle LoadInst: uses a variable
-                if (auto *LI = dyn_cast<LoadInst>(&I)) {
-                    Value *loadedVarPtr = LI->getPointerOperand();
-                    if (MemToVar.find(loadedVarPtr) != MemToVar.end()) {
-                        Value *var = MemToVar[loadedVarPtr];
-                        if (defined.find(var) == defined.end()) {
-                            UEVar.insert(var);
-                        }
-                    }
-                    continue;
-                }
-
-                // Other instructions (add, icmp, etc.) are ignored as they handle SSA temporaries
-            }
-
-            UEVarMap[&BB] = UEVar;
-            VarKillMap[&BB] = VarKill;
-        }
-
-        // Step 3: Compute LiveOut using worklist-based approach
-        std::deque<BasicBlock *> worklist;
-        for (BasicBlock &BB : F) {
-            worklist.push_back(&BB);
-        }
-
-        while (!worklist.empty()) {
-            BasicBlock *BB = worklist.front();
-            worklist.pop_front();
-
-            std::set<Value *> newLiveOut;
-
-            for (BasicBlock *Succ : successors(BB)) {
-                // Add UEVar of successor
-                for (Value *V : UEVarMap[Succ]) {
-                    newLiveOut.insert(V);
-                }
-                // Add (LiveOut of successor - VarKill of successor)
-                for (Value *V : LiveOutMap[Succ]) {
-                    if (VarKillMap[Succ].find(V) == VarKillMap[Succ].end()) {
-                        newLiveOut.insert(V);
-                    }
-                }
-            }
-
-            if (newLiveOut != LiveOutMap[BB]) {
-                LiveOutMap[BB] = newLiveOut;
-                for (BasicBlock *Pred : predecessors(BB)) {
-                    worklist.push_back(Pred);
-                }
-            }
-        }
-
-        // Step 4: Print the results
-        for (BasicBlock &BB : F) {
-            errs() << "----- " << BB.getName() << " -----\n";
-
-            auto printVarSet = [](const std::string &label, const std::set<Value *> &varSet) {
-                errs() << label << ": ";
-                bool first = true;
-                for (Value *V : varSet) {
-                    if (V->hasName()) {
-                        if (!first) errs() << " ";
-                        errs() << V->getName();
-                        first = false;
-                    }
-                }
-                errs() << "\n";
-            };
-
-            printVarSet("UEVAR", UEVarMap[&BB]);
-            printVarSet("VARKILL", VarKillMap[&BB]);
-            printVarSet("LIVEOUT", LiveOutMap[&BB]);
-        }
+  // Step 1: Identify allocated variables (`alloca`) and give each one an
+  // index. The indices follow the program order of the allocas, so that the
+  // printed sets don't depend on where the allocas live in memory.
+  SmallVector<AllocaInst *, 16> Vars;
+  for (Instruction &I : instructions(F))
+    if (auto *AI = dyn_cast<AllocaInst>(&I))
+      if (AI->hasName())
+        Vars.push_back(AI);
+
+  DenseMap<const Value *, unsigned> VarIdx;
+  for (unsigned Idx = 0, E = Vars.size(); Idx != E; ++Idx)
+    VarIdx[Vars[Idx]] = Idx;
+
+  // Give each block an index (in layout order)
+  SmallVector<BasicBlock *, 32> Blocks;
+  DenseMap<const BasicBlock *, unsigned> BlockIdx;
+  for (BasicBlock &BB : F) {
+    BlockIdx[&BB] = Blocks.size();
+    Blocks.push_back(&BB);
+  }
+
+  unsigned NumVars = Vars.size();
+  unsigned NumBlocks = Blocks.size();
+  std::vector<BitVector> UEVar(NumBlocks, BitVector(NumVars));
+  std::vector<BitVector> VarKill(NumBlocks, BitVector(NumVars));
+  std::vector<BitVector> LiveOut(NumBlocks, BitVector(NumVars));
+
+  // Step 2: Compute UEVar and VarKill for each block
+  for (unsigned BBIdx = 0; BBIdx != NumBlocks; ++BBIdx) {
+    for (Instruction &I : *Blocks[BBIdx]) {
+      // Handle StoreInst: defines a variable
+      if (auto *SI = dyn_cast<StoreInst>(&I)) {
+        auto It = VarIdx.find(SI->getPointerOperand());
+        if (It != VarIdx.end())
+          VarKill[BBIdx].set(It->second);
+        continue;
+      }
+
+      // Handle LoadInst: uses a variable (upward-exposed only if it hasn't
+      // been defined earlier in this block)
+      if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        auto It = VarIdx.find(LI->getPointerOperand());
+        if (It != VarIdx.end() && !VarKill[BBIdx].test(It->second))
+          UEVar[BBIdx].set(It->second);
+        continue;
+      }
+
+      // Other instructions (add, icmp, etc.) are ignored as they handle SSA
+      // temporaries
+    }
+  }
+
+  // Step 3: Compute LiveOut using worklist-based approach. Reachable blocks
+  // are seeded in post-order, unreachable blocks are appended at the end.
+  std::deque<unsigned> Worklist;
+  BitVector InWorklist(NumBlocks);
+  auto Enqueue = [&](const BasicBlock *BB) {
+    unsigned Idx = BlockIdx.lookup(BB);
+    if (InWorklist.test(Idx))
+      return;
+    InWorklist.set(Idx);
+    Worklist.push_back(Idx);
+  };
+
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : llvm::reverse(RPOT))
+    Enqueue(BB);
+  for (BasicBlock *BB : Blocks)
+    Enqueue(BB);
+
+  BitVector NewLiveOut(NumVars);
+  BitVector Tmp(NumVars);
+  while (!Worklist.empty()) {
+    unsigned BBIdx = Worklist.front();
+    Worklist.pop_front();
+    InWorklist.reset(BBIdx);
+
+    // LiveOut(BB) = U_{Succ} UEVar(Succ) | (LiveOut(Succ) & ~VarKill(Succ))
+    NewLiveOut.reset();
+    for (BasicBlock *Succ : successors(Blocks[BBIdx])) {
+      unsigned SuccIdx = BlockIdx.lookup(Succ);
+      Tmp = LiveOut[SuccIdx];
+      Tmp.reset(VarKill[SuccIdx]);
+      Tmp |= UEVar[SuccIdx];
+      NewLiveOut |= Tmp;
+    }
+
+    if (NewLiveOut != LiveOut[BBIdx]) {
+      LiveOut[BBIdx] = NewLiveOut;
+      for (BasicBlock *Pred : predecessors(Blocks[BBIdx]))
+        Enqueue(Pred);
+    }
+  }
+
+  // Step 4: Print the results
+  auto printVarSet = [&Vars](const char *Label, const BitVector &VarSet) {
+    errs() << Label << ": ";
+    bool First = true;
+    for (unsigned Idx : VarSet.set_bits()) {
+      if (!First)
+        errs() << " ";
+      errs() << Vars[Idx]->getName();
+      First = false;
+    }
+    errs() << "\n";
+  };
+
+  for (unsigned BBIdx = 0; BBIdx != NumBlocks; ++BBIdx) {
+    errs() << "----- " << Blocks[BBIdx]->getName() << " -----\n";
+    printVarSet("UEVAR", UEVar[BBIdx]);
+    printVarSet("VARKILL", VarKill[BBIdx]);
+    printVarSet("LIVEOUT", LiveOut[BBIdx]);
+  }
 }
 
 // New PM implementation
@@ -183,7 +207,9 @@ llvm::PassPluginLibraryInfo getHelloWorldPluginInfo() {
 // This is the core interface for pass plugins. It guarantees that 'opt' will
 // be able to recognize HelloWorld when added to the pass pipeline on the
 // command line, i.e. via '-passes=hello-world'
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getHelloWorldPluginInfo();
 }
+#endif
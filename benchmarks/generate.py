@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+# === generate.py =============================================================
+#  Generates scalable LLVM IR modules for benchmarking the llvm-tutor passes
+#
+#  DESCRIPTION:
+#   Every "family" of modules stresses a different dimension of the passes:
+#     * deep-domtree    - one function with a chain of N nested conditionals,
+#                         i.e. a dominator tree of depth N (RIV, DuplicateBB)
+#     * wide-switch     - a switch with N cases, the case blocks come in 4
+#                         groups of identical blocks (MergeBB)
+#     * many-globals    - N integer globals, all loaded in one function
+#                         (RIV with `require<integer-globals>`)
+#     * long-blocks     - one basic block with N integer, floating-point and
+#                         memory instructions (MBA, OpcodeCounter,
+#                         ConvertFCmpEq, Liveness)
+#     * many-functions  - N functions that call each other, directly and via a
+#                         constant table of function pointers
+#                         (StaticCallCounter, DynamicCallCounter,
+#                         InjectFuncCall)
+#   The generated modules are deterministic, i.e. the same family and size
+#   always give the same module.
+#
+#  USAGE:
+#    python3 benchmarks/generate.py --family deep-domtree --size 100 -o out.ll
+#    python3 benchmarks/generate.py --list
+#
+# =============================================================================
+import argparse
+import sys
+
+
+def deep_domtree(n):
+    lines = ["define i32 @deep(i32 %x, i32 %y) {", "bb0:", "  br label %bb1"]
+    prev = "%x"
+    for k in range(1, n + 1):
+        lines += [
+            f"bb{k}:",
+            f"  %v{k} = add i32 {prev}, {k}",
+            f"  %a{k} = xor i32 %v{k}, %x",
+            f"  %s{k} = sub i32 %a{k}, %y",
+            f"  %m{k} = and i32 %s{k}, {k * 7 + 1}",
+            f"  %c{k} = icmp slt i32 %m{k}, %y",
+            f"  br i1 %c{k}, label %bb{k + 1}, label %exit",
+        ]
+        prev = f"%m{k}"
+    incoming = ", ".join(f"[ %v{k}, %bb{k} ]" for k in range(1, n + 1))
+    lines += [
+        f"bb{n + 1}:",
+        "  br label %exit",
+        "exit:",
+        f"  %r = phi i32 {incoming}, [ {prev}, %bb{n + 1} ]",
+        "  ret i32 %r",
+        "}",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+def wide_switch(n):
+    lines = ["@out = global i32 0", "",
+             "define void @wide(i32 %x, i32 %y) {", "entry:",
+             "  switch i32 %x, label %exit ["]
+    lines += [f"    i32 {k}, label %case{k}" for k in range(n)]
+    lines.append("  ]")
+    for k in range(n):
+        # Four groups of identical blocks, so that MergeBB has something to
+        # merge (and something to reject)
+        lines += [
+            f"case{k}:",
+            f"  %a{k} = add i32 %x, %y",
+            f"  %b{k} = mul i32 %a{k}, {k % 4 + 3}",
+            f"  store i32 %b{k}, ptr @out",
+            "  br label %exit",
+        ]
+    lines += ["exit:", "  ret void", "}"]
+    return "\n".join(lines) + "\n"
+
+
+def many_globals(n):
+    lines = [f"@g{k} = global i32 {k}" for k in range(n)]
+    lines += ["", "define i32 @use_globals(i32 %x) {", "entry:",
+              "  br label %bb0"]
+    prev = "%x"
+    # One block per 16 globals
+    num_blocks = (n + 15) // 16
+    for b in range(num_blocks):
+        lines.append(f"bb{b}:")
+        for k in range(b * 16, min(n, (b + 1) * 16)):
+            lines += [f"  %l{k} = load i32, ptr @g{k}",
+                      f"  %s{k} = add i32 {prev}, %l{k}"]
+            prev = f"%s{k}"
+        lines.append(f"  br label %bb{b + 1}")
+    lines += [f"bb{num_blocks}:", f"  ret i32 {prev}", "}"]
+    return "\n".join(lines) + "\n"
+
+
+def long_blocks(n):
+    int_ops = ["add", "sub", "and", "or", "xor", "mul"]
+    lines = ["define i32 @long(i32 %x, i32 %y, double %d) {", "entry:",
+             "  %p = alloca i32", "  %q = alloca double"]
+    i_prev2, i_prev, f_prev = "%x", "%y", "%d"
+    for k in range(n):
+        kind = k % 8
+        if kind < 6:
+            lines.append(
+                f"  %i{k} = {int_ops[kind]} i32 {i_prev}, {i_prev2}")
+            i_prev2, i_prev = i_prev, f"%i{k}"
+        elif kind == 6:
+            lines += [f"  %f{k} = fadd double {f_prev}, 1.0",
+                      f"  %fc{k} = fcmp oeq double %f{k}, %d",
+                      f"  %z{k} = zext i1 %fc{k} to i32",
+                      f"  store double %f{k}, ptr %q"]
+            f_prev = f"%f{k}"
+            i_prev2, i_prev = i_prev, f"%z{k}"
+        else:
+            lines += [f"  store i32 {i_prev}, ptr %p",
+                      f"  %ld{k} = load i32, ptr %p"]
+            i_prev2, i_prev = i_prev, f"%ld{k}"
+    lines += [f"  ret i32 {i_prev}", "}"]
+    return "\n".join(lines) + "\n"
+
+
+def many_functions(n):
+    lines = []
+    # A constant table of function pointers (a "vtable")
+    table = ", ".join(f"ptr @f{k}" for k in range(n))
+    lines += [f"@table = internal constant [{n} x ptr] [{table}]", ""]
+    for k in range(n):
+        lines += [f"define internal i32 @f{k}(i32 %x) {{",
+                  f"  %r0 = add i32 %x, {k}"]
+        prev = "%r0"
+        # Calls to (up to) 3 functions defined earlier. The call graph is
+        # acyclic and the number of calls made at run-time grows
+        # polynomially, so the module can also be executed.
+        callees = sorted({k // 2, k // 3, k // 5} - {k})
+        for c, callee in enumerate(callees):
+            lines += [f"  %c{c} = call i32 @f{callee}(i32 {prev})",
+                      f"  %r{c + 1} = and i32 %c{c}, 255"]
+            prev = f"%r{c + 1}"
+        lines += [f"  ret i32 {prev}", "}"]
+    lines += ["define i32 @main() {",
+              f"  %slot = getelementptr inbounds [{n} x ptr], ptr @table, i64 0, i64 {n - 1}",
+              "  %fp = load ptr, ptr %slot",
+              "  %r = call i32 %fp(i32 0)",
+              f"  %d = call i32 @f{n // 2}(i32 %r)",
+              "  ret i32 0",
+              "}"]
+    return "\n".join(lines) + "\n"
+
+
+# Family name -> (generator, the base size)
+FAMILIES = {
+    "deep-domtree": (deep_domtree, 250),
+    "wide-switch": (wide_switch, 250),
+    "many-globals": (many_globals, 500),
+    "long-blocks": (long_blocks, 10000),
+    "many-functions": (many_functions, 1000),
+}
+
+
+def generate(family, size):
+    return FAMILIES[family][0](size)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generates scalable LLVM IR modules for benchmarking")
+    parser.add_argument("--family", choices=sorted(FAMILIES))
+    parser.add_argument("--size", type=int,
+                        help="The size of the module (the default is the "
+                             "base size of the family)")
+    parser.add_argument("-o", "--output", default="-")
+    parser.add_argument("--list", action="store_true",
+                        help="List the families and their base sizes")
+    args = parser.parse_args()
+
+    if args.list:
+        for name, (_, base_size) in sorted(FAMILIES.items()):
+            print(f"{name:<16} {base_size}")
+        return 0
+
+    if args.family is None:
+        parser.error("--family is required")
+    size = args.size if args.size is not None else FAMILIES[args.family][1]
+    if size < 1:
+        parser.error("--size has to be positive")
+
+    module = generate(args.family, size)
+    if args.output == "-":
+        sys.stdout.write(module)
+    else:
+        with open(args.output, "w") as out:
+            out.write(module)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,371 @@
+#!/usr/bin/env python3
+# === run.py ==================================================================
+#  Runs the llvm-tutor passes on the generated benchmark modules
+#
+#  DESCRIPTION:
+#   For every pass (see PASSES below), every family of modules (see
+#   generate.py) and every scale, this script runs the pass through opt (new
+#   PM) and records:
+#     * the wall time (the fastest of --repeat runs),
+#     * the peak RSS of opt,
+#     * the number of instructions before and after (i.e. the IR growth),
+#   together with the same for `-passes=verify` (i.e. the cost of reading and
+#   writing the module), so that the time spent in the pass itself can be
+#   told apart. For every pass and family, the scaling exponent k (for
+#   time ~ size^k, computed from the two largest sizes) is reported too - k
+#   close to 2 for a pass that's expected to be linear is a red flag.
+#   The exponent is not reported for runs that are too fast to time
+#   reliably.
+#
+#   The results are written as JSON (see --output). With --baseline, the
+#   results are compared against an earlier run and the script fails if any
+#   of the passes became slower than --threshold allows.
+#
+#  USAGE:
+#    # Normally, through the `benchmark` target:
+#    cmake --build <build_dir> --target benchmark
+#    # or directly:
+#    python3 benchmarks/run.py --opt $LLVM_DIR/bin/opt \
+#      --plugin-dir <build_dir>/lib --output results.json
+#    python3 benchmarks/run.py ... --baseline old-results.json
+#
+#  REQUIREMENTS:
+#   Python 3.9 and a POSIX system (for the peak RSS).
+# =============================================================================
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import generate  # noqa: E402
+
+# Name -> (the plugins to load, the pipeline, the families to run it on). The
+# families are the ones that the pass has something to do for.
+PASSES = {
+    "HelloWorld": (["Liveness", "HelloWorld"], "hello-world", ["many-functions"]),
+    "OpcodeCounter": (["OpcodeCounter"], "print<opcode-counter>",
+                      ["long-blocks", "many-functions"]),
+    "InjectFuncCall": (["InjectFuncCall"], "inject-func-call",
+                       ["many-functions"]),
+    "InjectFuncCall-trace": (["InjectFuncCall"],
+                             "inject-func-call<trace;ids={tmpdir}/ids>",
+                             ["many-functions"]),
+    "StaticCallCounter": (["StaticCallCounter"], "print<static-cc>",
+                          ["many-functions"]),
+    "StaticCallCounter-indirect": (["StaticCallCounter"],
+                                   "print<static-cc<indirect>>",
+                                   ["many-functions"]),
+    "DynamicCallCounter": (["DynamicCallCounter"], "dynamic-cc",
+                           ["many-functions"]),
+    "MBA": (["MBA"], "mba", ["long-blocks", "deep-domtree"]),
+    "MBAAdd": (["MBAAdd"], "mba-add", ["long-blocks"]),
+    "MBASub": (["MBASub"], "mba-sub", ["long-blocks", "deep-domtree"]),
+    "FindFCmpEq": (["FindFCmpEq"], "print<find-fcmp-eq>", ["long-blocks"]),
+    "ConvertFCmpEq": (["ConvertFCmpEq"], "convert-fcmp-eq", ["long-blocks"]),
+    "RIV": (["RIV"], "require<integer-globals>,function(print<riv>)",
+            ["deep-domtree", "many-globals", "long-blocks", "wide-switch"]),
+    "Liveness": (["Liveness"], "print<liveness>",
+                 ["long-blocks", "deep-domtree"]),
+    "DuplicateBB": (["RIV", "DuplicateBB"], "duplicate-bb",
+                    ["deep-domtree", "many-globals", "wide-switch"]),
+    "MergeBB": (["MergeBB"], "merge-bb", ["wide-switch"]),
+    "DuplicateBB+MergeBB": (["RIV", "DuplicateBB", "MergeBB"],
+                            "duplicate-bb,merge-bb",
+                            ["deep-domtree", "wide-switch"]),
+}
+
+SCHEMA_VERSION = 1
+
+
+def default_shlib_ext():
+    return ".dylib" if platform.system() == "Darwin" else ".so"
+
+
+def run_opt(cmd, timeout):
+    """Runs cmd and returns (seconds, peak RSS in KiB, exit status). The
+    exit status is None on a timeout."""
+    timed_out = threading.Event()
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+
+    def kill():
+        timed_out.set()
+        proc.kill()
+
+    timer = threading.Timer(timeout, kill)
+    timer.start()
+    try:
+        # Unlike Popen.wait, wait4 also returns the resource usage of the
+        # child (and of that child only)
+        _, status, rusage = os.wait4(proc.pid, 0)
+    finally:
+        timer.cancel()
+    seconds = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+
+    # ru_maxrss is in bytes on Darwin and in KiB on Linux
+    rss = rusage.ru_maxrss
+    if platform.system() == "Darwin":
+        rss //= 1024
+    return seconds, rss, None if timed_out.is_set() else proc.returncode
+
+
+def count_instructions(args, bitcode):
+    """Returns the number of instructions in bitcode (as reported by
+    `print<module-opcode-counter;format=json>`)."""
+    cmd = [args.opt, "-load-pass-plugin", plugin_path(args, "OpcodeCounter"),
+           "-passes=print<module-opcode-counter;format=json>",
+           "-disable-output", bitcode]
+    result = subprocess.run(cmd, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE, check=True,
+                            universal_newlines=True)
+    return json.loads(result.stderr)["instructions"]
+
+
+def plugin_path(args, plugin):
+    return os.path.join(args.plugin_dir, "lib" + plugin + args.shlib_ext)
+
+
+def measure(args, cmd):
+    """Returns {"seconds": ..., "peak_rss_kib": ...} for cmd (the fastest of
+    args.repeat runs and the highest peak RSS). On a failure or a timeout,
+    "seconds" is None and "error" says what happened."""
+    times, rss = [], 0
+    for _ in range(args.repeat):
+        seconds, run_rss, status = run_opt(cmd, args.timeout)
+        if status != 0:
+            error = "timeout" if status is None else f"exit status {status}"
+            return {"seconds": None, "peak_rss_kib": None, "error": error}
+        times.append(seconds)
+        rss = max(rss, run_rss)
+    return {"seconds": min(times), "peak_rss_kib": rss}
+
+
+# The minimum net time (i.e. without the `verify` baseline) that is required to
+# estimate the scaling exponent
+MIN_SCALING_SECONDS = 0.01
+
+
+def scaling_exponent(points):
+    """points: [(size, seconds)] sorted by size. Returns k for
+    seconds ~ size^k, computed from the two largest sizes."""
+    points = [(n, t) for n, t in points if t is not None]
+    if len(points) < 2:
+        return None
+    (n1, t1), (n2, t2) = points[-2], points[-1]
+    # Below that the timer noise dominates and the exponent is meaningless
+    if t1 < MIN_SCALING_SECONDS or t2 <= 0:
+        return None
+    return math.log(t2 / t1) / math.log(n2 / n1)
+
+
+def get_commit():
+    try:
+        return subprocess.run(
+            ["git", "-C", os.path.dirname(os.path.abspath(__file__)),
+             "rev-parse", "HEAD"], stdout=subprocess.PIPE,
+            stderr=subprocess.DEVNULL, check=True,
+            universal_newlines=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def get_opt_version(opt):
+    result = subprocess.run([opt, "--version"], stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL,
+                            universal_newlines=True)
+    for line in result.stdout.splitlines():
+        if "LLVM version" in line:
+            return line.strip()
+    return None
+
+
+def run_benchmarks(args, tmpdir):
+    results = []
+    inputs = {}
+    for family in args.families:
+        for scale in args.scales:
+            size = generate.FAMILIES[family][1] * scale
+            ll = os.path.join(tmpdir, f"{family}-{size}.ll")
+            bc = os.path.join(tmpdir, f"{family}-{size}.bc")
+            with open(ll, "w") as out:
+                out.write(generate.generate(family, size))
+            # Start from bitcode, so that parsing is as cheap as possible
+            subprocess.run([args.opt, "-passes=verify", ll, "-o", bc],
+                           check=True)
+            out_bc = os.path.join(tmpdir, "out.bc")
+            baseline = measure(args, [args.opt, "-passes=verify", bc, "-o",
+                                      out_bc])
+            inputs[(family, size)] = (bc, baseline, count_instructions(args,
+                                                                       bc))
+
+    for name in args.passes:
+        plugins, pipeline, families = PASSES[name]
+        pipeline = pipeline.format(tmpdir=tmpdir)
+        load = []
+        for plugin in plugins:
+            load += ["-load-pass-plugin", plugin_path(args, plugin)]
+        for family in families:
+            if family not in args.families:
+                continue
+            for scale in args.scales:
+                size = generate.FAMILIES[family][1] * scale
+                bc, baseline, instructions_before = inputs[(family, size)]
+                out_bc = os.path.join(tmpdir, "out.bc")
+                cmd = [args.opt] + load + ["-passes=" + pipeline, bc, "-o",
+                                           out_bc]
+                result = {"pass": name, "pipeline": pipeline,
+                          "family": family, "size": size,
+                          "baseline_seconds": baseline["seconds"],
+                          "instructions_before": instructions_before}
+                result.update(measure(args, cmd))
+                if result["seconds"] is not None:
+                    after = count_instructions(args, out_bc)
+                    result["instructions_after"] = after
+                    result["growth"] = after / instructions_before
+                results.append(result)
+                print_result(result)
+    return results
+
+
+def print_result(result):
+    seconds = result["seconds"]
+    time_str = result.get("error", "") if seconds is None \
+        else f"{seconds:8.3f}s"
+    rss = result["peak_rss_kib"]
+    rss_str = "" if rss is None else f"{rss / 1024:8.1f} MiB"
+    growth = result.get("growth")
+    growth_str = "" if growth is None else f"x{growth:.2f}"
+    print(f"{result['pass']:<28} {result['family']:<16} "
+          f"{result['size']:>7} {time_str} {rss_str} {growth_str}",
+          flush=True)
+
+
+def summarise_scaling(results):
+    by_key = {}
+    for result in results:
+        # The time spent in the pass, i.e. without reading/writing the module
+        seconds = result["seconds"]
+        if seconds is not None:
+            seconds = max(seconds - result["baseline_seconds"], 0.0)
+        by_key.setdefault((result["pass"], result["family"]), []).append(
+            (result["size"], seconds))
+    scaling = []
+    for (name, family), points in sorted(by_key.items()):
+        points.sort()
+        scaling.append({"pass": name, "family": family,
+                        "exponent": scaling_exponent(points)})
+    return scaling
+
+
+def compare(results, baseline_file, threshold):
+    """Returns the list of results that are more than `threshold` times
+    slower than in baseline_file."""
+    with open(baseline_file) as f:
+        baseline = json.load(f)
+    old = {(r["pass"], r["family"], r["size"]): r
+           for r in baseline["results"]}
+    regressions = []
+    for result in results:
+        prev = old.get((result["pass"], result["family"], result["size"]))
+        if prev is None or prev["seconds"] is None:
+            continue
+        if result["seconds"] is None or \
+                result["seconds"] > prev["seconds"] * threshold:
+            regressions.append((result, prev))
+    return regressions
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Runs the llvm-tutor passes on generated modules")
+    parser.add_argument("--opt", required=True, help="The opt binary to use")
+    parser.add_argument("--plugin-dir", required=True,
+                        help="The directory with the llvm-tutor plugins")
+    parser.add_argument("--shlib-ext", default=default_shlib_ext())
+    parser.add_argument("--output", default="benchmark-results.json",
+                        help="Where to write the results (JSON)")
+    parser.add_argument("--scales", default="1,2,4,8",
+                        help="The sizes of the modules, as multiples of the "
+                             "base sizes (comma-separated)")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="The number of runs per measurement (the "
+                             "fastest is reported)")
+    parser.add_argument("--timeout", type=float, default=300,
+                        help="The timeout for a single run (in seconds)")
+    parser.add_argument("--passes", default=",".join(PASSES),
+                        help="The passes to run (comma-separated)")
+    parser.add_argument("--families", default=",".join(generate.FAMILIES),
+                        help="The families of modules (comma-separated)")
+    parser.add_argument("--baseline",
+                        help="Compare against the results in this file")
+    parser.add_argument("--threshold", type=float, default=1.25,
+                        help="With --baseline, fail if any run is this many "
+                             "times slower")
+    args = parser.parse_args()
+
+    args.scales = sorted({int(s) for s in args.scales.split(",")})
+    args.passes = args.passes.split(",")
+    args.families = args.families.split(",")
+    for name in args.passes:
+        if name not in PASSES:
+            parser.error(f"unknown pass: {name}")
+    for family in args.families:
+        if family not in generate.FAMILIES:
+            parser.error(f"unknown family: {family}")
+    if args.repeat < 1 or min(args.scales) < 1:
+        parser.error("--repeat and --scales have to be positive")
+    return args
+
+
+def main():
+    args = parse_args()
+
+    with tempfile.TemporaryDirectory(prefix="llvm-tutor-bench-") as tmpdir:
+        results = run_benchmarks(args, tmpdir)
+
+    scaling = summarise_scaling(results)
+    report = {
+        "schema": SCHEMA_VERSION,
+        "commit": get_commit(),
+        "opt": args.opt,
+        "opt_version": get_opt_version(args.opt),
+        "date": datetime.datetime.now(datetime.timezone.utc).isoformat(),
+        "repeat": args.repeat,
+        "results": results,
+        "scaling": scaling,
+    }
+    with open(args.output, "w") as out:
+        json.dump(report, out, indent=2)
+        out.write("\n")
+
+    print("\nScaling exponents (time ~ size^k):")
+    for entry in scaling:
+        k = entry["exponent"]
+        print(f"  {entry['pass']:<28} {entry['family']:<16} "
+              + ("n/a" if k is None else f"{k:.2f}"))
+    print(f"\nResults written to {args.output}")
+
+    if args.baseline:
+        regressions = compare(results, args.baseline, args.threshold)
+        for result, prev in regressions:
+            new = result["seconds"]
+            print(f"REGRESSION: {result['pass']} on {result['family']} "
+                  f"(size {result['size']}): {prev['seconds']:.3f}s -> "
+                  + (result["error"] if new is None else f"{new:.3f}s"))
+        if regressions:
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,33 @@
+//========================================================================
+// FILE:
+//    BlockHotness.h
+//
+// DESCRIPTION:
+//    Helpers for the profile-guided llvm-tutor passes (DuplicateBB and MBA)
+//    that compare block frequencies, as reported by BlockFrequencyInfo, with
+//    the frequency of the entry block.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_BLOCKHOTNESS_H
+#define LLVM_TUTOR_BLOCKHOTNESS_H
+
+#include "llvm/ADT/APInt.h"
+
+#include <cstdint>
+
+// Returns true if a block with frequency Freq is executed at least Percent
+// times per 100 executions of the entry block (with frequency EntryFreq), i.e.
+// if Freq * 100 >= EntryFreq * Percent. Both products can overflow 64 bits
+// (the frequencies use the full range of uint64_t), so these are computed
+// with 128 bits.
+inline bool isAtLeastPercentOfEntry(uint64_t Freq, uint64_t EntryFreq,
+                                    unsigned Percent) {
+  llvm::APInt Lhs(128, Freq);
+  Lhs *= 100;
+  llvm::APInt Rhs(128, EntryFreq);
+  Rhs *= Percent;
+  return Lhs.uge(Rhs);
+}
+
+#endif // LLVM_TUTOR_BLOCKHOTNESS_H
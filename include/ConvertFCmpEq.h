@@ -12,13 +12,19 @@
 #define LLVM_TUTOR_CONVERT_FCMP_EQ_H
 
 #include "FindFCmpEq.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
 // Forward declarations
 namespace llvm {
 
+class Constant;
+class FCmpInst;
 class Function;
+class LLVMContext;
+class Type;
+class raw_ostream;
 
 } // namespace llvm
 
@@ -27,6 +33,20 @@ class Function;
 //------------------------------------------------------------------------------
 
 struct ConvertFCmpEq : llvm::PassInfoMixin<ConvertFCmpEq> {
+  // How the absolute value of the difference is computed:
+  //  * SignMask - bitcast to an integer, clear the sign bit and bitcast back
+  //  * FAbs - call llvm.fabs, which works directly on vectors and which is
+  //    understood by the cost models of the vectorizers
+  enum class Lowering { SignMask, FAbs };
+
+  explicit ConvertFCmpEq(Lowering Lower = Lowering::SignMask) : Lower(Lower) {}
+  // The fused mode: rather than requesting the FindFCmpEq analysis, the
+  // comparisons are found, reported to ReportOS (in the same format as
+  // print<find-fcmp-eq>) and converted in a single walk over the function.
+  explicit ConvertFCmpEq(llvm::raw_ostream &ReportOS,
+                         Lowering Lower = Lowering::SignMask)
+      : ReportOS(&ReportOS), Lower(Lower) {}
+
   // This is one of the standard run() member functions expected by
   // PassInfoMixin. When the pass is executed by the new PM, this is the
   // function that will be called.
@@ -36,11 +56,34 @@ struct ConvertFCmpEq : llvm::PassInfoMixin<ConvertFCmpEq> {
   // legacy pass (or any other code) without having to supply a
   // FunctionAnalysisManager argument.
   bool run(llvm::Function &Func, const FindFCmpEq::Result &Comparisons);
+  // The fused mode (see above)
+  bool runFused(llvm::Function &Func, llvm::raw_ostream &ReportOS);
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  // The constants used to convert the comparisons of one type
+  struct FPConstants {
+    // All bits set but the sign bit (of every element)
+    llvm::Constant *SignMask = nullptr;
+    // The machine epsilon (of every element)
+    llvm::Constant *Epsilon = nullptr;
+  };
+
+  // Returns false if the type of FCmp is not supported
+  bool convert(llvm::FCmpInst &FCmp);
+  // Returns null if Ty (the type of the operands of an fcmp) is not supported
+  const FPConstants *getConstants(llvm::Type *Ty);
+
+  llvm::raw_ostream *ReportOS = nullptr;
+  Lowering Lower;
+  // Type -> the constants for that type (created on first use)
+  llvm::DenseMap<llvm::Type *, FPConstants> ConstantCache;
+  // The context that the types in ConstantCache belong to
+  llvm::LLVMContext *CachedCtx = nullptr;
 };
 
 #endif // !LLVM_TUTOR_CONVERT_FCMP_EQ_H
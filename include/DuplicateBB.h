@@ -11,6 +11,7 @@
 #define LLVM_TUTOR_DUPLICATE_BB_H
 
 #include "RIV.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/ValueMap.h"
@@ -18,8 +19,10 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 
 namespace llvm {
+class BlockFrequencyInfo;
 class RandomNumberGenerator;
 } // namespace llvm
 
@@ -27,6 +30,32 @@ class RandomNumberGenerator;
 // New PM interface
 //------------------------------------------------------------------------------
 struct DuplicateBB : public llvm::PassInfoMixin<DuplicateBB> {
+  // Profile-guided selection of the blocks to duplicate. If either option is
+  // set, the blocks are ranked by their frequency as reported by
+  // BlockFrequencyInfo (which reflects the profile data, if present).
+  struct Options {
+    // Only blocks that are executed at least MinHotness times per 100
+    // executions of the entry block are duplicated (0 = all blocks)
+    unsigned MinHotness = 0;
+    // The maximum number of instructions (per function) in the blocks that
+    // are duplicated. The hottest blocks are picked first (0 = no limit).
+    unsigned SizeBudget = 0;
+    // Move the original instructions into lt-clone-1 (so that every
+    // instruction is cloned only once) and only create PHI nodes for the
+    // values that are used outside of lt-clone-1 (or that are the context
+    // values of other blocks)
+    bool PrunePhis = false;
+    // How the RIV sets are stored (`riv=flat|chained|bitset`). If set, the
+    // sets are computed by DuplicateBB rather than taken from the registered
+    // RIV analysis (which is always flat).
+    std::optional<RIV::Representation> RIVRepr;
+
+    bool isProfileGuided() const { return MinHotness || SizeBudget; }
+  };
+
+  DuplicateBB() = default;
+  explicit DuplicateBB(Options Opts) : Opts(Opts) {}
+
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &);
 
@@ -40,16 +69,38 @@ struct DuplicateBB : public llvm::PassInfoMixin<DuplicateBB> {
   using ValueToPhiMap = std::map<llvm::Value *, llvm::Value *>;
 
   // Creates a BBToSingleRIVMap of BasicBlocks that are suitable for cloning.
+  // The context values are picked with RNG. BFI is only required if
+  // Opts.isProfileGuided() is true. Only reads F, so it can be used for
+  // different functions concurrently.
   BBToSingleRIVMap findBBsToDuplicate(llvm::Function &F,
-                                      const RIV::Result &RIVResult);
+                                      const RIV::Result &RIVResult,
+                                      llvm::RandomNumberGenerator &RNG,
+                                      const llvm::BlockFrequencyInfo *BFI =
+                                          nullptr) const;
+
+  // Every function gets its own random number generator, seeded with the
+  // name of the function (and -rng-seed). That way the blocks selected for F
+  // don't depend on the other functions in the module, nor on the order in
+  // which the functions are visited.
+  static std::unique_ptr<llvm::RandomNumberGenerator>
+  createRNG(llvm::Function &F);
+
+  // Clones the blocks in Targets (as selected by findBBsToDuplicate)
+  void duplicateBlocks(const BBToSingleRIVMap &Targets);
 
   // Clones the input basic block:
   //  * injects an `if-then-else` construct using ContextValue
   //  * duplicates BB
   //  * adds PHI nodes as required
+  // With Opts.PrunePhis, the values in ContextValues (i.e. the context values
+  // of the blocks that are yet to be cloned) always get a PHI node.
   void cloneBB(llvm::BasicBlock &BB, llvm::Value *ContextValue,
-               ValueToPhiMap &ReMapper);
+               ValueToPhiMap &ReMapper,
+               const llvm::SmallPtrSetImpl<llvm::Value *> *ContextValues =
+                   nullptr);
 
+  // The number of blocks duplicated so far in the current function (used to
+  // name the new blocks)
   unsigned DuplicateBBCount = 0;
 
   // Without isRequired returning true, this pass will be skipped for functions
@@ -57,7 +108,12 @@ struct DuplicateBB : public llvm::PassInfoMixin<DuplicateBB> {
   // all functions with optnone.
   static bool isRequired() { return true; }
 
-  std::unique_ptr<llvm::RandomNumberGenerator> pRNG;
+  Options Opts;
 };
 
+// Parses `duplicate-bb` and `duplicate-bb<Opt1;Opt2;...>` (see DuplicateBB.cpp
+// for the options). Returns nothing if Name is not a valid duplicate-bb
+// pipeline element.
+std::optional<DuplicateBB> parseDuplicateBB(llvm::StringRef Name);
+
 #endif
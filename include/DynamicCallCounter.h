@@ -11,22 +11,92 @@
 #ifndef LLVM_TUTOR_INSTRUMENT_BASIC_H
 #define LLVM_TUTOR_INSTRUMENT_BASIC_H
 
+#include "StaticCallCounter.h"
+
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+#include <cstdint>
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct DynamicCallCounter : public llvm::PassInfoMixin<DynamicCallCounter> {
+  // How the call counters are laid out in memory:
+  //  * Separate - one global variable per function, `CounterFor_<name>`
+  //  * Padded - one array indexed by function ID, every counter occupies a
+  //    separate cache line (avoids false sharing in multi-threaded programs)
+  enum class CounterLayout { Separate, Padded };
+
+  // How the call counters are updated:
+  //  * Plain - load/add/store (not thread-safe)
+  //  * Atomic - `atomicrmw add` (thread-safe)
+  //  * PerThread - every thread updates its own copy of the counters, these
+  //    are added to the global counters when the thread exits (thread-safe)
+  enum class CounterUpdate { Plain, Atomic, PerThread };
+
+  // What's generated when the instrumented program exits:
+  //  * Text - the results are printed to stdout
+  //  * Binary - the counters and the function names are written to a binary
+  //    profile (see dynamic_cc::ProfileHeader below)
+  enum class OutputFormat { Text, Binary };
+
+  struct Options {
+    CounterLayout Layout = CounterLayout::Separate;
+    CounterUpdate Update = CounterUpdate::Plain;
+    OutputFormat Output = OutputFormat::Text;
+    // Functions with at most SkipSmall instructions that have at least one
+    // direct call site (as reported by StaticCallCounter) are neither
+    // instrumented nor reported (0 = instrument all functions)
+    unsigned SkipSmall = 0;
+    // Only every SamplePeriod-th call (per thread and per function) updates
+    // the counters, which are then incremented by SamplePeriod (1 = count
+    // every call)
+    unsigned SamplePeriod = 1;
+  };
+
+  DynamicCallCounter() = default;
+  explicit DynamicCallCounter(Options Opts) : Opts(Opts) {}
+
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &);
-  bool runOnModule(llvm::Module &M);
+  // StaticCalls is only required when Opts.SkipSmall is set
+  bool runOnModule(llvm::Module &M,
+                   const ResultStaticCC *StaticCalls = nullptr);
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  Options Opts;
 };
 
+//------------------------------------------------------------------------------
+// Binary profile format
+//------------------------------------------------------------------------------
+// The profile written by `dynamic-cc<binary>` consists of:
+//  * ProfileHeader,
+//  * NumFunctions call counts (uint64_t), indexed by function ID,
+//  * NamesSize bytes of NUL-terminated function names, in function ID order.
+// All fields use the byte order of the instrumented program.
+namespace dynamic_cc {
+constexpr uint64_t ProfileMagic = 0x46525043434e5944; // "DYNCCPRF"
+constexpr uint64_t ProfileVersion = 1;
+
+struct ProfileHeader {
+  uint64_t Magic;
+  uint64_t Version;
+  uint64_t NumFunctions;
+  uint64_t NamesSize;
+};
+
+// The environment variable that holds the path of the profile
+constexpr const char *ProfileFileEnvVar = "DYNAMIC_CC_PROFILE_FILE";
+// The path used when ProfileFileEnvVar is not set
+constexpr const char *DefaultProfileFile = "dynamic-cc.prof";
+} // namespace dynamic_cc
+
 #endif
@@ -12,6 +12,7 @@
 #ifndef LLVM_TUTOR_FIND_FCMP_EQ_H
 #define LLVM_TUTOR_FIND_FCMP_EQ_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 #include <vector>
@@ -46,6 +47,11 @@ private:
   static llvm::AnalysisKey Key;
 };
 
+// Prints FCmpEqInsts (the equality comparisons found in Func). Prints nothing
+// if FCmpEqInsts is empty.
+void printFCmpEqInstructions(llvm::raw_ostream &OS, llvm::Function &Func,
+                             llvm::ArrayRef<llvm::FCmpInst *> FCmpEqInsts);
+
 //------------------------------------------------------------------------------
 // New PM interface for the printer pass
 //------------------------------------------------------------------------------
@@ -14,10 +14,37 @@
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+#include <cstdint>
+#include <string>
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct InjectFuncCall : public llvm::PassInfoMixin<InjectFuncCall> {
+  // What's injected at the beginning of every function:
+  //  * Printf - a call to printf that prints the function name and the
+  //    number of arguments
+  //  * Trace - code that appends a record (see inject_func_call::TraceRecord
+  //    below) to a thread-local buffer, which is written to a trace file
+  //    once full (and when the thread or the program exits)
+  enum class Mode { Printf, Trace };
+
+  struct Options {
+    Mode Kind = Mode::Printf;
+    // Trace only: record the value of the cycle counter (llvm.readcyclecounter,
+    // e.g. rdtsc on X86) on every function entry
+    bool Timestamps = false;
+    // Trace only: the number of records in the buffer of every thread (must
+    // be a power of 2)
+    unsigned BufferSize = 1024;
+    // Trace only: the ID table (function ID -> name) is written to this file
+    // when the module is instrumented
+    std::string IDTableFile;
+  };
+
+  InjectFuncCall() = default;
+  explicit InjectFuncCall(Options Opts) : Opts(std::move(Opts)) {}
+
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &);
   bool runOnModule(llvm::Module &M);
@@ -26,6 +53,67 @@ struct InjectFuncCall : public llvm::PassInfoMixin<InjectFuncCall> {
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  Options Opts;
 };
 
+//------------------------------------------------------------------------------
+// Trace format
+//------------------------------------------------------------------------------
+// The trace written by programs instrumented with `inject-func-call<trace>`
+// consists of:
+//  * TraceHeader,
+//  * any number of blocks, each of which is a TraceBlockHeader followed by
+//    NumRecords TraceRecords (in the order in which the functions were
+//    entered by that thread).
+// Every block is written with one call to fwrite, so the blocks from
+// different threads don't interleave. All fields use the byte order of the
+// instrumented program.
+//
+// The names of the functions are not part of the trace. These are written to
+// a separate ID table when the module is instrumented:
+//    inject-func-call-ids <version> <module hash>
+//    <function ID> <function name>
+//    ...
+// The module hash identifies the table that a trace belongs to.
+namespace inject_func_call {
+constexpr uint64_t TraceMagic = 0x4543415254434649; // "IFCTRACE"
+constexpr uint64_t TraceVersion = 1;
+
+// TraceHeader::Flags
+constexpr uint64_t TraceHasTimestamps = 1;
+
+struct TraceHeader {
+  uint64_t Magic;
+  uint64_t Version;
+  uint64_t ModuleHash;
+  uint64_t Flags;
+};
+
+struct TraceBlockHeader {
+  // Threads are numbered from 1, in the order in which they enter their
+  // first instrumented function
+  uint32_t ThreadID;
+  uint32_t NumRecords;
+};
+
+struct TraceRecord {
+  // The index of the function in the ID table
+  uint32_t FuncID;
+  uint32_t NumArgs;
+  // 0 unless the trace was recorded with timestamps
+  uint64_t Timestamp;
+};
+
+// The environment variable that holds the path of the trace
+constexpr const char *TraceFileEnvVar = "INJECT_FUNC_CALL_TRACE_FILE";
+// The path used when TraceFileEnvVar is not set
+constexpr const char *DefaultTraceFile = "inject-func-call.trace";
+// The ID table is written here unless specified otherwise (`ids=<file>`)
+constexpr const char *DefaultIDTableFile = "inject-func-call.ids";
+// The first word of an ID table
+constexpr const char *IDTableMagic = "inject-func-call-ids";
+} // namespace inject_func_call
+
 #endif
@@ -0,0 +1,153 @@
+//==============================================================================
+// FILE:
+//    Liveness.h
+//
+// DESCRIPTION:
+//    Declares the Liveness Passes:
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_LIVENESS_H
+#define LLVM_TUTOR_LIVENESS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Result of the Liveness analysis
+//------------------------------------------------------------------------------
+// A read-only view of a set of (named) allocas. It's backed by one of the
+// BitVectors held in LivenessInfo and is only valid for as long as the
+// corresponding LivenessInfo is.
+class AllocaSetView {
+public:
+  // Iterates over the set bits and yields the corresponding allocas
+  class iterator {
+  public:
+    iterator(llvm::BitVector::const_set_bits_iterator It,
+             llvm::ArrayRef<llvm::AllocaInst *> Vars)
+        : It(It), Vars(Vars) {}
+
+    llvm::AllocaInst *operator*() const { return Vars[*It]; }
+    iterator &operator++() {
+      ++It;
+      return *this;
+    }
+    bool operator==(const iterator &Other) const { return It == Other.It; }
+    bool operator!=(const iterator &Other) const { return It != Other.It; }
+
+  private:
+    llvm::BitVector::const_set_bits_iterator It;
+    llvm::ArrayRef<llvm::AllocaInst *> Vars;
+  };
+
+  AllocaSetView(const llvm::BitVector &Bits,
+                llvm::ArrayRef<llvm::AllocaInst *> Vars)
+      : Bits(Bits), Vars(Vars) {}
+
+  iterator begin() const { return iterator(Bits.set_bits_begin(), Vars); }
+  iterator end() const { return iterator(Bits.set_bits_end(), Vars); }
+  unsigned size() const { return Bits.count(); }
+  bool empty() const { return Bits.none(); }
+
+  // The underlying bit-vector, indexed by LivenessInfo::getIndex()
+  const llvm::BitVector &bits() const { return Bits; }
+
+private:
+  const llvm::BitVector &Bits;
+  llvm::ArrayRef<llvm::AllocaInst *> Vars;
+};
+
+// For every basic block holds the UEVar, VarKill and LiveOut sets of named
+// allocas. Every alloca is assigned an index and the sets are stored as dense
+// bit-vectors.
+class LivenessInfo {
+public:
+  // All the allocas tracked by the analysis, ordered by their index
+  llvm::ArrayRef<llvm::AllocaInst *> variables() const { return Vars; }
+  // Returns true if AI is tracked by the analysis (i.e. it's a named alloca)
+  bool isTracked(const llvm::AllocaInst *AI) const {
+    return VarIdx.count(AI);
+  }
+  unsigned getIndex(const llvm::AllocaInst *AI) const;
+
+  AllocaSetView ueVar(const llvm::BasicBlock *BB) const {
+    return {UEVar[getBlockIndex(BB)], Vars};
+  }
+  AllocaSetView varKill(const llvm::BasicBlock *BB) const {
+    return {VarKill[getBlockIndex(BB)], Vars};
+  }
+  AllocaSetView liveOut(const llvm::BasicBlock *BB) const {
+    return {LiveOut[getBlockIndex(BB)], Vars};
+  }
+  bool isLiveOut(const llvm::BasicBlock *BB,
+                 const llvm::AllocaInst *AI) const;
+
+  // The result refers to basic blocks and to the loads/stores within them.
+  // Keep it only if it was explicitly preserved (or all analyses were) *and*
+  // the CFG was left intact.
+  bool invalidate(llvm::Function &F, const llvm::PreservedAnalyses &PA,
+                  llvm::FunctionAnalysisManager::Invalidator &);
+
+private:
+  friend struct Liveness;
+
+  unsigned getBlockIndex(const llvm::BasicBlock *BB) const;
+
+  // Index -> alloca and alloca -> index
+  llvm::SmallVector<llvm::AllocaInst *, 16> Vars;
+  llvm::DenseMap<const llvm::Value *, unsigned> VarIdx;
+  // Basic block -> index into UEVar/VarKill/LiveOut
+  llvm::DenseMap<const llvm::BasicBlock *, unsigned> BlockIdx;
+
+  std::vector<llvm::BitVector> UEVar;
+  std::vector<llvm::BitVector> VarKill;
+  std::vector<llvm::BitVector> LiveOut;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct Liveness : public llvm::AnalysisInfoMixin<Liveness> {
+  using Result = LivenessInfo;
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
+
+  Result computeLiveness(llvm::Function &F);
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<Liveness>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class LivenessPrinter : public llvm::PassInfoMixin<LivenessPrinter> {
+public:
+  explicit LivenessPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &FAM);
+  // Prints LI, the result of the analysis for F, as run does
+  static void printResult(llvm::raw_ostream &OS, const llvm::Function &F,
+                          const LivenessInfo &LI);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_LIVENESS_H
@@ -0,0 +1,127 @@
+//==============================================================================
+// FILE:
+//    MBA.h
+//
+// DESCRIPTION:
+//    Declares the MBA pass - the Mixed Boolean Arithmetic engine that MBAAdd
+//    and MBASub are presets of.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_MBA_H
+#define LLVM_TUTOR_MBA_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constant.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <array>
+#include <utility>
+
+// An MBA identity, i.e. a recipe for rewriting one binary operator. The table
+// of identities is defined (and documented) in MBA.cpp.
+struct MBAIdentity;
+
+namespace llvm {
+class BlockFrequencyInfo;
+class LoopInfo;
+} // namespace llvm
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct MBA : public llvm::PassInfoMixin<MBA> {
+  // The operators that can be obfuscated (to be used as a bit-mask)
+  enum Operator : unsigned {
+    Add = 1 << 0,
+    Sub = 1 << 1,
+    And = 1 << 2,
+    Or = 1 << 3,
+    Xor = 1 << 4,
+    AllOperators = Add | Sub | And | Or | Xor
+  };
+
+  struct Options {
+    // The operators to obfuscate
+    unsigned Operators = AllOperators;
+    // Only obfuscate instructions that are this wide (0 = any width for which
+    // there's an identity)
+    unsigned Width = 0;
+    // Instructions in loop blocks that are executed at least HotLoop times
+    // per 100 executions of the entry block are not obfuscated (0 = no limit)
+    unsigned HotLoop = 0;
+    // The maximum number of instructions (per function) that the
+    // substitutions may add. The coldest instructions are obfuscated first
+    // (0 = no limit).
+    unsigned Budget = 0;
+
+    bool isBudgeted() const { return HotLoop || Budget; }
+  };
+
+  // Parses the options that are shared by MBA and its presets, i.e.
+  // `hot-loop=N` and `budget=N`. Returns false if Option is not one of them
+  // (or is malformed).
+  static bool parseBudgetOption(llvm::StringRef Option, Options &Opts);
+
+  MBA() : MBA(Options()) {}
+  explicit MBA(Options Opts);
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &);
+  // Rewrites all the matching instructions in one walk over F. LI and BFI
+  // are only required if Opts.isBudgeted() is true.
+  bool runOnFunction(llvm::Function &F, const llvm::LoopInfo *LI = nullptr,
+                     const llvm::BlockFrequencyInfo *BFI = nullptr);
+  bool runOnBasicBlock(llvm::BasicBlock &BB);
+
+  // An instruction to rewrite and the identity to rewrite it with
+  using Candidate = std::pair<llvm::BinaryOperator *, const MBAIdentity *>;
+  // Collects the instructions in F that runOnFunction rewrites when
+  // Opts.isBudgeted() is false (in the order in which they are rewritten).
+  // Only reads F, so it can be used for different functions concurrently.
+  void collectCandidates(llvm::Function &F,
+                         llvm::SmallVectorImpl<Candidate> &Candidates) const;
+  // Rewrites the instructions collected by collectCandidates. Returns true if
+  // there were any.
+  bool rewriteCandidates(llvm::ArrayRef<Candidate> Candidates);
+
+  const Options &getOptions() const { return Opts; }
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+
+private:
+  // The identity used for BinOp (nullptr if BinOp is not to be obfuscated)
+  const MBAIdentity *getIdentity(const llvm::BinaryOperator &BinOp) const;
+  // The constants of Id materialised for Ty (created on first use)
+  llvm::ArrayRef<llvm::Constant *> getConstants(const MBAIdentity &Id,
+                                                llvm::Type *Ty);
+  void rewrite(llvm::BinaryOperator &BinOp, const MBAIdentity &Id);
+  bool runWithBudget(llvm::Function &F, const llvm::LoopInfo &LI,
+                     const llvm::BlockFrequencyInfo &BFI);
+
+  Options Opts;
+
+  // The number of widths that have dedicated identities (i8, i16, i32, i64)
+  // plus one for all the other widths
+  static constexpr unsigned NumWidthClasses = 5;
+  // [operator][width class] -> identity (nullptr = not obfuscated). Built
+  // from Opts in the constructor, so that every instruction is dispatched
+  // with a single lookup.
+  std::array<std::array<const MBAIdentity *, NumWidthClasses>, 5> Dispatch{};
+  // (identity, type) -> the constants of that identity
+  llvm::DenseMap<std::pair<const MBAIdentity *, llvm::Type *>,
+                 llvm::SmallVector<llvm::Constant *, 4>>
+      ConstantCache;
+  // The context that the types in ConstantCache belong to
+  llvm::LLVMContext *CachedCtx = nullptr;
+};
+
+#endif // LLVM_TUTOR_MBA_H
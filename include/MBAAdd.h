@@ -10,6 +10,7 @@
 #ifndef LLVM_TUTOR_MBA_ADD_H
 #define LLVM_TUTOR_MBA_ADD_H
 
+#include "MBA.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
@@ -18,14 +19,25 @@
 // New PM interface
 //------------------------------------------------------------------------------
 struct MBAAdd : public llvm::PassInfoMixin<MBAAdd> {
+  MBAAdd() : MBAAdd(MBA::Options()) {}
+  // Only the budget options of Opts (HotLoop and Budget) are used
+  explicit MBAAdd(MBA::Options Opts);
+
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &);
   bool runOnBasicBlock(llvm::BasicBlock &B);
+  // The preset engine (e.g. for the parallel adaptor, see ParallelFunctions.h)
+  const MBA &getEngine() const { return Engine; }
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  // MBAAdd is a preset of the MBA engine that only rewrites 8-bit add
+  // instructions
+  MBA Engine;
 };
 
 #endif
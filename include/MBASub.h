@@ -10,6 +10,7 @@
 #ifndef LLVM_TUTOR_MBA_SUB_H
 #define LLVM_TUTOR_MBA_SUB_H
 
+#include "MBA.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
@@ -17,13 +18,24 @@
 // PassInfoMixIn is a CRTP mix-in to automatically provide informational APIs
 // needed for passes. Currently it provides only the 'name' method.
 struct MBASub : public llvm::PassInfoMixin<MBASub> {
+  MBASub() : MBASub(MBA::Options()) {}
+  // Only the budget options of Opts (HotLoop and Budget) are used
+  explicit MBASub(MBA::Options Opts);
+
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &);
   bool runOnBasicBlock(llvm::BasicBlock &B);
+  // The preset engine (e.g. for the parallel adaptor, see ParallelFunctions.h)
+  const MBA &getEngine() const { return Engine; }
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  // MBASub is a preset of the MBA engine that only rewrites sub instructions
+  // (of any width)
+  MBA Engine;
 };
 #endif
@@ -10,23 +10,85 @@
 #ifndef LLVM_TUTOR_MERGEBBS_H
 #define LLVM_TUTOR_MERGEBBS_H
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+#include <unordered_map>
+
 using ResultMergeBB = llvm::StringMap<unsigned>;
 
+//------------------------------------------------------------------------------
+// Merge candidates
+//------------------------------------------------------------------------------
+// The predecessors of a basic block (BBSucc) that could be merged with one
+// another. Computed once per BBSucc and shared by all of its predecessors.
+struct MergeCandidates {
+  // Predecessor of BBSucc -> the values that it passes to the PHI nodes in
+  // BBSucc (one per PHI node, in the order of the PHI nodes)
+  llvm::DenseMap<const llvm::BasicBlock *, llvm::SmallVector<llvm::Value *, 1>>
+      IncomingValues;
+  // The predecessors of BBSucc bucketed by their structural hashes (see
+  // MergeBB::getStructuralHash). Every bucket is in predecessor order, blocks
+  // that become predecessors later on are appended. Blocks that were merged
+  // before this was computed are not included. (DenseMap reserves two key
+  // values, any 64-bit value is a valid hash)
+  std::unordered_map<uint64_t, llvm::SmallVector<llvm::BasicBlock *, 2>>
+      Buckets;
+};
+
+// BBSucc -> the merge candidates for BBSucc
+using MergeCandidatesMap =
+    llvm::DenseMap<const llvm::BasicBlock *, MergeCandidates>;
+
+//------------------------------------------------------------------------------
+// Block summaries
+//------------------------------------------------------------------------------
+// The properties of a basic block that are queried every time it's compared
+// with another block. Computed once per run (see MergeBB::summarizeBlocks),
+// so that blocks with many debug intrinsics are not rescanned.
+struct BlockSummary {
+  // The number of non-debug instructions (including the terminator)
+  unsigned NumNonDbgInsts = 0;
+  // The last non-debug instruction before the terminator (null if none)
+  llvm::Instruction *LastNonDbgInst = nullptr;
+  // A hash of the non-debug instructions (excluding the terminator): opcodes,
+  // types and operands
+  uint64_t InstsHash = 0;
+  // True if the terminators of all predecessors can be safely redirected to
+  // another block (see MergeBB::isSupportedPredecessor)
+  bool HasSupportedPreds = false;
+  // True if the address of the block is used for anything other than the
+  // address operand of indirectbr (see MergeBB::hasEscapingAddress)
+  bool HasEscapingAddress = false;
+};
+
+// BB -> the summary of BB. Blocks that are merged (and deleted) are removed.
+using BlockSummaryMap = llvm::DenseMap<const llvm::BasicBlock *, BlockSummary>;
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct MergeBB : public llvm::PassInfoMixin<MergeBB> {
   using Result = ResultMergeBB;
+
+  // If FixedPoint is set, blocks are merged until no more blocks can be
+  // merged. Otherwise every block is visited only once.
+  explicit MergeBB(bool FixedPoint = false) : FixedPoint(FixedPoint) {}
+
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &);
+  // Merges the duplicated blocks in F. Summaries has to hold the summaries of
+  // all blocks in F (see summarizeBlocks). Returns true if F was modified.
+  bool runOnFunction(llvm::Function &F, BlockSummaryMap &Summaries);
 
   // Checks whether the input instruction Inst (that has exactly one use) can be
   // removed. This is the case when its only user is either:
-  //  1) a PHI (it can be easily updated if Inst is removed), or
+  //  1) a PHI in the successor (it can be easily updated if Inst is removed),
+  //     or
   //  2) located in the same block as Inst (if that block is removed then the
   //     user will also be removed)
   bool canRemoveInst(const llvm::Instruction *Inst);
@@ -34,22 +96,59 @@ struct MergeBB : public llvm::PassInfoMixin<MergeBB> {
   // Instructions in Insts belong to different blocks that unconditionally
   // branch to a common successor. Analyze them and return true if it would be
   // possible to merge them, i.e. replace Inst1 with Inst2 (or vice-versa).
+  // Instructions used by PHI nodes can only be merged if they are used by the
+  // same PHI node.
   bool canMergeInstructions(llvm::ArrayRef<llvm::Instruction *> Insts);
 
-  // Replace the destination of incoming edges of BBToErase by BBToRetain
+  // Replace the destination of incoming edges of BBToErase by BBToRetain. If
+  // the address of BBToErase is taken (only by indirectbr, see
+  // hasEscapingAddress), it's replaced with the address of BBToRetain.
   unsigned updateBranchTargets(llvm::BasicBlock *BBToErase,
                                llvm::BasicBlock *BBToRetain);
 
+  // Summarizes every basic block in F (in one pass over F). Only reads F, so
+  // it can be used for different functions concurrently.
+  static BlockSummaryMap summarizeBlocks(llvm::Function &F);
+
+  // Returns true if the edge from Pred to BB can be redirected to another
+  // block. That's the case for branch, switch and indirectbr terminators (the
+  // address of BB is replaced as well), and for invokes that have BB as the
+  // normal (rather than the unwind) destination.
+  static bool isSupportedPredecessor(const llvm::BasicBlock *Pred,
+                                     const llvm::BasicBlock *BB);
+
+  // Returns true if the address of BB is taken and used for anything other
+  // than the address operand of indirectbr (e.g. it's stored in a jump table
+  // or compared). Such blocks are not merged into other blocks - the
+  // addresses of two different labels would then compare equal.
+  static bool hasEscapingAddress(const llvm::BasicBlock *BB);
+
+  // Combines the hash of the instructions in BB (see BlockSummary) with
+  // InVals, the values that BB passes to the PHI nodes in its successor.
+  // Blocks that could be merged have identical hashes.
+  static uint64_t getStructuralHash(const BlockSummaryMap &Summaries,
+                                    const llvm::BasicBlock *BB,
+                                    llvm::ArrayRef<llvm::Value *> InVals);
+
   // If BB is duplicated, then merges BB with its duplicate and adds BB to
   // DeleteList. DeleteList contains the list of blocks to be deleted.
-  bool
-  mergeDuplicatedBlock(llvm::BasicBlock *BB,
-                       llvm::SmallPtrSet<llvm::BasicBlock *, 8> &DeleteList);
+  // Candidates caches the merge candidates for the successors of the blocks
+  // visited so far. Summaries holds the summaries of all blocks that have not
+  // been merged yet. If BB is merged and RedirectedPreds is set, the
+  // predecessors of BB are appended to RedirectedPreds. Returns the block that
+  // BB was merged into (or null).
+  llvm::BasicBlock *mergeDuplicatedBlock(
+      llvm::BasicBlock *BB, llvm::SmallPtrSet<llvm::BasicBlock *, 8> &DeleteList,
+      MergeCandidatesMap &Candidates, BlockSummaryMap &Summaries,
+      llvm::SmallVectorImpl<llvm::BasicBlock *> *RedirectedPreds = nullptr);
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  bool FixedPoint;
 };
 
 //------------------------------------------------------------------------------
@@ -62,15 +161,19 @@ struct MergeBB : public llvm::PassInfoMixin<MergeBB> {
 //   *I-- = [BB1[n-1], BB2[n-1]];
 //   *I-- = [BB1[n-2], BB2[n-2]];
 //   ...
+// If Summaries is set, the starting points are read from there rather than
+// computed.
 class LockstepReverseIterator {
   llvm::BasicBlock *BB1;
   llvm::BasicBlock *BB2;
+  const BlockSummaryMap *Summaries;
 
   llvm::SmallVector<llvm::Instruction *, 2> Insts;
   bool Fail;
 
 public:
-  LockstepReverseIterator(llvm::BasicBlock *BB1In, llvm::BasicBlock *BB2In);
+  LockstepReverseIterator(llvm::BasicBlock *BB1In, llvm::BasicBlock *BB2In,
+                          const BlockSummaryMap *Summaries = nullptr);
 
   llvm::Instruction *getLastNonDbgInst(llvm::BasicBlock *BB);
   bool isValid() const { return !Fail; }
@@ -6,29 +6,154 @@
 //    Declares the OpcodeCounter Passes:
 //      * new pass manager interface
 //      * printer pass for the new pass manager
+//      * module-level analysis and printer pass for the new pass manager
 //
 // License: MIT
 //==============================================================================
 #ifndef LLVM_TUTOR_OPCODECOUNTER_H
 #define LLVM_TUTOR_OPCODECOUNTER_H
 
+#include "ResultPrinter.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <array>
+#include <cstddef>
+#include <iterator>
+
 //------------------------------------------------------------------------------
-// New PM interface
+// Result of the OpcodeCounter analysis
 //------------------------------------------------------------------------------
+// Opcode name -> the number of times it was used. This is what the analysis
+// used to return. It's still available via OpcodeHistogram::toOpcodeMap() and
+// OpcodeHistogram can be queried by name like this map (see below).
 using ResultOpcodeCounter = llvm::StringMap<unsigned>;
 
+// The number of times every opcode was used, indexed by
+// Instruction::getOpcode(). The opcodes are only mapped to their names when
+// queried by name or when converting to ResultOpcodeCounter.
+class OpcodeHistogram {
+public:
+  static constexpr unsigned NumOpcodes = llvm::Instruction::OtherOpsEnd;
+
+  // An (opcode name, count) pair with the same accessors as the entries of
+  // ResultOpcodeCounter
+  struct Entry {
+    llvm::StringRef Key;
+    unsigned second = 0;
+
+    llvm::StringRef getKey() const { return Key; }
+    llvm::StringRef first() const { return Key; }
+    unsigned getValue() const { return second; }
+  };
+
+  // Iterates over the opcodes that were used (in the order of their first
+  // use) and yields the corresponding Entry
+  class const_iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Entry *;
+    using reference = const Entry &;
+
+    const_iterator(const OpcodeHistogram &Histogram, const unsigned *It)
+        : Histogram(&Histogram), It(It) {}
+
+    const Entry &operator*() const {
+      Current = {llvm::Instruction::getOpcodeName(*It),
+                 Histogram->Counts[*It]};
+      return Current;
+    }
+    const Entry *operator->() const { return &**this; }
+    const_iterator &operator++() {
+      ++It;
+      return *this;
+    }
+    bool operator==(const const_iterator &Other) const {
+      return It == Other.It;
+    }
+    bool operator!=(const const_iterator &Other) const {
+      return It != Other.It;
+    }
+
+  private:
+    const OpcodeHistogram *Histogram;
+    const unsigned *It;
+    mutable Entry Current;
+  };
+
+  void add(const llvm::Instruction &Inst) {
+    unsigned Opcode = Inst.getOpcode();
+    if (Counts[Opcode]++ == 0)
+      UsedOpcodes.push_back(Opcode);
+  }
+  unsigned lookup(unsigned Opcode) const { return Counts[Opcode]; }
+  // The total number of instructions
+  unsigned total() const;
+
+  // ResultOpcodeCounter-like accessors, i.e. by opcode name (e.g. "add").
+  // These are read-only - the result of the analysis is not meant to be
+  // modified.
+  unsigned lookup(llvm::StringRef OpcodeName) const;
+  unsigned operator[](llvm::StringRef OpcodeName) const {
+    return lookup(OpcodeName);
+  }
+  size_t count(llvm::StringRef OpcodeName) const {
+    return lookup(OpcodeName) != 0;
+  }
+  const_iterator begin() const { return {*this, UsedOpcodes.begin()}; }
+  const_iterator end() const { return {*this, UsedOpcodes.end()}; }
+  // The number of distinct opcodes that were used
+  unsigned size() const { return UsedOpcodes.size(); }
+  bool empty() const { return UsedOpcodes.empty(); }
+
+  // Adds the counts from Other. The opcodes that are new to this histogram
+  // are appended in the order of their first use in Other, so merging is
+  // associative (but not commutative).
+  void merge(const OpcodeHistogram &Other);
+
+  // The opcodes that were used, in the order of their first use
+  llvm::ArrayRef<unsigned> usedOpcodes() const { return UsedOpcodes; }
+
+  // Opcode name -> count, only for the opcodes that were used. The names are
+  // inserted in the order of first use, so that the layout of the map (and
+  // hence the iteration order) is the same as when counting by name.
+  ResultOpcodeCounter toOpcodeMap() const;
+
+private:
+  std::array<unsigned, NumOpcodes> Counts{};
+  llvm::SmallVector<unsigned, 16> UsedOpcodes;
+};
+
+// The formats supported by printOpcodeHistogram:
+//  * Text - the human-readable table printed by print<opcode-counter>
+//  * JSON - {"name": <Name>, "instructions": <total>, "opcodes": {...}}
+//  * CSV - `name,opcode,count` rows (with a header)
+// In the JSON and CSV formats the opcodes are sorted by name.
+enum class OpcodeStatsFormat { Text, JSON, CSV };
+
+void printOpcodeHistogram(llvm::raw_ostream &OS,
+                          const OpcodeHistogram &Histogram,
+                          llvm::StringRef Name, OpcodeStatsFormat Format);
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
 struct OpcodeCounter : public llvm::AnalysisInfoMixin<OpcodeCounter> {
-  using Result = ResultOpcodeCounter;
-  Result run(llvm::Function &F,
-                              llvm::FunctionAnalysisManager &);
+  using Result = OpcodeHistogram;
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
 
-  OpcodeCounter::Result generateOpcodeMap(llvm::Function &F);
+  OpcodeCounter::Result generateHistogram(llvm::Function &F);
+  // Same as generateHistogram(F).toOpcodeMap()
+  ResultOpcodeCounter generateOpcodeMap(llvm::Function &F);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -45,14 +170,64 @@ private:
 //------------------------------------------------------------------------------
 class OpcodeCounterPrinter : public llvm::PassInfoMixin<OpcodeCounterPrinter> {
 public:
-  explicit OpcodeCounterPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  explicit OpcodeCounterPrinter(llvm::raw_ostream &OutS,
+                                ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
   llvm::PreservedAnalyses run(llvm::Function &Func,
                               llvm::FunctionAnalysisManager &FAM);
+  // Prints Histogram, the result of the analysis for Func, as run does
+  static void printResult(llvm::raw_ostream &OS, const llvm::Function &Func,
+                          const OpcodeHistogram &Histogram,
+                          ResultFormat Format = ResultFormat::Text);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+  ResultFormat Format;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the module-level analysis
+//------------------------------------------------------------------------------
+// The opcode histogram of a whole module, i.e. the merged histograms of all
+// the functions in that module
+struct ModuleOpcodeCounter
+    : public llvm::AnalysisInfoMixin<ModuleOpcodeCounter> {
+  using Result = OpcodeHistogram;
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+
+  // Counts the opcodes in every function in parallel (for large modules). The
+  // partial results are merged in the order of the functions, so the result
+  // doesn't depend on the number of threads.
+  static Result countOpcodes(llvm::Module &M);
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<ModuleOpcodeCounter>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the module-level printer pass
+//------------------------------------------------------------------------------
+class ModuleOpcodeCounterPrinter
+    : public llvm::PassInfoMixin<ModuleOpcodeCounterPrinter> {
+public:
+  explicit ModuleOpcodeCounterPrinter(
+      llvm::raw_ostream &OutS,
+      OpcodeStatsFormat Format = OpcodeStatsFormat::Text)
+      : OS(OutS), Format(Format) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
 
 private:
   llvm::raw_ostream &OS;
+  OpcodeStatsFormat Format;
 };
 #endif
@@ -0,0 +1,92 @@
+//==============================================================================
+// FILE:
+//    ParallelFunctions.h
+//
+// DESCRIPTION:
+//    Declares the parallel adaptor - a module pass that runs function-local
+//    llvm-tutor passes over the functions of a module on a thread pool:
+//      * ParallelFunctionPass is the interface of the passes that it can run,
+//      * ParallelFunctions is the adaptor itself.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_PARALLEL_FUNCTIONS_H
+#define LLVM_TUTOR_PARALLEL_FUNCTIONS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// ParallelFunctionPass
+//------------------------------------------------------------------------------
+// A function pass split into two parts:
+//  * plan - only reads the function, so it can run for different functions
+//    concurrently,
+//  * apply - modifies the function (based on the plan) and prints the
+//    output, always on the thread that runs the adaptor.
+// The functions are processed in batches. For every batch the adaptor calls
+// startBatch, then plan for every function in the batch (concurrently) and
+// then apply for every function in the batch (in function order).
+struct ParallelFunctionPass {
+  virtual ~ParallelFunctionPass() = default;
+
+  // Prepares for a batch of NumFunctions functions from M
+  virtual void startBatch(llvm::Module &M, size_t NumFunctions) = 0;
+  // Plans F, the Idx-th function in the batch. Runs on a worker thread, so it
+  // must only read the IR and must only write to the state of F (i.e. slot
+  // Idx). Phase timers are disabled (see PhaseStats.h).
+  virtual void plan(llvm::Function &F, size_t Idx) = 0;
+  // Applies the plan for F (the Idx-th function in the batch). The output
+  // for F goes to OS.
+  virtual llvm::PreservedAnalyses apply(llvm::Function &F, size_t Idx,
+                                        llvm::raw_ostream &OS) = 0;
+};
+
+// Creates the ParallelFunctionPass for Name, one of:
+//  * mba-add, mba-sub
+//  * merge-bb, merge-bb<fixed-point>
+//  * duplicate-bb, duplicate-bb<prune-phis>
+//  * hello-world, print<liveness>
+//  * print<opcode-counter>, print<opcode-counter;format=compact>
+// The options that require BlockFrequencyInfo (e.g. duplicate-bb<hot=N>) are
+// not supported. Returns nullptr if Name is not supported.
+std::unique_ptr<ParallelFunctionPass>
+createParallelFunctionPass(llvm::StringRef Name);
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+class ParallelFunctions : public llvm::PassInfoMixin<ParallelFunctions> {
+public:
+  using PassList = std::vector<std::unique_ptr<ParallelFunctionPass>>;
+
+  // Runs Passes (in order) on every function definition. NumThreads is the
+  // number of threads used for planning (0 = one per hardware thread).
+  ParallelFunctions(llvm::raw_ostream &OutS, PassList Passes,
+                    unsigned NumThreads)
+      : OS(OutS), Passes(std::move(Passes)), NumThreads(NumThreads) {}
+
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+
+  // The maximum number of functions in a batch. Bounds the memory used for
+  // the plans and for the buffered output.
+  static constexpr size_t BatchSize = 1024;
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+  PassList Passes;
+  unsigned NumThreads;
+};
+
+#endif // LLVM_TUTOR_PARALLEL_FUNCTIONS_H
@@ -0,0 +1,110 @@
+//========================================================================
+// FILE:
+//    PhaseStats.h
+//
+// DESCRIPTION:
+//    Timers and counters for the phases of the llvm-tutor passes (e.g. STEP 1,
+//    2 and 3 of RIV, or the candidate search vs the rewrite in MergeBB). This
+//    is shared by all the plugins:
+//      * PhaseTimer times a phase for as long as it's alive,
+//      * addPhaseCount adds to a counter of a phase.
+//    Every pass gets its own TimerGroup (and every phase a Timer in that
+//    group), so the timers are printed together with the other timers when
+//    -time-passes is used (the counters are printed right after them). The
+//    output goes wherever -info-output-file points to.
+//
+//    When the LLVM_TUTOR_PHASE_STATS environment variable is set, the timers
+//    and the counters are also written, as JSON, to the file it points to:
+//      {
+//        "<pass>": {
+//          "<phase>": {
+//            "runs": 2, "wall": 0.1, "user": 0.1, "sys": 0.0,
+//            "counters": { "<counter>": 42 }
+//          }
+//        }
+//      }
+//    (the times are in seconds). Both are written when LLVM shuts down.
+//
+//    Phases of the same pass can be nested. The time is attributed to the
+//    innermost phase only, i.e. the time of the outer phase excludes the
+//    nested ones. A phase can also be re-entered while it's running (e.g. by
+//    a recursive pass). That is counted as a run, but the time still goes to
+//    the phases that were running already.
+//
+//    llvm::Timer is not thread-safe, so worker threads have to disable the
+//    timers with PhaseTimersDisabled (the counters are thread-safe).
+//
+//    When neither -time-passes nor LLVM_TUTOR_PHASE_STATS is used, this is
+//    disabled and PhaseTimer and addPhaseCount do nothing (apart from
+//    checking whether it's enabled). Still, don't use them in hot loops -
+//    count locally and call addPhaseCount once per phase.
+//
+// USAGE:
+//      {
+//        PhaseTimer T("merge-bb", "search");
+//        ...
+//        addPhaseCount("merge-bb", "search", "candidates", NumCandidates);
+//      }
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_PHASE_STATS_H
+#define LLVM_TUTOR_PHASE_STATS_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+
+namespace llvm {
+class Timer;
+} // namespace llvm
+
+// The environment variable that enables the JSON output
+inline constexpr const char *PhaseStatsEnvVar = "LLVM_TUTOR_PHASE_STATS";
+
+// Returns true if the phases are timed and counted, i.e. with -time-passes or
+// when LLVM_TUTOR_PHASE_STATS is set
+bool arePhaseStatsEnabled();
+
+//------------------------------------------------------------------------------
+// PhaseTimer
+//------------------------------------------------------------------------------
+// Times the phase Phase of the pass Pass from construction to destruction
+class PhaseTimer {
+public:
+  PhaseTimer(llvm::StringRef Pass, llvm::StringRef Phase);
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  // nullptr when disabled (or when the phase is running already)
+  llvm::Timer *T = nullptr;
+  // The enclosing phase (on this thread), paused while this one is running
+  PhaseTimer *Outer = nullptr;
+};
+
+// Disables PhaseTimer on the calling thread for as long as it's alive (the
+// counters are still updated). Used by the worker threads of the parallel
+// adaptor (see ParallelFunctions.h).
+class PhaseTimersDisabled {
+public:
+  PhaseTimersDisabled();
+  ~PhaseTimersDisabled();
+
+  PhaseTimersDisabled(const PhaseTimersDisabled &) = delete;
+  PhaseTimersDisabled &operator=(const PhaseTimersDisabled &) = delete;
+
+private:
+  bool WereDisabled;
+};
+
+//------------------------------------------------------------------------------
+// Counters
+//------------------------------------------------------------------------------
+// Adds N to the counter Counter of the phase Phase of the pass Pass
+void addPhaseCount(llvm::StringRef Pass, llvm::StringRef Phase,
+                   llvm::StringRef Counter, uint64_t N = 1);
+
+#endif // LLVM_TUTOR_PHASE_STATS_H
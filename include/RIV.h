@@ -5,6 +5,8 @@
 // DESCRIPTION:
 //    Declares the RIV passes:
 //      * new pass manager interface
+//      * the IntegerGlobals module analysis used by RIV (and
+//        SharedIntegerGlobals, used when it's not cached)
 //      * legacy pass manager interface
 //      * printer pass for the new pass manager
 //
@@ -13,25 +15,316 @@
 #ifndef LLVM_TUTOR_RIV_H
 #define LLVM_TUTOR_RIV_H
 
+#include "ResultPrinter.h"
+
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/MapVector.h"
-#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/ADT/iterator.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Result of the RIV analysis
+//------------------------------------------------------------------------------
+// One link in a chain of reachable integer values. Every node holds only the
+// values that it adds on top of its parent (the delta), so a chain shares all
+// of its ancestors with its siblings.
+struct RIVNode {
+  llvm::ArrayRef<llvm::Value *> Delta;
+  const RIVNode *Parent = nullptr;
+  // The number of values in this node and all of its ancestors
+  size_t Size = 0;
+};
+
+// A read-only view of the set of reachable integer values for one basic
+// block. The values in Head are visited first, followed by the Delta of every
+// node in the Tail chain. With the flat representation the whole set is held
+// in Head (except for the input arguments and the globals), with the chained
+// representation it's all in Tail. The globals may be owned by the
+// IntegerGlobals analysis, everything else is owned by the enclosing RIVResult.
+//
+// With the bitset representation, the set is a bit vector (Words) instead,
+// with one bit for every value in Numbering, i.e. for every integer value in
+// the function (plus the globals). The values are visited in the order of
+// their bits. Every bit vector comes with a rank index (Ranks) - the number of
+// bits set in the words before every word - so that operator[] doesn't have
+// to count the bits from the start.
+class RIVSet {
+public:
+  using BitWord = uint64_t;
+  using RankWord = uint32_t;
+  static constexpr unsigned BitWordSize = sizeof(BitWord) * CHAR_BIT;
+  static size_t getNumWords(size_t NumBits) {
+    return llvm::divideCeil(NumBits, BitWordSize);
+  }
+
+  class iterator
+      : public llvm::iterator_facade_base<iterator, std::forward_iterator_tag,
+                                          llvm::Value *, std::ptrdiff_t,
+                                          llvm::Value *const *,
+                                          llvm::Value *const &> {
+  public:
+    iterator() = default;
+    iterator(llvm::ArrayRef<llvm::Value *> Head, const RIVNode *Tail)
+        : Cur(Head), Next(Tail) {
+      skipEmpty();
+    }
+    iterator(const BitWord *Words, llvm::ArrayRef<llvm::Value *> Numbering)
+        : Cur(Numbering), Words(Words) {
+      findNextBit(0);
+    }
+
+    llvm::Value *const &operator*() const { return Cur[Idx]; }
+    iterator &operator++() {
+      if (Words) {
+        findNextBit(Idx + 1);
+        return *this;
+      }
+      ++Idx;
+      skipEmpty();
+      return *this;
+    }
+    bool operator==(const iterator &Other) const {
+      return Cur.data() == Other.Cur.data() && Idx == Other.Idx &&
+             Next == Other.Next && Words == Other.Words;
+    }
+
+  private:
+    // Move to the next non-empty segment once the current one is exhausted.
+    // The end iterator is ({}, 0, nullptr, nullptr).
+    void skipEmpty() {
+      while (Idx == Cur.size() && Next) {
+        Cur = Next->Delta;
+        Next = Next->Parent;
+        Idx = 0;
+      }
+      if (Idx == Cur.size()) {
+        Cur = {};
+        Idx = 0;
+      }
+    }
+    // Bitset only: move to the first set bit at or after Bit (a word at a
+    // time), or to the end if there's none
+    void findNextBit(size_t Bit) {
+      size_t NumWords = getNumWords(Cur.size());
+      for (size_t W = Bit / BitWordSize; W < NumWords; ++W) {
+        BitWord Word = Words[W];
+        if (W == Bit / BitWordSize)
+          Word &= ~BitWord(0) << (Bit % BitWordSize);
+        if (Word) {
+          Idx = W * BitWordSize + llvm::countr_zero(Word);
+          return;
+        }
+      }
+      *this = iterator();
+    }
+
+    // With the bitset representation, Cur is the numbering and Idx the
+    // current bit
+    llvm::ArrayRef<llvm::Value *> Cur;
+    size_t Idx = 0;
+    const RIVNode *Next = nullptr;
+    const BitWord *Words = nullptr;
+  };
+
+  RIVSet() = default;
+  RIVSet(llvm::ArrayRef<llvm::Value *> Head, const RIVNode *Tail)
+      : Head(Head), Tail(Tail),
+        NumValues(Head.size() + (Tail ? Tail->Size : 0)) {}
+  // Bitset: Words and Ranks hold getNumWords(Numbering.size()) words each,
+  // NumValues bits of Words are set
+  RIVSet(const BitWord *Words, const RankWord *Ranks,
+         llvm::ArrayRef<llvm::Value *> Numbering, size_t NumValues)
+      : Head(Numbering), NumValues(NumValues), Words(Words), Ranks(Ranks) {}
+
+  iterator begin() const {
+    return Words ? iterator(Words, Head) : iterator(Head, Tail);
+  }
+  iterator end() const { return iterator(); }
+  size_t size() const { return NumValues; }
+  bool empty() const { return 0 == NumValues; }
+  // Linear in the size of the set
+  bool contains(const llvm::Value *V) const {
+    return llvm::is_contained(*this, V);
+  }
+  // Returns the Idx-th value (in iteration order). Linear in the number of
+  // segments rather than in the number of values, i.e. constant for the flat
+  // representation. For the bitset representation it's a binary search over
+  // the rank index, i.e. logarithmic in the number of words.
+  llvm::Value *operator[](size_t Idx) const {
+    assert(Idx < NumValues && "Index out of range");
+    if (Words) {
+      // The last word with fewer than Idx + 1 bits set before it
+      size_t W = std::upper_bound(Ranks, Ranks + getNumWords(Head.size()),
+                                  Idx) -
+                 Ranks - 1;
+      BitWord Word = Words[W];
+      // Drop the lowest bits that are set, up to the Idx-th one
+      for (Idx -= Ranks[W]; Idx; --Idx)
+        Word &= Word - 1;
+      return Head[W * BitWordSize + llvm::countr_zero(Word)];
+    }
+    if (Idx < Head.size())
+      return Head[Idx];
+    Idx -= Head.size();
+    for (const RIVNode *Node = Tail; Node; Node = Node->Parent) {
+      if (Idx < Node->Delta.size())
+        return Node->Delta[Idx];
+      Idx -= Node->Delta.size();
+    }
+    llvm_unreachable("Inconsistent RIV set size");
+  }
+
+private:
+  // With the bitset representation, this is the numbering
+  llvm::ArrayRef<llvm::Value *> Head;
+  const RIVNode *Tail = nullptr;
+  size_t NumValues = 0;
+  const BitWord *Words = nullptr;
+  const RankWord *Ranks = nullptr;
+};
+
+class IntegerGlobalsInfo;
+
+// For every basic block holds the set of reachable integer values for that
+// block. The blocks are kept in the order in which they were visited.
+class RIVResult {
+  using MapTy = llvm::MapVector<llvm::BasicBlock const *, RIVSet>;
+
+public:
+  using const_iterator = MapTy::const_iterator;
+
+  // Returns an empty set for blocks that are not reachable from the entry
+  RIVSet lookup(llvm::BasicBlock const *BB) const { return Sets.lookup(BB); }
+
+  const_iterator begin() const { return Sets.begin(); }
+  const_iterator end() const { return Sets.end(); }
+  size_t size() const { return Sets.size(); }
+  bool empty() const { return Sets.empty(); }
+
+private:
+  friend struct RIV;
+
+  MapTy Sets;
+  // The integer globals referenced by Sets, when shared with the other
+  // functions (see SharedIntegerGlobals)
+  std::shared_ptr<const IntegerGlobalsInfo> SharedGlobals;
+  // Backs the values and the nodes referenced by Sets
+  llvm::BumpPtrAllocator Alloc;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the IntegerGlobals analysis
+//------------------------------------------------------------------------------
+// The integer global variables of a module (in module order). These are
+// reachable from every basic block, so RIV shares them between all functions
+// when this analysis is cached (otherwise see SharedIntegerGlobals).
+class IntegerGlobalsInfo {
+public:
+  llvm::ArrayRef<llvm::Value *> globals() const { return Globals; }
+
+  // Function analyses can only access the cached results of module analyses
+  // that are not invalidated behind their back. When IntegerGlobals is not
+  // preserved, this result still stays valid for as long as the list of
+  // integer globals in M is unchanged (e.g. after DuplicateBB has modified a
+  // function). Only then the globals are rescanned.
+  bool invalidate(llvm::Module &M, const llvm::PreservedAnalyses &PA,
+                  llvm::ModuleAnalysisManager::Invalidator &);
+
+private:
+  friend struct IntegerGlobals;
+
+  std::vector<llvm::Value *> Globals;
+};
+
+struct IntegerGlobals : public llvm::AnalysisInfoMixin<IntegerGlobals> {
+  using Result = IntegerGlobalsInfo;
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+
+  static Result collectIntegerGlobals(llvm::Module &M);
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<IntegerGlobals>;
+};
+
+// The integer globals used by RIV when IntegerGlobals is not cached (i.e.
+// without `require<integer-globals>`). A function analysis can't compute a
+// module analysis, so this one collects the globals for the first function of
+// a module and hands the same list to the other functions.
+//
+// The results are never invalidated individually (function passes must not
+// add or remove globals). These are only dropped when all the function
+// analyses are cleared, e.g. after a module pass that didn't preserve them.
+// Once no result refers to the list anymore, it's collected again.
+struct SharedIntegerGlobals
+    : public llvm::AnalysisInfoMixin<SharedIntegerGlobals> {
+  struct Result {
+    std::shared_ptr<const IntegerGlobalsInfo> Globals;
+
+    bool invalidate(llvm::Function &, const llvm::PreservedAnalyses &,
+                    llvm::FunctionAnalysisManager::Invalidator &) {
+      return false;
+    }
+  };
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
+
+private:
+  // The list that was handed out last (not owned)
+  const llvm::Module *LastModule = nullptr;
+  std::weak_ptr<const IntegerGlobalsInfo> LastGlobals;
+
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<SharedIntegerGlobals>;
+};
 
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct RIV : public llvm::AnalysisInfoMixin<RIV> {
-  // A map that for every basic block holds a set of pointers to reachable
-  // integer values for that block.
-  using Result = llvm::MapVector<llvm::BasicBlock const *,
-                                 llvm::SmallPtrSet<llvm::Value *, 8>>;
+  // How the RIV sets are stored:
+  //  * Flat - every block holds a full copy of its set
+  //  * Chained - every dom-tree node holds only the values defined in its
+  //    immediate dominator, plus a pointer to the node of that dominator
+  //  * Bitset - the values in the function are numbered once and every block
+  //    holds a bit vector (shared by all the children of its immediate
+  //    dominator)
+  enum class Representation { Flat, Chained, Bitset };
+
+  explicit RIV(Representation Repr = Representation::Flat) : Repr(Repr) {}
+
+  // Parses `flat`, `chained` or `bitset` (e.g. from `print<riv;repr=bitset>`).
+  // Returns nothing if Name is neither.
+  static std::optional<Representation> parseRepresentation(llvm::StringRef Name);
+
+  using Result = RIVResult;
   Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
+  // If Globals is null, the integer globals are collected from F's module
   Result buildRIV(llvm::Function &F,
-                  llvm::DomTreeNodeBase<llvm::BasicBlock> *CFGRoot);
+                  llvm::DomTreeNodeBase<llvm::BasicBlock> *CFGRoot,
+                  const IntegerGlobals::Result *Globals = nullptr);
 
 private:
+  Representation Repr;
+
   // A special type used by analysis passes to provide an address that
   // identifies that particular analysis pass type.
   static llvm::AnalysisKey Key;
@@ -43,12 +336,19 @@ private:
 //------------------------------------------------------------------------------
 class RIVPrinter : public llvm::PassInfoMixin<RIVPrinter> {
 public:
-  explicit RIVPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  // Without Repr, the result of the registered RIV analysis (i.e. the flat
+  // one) is printed. Otherwise the sets are computed here with Repr.
+  explicit RIVPrinter(llvm::raw_ostream &OutS,
+                      ResultFormat Format = ResultFormat::Text,
+                      std::optional<RIV::Representation> Repr = std::nullopt)
+      : OS(OutS), Format(Format), Repr(Repr) {}
   llvm::PreservedAnalyses run(llvm::Function &F,
                               llvm::FunctionAnalysisManager &FAM);
 
 private:
   llvm::raw_ostream &OS;
+  ResultFormat Format;
+  std::optional<RIV::Representation> Repr;
 };
 
 #endif // LLVM_TUTOR_RIV_H
@@ -0,0 +1,124 @@
+//========================================================================
+// FILE:
+//    ResultPrinter.h
+//
+// DESCRIPTION:
+//    The output backend of the printer passes (print<riv>,
+//    print<opcode-counter> and print<static-cc>). This is shared by all the
+//    plugins:
+//      * ResultFormat selects between the column-aligned tables (Text) and a
+//        machine-readable format (Compact),
+//      * ResultStream writes either of them straight to the target
+//        raw_ostream.
+//
+//    In the Compact format every line is one record - the kind of the record
+//    followed by its fields, all separated with tabs:
+//      riv              <function> <block> <value>...
+//      opcode-counter   <function> <opcode> <count>
+//      static-cc        <callee> <direct calls> [<indirect calls>]
+//      static-cc-unresolved <count>
+//    Functions, blocks and values are printed as operands (e.g. `@foo`,
+//    `%entry`, `%x`), i.e. names that contain spaces, tabs or other special
+//    characters are quoted and escaped as in textual IR (e.g. `@"a\09b"`). So
+//    the records can be split on tabs without any further escaping.
+//
+// USAGE:
+//      opt -load-pass-plugin libRIV.so `\`
+//        -passes="print<riv;format=compact>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_RESULT_PRINTER_H
+#define LLVM_TUTOR_RESULT_PRINTER_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/IR/Value.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <optional>
+
+enum class ResultFormat { Text, Compact };
+
+// Parses `print<Pass>` and `print<Pass;Param1;Param2;...>`. `format=F`, where
+// F is either `text` or `compact`, is accepted for every pass. Any other
+// parameter is passed to ParseParam, which returns false if it's not valid.
+// Returns nothing if Name is not a valid printer name.
+std::optional<ResultFormat>
+parsePrinterName(llvm::StringRef Name, llvm::StringRef Pass,
+                 llvm::function_ref<bool(llvm::StringRef)> ParseParam = nullptr);
+
+// A raw_ostream for the printer passes. Everything is written straight to the
+// underlying stream - there are no intermediate strings. The current column
+// is tracked, so that fields whose width is only known once they have been
+// printed (e.g. values) can still be padded. All values are printed with one
+// ModuleSlotTracker, so the slots of a function are only computed once rather
+// than for every value.
+class ResultStream : public llvm::formatted_raw_ostream {
+public:
+  // M is only required for printing values
+  explicit ResultStream(llvm::raw_ostream &OS, const llvm::Module *M = nullptr)
+      : formatted_raw_ostream(OS), MST(M) {}
+
+  // Numbers the values in F (only needed before printing its unnamed values)
+  void incorporateFunction(const llvm::Function &F) {
+    MST.incorporateFunction(F);
+  }
+
+  //----------------------------------------------------------------------------
+  // Text
+  //----------------------------------------------------------------------------
+  // Pads the current line with spaces up to Column (i.e. what `%-Ns` does for
+  // a field that started at Column - N). Unlike PadToColumn, nothing is added
+  // if the line is already that long.
+  ResultStream &padTo(unsigned Column) {
+    unsigned Current = getColumn();
+    if (Current < Column)
+      indent(Column - Current);
+    return *this;
+  }
+  // Prints V in full, e.g. `%x = add i32 %a, %b`
+  ResultStream &value(const llvm::Value &V) {
+    V.print(*this, MST);
+    return *this;
+  }
+  // Prints V as an operand without its type, e.g. `%x`
+  ResultStream &operand(const llvm::Value &V) {
+    V.printAsOperand(*this, /*PrintType=*/false, MST);
+    return *this;
+  }
+
+  //----------------------------------------------------------------------------
+  // Compact
+  //----------------------------------------------------------------------------
+  // Starts a record of kind Kind. The fields are added with field() and the
+  // record is finished with endRecord().
+  ResultStream &record(llvm::StringRef Kind) {
+    *this << Kind;
+    return *this;
+  }
+  ResultStream &field(llvm::StringRef Field) {
+    *this << '\t' << Field;
+    return *this;
+  }
+  ResultStream &field(uint64_t Field) {
+    *this << '\t' << Field;
+    return *this;
+  }
+  ResultStream &field(const llvm::Value &V) {
+    *this << '\t';
+    return operand(V);
+  }
+  void endRecord() { *this << '\n'; }
+
+private:
+  llvm::ModuleSlotTracker MST;
+};
+
+#endif // LLVM_TUTOR_RESULT_PRINTER_H
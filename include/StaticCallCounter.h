@@ -7,14 +7,19 @@
 //      * new pass manager interface
 //      * legacy pass manager interface
 //      * printer pass for the new pass manager
+//    and the passes that also count indirect calls (the `indirect` mode)
+//      * a function analysis (cached per function)
+//      * a module analysis that combines the function results
+//      * printer pass for the new pass manager
 //
 // License: MIT
 //========================================================================
 #ifndef LLVM_TUTOR_STATICCALLCOUNTER_H
 #define LLVM_TUTOR_STATICCALLCOUNTER_H
 
+#include "ResultPrinter.h"
+
 #include "llvm/ADT/MapVector.h"
-#include "llvm/IR/AbstractCallSite.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
@@ -29,6 +34,8 @@ struct StaticCallCounter : public llvm::AnalysisInfoMixin<StaticCallCounter> {
   using Result = ResultStaticCC;
   Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
   Result runOnModule(llvm::Module &M);
+  // Adds the direct calls made from Func to Res. Func has to be materialised.
+  static void countDirectCalls(const llvm::Function &Func, Result &Res);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -46,7 +53,9 @@ private:
 class StaticCallCounterPrinter
     : public llvm::PassInfoMixin<StaticCallCounterPrinter> {
 public:
-  explicit StaticCallCounterPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  explicit StaticCallCounterPrinter(llvm::raw_ostream &OutS,
+                                    ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &MAM);
   // Part of the official API:
@@ -55,6 +64,75 @@ public:
 
 private:
   llvm::raw_ostream &OS;
+  ResultFormat Format;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the `indirect` mode
+//------------------------------------------------------------------------------
+// The calls to one function
+struct CallCounts {
+  unsigned Direct = 0;
+  // The number of indirect calls that may target this function (one call with
+  // N possible targets is counted once for each of them)
+  unsigned Indirect = 0;
+};
+
+struct ResultCallGraphCC {
+  // Callee -> the calls to that callee
+  llvm::MapVector<const llvm::Function *, CallCounts> Callees;
+  // The number of indirect calls with unknown targets
+  unsigned NumUnresolved = 0;
+
+  void merge(const ResultCallGraphCC &Other);
+};
+
+// Counts the calls made from one function. Indirect calls are resolved with
+// `!callees` metadata and, failing that, by following the called pointer
+// through casts, selects, PHIs, loads from constant globals (e.g. vtables
+// with known offsets) and allocas that are only loaded from and stored to.
+// Being a function analysis, the results are cached per function by the
+// function analysis manager, i.e. only the functions that were modified are
+// rescanned.
+struct FunctionCallCounter
+    : public llvm::AnalysisInfoMixin<FunctionCallCounter> {
+  using Result = ResultCallGraphCC;
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &);
+  static Result countCalls(const llvm::Function &F);
+  static bool isRequired() { return true; }
+
+private:
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FunctionCallCounter>;
+};
+
+// Combines the FunctionCallCounter results for all the functions in a module.
+// Requires FunctionCallCounter to be registered with the function analysis
+// manager.
+struct CallGraphCallCounter
+    : public llvm::AnalysisInfoMixin<CallGraphCallCounter> {
+  using Result = ResultCallGraphCC;
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+  static bool isRequired() { return true; }
+
+private:
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<CallGraphCallCounter>;
+};
+
+class CallGraphCallCounterPrinter
+    : public llvm::PassInfoMixin<CallGraphCallCounterPrinter> {
+public:
+  explicit CallGraphCallCounterPrinter(llvm::raw_ostream &OutS,
+                                       ResultFormat Format = ResultFormat::Text)
+      : OS(OutS), Format(Format) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+  ResultFormat Format;
 };
 
 #endif // LLVM_TUTOR_STATICCALLCOUNTER_H
@@ -13,6 +13,13 @@
 //    stream). It also demonstrates how instructions can be modified without
 //    having to completely replace them.
 //
+//    Comparisons of half, float, double (or any other type with an IEEE 754
+//    layout) and of fixed-width vectors of these are converted. In the fused
+//    mode (convert-fcmp-eq<fused>), the comparisons are also reported (like
+//    print<find-fcmp-eq> does) and the function is scanned only once. With
+//    convert-fcmp-eq<fabs>, the absolute value is computed with llvm.fabs
+//    rather than by masking out the sign bit.
+//
 //    Originally developed for [1].
 //
 //    [1] "Writing an LLVM Optimization" by Jonathan Smith
@@ -20,19 +27,27 @@
 // USAGE:
 //      opt --load-pass-plugin libConvertFCmpEq.dylib [--stats] `\`
 //        --passes='convert-fcmp-eq' --disable-output <input-llvm-file>
+//      opt --load-pass-plugin libConvertFCmpEq.dylib `\`
+//        --passes='convert-fcmp-eq<fused;fabs>' -S <input-llvm-file>
 //
 // License: MIT
 //=============================================================================
 #include "ConvertFCmpEq.h"
+#include "PhaseStats.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/Attributes.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
@@ -42,12 +57,18 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
 #include <cassert>
+#include <optional>
 
 using namespace llvm;
 
-// Unnamed namespace for private functions
-static FCmpInst *convertFCmpEqInstruction(FCmpInst *FCmp) noexcept {
+// Converts FCmp (an equality comparison of scalar or fixed-width vector
+// floating-point values) into a difference-based comparison. Epsilon and
+// SignMask must match the type of the operands of FCmp, see getConstants().
+// If SignMask is null, the absolute value is computed with llvm.fabs instead.
+static FCmpInst *convertFCmpEqInstruction(FCmpInst *FCmp, Constant *Epsilon,
+                                          Constant *SignMask) noexcept {
   assert(FCmp && "The given fcmp instruction is null");
 
   if (!FCmp->isEquality()) {
@@ -75,41 +96,31 @@ static FCmpInst *convertFCmpEqInstruction(FCmpInst *FCmp) noexcept {
     }
   }();
 
-  // Create the objects and values needed to perform the equality comparison
-  // conversion.
-  Module *M = FCmp->getModule();
-  assert(M && "The given fcmp instruction does not belong to a module");
-  LLVMContext &Ctx = M->getContext();
-  IntegerType *I64Ty = IntegerType::get(Ctx, 64);
-  Type *DoubleTy = Type::getDoubleTy(Ctx);
-
-  // Define the sign-mask and double-precision machine epsilon constants.
-  ConstantInt *SignMask = ConstantInt::get(I64Ty, ~(1L << 63));
-  // The machine epsilon value for IEEE 754 double-precision values is 2 ^ -52
-  // or (b / 2) * b ^ -(p - 1) where b (base) = 2 and p (precision) = 53.
-  APInt EpsilonBits(64, 0x3CB0000000000000);
-  Constant *EpsilonValue =
-      ConstantFP::get(DoubleTy, EpsilonBits.bitsToDouble());
-
   // Create an IRBuilder with an insertion point set to the given fcmp
   // instruction.
   IRBuilder<> Builder(FCmp);
   // Create the subtraction, casting, absolute value, and new comparison
-  // instructions one at a time.
+  // instructions one at a time (the comments show the double case).
   // %0 = fsub double %a, %b
-  auto *FSubInst = Builder.CreateFSub(LHS, RHS);
-  // %1 = bitcast double %0 to i64
-  auto *CastToI64 = Builder.CreateBitCast(FSubInst, I64Ty);
-  // %2 = and i64 %1, 0x7fffffffffffffff
-  auto *AbsValue = Builder.CreateAnd(CastToI64, SignMask);
-  // %3 = bitcast i64 %2 to double
-  auto *CastToDouble = Builder.CreateBitCast(AbsValue, DoubleTy);
-  // %4 = fcmp <olt/ult/oge/uge> double %3, 0x3cb0000000000000
+  Value *FSubInst = Builder.CreateFSub(LHS, RHS);
+  Value *AbsValue = nullptr;
+  if (SignMask) {
+    // %1 = bitcast double %0 to i64
+    auto *CastToInt = Builder.CreateBitCast(FSubInst, SignMask->getType());
+    // %2 = and i64 %1, 0x7fffffffffffffff
+    auto *MaskedValue = Builder.CreateAnd(CastToInt, SignMask);
+    // %3 = bitcast i64 %2 to double
+    AbsValue = Builder.CreateBitCast(MaskedValue, LHS->getType());
+  } else {
+    // %1 = call double @llvm.fabs.f64(double %0)
+    AbsValue = Builder.CreateUnaryIntrinsic(Intrinsic::fabs, FSubInst);
+  }
+  // %4 = fcmp <olt/ult/oge/uge> double %3 (or %1), 0x3cb0000000000000
   // Rather than creating a new instruction, we'll just change the predicate and
   // operands of the existing fcmp instruction to match what we want.
   FCmp->setPredicate(CmpPred);
-  FCmp->setOperand(0, CastToDouble);
-  FCmp->setOperand(1, EpsilonValue);
+  FCmp->setOperand(0, AbsValue);
+  FCmp->setOperand(1, Epsilon);
   return FCmp;
 }
 
@@ -123,15 +134,74 @@ STATISTIC(FCmpEqConversionCount,
 //------------------------------------------------------------------------------
 // ConvertFCmpEq implementation
 //------------------------------------------------------------------------------
+const ConvertFCmpEq::FPConstants *ConvertFCmpEq::getConstants(Type *Ty) {
+  // The types are owned by the context, so the cache can only be reused
+  // within one context
+  LLVMContext &Ctx = Ty->getContext();
+  if (CachedCtx != &Ctx) {
+    ConstantCache.clear();
+    CachedCtx = &Ctx;
+  }
+
+  auto [It, Inserted] = ConstantCache.try_emplace(Ty);
+  if (!Inserted)
+    return It->second.SignMask ? &It->second : nullptr;
+
+  // Only the types with an IEEE 754-like layout (i.e. all but ppc_fp128),
+  // either scalars or fixed-width vectors, are supported. These are the types
+  // for which masking out the top bit yields the absolute value. The entry
+  // for any other type is left empty.
+  Type *ElemTy = Ty->getScalarType();
+  if (!ElemTy->isIEEE() || isa<ScalableVectorType>(Ty))
+    return nullptr;
+
+  const fltSemantics &Sem = ElemTy->getFltSemantics();
+  unsigned NumBits = ElemTy->getPrimitiveSizeInBits();
+
+  // The machine epsilon is b ^ -(p - 1), where b (base) = 2 and p is the
+  // precision, e.g. 2 ^ -52 (0x3CB0000000000000) for double-precision values.
+  APFloat Epsilon =
+      scalbn(APFloat(Sem, 1), 1 - int(APFloat::semanticsPrecision(Sem)),
+             APFloat::rmNearestTiesToEven);
+
+  // Both constants are splatted if Ty is a vector type
+  FPConstants &Constants = It->second;
+  Type *IntTy = Ty->getWithNewType(IntegerType::get(Ctx, NumBits));
+  Constants.SignMask =
+      ConstantInt::get(IntTy, APInt::getSignedMaxValue(NumBits));
+  Constants.Epsilon = ConstantFP::get(Ty, Epsilon);
+  return &Constants;
+}
+
+bool ConvertFCmpEq::convert(FCmpInst &FCmp) {
+  const FPConstants *Constants = getConstants(FCmp.getOperand(0)->getType());
+  if (!Constants) {
+    LLVM_DEBUG(dbgs() << "Ignoring fcmp of unsupported type: " << FCmp
+                      << "\n");
+    return false;
+  }
+
+  return convertFCmpEqInstruction(
+      &FCmp, Constants->Epsilon,
+      Lower == Lowering::SignMask ? Constants->SignMask : nullptr);
+}
+
 PreservedAnalyses ConvertFCmpEq::run(Function &Func,
                                      FunctionAnalysisManager &FAM) {
-  auto &Comparisons = FAM.getResult<FindFCmpEq>(Func);
-  bool Modified = run(Func, Comparisons);
-  return Modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+  bool Modified = ReportOS ? runFused(Func, *ReportOS)
+                           : run(Func, FAM.getResult<FindFCmpEq>(Func));
+  if (!Modified)
+    return PreservedAnalyses::all();
+
+  // Only new instructions are added, the CFG is left intact
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
 }
 
 bool ConvertFCmpEq::run(Function &Func,
                         const FindFCmpEq::Result &Comparisons) {
+  PhaseTimer T(PassArg, "convert");
   bool Modified = false;
   // Functions marked explicitly 'optnone' should be ignored since we shouldn't
   // be changing anything in them anyway.
@@ -140,13 +210,55 @@ bool ConvertFCmpEq::run(Function &Func,
                       << "\"\n");
     Modified = false;
   } else {
+    uint64_t NumConverted = 0;
     for (FCmpInst *FCmp : Comparisons) {
-      if (convertFCmpEqInstruction(FCmp)) {
+      if (convert(*FCmp)) {
         ++FCmpEqConversionCount;
+        NumConverted++;
         Modified = true;
       }
     }
+    addPhaseCount(PassArg, "convert", "converted", NumConverted);
+  }
+
+  return Modified;
+}
+
+bool ConvertFCmpEq::runFused(Function &Func, raw_ostream &ReportOS) {
+  // The only walk over the function. The comparisons are reported before
+  // any of them is converted so that the instruction numbering in the report
+  // matches the input (and print<find-fcmp-eq>).
+  SmallVector<FCmpInst *, 8> Comparisons;
+  {
+    PhaseTimer T(PassArg, "find");
+    for (Instruction &Inst : instructions(Func))
+      if (auto *FCmp = dyn_cast<FCmpInst>(&Inst); FCmp && FCmp->isEquality())
+        Comparisons.push_back(FCmp);
+    addPhaseCount(PassArg, "find", "comparisons", Comparisons.size());
+  }
+
+  {
+    PhaseTimer T(PassArg, "report");
+    printFCmpEqInstructions(ReportOS, Func, Comparisons);
+  }
+
+  bool Modified = false;
+  if (Func.hasFnAttribute(Attribute::OptimizeNone)) {
+    LLVM_DEBUG(dbgs() << "Ignoring optnone-marked function \"" << Func.getName()
+                      << "\"\n");
+    return Modified;
+  }
+
+  PhaseTimer T(PassArg, "convert");
+  uint64_t NumConverted = 0;
+  for (FCmpInst *FCmp : Comparisons) {
+    if (convert(*FCmp)) {
+      ++FCmpEqConversionCount;
+      NumConverted++;
+      Modified = true;
+    }
   }
+  addPhaseCount(PassArg, "convert", "converted", NumConverted);
 
   return Modified;
 }
@@ -154,14 +266,52 @@ bool ConvertFCmpEq::run(Function &Func,
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses "convert-fcmp-eq" and "convert-fcmp-eq<fused;fabs>" (both options are
+// optional)
+static std::optional<ConvertFCmpEq> parseConvertFCmpEq(StringRef Name) {
+  if (!Name.consume_front(PassArg))
+    return std::nullopt;
+
+  if (Name.empty())
+    return ConvertFCmpEq();
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  bool Fused = false;
+  auto Lower = ConvertFCmpEq::Lowering::SignMask;
+  SmallVector<StringRef, 2> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options) {
+    if (Option == "fused")
+      Fused = true;
+    else if (Option == "fabs")
+      Lower = ConvertFCmpEq::Lowering::FAbs;
+    else
+      return std::nullopt;
+  }
+
+  return Fused ? ConvertFCmpEq(llvm::outs(), Lower) : ConvertFCmpEq(Lower);
+}
+
 PassPluginLibraryInfo getConvertFCmpEqPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, PluginName, LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "FAM.getResult<FindFCmpEq>(Function)"
+            // FindFCmpEq is linked into this plugin, so that it can be used
+            // without libFindFCmpEq. Registering it twice (if both plugins
+            // are loaded) is harmless.
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM) {
+                  FAM.registerPass([&] { return FindFCmpEq(); });
+                });
+            // #2 REGISTRATION FOR "opt -passes=convert-fcmp-eq" and
+            // "opt -passes=convert-fcmp-eq<fused;fabs>"
             PB.registerPipelineParsingCallback(
                 [&](StringRef Name, FunctionPassManager &FPM,
                     ArrayRef<PassBuilder::PipelineElement>) {
-                  if (!Name.compare(PassArg)) {
-                    FPM.addPass(ConvertFCmpEq());
+                  if (auto Pass = parseConvertFCmpEq(Name)) {
+                    FPM.addPass(std::move(*Pass));
                     return true;
                   }
 
@@ -170,7 +320,9 @@ PassPluginLibraryInfo getConvertFCmpEqPluginInfo() {
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getConvertFCmpEqPluginInfo();
 }
+#endif
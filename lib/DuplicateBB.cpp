@@ -27,7 +27,29 @@
 //    constant values lead to trivial `if` conditions (e.g. if ( 0 == 0 )).
 //
 //    All newly created basic blocks are suffixed with the original basic
-//    block's numeric ID.
+//    block's numeric ID (counted per function).
+//
+//    The random generator is seeded per function (see DuplicateBB::createRNG),
+//    so the output for a function doesn't depend on the rest of the module,
+//    nor on the order in which the functions are visited (e.g. by the
+//    parallel adaptor, see ParallelFunctions.h).
+//
+//    By default, every suitable block is duplicated. In the profile-guided
+//    mode (`duplicate-bb<hot=N;budget=M>`, either option can be omitted), the
+//    blocks are ranked by their frequency (as reported by BlockFrequencyInfo,
+//    which takes the profile data into account). Only the blocks that are
+//    executed at least N times per 100 executions of the entry block are
+//    duplicated, hottest first, until the duplicated blocks contain M
+//    instructions in total.
+//
+//    By default, every instruction in BB is cloned twice and replaced with a
+//    PHI node in lt-tail (later passes remove the PHI nodes that are unused).
+//    With `duplicate-bb<prune-phis>`, the original instructions are moved to
+//    lt-clone-1 instead, so that only lt-clone-2 requires clones, and PHI nodes
+//    are only created for the values that are used outside of the clones.
+//
+//    Selecting the blocks and cloning them are timed and counted separately,
+//    see PhaseStats.h.
 //
 //  ALGORITHM:
 //    --------------------------------------------------------------------------
@@ -68,6 +90,10 @@
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib//libRIV.so `\`
 //      -load-pass-plugin <BUILD_DIR>/lib//libDuplicateBB.so `\`
 //      -passes=duplicate-bb -S <bitcode-file>
+//    or, in the profile-guided mode:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib//libRIV.so `\`
+//      -load-pass-plugin <BUILD_DIR>/lib//libDuplicateBB.so `\`
+//      -passes="duplicate-bb<hot=200;budget=1000>" -S <bitcode-file>
 //
 // REFERENCES:
 //    Based on examples from:
@@ -77,8 +103,12 @@
 // License: MIT
 //==============================================================================
 #include "DuplicateBB.h"
+#include "BlockHotness.h"
+#include "PhaseStats.h"
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
@@ -87,21 +117,49 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
+#include <numeric>
+#include <optional>
 #include <random>
 
 #define DEBUG_TYPE "duplicate-bb"
 
 STATISTIC(DuplicateBBCountStats, "The # of duplicated blocks");
+STATISTIC(NumColdBBs, "The # of blocks not duplicated because they are cold");
+STATISTIC(NumOverBudgetBBs,
+          "The # of blocks not duplicated because of the size budget");
+
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "duplicate-bb";
 
 using namespace llvm;
 
 //------------------------------------------------------------------------------
 // DuplicateBB Implementation
 //------------------------------------------------------------------------------
+// The number of instructions in BB that cloneBB duplicates (i.e. excluding PHI
+// nodes and the terminator)
+static unsigned getNumInstsToClone(BasicBlock &BB) {
+  unsigned NumInsts = 0;
+  for (Instruction &I :
+       make_range(BB.getFirstNonPHI()->getIterator(), BB.end()))
+    if (!I.isTerminator())
+      NumInsts++;
+  return NumInsts;
+}
+
 DuplicateBB::BBToSingleRIVMap
-DuplicateBB::findBBsToDuplicate(Function &F, const RIV::Result &RIVResult) {
+DuplicateBB::findBBsToDuplicate(Function &F, const RIV::Result &RIVResult,
+                                RandomNumberGenerator &RNG,
+                                const BlockFrequencyInfo *BFI) const {
   BBToSingleRIVMap BlocksToDuplicate;
 
+  // Profile-guided mode only: the frequencies of the blocks in
+  // BlocksToDuplicate
+  SmallVector<uint64_t, 16> Freqs;
+  assert((!Opts.isProfileGuided() || BFI) && "BlockFrequencyInfo is required");
+  uint64_t EntryFreq =
+      Opts.isProfileGuided() ? BFI->getEntryFreq().getFrequency() : 0;
+
   for (BasicBlock &BB : F) {
     // Basic blocks which are landing pads are used for handling exceptions.
     // That's out of scope of this pass.
@@ -120,28 +178,123 @@ DuplicateBB::findBBsToDuplicate(Function &F, const RIV::Result &RIVResult) {
     }
 
     // Get a random context value from the RIV set
-    auto Iter = ReachableValues.begin();
     std::uniform_int_distribution<> Dist(0, ReachableValuesCount - 1);
-    std::advance(Iter, Dist(*pRNG));
+    Value *ContextValue = ReachableValues[Dist(RNG)];
 
-    if (dyn_cast<GlobalValue>(*Iter)) {
+    if (dyn_cast<GlobalValue>(ContextValue)) {
       LLVM_DEBUG(errs() << "Random context value is a global variable. "
                         << "Skipping this BB\n");
       continue;
     }
 
-    LLVM_DEBUG(errs() << "Random context value: " << **Iter << "\n");
+    LLVM_DEBUG(errs() << "Random context value: " << *ContextValue << "\n");
+
+    // Skip the blocks that are executed less often than required. The
+    // frequencies are relative to the frequency of the entry block.
+    if (Opts.isProfileGuided()) {
+      uint64_t Freq = BFI->getBlockFreq(&BB).getFrequency();
+      if (Opts.MinHotness &&
+          !isAtLeastPercentOfEntry(Freq, EntryFreq, Opts.MinHotness)) {
+        LLVM_DEBUG(errs() << "Cold BB. Skipping this BB\n");
+        NumColdBBs++;
+        continue;
+      }
+      Freqs.push_back(Freq);
+    }
 
     // Store the binding between the current BB and the context variable that
     // will be used for the `if-then-else` construct.
-    BlocksToDuplicate.emplace_back(&BB, *Iter);
+    BlocksToDuplicate.emplace_back(&BB, ContextValue);
   }
 
-  return BlocksToDuplicate;
+  if (!Opts.SizeBudget)
+    return BlocksToDuplicate;
+
+  // Spend the size budget on the hottest blocks first (ties are broken by the
+  // order of the blocks in F). Blocks that don't fit are skipped, but smaller
+  // (colder) blocks might still fit.
+  SmallVector<unsigned, 16> Order(BlocksToDuplicate.size());
+  std::iota(Order.begin(), Order.end(), 0);
+  llvm::stable_sort(Order,
+                    [&](unsigned A, unsigned B) { return Freqs[A] > Freqs[B]; });
+
+  SmallVector<bool, 16> IsSelected(BlocksToDuplicate.size(), false);
+  unsigned RemainingBudget = Opts.SizeBudget;
+  for (unsigned Idx : Order) {
+    unsigned NumInsts =
+        getNumInstsToClone(*std::get<0>(BlocksToDuplicate[Idx]));
+    if (NumInsts > RemainingBudget) {
+      LLVM_DEBUG(errs() << "Size budget exceeded. Skipping this BB\n");
+      NumOverBudgetBBs++;
+      continue;
+    }
+    RemainingBudget -= NumInsts;
+    IsSelected[Idx] = true;
+  }
+
+  // Keep the selected blocks in the order of F
+  BBToSingleRIVMap SelectedBlocks;
+  for (unsigned Idx = 0, E = BlocksToDuplicate.size(); Idx != E; ++Idx)
+    if (IsSelected[Idx])
+      SelectedBlocks.push_back(BlocksToDuplicate[Idx]);
+
+  return SelectedBlocks;
+}
+
+// Implements cloneBB for Opts.PrunePhis. The instructions in Tail are moved
+// into ThenTerm's block and cloned (once) into ElseTerm's block. The clones are
+// remapped in one go. Only the values that are used outside of ThenTerm's
+// block (or are in ContextValues) are merged with PHI nodes.
+static void moveAndCloneInsts(BasicBlock *Tail, Instruction *ThenTerm,
+                              Instruction *ElseTerm,
+                              DuplicateBB::ValueToPhiMap &ReMapper,
+                              const SmallPtrSetImpl<Value *> *ContextValues) {
+  BasicBlock *ThenBB = ThenTerm->getParent();
+  BasicBlock *ElseBB = ElseTerm->getParent();
+
+  SmallVector<Instruction *, 16> Insts;
+  for (Instruction &Instr : *Tail)
+    if (!Instr.isTerminator())
+      Insts.push_back(&Instr);
+
+  ValueToValueMapTy ElseVMap;
+  for (Instruction *Instr : Insts) {
+    Instruction *ElseClone = Instr->clone();
+    ElseClone->insertBefore(ElseTerm);
+    ElseVMap[Instr] = ElseClone;
+    Instr->moveBefore(ThenTerm);
+  }
+  SmallVector<BasicBlock *, 1> ElseBlocks{ElseBB};
+  remapInstructionsInBlocks(ElseBlocks, ElseVMap);
+
+  for (Instruction *Instr : Insts) {
+    if (Instr->getType()->isVoidTy())
+      continue;
+
+    auto IsUsedOutsideThenBB = [ThenBB](const User *U) {
+      return cast<Instruction>(U)->getParent() != ThenBB;
+    };
+    if (!llvm::any_of(Instr->users(), IsUsedOutsideThenBB) &&
+        !(ContextValues && ContextValues->count(Instr)))
+      continue;
+
+    PHINode *Phi =
+        PHINode::Create(Instr->getType(), 2, "", Tail->getTerminator());
+    Phi->takeName(Instr);
+    Phi->addIncoming(Instr, ThenBB);
+    Phi->addIncoming(ElseVMap[Instr], ElseBB);
+    Instr->replaceUsesWithIf(Phi, [ThenBB, Phi](Use &U) {
+      return U.getUser() != Phi &&
+             cast<Instruction>(U.getUser())->getParent() != ThenBB;
+    });
+
+    ReMapper[Instr] = Phi;
+  }
 }
 
 void DuplicateBB::cloneBB(BasicBlock &BB, Value *ContextValue,
-                          ValueToPhiMap &ReMapper) {
+                          ValueToPhiMap &ReMapper,
+                          const SmallPtrSetImpl<Value *> *ContextValues) {
   // Don't duplicate Phi nodes - start right after them
   Instruction *BBHead = BB.getFirstNonPHI();
 
@@ -169,6 +322,12 @@ void DuplicateBB::cloneBB(BasicBlock &BB, Value *ContextValue,
   ThenTerm->getParent()->getSinglePredecessor()->setName("lt-if-then-else-" +
                                                          DuplicatedBBId);
 
+  if (Opts.PrunePhis) {
+    moveAndCloneInsts(Tail, ThenTerm, ElseTerm, ReMapper, ContextValues);
+    ++DuplicateBBCount;
+    return;
+  }
+
   // Variables to keep track of the new bindings
   ValueToValueMapTy TailVMap, ThenVMap, ElseVMap;
 
@@ -234,23 +393,62 @@ void DuplicateBB::cloneBB(BasicBlock &BB, Value *ContextValue,
   ++DuplicateBBCount;
 }
 
-PreservedAnalyses DuplicateBB::run(llvm::Function &F,
-                                   llvm::FunctionAnalysisManager &FAM) {
-  if (!pRNG)
-    pRNG = F.getParent()->createRNG("duplicate-bb");
-  
-  BBToSingleRIVMap Targets = findBBsToDuplicate(F, FAM.getResult<RIV>(F));
+std::unique_ptr<RandomNumberGenerator> DuplicateBB::createRNG(Function &F) {
+  return F.getParent()->createRNG(("duplicate-bb." + F.getName()).str());
+}
+
+void DuplicateBB::duplicateBlocks(const BBToSingleRIVMap &Targets) {
+  PhaseTimer T(PassArg, "clone");
+
+  // The names of the new blocks are unique per function
+  DuplicateBBCount = 0;
 
   // This map is used to keep track of the new bindings. Otherwise, the
   // information from RIV will become obsolete.
   ValueToPhiMap ReMapper;
 
+  // With Opts.PrunePhis, the context values used by the blocks that are yet
+  // to be cloned have to get PHI nodes, even if they are not used anywhere
+  // else
+  SmallPtrSet<Value *, 16> ContextValues;
+  if (Opts.PrunePhis)
+    for (auto &BB_Ctx : Targets)
+      ContextValues.insert(std::get<1>(BB_Ctx));
+
   // Duplicate
+  uint64_t NumClonedInsts = 0;
   for (auto &BB_Ctx : Targets) {
-    cloneBB(*std::get<0>(BB_Ctx), std::get<1>(BB_Ctx), ReMapper);
+    NumClonedInsts += getNumInstsToClone(*std::get<0>(BB_Ctx));
+    cloneBB(*std::get<0>(BB_Ctx), std::get<1>(BB_Ctx), ReMapper,
+            &ContextValues);
   }
+  addPhaseCount(PassArg, "clone", "cloned-instructions", NumClonedInsts);
+
+  DuplicateBBCountStats += DuplicateBBCount;
+}
+
+PreservedAnalyses DuplicateBB::run(llvm::Function &F,
+                                   llvm::FunctionAnalysisManager &FAM) {
+  const BlockFrequencyInfo *BFI = nullptr;
+  if (Opts.isProfileGuided())
+    BFI = &FAM.getResult<BlockFrequencyAnalysis>(F);
+
+  std::optional<RIV::Result> OwnRIVResult;
+  if (Opts.RIVRepr)
+    OwnRIVResult.emplace(RIV(*Opts.RIVRepr).run(F, FAM));
+  const RIV::Result &RIVResult =
+      OwnRIVResult ? *OwnRIVResult : FAM.getResult<RIV>(F);
+
+  BBToSingleRIVMap Targets;
+  {
+    PhaseTimer T(PassArg, "select");
+    Targets = findBBsToDuplicate(F, RIVResult, *createRNG(F), BFI);
+    addPhaseCount(PassArg, "select", "blocks", F.size());
+    addPhaseCount(PassArg, "select", "selected-blocks", Targets.size());
+  }
+
+  duplicateBlocks(Targets);
 
-  DuplicateBBCountStats = DuplicateBBCount;
   return (Targets.empty() ? llvm::PreservedAnalyses::all()
                           : llvm::PreservedAnalyses::none());
 }
@@ -258,14 +456,50 @@ PreservedAnalyses DuplicateBB::run(llvm::Function &F,
 //------------------------------------------------------------------------------
 // New PM Registration
 //------------------------------------------------------------------------------
+// The options enable the profile-guided mode (`hot=N` and `budget=N`), select
+// how the blocks are cloned (`prune-phis`) and how the RIV sets are stored
+// (`riv=flat|chained|bitset`)
+std::optional<DuplicateBB> parseDuplicateBB(StringRef Name) {
+  if (!Name.consume_front("duplicate-bb"))
+    return std::nullopt;
+
+  DuplicateBB::Options Opts;
+  if (Name.empty())
+    return DuplicateBB(Opts);
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  SmallVector<StringRef, 2> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options) {
+    if (Option == "prune-phis")
+      Opts.PrunePhis = true;
+    else if (Option.consume_front("hot=")) {
+      if (Option.getAsInteger(10, Opts.MinHotness))
+        return std::nullopt;
+    } else if (Option.consume_front("budget=")) {
+      if (Option.getAsInteger(10, Opts.SizeBudget))
+        return std::nullopt;
+    } else if (Option.consume_front("riv=")) {
+      Opts.RIVRepr = RIV::parseRepresentation(Option);
+      if (!Opts.RIVRepr)
+        return std::nullopt;
+    } else
+      return std::nullopt;
+  }
+
+  return DuplicateBB(Opts);
+}
+
 llvm::PassPluginLibraryInfo getDuplicateBBPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "duplicate-bb", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, FunctionPassManager &FPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "duplicate-bb") {
-                    FPM.addPass(DuplicateBB());
+                  if (auto Pass = parseDuplicateBB(Name)) {
+                    FPM.addPass(std::move(*Pass));
                     return true;
                   }
                   return false;
@@ -273,7 +507,9 @@ llvm::PassPluginLibraryInfo getDuplicateBBPluginInfo() {
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getDuplicateBBPluginInfo();
 }
+#endif
@@ -12,7 +12,7 @@
 //    This pass adds/injects code that will count function calls at
 //    runtime and prints the results when the module exits. More specifically:
 //      1. For every function F _defined_ in M:
-//          * defines a global variable, `i32 CounterFor_F`, initialised with 0
+//          * defines a global variable, `i64 CounterFor_F`, initialised with 0
 //          * adds instructions at the beginning of F that increment `CounterFor_F`
 //            every time F executes
 //      2. At the end of the module (after `main`), calls `printf_wrapper` that
@@ -23,15 +23,61 @@
 //    To illustrate, the following code will be injected at the beginning of
 //    function F (defined in the input module):
 //    ```IR
-//      %1 = load i32, i32* @CounterFor_F
-//      %2 = add i32 1, %1
-//      store i32 %2, i32* @CounterFor_F
+//      %1 = load i64, ptr @CounterFor_F
+//      %2 = add i64 1, %1
+//      store i64 %2, ptr @CounterFor_F
 //    ```
 //    The following definition of `CounterFor_F` is also added:
 //    ```IR
-//      @CounterFor_foo = common global i32 0, align 4
+//      @CounterFor_foo = common global i64 0, align 8
 //    ```
 //
+//    Separate counters (that's the default) are likely to share cache lines.
+//    In multi-threaded programs that leads to false sharing. With
+//    `dynamic-cc<padded>` all counters are stored in one array instead,
+//    `CallCounters`, indexed by function ID (i.e. the order in which the
+//    functions are defined in M). Every counter is padded to occupy a
+//    separate cache line:
+//    ```IR
+//      @CallCounters = common global [N x [8 x i64]] zeroinitializer, align 64
+//    ```
+//
+//    The increments above are not thread-safe. There are two thread-safe
+//    alternatives (these can be combined with either counter layout):
+//      * `dynamic-cc<atomic>` - every increment is an atomic read-modify-write:
+//        ```IR
+//          %1 = atomicrmw add ptr @CounterFor_F, i64 1 monotonic
+//        ```
+//      * `dynamic-cc<per-thread>` - every thread increments its own (i.e.
+//        thread-local) copy of the counters with plain loads and stores. The
+//        local copies are added to the global counters (atomically) when the
+//        thread exits, and for the main thread, before the results are
+//        printed. This relies on pthread keys, so it's only available on
+//        POSIX systems. Threads that are still running when the results are
+//        printed are not accounted for.
+//
+//    With `dynamic-cc<binary>`, the results are not printed. Instead, the
+//    counters and a table of function names are written to a binary profile
+//    (with one call to `fwrite`) when the module exits. The profile is saved
+//    in the file specified via the DYNAMIC_CC_PROFILE_FILE environment
+//    variable (or in dynamic-cc.prof). Use tools/DynamicCCReader.cpp to print
+//    it.
+//
+//    To reduce the overhead of the instrumentation (e.g. for tiny functions
+//    that are called very often), there are two more options:
+//      * `dynamic-cc<skip-small=N>` - functions with at most N instructions
+//        that are called directly from at least one call site (according to
+//        StaticCallCounter) are not instrumented. These are also omitted from
+//        the results.
+//      * `dynamic-cc<sample=N>` - every thread keeps a thread-local countdown
+//        for every function. Only when it reaches 0 (i.e. once every N calls)
+//        the shared counter is updated, and it's incremented by N. The
+//        reported counts are therefore rounded up to a multiple of N (per
+//        thread). Sampling can't be combined with `per-thread`, which doesn't
+//        touch the shared counters in the first place.
+//
+//    Options are separated with `;`, e.g. `dynamic-cc<padded;atomic>`.
+//
 //    This pass will only count calls to functions _defined_ in the input
 //    module. Functions that are only _declared_ (and defined elsewhere) are not
 //    counted.
@@ -40,42 +86,374 @@
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
 //        -passes=-"dynamic-cc" <bitcode-file> -o instrumentend.bin
 //      $ lli instrumented.bin
+//    or, with the padded counter layout:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<padded>" <bitcode-file> -o instrumentend.bin
+//      $ lli instrumented.bin
+//    or, with atomic increments:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<atomic>" <bitcode-file> -o instrumentend.bin
+//      $ lli instrumented.bin
 //
 // License: MIT
 //========================================================================
 #include "DynamicCallCounter.h"
+#include "PhaseStats.h"
 
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
+#include <optional>
+
 using namespace llvm;
 
 #define DEBUG_TYPE "dynamic-cc"
 
+// The size of a cache line (in bytes) assumed for the padded counter layout
+static constexpr unsigned CacheLineSize = 64;
+
 Constant *CreateGlobalCounter(Module &M, StringRef GlobalVarName) {
   auto &CTX = M.getContext();
 
   // This will insert a declaration into M
   Constant *NewGlobalVar =
-      M.getOrInsertGlobal(GlobalVarName, IntegerType::getInt32Ty(CTX));
+      M.getOrInsertGlobal(GlobalVarName, IntegerType::getInt64Ty(CTX));
 
   // This will change the declaration into definition (and initialise to 0)
   GlobalVariable *NewGV = M.getNamedGlobal(GlobalVarName);
   NewGV->setLinkage(GlobalValue::CommonLinkage);
-  NewGV->setAlignment(MaybeAlign(4));
-  NewGV->setInitializer(llvm::ConstantInt::get(CTX, APInt(32, 0)));
+  NewGV->setAlignment(MaybeAlign(8));
+  NewGV->setInitializer(llvm::ConstantInt::get(CTX, APInt(64, 0)));
 
   return NewGlobalVar;
 }
 
+// Creates one array with NumCounters call counters, each in a separate cache
+// line, and returns a pointer to every counter.
+static SmallVector<Constant *, 16> CreatePaddedCounters(Module &M,
+                                                        unsigned NumCounters) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  ArrayType *PaddedCounterTy = ArrayType::get(Int64Ty, CacheLineSize / 8);
+  ArrayType *CountersTy = ArrayType::get(PaddedCounterTy, NumCounters);
+
+  auto *Counters = new GlobalVariable(M, CountersTy, /*isConstant=*/false,
+                                      GlobalValue::CommonLinkage,
+                                      Constant::getNullValue(CountersTy),
+                                      "CallCounters");
+  Counters->setAlignment(MaybeAlign(CacheLineSize));
+
+  SmallVector<Constant *, 16> CounterPtrs;
+  for (unsigned FuncID = 0; FuncID < NumCounters; FuncID++) {
+    Constant *Indices[] = {ConstantInt::get(Int64Ty, 0),
+                           ConstantInt::get(Int64Ty, FuncID),
+                           ConstantInt::get(Int64Ty, 0)};
+    CounterPtrs.push_back(
+        ConstantExpr::getInBoundsGetElementPtr(CountersTy, Counters, Indices));
+  }
+
+  return CounterPtrs;
+}
+
+// The state required for the per-thread update mode:
+//  * thread-local copies of the counters (one array of i64, there's no
+//    sharing, hence no padding is needed),
+//  * a thread-local flag that is set once the current thread has registered
+//    FlushFunc as its exit handler,
+//  * a pthread key that's used to register the exit handlers.
+struct PerThreadCounters {
+  GlobalVariable *LocalCounters = nullptr;
+  GlobalVariable *IsRegistered = nullptr;
+  GlobalVariable *ThreadKey = nullptr;
+  // Registers FlushFunc as the exit handler of the calling thread
+  Function *RegisterFunc = nullptr;
+  // Adds the local counters to the global ones and resets the local counters
+  Function *FlushFunc = nullptr;
+};
+
+// pthread_key_t is `unsigned int` on Linux and `unsigned long` on Darwin
+static IntegerType *getPthreadKeyTy(Module &M) {
+  if (Triple(M.getTargetTriple()).isOSDarwin())
+    return IntegerType::getInt64Ty(M.getContext());
+  return IntegerType::getInt32Ty(M.getContext());
+}
+
+static PerThreadCounters CreatePerThreadCounters(Module &M,
+                                                 unsigned NumCounters) {
+  auto &CTX = M.getContext();
+  PerThreadCounters PTC;
+
+  ArrayType *LocalCountersTy =
+      ArrayType::get(IntegerType::getInt64Ty(CTX), NumCounters);
+  PTC.LocalCounters = new GlobalVariable(
+      M, LocalCountersTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      Constant::getNullValue(LocalCountersTy), "LocalCallCounters", nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+  PTC.IsRegistered = new GlobalVariable(
+      M, Type::getInt1Ty(CTX), /*isConstant=*/false,
+      GlobalValue::InternalLinkage, ConstantInt::getFalse(CTX),
+      "LocalCallCountersRegistered", nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+  PTC.ThreadKey = new GlobalVariable(
+      M, getPthreadKeyTy(M), /*isConstant=*/false,
+      GlobalValue::InternalLinkage,
+      Constant::getNullValue(getPthreadKeyTy(M)), "LocalCallCountersKey");
+
+  // The bodies are only defined once all the global counters are known (see
+  // DefinePerThreadCounterFuncs)
+  PTC.RegisterFunc = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "register_local_counters", M);
+  PTC.FlushFunc = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), PointerType::getUnqual(CTX),
+                        /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "flush_local_counters", M);
+
+  return PTC;
+}
+
+// Creates a table of pointers to the global counters, indexed by function ID
+static GlobalVariable *CreateCounterTable(Module &M,
+                                          ArrayRef<Constant *> Counters) {
+  ArrayType *CounterTableTy =
+      ArrayType::get(PointerType::getUnqual(M.getContext()), Counters.size());
+  return new GlobalVariable(M, CounterTableTy, /*isConstant=*/true,
+                            GlobalValue::PrivateLinkage,
+                            ConstantArray::get(CounterTableTy, Counters),
+                            "CallCounterTable");
+}
+
+// Defines the functions that manage the thread-local counters. CounterTable
+// points to the global counters (see CreateCounterTable), indexed by function
+// ID (i.e. in the same order as PTC.LocalCounters).
+static void DefinePerThreadCounterFuncs(Module &M, PerThreadCounters &PTC,
+                                        GlobalVariable *CounterTable) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *KeyTy = getPthreadKeyTy(M);
+
+  // int pthread_key_create(pthread_key_t *, void (*)(void *))
+  FunctionCallee KeyCreate = M.getOrInsertFunction(
+      "pthread_key_create", Type::getInt32Ty(CTX), PtrTy, PtrTy);
+  // int pthread_setspecific(pthread_key_t, const void *)
+  FunctionCallee SetSpecific = M.getOrInsertFunction(
+      "pthread_setspecific", Type::getInt32Ty(CTX), KeyTy, PtrTy);
+
+  // flush_local_counters: the global counters are not necessarily contiguous
+  // (e.g. with the default layout), so iterate over CounterTable instead.
+  auto *CounterTableTy = cast<ArrayType>(CounterTable->getValueType());
+  uint64_t NumCounters = CounterTableTy->getNumElements();
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", PTC.FlushFunc);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", PTC.FlushFunc);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", PTC.FlushFunc);
+  IRBuilder<> Builder(Entry);
+  Builder.CreateBr(Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "idx");
+  Idx->addIncoming(Builder.getInt64(0), Entry);
+  Value *LocalCounter = Builder.CreateInBoundsGEP(
+      PTC.LocalCounters->getValueType(), PTC.LocalCounters,
+      {Builder.getInt64(0), Idx});
+  Value *LocalCount = Builder.CreateLoad(Int64Ty, LocalCounter);
+  Value *Counter = Builder.CreateLoad(
+      PtrTy,
+      Builder.CreateInBoundsGEP(CounterTableTy, CounterTable,
+                                {Builder.getInt64(0), Idx}));
+  Builder.CreateAtomicRMW(AtomicRMWInst::Add, Counter, LocalCount,
+                          MaybeAlign(8), AtomicOrdering::Monotonic);
+  Builder.CreateStore(Builder.getInt64(0), LocalCounter);
+  Value *NextIdx = Builder.CreateAdd(Idx, Builder.getInt64(1));
+  Idx->addIncoming(NextIdx, Loop);
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NextIdx, Builder.getInt64(NumCounters)), Exit,
+      Loop);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  // register_local_counters: pthread calls the destructor associated with a
+  // key on thread exit, but only if the thread has set a non-null value for
+  // that key.
+  Builder.SetInsertPoint(BasicBlock::Create(CTX, "entry", PTC.RegisterFunc));
+  Builder.CreateStore(Builder.getTrue(), PTC.IsRegistered);
+  Builder.CreateCall(SetSpecific, {Builder.CreateLoad(KeyTy, PTC.ThreadKey),
+                                   PTC.LocalCounters});
+  Builder.CreateRetVoid();
+
+  // Create the key before main starts
+  Function *InitF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "init_local_counters", M);
+  Builder.SetInsertPoint(BasicBlock::Create(CTX, "entry", InitF));
+  Builder.CreateCall(KeyCreate, {PTC.ThreadKey, PTC.FlushFunc});
+  Builder.CreateRetVoid();
+  appendToGlobalCtors(M, InitF, /*Priority=*/0);
+}
+
+// Defines `write_profile`, which writes the binary profile (see
+// dynamic_cc::ProfileHeader) with one call to fwrite. The profile is assembled
+// in a global buffer that holds the header and the function names from the
+// start - only the counters are copied in at exit. If FlushFunc is set, it's
+// called first to flush the thread-local counters of the calling thread.
+static Function *CreateProfileWriter(Module &M, GlobalVariable *CounterTable,
+                                     ArrayRef<StringRef> FuncNames,
+                                     Function *FlushFunc) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = IntegerType::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  std::string Names;
+  for (StringRef Name : FuncNames) {
+    Names += Name;
+    Names += '\0';
+  }
+
+  // The buffer with the profile: {header, counts, names}, without padding
+  ArrayType *HeaderTy = ArrayType::get(Int64Ty, 4);
+  ArrayType *CountsTy = ArrayType::get(Int64Ty, FuncNames.size());
+  ArrayType *NamesTy = ArrayType::get(Type::getInt8Ty(CTX), Names.size());
+  StructType *ProfileTy =
+      StructType::get(CTX, {HeaderTy, CountsTy, NamesTy}, /*isPacked=*/true);
+  uint64_t ProfileSize = sizeof(dynamic_cc::ProfileHeader) +
+                         FuncNames.size() * sizeof(uint64_t) + Names.size();
+
+  Constant *Header = ConstantArray::get(
+      HeaderTy, {ConstantInt::get(Int64Ty, dynamic_cc::ProfileMagic),
+                 ConstantInt::get(Int64Ty, dynamic_cc::ProfileVersion),
+                 ConstantInt::get(Int64Ty, FuncNames.size()),
+                 ConstantInt::get(Int64Ty, Names.size())});
+  auto *Profile = new GlobalVariable(
+      M, ProfileTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantStruct::get(
+          ProfileTy,
+          {Header, Constant::getNullValue(CountsTy),
+           ConstantDataArray::getString(CTX, Names, /*AddNull=*/false)}),
+      "CallCounterProfile");
+  Profile->setAlignment(MaybeAlign(8));
+
+  // char *getenv(const char *)
+  FunctionCallee GetEnv = M.getOrInsertFunction("getenv", PtrTy, PtrTy);
+  // FILE *fopen(const char *, const char *)
+  FunctionCallee FOpen = M.getOrInsertFunction("fopen", PtrTy, PtrTy, PtrTy);
+  // size_t fwrite(const void *, size_t, size_t, FILE *)
+  FunctionCallee FWrite = M.getOrInsertFunction("fwrite", Int64Ty, PtrTy,
+                                                Int64Ty, Int64Ty, PtrTy);
+  // int fclose(FILE *)
+  FunctionCallee FClose =
+      M.getOrInsertFunction("fclose", Type::getInt32Ty(CTX), PtrTy);
+
+  Function *WriterF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "write_profile", M);
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", WriterF);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", WriterF);
+  BasicBlock *Write = BasicBlock::Create(CTX, "write", WriterF);
+  BasicBlock *Close = BasicBlock::Create(CTX, "close", WriterF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", WriterF);
+  IRBuilder<> Builder(Entry);
+
+  if (FlushFunc)
+    Builder.CreateCall(FlushFunc, {ConstantPointerNull::get(PtrTy)});
+  Builder.CreateBr(Loop);
+
+  // Copy the counters into the profile
+  Builder.SetInsertPoint(Loop);
+  PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "idx");
+  Idx->addIncoming(Builder.getInt64(0), Entry);
+  Value *Counter = Builder.CreateLoad(
+      PtrTy, Builder.CreateInBoundsGEP(CounterTable->getValueType(),
+                                       CounterTable,
+                                       {Builder.getInt64(0), Idx}));
+  Value *Count = Builder.CreateLoad(Int64Ty, Counter);
+  Builder.CreateStore(Count, Builder.CreateInBoundsGEP(
+                                 ProfileTy, Profile,
+                                 {Builder.getInt32(0), Builder.getInt32(1),
+                                  Idx}));
+  Value *NextIdx = Builder.CreateAdd(Idx, Builder.getInt64(1));
+  Idx->addIncoming(NextIdx, Loop);
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NextIdx, Builder.getInt64(FuncNames.size())), Write,
+      Loop);
+
+  // Write the profile to the file specified via ProfileFileEnvVar (or to
+  // DefaultProfileFile)
+  Builder.SetInsertPoint(Write);
+  Value *EnvPath = Builder.CreateCall(
+      GetEnv, {Builder.CreateGlobalStringPtr(dynamic_cc::ProfileFileEnvVar)});
+  Value *Path = Builder.CreateSelect(
+      Builder.CreateIsNull(EnvPath),
+      Builder.CreateGlobalStringPtr(dynamic_cc::DefaultProfileFile), EnvPath);
+  Value *File =
+      Builder.CreateCall(FOpen, {Path, Builder.CreateGlobalStringPtr("wb")});
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Exit, Close);
+
+  Builder.SetInsertPoint(Close);
+  Builder.CreateCall(FWrite, {Profile, Builder.getInt64(1),
+                              Builder.getInt64(ProfileSize), File});
+  Builder.CreateCall(FClose, {File});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return WriterF;
+}
+
+// Creates one array of NumCounters thread-local countdowns (one per function)
+// for the sampled counting mode
+static GlobalVariable *CreateCountdowns(Module &M, unsigned NumCounters) {
+  ArrayType *CountdownsTy =
+      ArrayType::get(IntegerType::getInt32Ty(M.getContext()), NumCounters);
+  return new GlobalVariable(M, CountdownsTy, /*isConstant=*/false,
+                            GlobalValue::InternalLinkage,
+                            Constant::getNullValue(CountdownsTy),
+                            "CallCountdowns", nullptr,
+                            GlobalValue::GeneralDynamicTLSModel);
+}
+
+// Injects the instructions that add Amount to the i64 counter pointed to by
+// Counter
+static void CreateCounterIncrement(IRBuilder<> &Builder, Value *Counter,
+                                   uint64_t Amount, bool IsAtomic) {
+  if (IsAtomic) {
+    Builder.CreateAtomicRMW(AtomicRMWInst::Add, Counter,
+                            Builder.getInt64(Amount), MaybeAlign(8),
+                            AtomicOrdering::Monotonic);
+    return;
+  }
+
+  LoadInst *Load2 = Builder.CreateLoad(Builder.getInt64Ty(), Counter);
+  Value *Inc2 = Builder.CreateAdd(Builder.getInt64(Amount), Load2);
+  Builder.CreateStore(Inc2, Counter);
+}
+
+// Returns the point at which the call-counting code is inserted into F. For
+// the per-thread and the sampled modes that's after the static allocas, as
+// the entry block is split there.
+static BasicBlock::iterator getCounterInsertionPt(Function &F,
+                                                  bool SkipAllocas) {
+  BasicBlock::iterator InsertPt = F.getEntryBlock().getFirstInsertionPt();
+  if (SkipAllocas)
+    while (isa<AllocaInst>(InsertPt))
+      ++InsertPt;
+  return InsertPt;
+}
+
 //-----------------------------------------------------------------------------
 // DynamicCallCounter implementation
 //-----------------------------------------------------------------------------
-bool DynamicCallCounter::runOnModule(Module &M) {
-  bool Instrumented = false;
-
+bool DynamicCallCounter::runOnModule(Module &M,
+                                     const ResultStaticCC *StaticCalls) {
   // Function name <--> IR variable that holds the call counter
   llvm::StringMap<Constant *> CallCounterMap;
   // Function name <--> IR variable that holds the function name
@@ -83,40 +461,142 @@ bool DynamicCallCounter::runOnModule(Module &M) {
 
   auto &CTX = M.getContext();
 
+  assert((0 == Opts.SkipSmall || StaticCalls) &&
+         "skip-small requires the StaticCallCounter results");
+  auto IsInstrumented = [&](const Function &F) {
+    if (F.isDeclaration())
+      return false;
+    if (0 == Opts.SkipSmall)
+      return true;
+    return F.getInstructionCount() > Opts.SkipSmall ||
+           0 == StaticCalls->lookup(&F);
+  };
+
+  // With the padded layout, the per-thread and the sampled modes, all
+  // counters are allocated up-front. Functions are assigned IDs in the order
+  // in which they are defined.
+  unsigned NumDefinedFuncs = llvm::count_if(M, IsInstrumented);
+  if (0 == NumDefinedFuncs)
+    return false;
+
+  SmallVector<Constant *, 16> PaddedCounters;
+  if (Opts.Layout == CounterLayout::Padded)
+    PaddedCounters = CreatePaddedCounters(M, NumDefinedFuncs);
+
+  PerThreadCounters PTC;
+  if (Opts.Update == CounterUpdate::PerThread)
+    PTC = CreatePerThreadCounters(M, NumDefinedFuncs);
+
+  bool IsSampled = Opts.SamplePeriod > 1;
+  GlobalVariable *Countdowns = nullptr;
+  if (IsSampled)
+    Countdowns = CreateCountdowns(M, NumDefinedFuncs);
+
+  // The global counters and the function names, indexed by function ID
+  SmallVector<Constant *, 16> Counters;
+  SmallVector<StringRef, 16> FuncNames;
+
   // STEP 1: For each function in the module, inject a call-counting code
   // --------------------------------------------------------------------
   for (auto &F : M) {
-    if (F.isDeclaration())
+    if (!IsInstrumented(F)) {
+      if (!F.isDeclaration())
+        LLVM_DEBUG(dbgs() << " Skipped: " << F.getName() << "\n");
       continue;
+    }
 
     // Get an IR builder. Sets the insertion point to the top of the function
-    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
-
-    // Create a global variable to count the calls to this function
-    std::string CounterName = "CounterFor_" + std::string(F.getName());
-    Constant *Var = CreateGlobalCounter(M, CounterName);
+    IRBuilder<> Builder(&*getCounterInsertionPt(
+        F, Opts.Update == CounterUpdate::PerThread || IsSampled));
+
+    // Create (or get) a global variable to count the calls to this function
+    unsigned FuncID = Counters.size();
+    Constant *Var;
+    if (Opts.Layout == CounterLayout::Padded) {
+      Var = PaddedCounters[FuncID];
+    } else {
+      std::string CounterName = "CounterFor_" + std::string(F.getName());
+      Var = CreateGlobalCounter(M, CounterName);
+    }
     CallCounterMap[F.getName()] = Var;
+    Counters.push_back(Var);
+    FuncNames.push_back(F.getName());
 
-    // Create a global variable to hold the name of this function
-    auto FuncName = Builder.CreateGlobalStringPtr(F.getName());
-    FuncNameMap[F.getName()] = FuncName;
+    // Create a global variable to hold the name of this function (the binary
+    // profile holds its own table of names)
+    if (Opts.Output == OutputFormat::Text) {
+      auto FuncName = Builder.CreateGlobalStringPtr(F.getName());
+      FuncNameMap[F.getName()] = FuncName;
+    }
 
     // Inject instruction to increment the call count each time this function
     // executes
-    LoadInst *Load2 = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), Var);
-    Value *Inc2 = Builder.CreateAdd(Builder.getInt32(1), Load2);
-    Builder.CreateStore(Inc2, Var);
+    switch (Opts.Update) {
+    case CounterUpdate::Plain:
+    case CounterUpdate::Atomic: {
+      bool IsAtomic = Opts.Update == CounterUpdate::Atomic;
+      if (!IsSampled) {
+        CreateCounterIncrement(Builder, Var, 1, IsAtomic);
+        break;
+      }
+
+      // Decrement the thread-local countdown and, once it reaches 0, reset it
+      // and account for the last SamplePeriod calls in one go
+      Value *CountdownVar = Builder.CreateConstInBoundsGEP2_64(
+          Countdowns->getValueType(), Countdowns, 0, FuncID);
+      Value *Countdown = Builder.CreateLoad(Builder.getInt32Ty(), CountdownVar);
+      Value *IsSample = Builder.CreateICmpEQ(Countdown, Builder.getInt32(0));
+      Value *NextCountdown = Builder.CreateSelect(
+          IsSample, Builder.getInt32(Opts.SamplePeriod - 1),
+          Builder.CreateSub(Countdown, Builder.getInt32(1)));
+      Builder.CreateStore(NextCountdown, CountdownVar);
+
+      Instruction *SampleTerm = SplitBlockAndInsertIfThen(
+          IsSample, &*Builder.GetInsertPoint(), /*Unreachable=*/false,
+          MDBuilder(CTX).createUnlikelyBranchWeights());
+      IRBuilder<> SampleBuilder(SampleTerm);
+      CreateCounterIncrement(SampleBuilder, Var, Opts.SamplePeriod, IsAtomic);
+      break;
+    }
+    case CounterUpdate::PerThread: {
+      // Increment the thread-local copy of the counter ...
+      Value *LocalVar = Builder.CreateConstInBoundsGEP2_64(
+          PTC.LocalCounters->getValueType(), PTC.LocalCounters, 0, FuncID);
+      CreateCounterIncrement(Builder, LocalVar, 1, /*IsAtomic=*/false);
+
+      // ... and make sure that it's flushed when this thread exits
+      Value *IsRegistered =
+          Builder.CreateLoad(Builder.getInt1Ty(), PTC.IsRegistered);
+      Instruction *RegisterTerm = SplitBlockAndInsertIfThen(
+          Builder.CreateNot(IsRegistered), &*Builder.GetInsertPoint(),
+          /*Unreachable=*/false,
+          MDBuilder(CTX).createUnlikelyBranchWeights());
+      IRBuilder<>(RegisterTerm).CreateCall(PTC.RegisterFunc);
+      break;
+    }
+    }
 
     // The following is visible only if you pass -debug on the command line
     // *and* you have an assert build.
     LLVM_DEBUG(dbgs() << " Instrumented: " << F.getName() << "\n");
-
-    Instrumented = true;
   }
 
-  // Stop here if there are no function definitions in this module
-  if (false == Instrumented)
-    return Instrumented;
+  GlobalVariable *CounterTable = nullptr;
+  if (Opts.Update == CounterUpdate::PerThread ||
+      Opts.Output == OutputFormat::Binary)
+    CounterTable = CreateCounterTable(M, Counters);
+
+  if (Opts.Update == CounterUpdate::PerThread)
+    DefinePerThreadCounterFuncs(M, PTC, CounterTable);
+
+  // With the binary output format, STEP 2 - STEP 5 are replaced with a call to
+  // `write_profile` at the very end of this module
+  if (Opts.Output == OutputFormat::Binary) {
+    Function *WriterF =
+        CreateProfileWriter(M, CounterTable, FuncNames, PTC.FlushFunc);
+    appendToGlobalDtors(M, WriterF, /*Priority=*/0);
+    return true;
+  }
 
   // STEP 2: Inject the declaration of printf
   // ----------------------------------------
@@ -192,11 +672,17 @@ bool DynamicCallCounter::runOnModule(Module &M) {
   llvm::Value *ResultFormatStrPtr =
       Builder.CreatePointerCast(ResultFormatStrVar, PrintfArgTy);
 
+  // The main thread exits after the results are printed, so flush its local
+  // counters first
+  if (Opts.Update == CounterUpdate::PerThread)
+    Builder.CreateCall(PTC.FlushFunc,
+                       {ConstantPointerNull::get(PointerType::getUnqual(CTX))});
+
   Builder.CreateCall(Printf, {ResultHeaderStrPtr});
 
   LoadInst *LoadCounter;
   for (auto &item : CallCounterMap) {
-    LoadCounter = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), item.second);
+    LoadCounter = Builder.CreateLoad(IntegerType::getInt64Ty(CTX), item.second);
     // LoadCounter = Builder.CreateLoad(item.second);
     Builder.CreateCall(
         Printf, {ResultFormatStrPtr, FuncNameMap[item.first()], LoadCounter});
@@ -213,8 +699,16 @@ bool DynamicCallCounter::runOnModule(Module &M) {
 }
 
 PreservedAnalyses DynamicCallCounter::run(llvm::Module &M,
-                                          llvm::ModuleAnalysisManager &) {
-  bool Changed = runOnModule(M);
+                                          llvm::ModuleAnalysisManager &MAM) {
+  const ResultStaticCC *StaticCalls = nullptr;
+  if (Opts.SkipSmall)
+    StaticCalls = &MAM.getResult<StaticCallCounter>(M);
+
+  bool Changed;
+  {
+    PhaseTimer T(DEBUG_TYPE, "instrument");
+    Changed = runOnModule(M, StaticCalls);
+  }
 
   return (Changed ? llvm::PreservedAnalyses::none()
                   : llvm::PreservedAnalyses::all());
@@ -223,22 +717,73 @@ PreservedAnalyses DynamicCallCounter::run(llvm::Module &M,
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses `dynamic-cc` and `dynamic-cc<Opt1;Opt2;...>`, where the options
+// select the counter layout (`padded`), the update mode (`atomic` or
+// `per-thread`), the output format (`binary`) and which calls are counted
+// (`skip-small=N` and `sample=N`).
+static std::optional<DynamicCallCounter>
+parseDynamicCallCounter(StringRef Name) {
+  if (!Name.consume_front("dynamic-cc"))
+    return std::nullopt;
+
+  DynamicCallCounter::Options Opts;
+  if (Name.empty())
+    return DynamicCallCounter(Opts);
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  SmallVector<StringRef, 2> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options) {
+    if (Option == "padded")
+      Opts.Layout = DynamicCallCounter::CounterLayout::Padded;
+    else if (Option == "atomic")
+      Opts.Update = DynamicCallCounter::CounterUpdate::Atomic;
+    else if (Option == "per-thread")
+      Opts.Update = DynamicCallCounter::CounterUpdate::PerThread;
+    else if (Option == "binary")
+      Opts.Output = DynamicCallCounter::OutputFormat::Binary;
+    else if (Option.consume_front("skip-small=")) {
+      if (Option.getAsInteger(10, Opts.SkipSmall))
+        return std::nullopt;
+    } else if (Option.consume_front("sample=")) {
+      if (Option.getAsInteger(10, Opts.SamplePeriod) || 0 == Opts.SamplePeriod)
+        return std::nullopt;
+    } else
+      return std::nullopt;
+  }
+
+  if (Opts.SamplePeriod > 1 &&
+      Opts.Update == DynamicCallCounter::CounterUpdate::PerThread)
+    return std::nullopt;
+
+  return DynamicCallCounter(Opts);
+}
+
 llvm::PassPluginLibraryInfo getDynamicCallCounterPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "dynamic-cc", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "dynamic-cc") {
-                    MPM.addPass(DynamicCallCounter());
+                  if (auto Pass = parseDynamicCallCounter(Name)) {
+                    MPM.addPass(std::move(*Pass));
                     return true;
                   }
                   return false;
                 });
+            // `skip-small` relies on the StaticCallCounter analysis
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return StaticCallCounter(); });
+                });
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getDynamicCallCounterPluginInfo();
 }
+#endif
@@ -26,6 +26,7 @@
 // License: MIT
 //=============================================================================
 #include "FindFCmpEq.h"
+#include "PhaseStats.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
@@ -45,9 +46,8 @@
 
 using namespace llvm;
 
-static void
-printFCmpEqInstructions(raw_ostream &OS, Function &Func,
-                        const FindFCmpEq::Result &FCmpEqInsts) noexcept {
+void printFCmpEqInstructions(raw_ostream &OS, Function &Func,
+                             ArrayRef<FCmpInst *> FCmpEqInsts) {
   if (FCmpEqInsts.empty())
     return;
 
@@ -79,6 +79,7 @@ FindFCmpEq::Result FindFCmpEq::run(Function &Func,
 }
 
 FindFCmpEq::Result FindFCmpEq::run(Function &Func) {
+  PhaseTimer T(PassArg, "find");
   Result Comparisons;
   for (Instruction &Inst : instructions(Func)) {
     // We're only looking for 'fcmp' instructions here.
@@ -90,6 +91,7 @@ FindFCmpEq::Result FindFCmpEq::run(Function &Func) {
       }
     }
   }
+  addPhaseCount(PassArg, "find", "comparisons", Comparisons.size());
 
   return Comparisons;
 }
@@ -133,7 +135,9 @@ PassPluginLibraryInfo getFindFCmpEqPluginInfo() {
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getFindFCmpEqPluginInfo();
 }
+#endif
@@ -20,26 +20,449 @@
 //    (llvm-tutor)   number of arguments: 3
 //    ```
 //
+//    A printf per call is far too slow for hot code. With
+//    `inject-func-call<trace>`, every function entry appends a 16-byte record
+//    (function ID, number of arguments and, with `timestamps`, the value of
+//    the cycle counter) to a thread-local buffer instead. A full buffer is
+//    written to the trace file with one call to fwrite, and so is the
+//    remainder when the thread (pthread key destructor) or the program
+//    (global destructor) exits. The function names are not part of the
+//    trace - these are written to an ID table when the module is
+//    instrumented (see InjectFuncCall.h for both formats). Use
+//    tools/InjectFuncCallReader.cpp to print the trace. The buffer size (in
+//    records) can be set with `buffer=N` and the path of the ID table with
+//    `ids=<file>`, e.g. `inject-func-call<trace;timestamps;ids=foo.ids>`.
+//
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
 //        -passes=-"inject-func-call" <bitcode-file>
+//    or, with tracing:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes="inject-func-call<trace;ids=<ids-file>>" <bitcode-file> `\`
+//        -o instrumented.bin
+//      $ INJECT_FUNC_CALL_TRACE_FILE=<trace-file> lli instrumented.bin
+//      $ <BUILD_DIR>/bin/inject-func-call-reader <trace-file> <ids-file>
 //
 // License: MIT
 //========================================================================
 #include "InjectFuncCall.h"
+#include "PhaseStats.h"
 
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <optional>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "inject-func-call"
 
+//-----------------------------------------------------------------------------
+// Tracing runtime
+//-----------------------------------------------------------------------------
+// The globals and the functions that implement the tracing mode. Everything
+// is defined in the instrumented module, so no runtime library is required
+// (apart from libc and pthreads).
+struct TraceRuntime {
+  // Thread-local: {TraceBlockHeader, [BufferSize x TraceRecord]}. The header
+  // is filled in right before the block is written out.
+  GlobalVariable *Buffer = nullptr;
+  // Thread-local: the number of records in Buffer
+  GlobalVariable *NumRecords = nullptr;
+  // Thread-local: the ID of this thread (0 = not assigned yet)
+  GlobalVariable *ThreadID = nullptr;
+  // The ID of the most recently registered thread
+  GlobalVariable *LastThreadID = nullptr;
+  // The pthread key used to flush the buffers on thread exit
+  GlobalVariable *ThreadKey = nullptr;
+  // The trace file (FILE *)
+  GlobalVariable *File = nullptr;
+  // `void trace_slow_path(i64 NumRecords)` - called on function entry when
+  // the buffer is either empty or full
+  Function *SlowPath = nullptr;
+};
+
+// pthread_key_t is `unsigned int` on Linux and `unsigned long` on Darwin
+static IntegerType *getPthreadKeyTy(Module &M) {
+  if (Triple(M.getTargetTriple()).isOSDarwin())
+    return IntegerType::getInt64Ty(M.getContext());
+  return IntegerType::getInt32Ty(M.getContext());
+}
+
+// The type of inject_func_call::TraceRecord
+static StructType *getTraceRecordTy(LLVMContext &CTX) {
+  return StructType::get(CTX, {Type::getInt32Ty(CTX), Type::getInt32Ty(CTX),
+                               Type::getInt64Ty(CTX)});
+}
+
+// Defines `flush_trace_buffer`, which writes the buffer of the calling thread
+// (if not empty) to the trace file as one block. Its signature matches that of
+// a pthread key destructor.
+static Function *CreateTraceFlush(Module &M, const TraceRuntime &RT) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = Type::getInt32Ty(CTX);
+  Type *Int64Ty = Type::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  // size_t fwrite(const void *, size_t, size_t, FILE *)
+  FunctionCallee FWrite = M.getOrInsertFunction("fwrite", Int64Ty, PtrTy,
+                                                Int64Ty, Int64Ty, PtrTy);
+
+  Function *FlushF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), PtrTy, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "flush_trace_buffer", M);
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", FlushF);
+  BasicBlock *Write = BasicBlock::Create(CTX, "write", FlushF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", FlushF);
+  IRBuilder<> Builder(Entry);
+
+  Value *NumRecords = Builder.CreateLoad(Int64Ty, RT.NumRecords);
+  Value *File = Builder.CreateLoad(PtrTy, RT.File);
+  Builder.CreateCondBr(
+      Builder.CreateOr(Builder.CreateICmpEQ(NumRecords, Builder.getInt64(0)),
+                       Builder.CreateIsNull(File)),
+      Exit, Write);
+
+  // Fill in the block header and write the block
+  Builder.SetInsertPoint(Write);
+  Type *BufferTy = RT.Buffer->getValueType();
+  Builder.CreateStore(Builder.CreateLoad(Int32Ty, RT.ThreadID),
+                      Builder.CreateConstInBoundsGEP2_32(BufferTy, RT.Buffer,
+                                                         0, 0));
+  Builder.CreateStore(Builder.CreateTrunc(NumRecords, Int32Ty),
+                      Builder.CreateConstInBoundsGEP2_32(BufferTy, RT.Buffer,
+                                                         0, 1));
+  Value *BlockSize = Builder.CreateAdd(
+      Builder.getInt64(sizeof(inject_func_call::TraceBlockHeader)),
+      Builder.CreateMul(
+          NumRecords, Builder.getInt64(sizeof(inject_func_call::TraceRecord))));
+  Builder.CreateCall(FWrite, {RT.Buffer, BlockSize, Builder.getInt64(1), File});
+  Builder.CreateBr(Exit);
+
+  // The buffer is reset even if there's no trace file
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateStore(Builder.getInt64(0), RT.NumRecords);
+  Builder.CreateRetVoid();
+
+  return FlushF;
+}
+
+// Defines `trace_slow_path`. For an empty buffer, it makes sure that the
+// calling thread is registered (i.e. has an ID and flushes its buffer on
+// exit). For a full buffer, it flushes the buffer.
+static void DefineTraceSlowPath(Module &M, const TraceRuntime &RT,
+                                Function *FlushF) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = Type::getInt32Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *KeyTy = getPthreadKeyTy(M);
+
+  // int pthread_setspecific(pthread_key_t, const void *)
+  FunctionCallee SetSpecific = M.getOrInsertFunction(
+      "pthread_setspecific", Int32Ty, KeyTy, PtrTy);
+
+  Function *SlowPathF = RT.SlowPath;
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", SlowPathF);
+  BasicBlock *Flush = BasicBlock::Create(CTX, "flush", SlowPathF);
+  BasicBlock *CheckID = BasicBlock::Create(CTX, "check_id", SlowPathF);
+  BasicBlock *Register = BasicBlock::Create(CTX, "register", SlowPathF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", SlowPathF);
+  IRBuilder<> Builder(Entry);
+
+  Value *NumRecords = SlowPathF->getArg(0);
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NumRecords, Builder.getInt64(0)), CheckID, Flush);
+
+  Builder.SetInsertPoint(Flush);
+  Builder.CreateCall(FlushF, {ConstantPointerNull::get(PtrTy)});
+  Builder.CreateBr(Exit);
+
+  // pthread calls the destructor associated with a key on thread exit, but only
+  // if the thread has set a non-null value for that key
+  Builder.SetInsertPoint(CheckID);
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(Builder.CreateLoad(Int32Ty, RT.ThreadID),
+                           Builder.getInt32(0)),
+      Register, Exit);
+
+  Builder.SetInsertPoint(Register);
+  Value *PrevID =
+      Builder.CreateAtomicRMW(AtomicRMWInst::Add, RT.LastThreadID,
+                              Builder.getInt32(1), MaybeAlign(4),
+                              AtomicOrdering::Monotonic);
+  Builder.CreateStore(Builder.CreateAdd(PrevID, Builder.getInt32(1)),
+                      RT.ThreadID);
+  Builder.CreateCall(SetSpecific,
+                     {Builder.CreateLoad(KeyTy, RT.ThreadKey), RT.Buffer});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+}
+
+// Defines the constructor that opens the trace file (and writes the trace
+// header) and the destructor that flushes the buffer of the main thread
+static void CreateTraceCtorAndDtor(Module &M, const TraceRuntime &RT,
+                                   Function *FlushF, uint64_t ModuleHash,
+                                   bool Timestamps) {
+  auto &CTX = M.getContext();
+  Type *Int64Ty = Type::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+
+  // char *getenv(const char *)
+  FunctionCallee GetEnv = M.getOrInsertFunction("getenv", PtrTy, PtrTy);
+  // FILE *fopen(const char *, const char *)
+  FunctionCallee FOpen = M.getOrInsertFunction("fopen", PtrTy, PtrTy, PtrTy);
+  // size_t fwrite(const void *, size_t, size_t, FILE *)
+  FunctionCallee FWrite = M.getOrInsertFunction("fwrite", Int64Ty, PtrTy,
+                                                Int64Ty, Int64Ty, PtrTy);
+  // int fflush(FILE *)
+  FunctionCallee FFlush =
+      M.getOrInsertFunction("fflush", Type::getInt32Ty(CTX), PtrTy);
+  // int pthread_key_create(pthread_key_t *, void (*)(void *))
+  FunctionCallee KeyCreate = M.getOrInsertFunction(
+      "pthread_key_create", Type::getInt32Ty(CTX), PtrTy, PtrTy);
+
+  ArrayType *HeaderTy = ArrayType::get(Int64Ty, 4);
+  auto *Header = new GlobalVariable(
+      M, HeaderTy, /*isConstant=*/true, GlobalValue::PrivateLinkage,
+      ConstantArray::get(
+          HeaderTy,
+          {ConstantInt::get(Int64Ty, inject_func_call::TraceMagic),
+           ConstantInt::get(Int64Ty, inject_func_call::TraceVersion),
+           ConstantInt::get(Int64Ty, ModuleHash),
+           ConstantInt::get(Int64Ty, Timestamps
+                                         ? inject_func_call::TraceHasTimestamps
+                                         : 0)}),
+      "TraceHeader");
+
+  // open_trace: open the file specified via TraceFileEnvVar (or
+  // DefaultTraceFile) before main starts
+  Function *OpenF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "open_trace", M);
+  BasicBlock *Entry = BasicBlock::Create(CTX, "entry", OpenF);
+  BasicBlock *WriteHeader = BasicBlock::Create(CTX, "write_header", OpenF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", OpenF);
+  IRBuilder<> Builder(Entry);
+
+  // The key is created even if the file can't be opened - trace_slow_path
+  // sets it for every new thread regardless (and the flushes that follow are
+  // no-ops without a file)
+  Builder.CreateCall(KeyCreate, {RT.ThreadKey, FlushF});
+  Value *EnvPath = Builder.CreateCall(
+      GetEnv,
+      {Builder.CreateGlobalStringPtr(inject_func_call::TraceFileEnvVar)});
+  Value *Path = Builder.CreateSelect(
+      Builder.CreateIsNull(EnvPath),
+      Builder.CreateGlobalStringPtr(inject_func_call::DefaultTraceFile),
+      EnvPath);
+  Value *File =
+      Builder.CreateCall(FOpen, {Path, Builder.CreateGlobalStringPtr("wb")});
+  Builder.CreateStore(File, RT.File);
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Exit, WriteHeader);
+
+  Builder.SetInsertPoint(WriteHeader);
+  Builder.CreateCall(
+      FWrite, {Header, Builder.getInt64(sizeof(inject_func_call::TraceHeader)),
+               Builder.getInt64(1), File});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+  appendToGlobalCtors(M, OpenF, /*Priority=*/0);
+
+  // close_trace: other threads may still be running (and writing to the
+  // file) at this point, so the file is only flushed. It's closed by exit.
+  Function *CloseF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "close_trace", M);
+  Entry = BasicBlock::Create(CTX, "entry", CloseF);
+  BasicBlock *Flush = BasicBlock::Create(CTX, "flush", CloseF);
+  Exit = BasicBlock::Create(CTX, "exit", CloseF);
+  Builder.SetInsertPoint(Entry);
+  Builder.CreateCall(FlushF, {ConstantPointerNull::get(PtrTy)});
+  File = Builder.CreateLoad(PtrTy, RT.File);
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Exit, Flush);
+
+  Builder.SetInsertPoint(Flush);
+  Builder.CreateCall(FFlush, {File});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+  appendToGlobalDtors(M, CloseF, /*Priority=*/0);
+}
+
+static TraceRuntime CreateTraceRuntime(Module &M, unsigned BufferSize,
+                                       uint64_t ModuleHash, bool Timestamps) {
+  auto &CTX = M.getContext();
+  Type *Int32Ty = Type::getInt32Ty(CTX);
+  Type *Int64Ty = Type::getInt64Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *KeyTy = getPthreadKeyTy(M);
+  TraceRuntime RT;
+
+  StructType *BufferTy = StructType::get(
+      CTX, {Int32Ty, Int32Ty, ArrayType::get(getTraceRecordTy(CTX), BufferSize)});
+  RT.Buffer = new GlobalVariable(
+      M, BufferTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      Constant::getNullValue(BufferTy), "TraceBuffer", nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+  RT.Buffer->setAlignment(MaybeAlign(8));
+  RT.NumRecords = new GlobalVariable(
+      M, Int64Ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int64Ty, 0), "TraceNumRecords", nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+  RT.ThreadID = new GlobalVariable(
+      M, Int32Ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int32Ty, 0), "TraceThreadID", nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+  RT.LastThreadID = new GlobalVariable(
+      M, Int32Ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantInt::get(Int32Ty, 0), "TraceLastThreadID");
+  RT.ThreadKey = new GlobalVariable(
+      M, KeyTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      Constant::getNullValue(KeyTy), "TraceThreadKey");
+  RT.File = new GlobalVariable(M, PtrTy, /*isConstant=*/false,
+                               GlobalValue::InternalLinkage,
+                               ConstantPointerNull::get(PtrTy), "TraceFile");
+
+  RT.SlowPath = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), Int64Ty, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "trace_slow_path", M);
+  // Keep the fast path (i.e. the code injected into every function) small
+  RT.SlowPath->addFnAttr(Attribute::NoInline);
+  RT.SlowPath->addFnAttr(Attribute::Cold);
+
+  Function *FlushF = CreateTraceFlush(M, RT);
+  DefineTraceSlowPath(M, RT, FlushF);
+  CreateTraceCtorAndDtor(M, RT, FlushF, ModuleHash, Timestamps);
+
+  return RT;
+}
+
+// Injects the code that appends a record for F (with ID FuncID) to the trace
+// buffer:
+//    %n = load i64, ptr @TraceNumRecords
+//    %idx = and i64 %n, <BufferSize - 1>
+//    if (%idx == 0)              ; the buffer is either empty or full
+//      call void @trace_slow_path(i64 %n)
+//    store {FuncID, NumArgs, Timestamp} at @TraceBuffer.Records[%idx]
+//    store i64 (%idx + 1), ptr @TraceNumRecords
+static void InjectTraceRecord(Function &F, uint32_t FuncID,
+                              const TraceRuntime &RT, unsigned BufferSize,
+                              bool Timestamps) {
+  auto &CTX = F.getContext();
+
+  // The entry block is split below, so skip the static allocas
+  BasicBlock::iterator InsertPt = F.getEntryBlock().getFirstInsertionPt();
+  while (isa<AllocaInst>(InsertPt))
+    ++InsertPt;
+  IRBuilder<> Builder(&*InsertPt);
+
+  Value *NumRecords = Builder.CreateLoad(Builder.getInt64Ty(), RT.NumRecords);
+  Value *Idx =
+      Builder.CreateAnd(NumRecords, Builder.getInt64(BufferSize - 1));
+  Instruction *SplitBefore = &*InsertPt;
+  Instruction *SlowPathTerm = SplitBlockAndInsertIfThen(
+      Builder.CreateICmpEQ(Idx, Builder.getInt64(0)), SplitBefore,
+      /*Unreachable=*/false, MDBuilder(CTX).createUnlikelyBranchWeights());
+  IRBuilder<>(SlowPathTerm).CreateCall(RT.SlowPath, {NumRecords});
+
+  // The record is written in the tail block (i.e. where SplitBefore is now)
+  Builder.SetInsertPoint(SplitBefore);
+
+  Type *BufferTy = RT.Buffer->getValueType();
+  Value *Record = Builder.CreateInBoundsGEP(
+      BufferTy, RT.Buffer, {Builder.getInt32(0), Builder.getInt32(2), Idx});
+  StructType *RecordTy = getTraceRecordTy(CTX);
+  Builder.CreateStore(Builder.getInt32(FuncID),
+                      Builder.CreateStructGEP(RecordTy, Record, 0));
+  Builder.CreateStore(Builder.getInt32(F.arg_size()),
+                      Builder.CreateStructGEP(RecordTy, Record, 1));
+  Value *Timestamp = Builder.getInt64(0);
+  if (Timestamps)
+    Timestamp = Builder.CreateIntrinsic(Intrinsic::readcyclecounter, {}, {});
+  Builder.CreateStore(Timestamp, Builder.CreateStructGEP(RecordTy, Record, 2));
+  Builder.CreateStore(Builder.CreateAdd(Idx, Builder.getInt64(1)),
+                      RT.NumRecords);
+}
+
+// Writes the ID table for FuncNames (see InjectFuncCall.h for the format)
+static bool WriteIDTable(StringRef Path, ArrayRef<StringRef> FuncNames,
+                         uint64_t ModuleHash, LLVMContext &CTX) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    CTX.emitError("inject-func-call: cannot write the ID table to '" + Path +
+                  "': " + EC.message());
+    return false;
+  }
+
+  OS << inject_func_call::IDTableMagic << ' '
+     << inject_func_call::TraceVersion << ' ' << format_hex(ModuleHash, 18)
+     << '\n';
+  for (size_t Idx = 0, E = FuncNames.size(); Idx != E; ++Idx)
+    OS << Idx << ' ' << FuncNames[Idx] << '\n';
+  return true;
+}
+
+static bool runTracing(Module &M, const InjectFuncCall::Options &Opts) {
+  // Take a snapshot of the functions to instrument first, so that the
+  // functions of the runtime are not instrumented
+  SmallVector<Function *, 16> Funcs;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Funcs.push_back(&F);
+  if (Funcs.empty())
+    return false;
+
+  // The hash of the table ties traces to the table that they were recorded
+  // with
+  SmallVector<StringRef, 16> FuncNames;
+  std::string Names;
+  for (Function *F : Funcs) {
+    FuncNames.push_back(F->getName());
+    Names += F->getName();
+    Names += '\0';
+  }
+  uint64_t ModuleHash = xxHash64(Names);
+
+  StringRef IDTableFile = Opts.IDTableFile.empty()
+                              ? inject_func_call::DefaultIDTableFile
+                              : StringRef(Opts.IDTableFile);
+  WriteIDTable(IDTableFile, FuncNames, ModuleHash, M.getContext());
+
+  TraceRuntime RT =
+      CreateTraceRuntime(M, Opts.BufferSize, ModuleHash, Opts.Timestamps);
+  for (size_t FuncID = 0, E = Funcs.size(); FuncID != E; ++FuncID) {
+    LLVM_DEBUG(dbgs() << " Injecting trace record inside "
+                      << Funcs[FuncID]->getName() << "\n");
+    InjectTraceRecord(*Funcs[FuncID], FuncID, RT, Opts.BufferSize,
+                      Opts.Timestamps);
+  }
+
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 // InjectFuncCall implementation
 //-----------------------------------------------------------------------------
 bool InjectFuncCall::runOnModule(Module &M) {
+  if (Opts.Kind == Mode::Trace)
+    return runTracing(M, Opts);
+
   bool InsertedAtLeastOnePrintf = false;
 
   auto &CTX = M.getContext();
@@ -109,7 +532,11 @@ bool InjectFuncCall::runOnModule(Module &M) {
 
 PreservedAnalyses InjectFuncCall::run(llvm::Module &M,
                                        llvm::ModuleAnalysisManager &) {
-  bool Changed =  runOnModule(M);
+  bool Changed;
+  {
+    PhaseTimer T(DEBUG_TYPE, "instrument");
+    Changed = runOnModule(M);
+  }
 
   return (Changed ? llvm::PreservedAnalyses::none()
                   : llvm::PreservedAnalyses::all());
@@ -119,14 +546,53 @@ PreservedAnalyses InjectFuncCall::run(llvm::Module &M,
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses `inject-func-call` and `inject-func-call<trace;...>`, where the
+// options of the tracing mode are `timestamps`, `buffer=N` and `ids=<file>`.
+static std::optional<InjectFuncCall> parseInjectFuncCall(StringRef Name) {
+  if (!Name.consume_front("inject-func-call"))
+    return std::nullopt;
+
+  InjectFuncCall::Options Opts;
+  if (Name.empty())
+    return InjectFuncCall(Opts);
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  SmallVector<StringRef, 2> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options) {
+    if (Option == "trace")
+      Opts.Kind = InjectFuncCall::Mode::Trace;
+    else if (Option == "timestamps")
+      Opts.Timestamps = true;
+    else if (Option.consume_front("buffer=")) {
+      if (Option.getAsInteger(10, Opts.BufferSize) ||
+          !isPowerOf2_32(Opts.BufferSize))
+        return std::nullopt;
+    } else if (Option.consume_front("ids=")) {
+      if (Option.empty())
+        return std::nullopt;
+      Opts.IDTableFile = Option.str();
+    } else
+      return std::nullopt;
+  }
+
+  // All the other options only apply to the tracing mode
+  if (Opts.Kind != InjectFuncCall::Mode::Trace && !Options.empty())
+    return std::nullopt;
+
+  return InjectFuncCall(Opts);
+}
+
 llvm::PassPluginLibraryInfo getInjectFuncCallPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "inject-func-call", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "inject-func-call") {
-                    MPM.addPass(InjectFuncCall());
+                  if (auto Pass = parseInjectFuncCall(Name)) {
+                    MPM.addPass(std::move(*Pass));
                     return true;
                   }
                   return false;
@@ -134,7 +600,9 @@ llvm::PassPluginLibraryInfo getInjectFuncCallPluginInfo() {
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getInjectFuncCallPluginInfo();
 }
+#endif
@@ -0,0 +1,86 @@
+//==============================================================================
+// FILE:
+//    LLVMTutor.cpp
+//
+// DESCRIPTION:
+//    A plugin that bundles all the passes and analyses from llvm-tutor, so
+//    that only one plugin has to be loaded, e.g. instead of:
+//      opt -load-pass-plugin libRIV.so -load-pass-plugin libDuplicateBB.so ...
+//    just:
+//      opt -load-pass-plugin libLLVMTutor.so ...
+//    The per-pass plugins are still built - this plugin is built from the same
+//    sources (see lib/CMakeLists.txt). Every plugin registers its passes
+//    through its get<Plugin>PluginInfo function. Here all of these are called
+//    from one PassPluginLibraryInfo.
+//
+//    Registering an analysis twice (e.g. StaticCallCounter is registered by
+//    both StaticCallCounter and DynamicCallCounter) is fine - the analysis
+//    managers ignore the second registration.
+//
+//    Unlike libOpcodeCounter, this plugin doesn't add OpcodeCounterPrinter to
+//    the -O{1|2|3|s} pipelines - loading it doesn't change what they print.
+//
+// USAGE:
+//      opt -load-pass-plugin <BUILD_DIR>/lib/libLLVMTutor.so `\`
+//        -passes="duplicate-bb,merge-bb" <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+// Defined in the corresponding <Plugin>.cpp files
+llvm::PassPluginLibraryInfo getConvertFCmpEqPluginInfo();
+llvm::PassPluginLibraryInfo getDuplicateBBPluginInfo();
+llvm::PassPluginLibraryInfo getDynamicCallCounterPluginInfo();
+llvm::PassPluginLibraryInfo getFindFCmpEqPluginInfo();
+llvm::PassPluginLibraryInfo getHelloWorldPluginInfo();
+llvm::PassPluginLibraryInfo getInjectFuncCallPluginInfo();
+llvm::PassPluginLibraryInfo getLivenessPluginInfo();
+llvm::PassPluginLibraryInfo getMBAPluginInfo();
+llvm::PassPluginLibraryInfo getMBAAddPluginInfo();
+llvm::PassPluginLibraryInfo getMBASubPluginInfo();
+llvm::PassPluginLibraryInfo getMergeBBPluginInfo();
+llvm::PassPluginLibraryInfo getOpcodeCounterPluginInfo();
+llvm::PassPluginLibraryInfo getParallelFunctionsPluginInfo();
+llvm::PassPluginLibraryInfo getRIVPluginInfo();
+llvm::PassPluginLibraryInfo getStaticCallCounterPluginInfo();
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getLLVMTutorPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "LLVMTutor", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // None of these adds passes to the optimisation pipelines (e.g.
+            // OpcodeCounterPrinter is only added by libOpcodeCounter), so the
+            // order doesn't matter
+            for (auto GetPluginInfo : {
+                     getStaticCallCounterPluginInfo,
+                     getDynamicCallCounterPluginInfo,
+                     getFindFCmpEqPluginInfo,
+                     getConvertFCmpEqPluginInfo,
+                     getInjectFuncCallPluginInfo,
+                     getMBAPluginInfo,
+                     getMBAAddPluginInfo,
+                     getMBASubPluginInfo,
+                     getRIVPluginInfo,
+                     getDuplicateBBPluginInfo,
+                     getOpcodeCounterPluginInfo,
+                     getMergeBBPluginInfo,
+                     getLivenessPluginInfo,
+                     getParallelFunctionsPluginInfo,
+                     getHelloWorldPluginInfo,
+                 })
+              GetPluginInfo().RegisterPassBuilderCallbacks(PB);
+          }};
+}
+
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getLLVMTutorPluginInfo();
+}
+#endif
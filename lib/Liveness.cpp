@@ -0,0 +1,271 @@
+//=============================================================================
+// FILE:
+//    Liveness.cpp
+//
+// DESCRIPTION:
+//    For every basic block in the input function, computes the sets of
+//    variables (named allocas) that are:
+//      * UEVar   - used in the block before being (re-)defined in it,
+//      * VarKill - defined (stored to) in the block,
+//      * LiveOut - live on exit from the block.
+//    The results can be printed through the use of a printing pass.
+//
+// ALGORITHM:
+//    -------------------------------------------------------------------------
+//    STEP 1:
+//    Give every named alloca an index. All sets are then stored as dense
+//    bit-vectors (one per block) indexed by these.
+//    -------------------------------------------------------------------------
+//    STEP 2:
+//    For every BB in F compute UEVar(BB) and VarKill(BB)
+//    -------------------------------------------------------------------------
+//    STEP 3:
+//    Iterate to a fixed point using a worklist:
+//      LiveOut(BB) = U_{S in succ(BB)} UEVar(S) | (LiveOut(S) & ~VarKill(S))
+//    Reachable blocks are seeded in post-order (i.e. reverse RPO, which is the
+//    natural order for a backward problem), unreachable blocks are appended
+//    at the end. A block is never queued twice.
+//    -------------------------------------------------------------------------
+//
+// USAGE:
+//      opt -load-pass-plugin libLiveness.dylib `\`
+//        -passes="print<liveness>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//=============================================================================
+#include "Liveness.h"
+#include "PhaseStats.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include <deque>
+#include <optional>
+
+using namespace llvm;
+
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "liveness";
+
+// Pretty-prints the result of this analysis
+static void printLivenessResult(llvm::raw_ostream &OutS, const Function &F,
+                                const LivenessInfo &LI);
+
+//-----------------------------------------------------------------------------
+// LivenessInfo implementation
+//-----------------------------------------------------------------------------
+unsigned LivenessInfo::getIndex(const AllocaInst *AI) const {
+  auto It = VarIdx.find(AI);
+  assert(It != VarIdx.end() && "Alloca not tracked by Liveness");
+  return It->second;
+}
+
+unsigned LivenessInfo::getBlockIndex(const BasicBlock *BB) const {
+  auto It = BlockIdx.find(BB);
+  assert(It != BlockIdx.end() && "Basic block not analysed by Liveness");
+  return It->second;
+}
+
+bool LivenessInfo::isLiveOut(const BasicBlock *BB,
+                             const AllocaInst *AI) const {
+  auto It = VarIdx.find(AI);
+  if (It == VarIdx.end())
+    return false;
+  return LiveOut[getBlockIndex(BB)].test(It->second);
+}
+
+bool LivenessInfo::invalidate(Function &, const PreservedAnalyses &PA,
+                              FunctionAnalysisManager::Invalidator &) {
+  auto PAC = PA.getChecker<Liveness>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>()) ||
+         !PAC.preservedSet<CFGAnalyses>();
+}
+
+//-----------------------------------------------------------------------------
+// Liveness implementation
+//-----------------------------------------------------------------------------
+LivenessInfo Liveness::computeLiveness(Function &F) {
+  LivenessInfo Res;
+
+  // STEPs 1 and 2 only look at the blocks in isolation, STEP 3 is the dataflow
+  std::optional<PhaseTimer> LocalTimer(std::in_place, PassArg, "local");
+
+  // STEP 1: Identify allocated variables (`alloca`) and give each one an
+  // index. The indices follow the program order of the allocas, so that the
+  // printed sets don't depend on where the allocas live in memory.
+  for (Instruction &I : instructions(F))
+    if (auto *AI = dyn_cast<AllocaInst>(&I))
+      if (AI->hasName())
+        Res.Vars.push_back(AI);
+
+  for (unsigned Idx = 0, E = Res.Vars.size(); Idx != E; ++Idx)
+    Res.VarIdx[Res.Vars[Idx]] = Idx;
+
+  // Give each block an index (in layout order)
+  SmallVector<BasicBlock *, 32> Blocks;
+  for (BasicBlock &BB : F) {
+    Res.BlockIdx[&BB] = Blocks.size();
+    Blocks.push_back(&BB);
+  }
+
+  unsigned NumVars = Res.Vars.size();
+  unsigned NumBlocks = Blocks.size();
+  Res.UEVar.assign(NumBlocks, BitVector(NumVars));
+  Res.VarKill.assign(NumBlocks, BitVector(NumVars));
+  Res.LiveOut.assign(NumBlocks, BitVector(NumVars));
+
+  // STEP 2: Compute UEVar and VarKill for each block
+  for (unsigned BBIdx = 0; BBIdx != NumBlocks; ++BBIdx) {
+    BitVector &UEVar = Res.UEVar[BBIdx];
+    BitVector &VarKill = Res.VarKill[BBIdx];
+
+    for (Instruction &I : *Blocks[BBIdx]) {
+      // Handle StoreInst: defines a variable
+      if (auto *SI = dyn_cast<StoreInst>(&I)) {
+        auto It = Res.VarIdx.find(SI->getPointerOperand());
+        if (It != Res.VarIdx.end())
+          VarKill.set(It->second);
+        continue;
+      }
+
+      // Handle LoadInst: uses a variable (upward-exposed only if it hasn't
+      // been defined earlier in this block)
+      if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        auto It = Res.VarIdx.find(LI->getPointerOperand());
+        if (It != Res.VarIdx.end() && !VarKill.test(It->second))
+          UEVar.set(It->second);
+        continue;
+      }
+
+      // Other instructions (add, icmp, etc.) are ignored as they handle SSA
+      // temporaries
+    }
+  }
+
+  addPhaseCount(PassArg, "local", "blocks", NumBlocks);
+  addPhaseCount(PassArg, "local", "variables", NumVars);
+  LocalTimer.reset();
+
+  // STEP 3: Compute LiveOut using worklist-based approach
+  PhaseTimer DataflowTimer(PassArg, "dataflow");
+  uint64_t NumVisits = 0;
+  std::deque<unsigned> Worklist;
+  BitVector InWorklist(NumBlocks);
+  auto Enqueue = [&](const BasicBlock *BB) {
+    unsigned Idx = Res.getBlockIndex(BB);
+    if (InWorklist.test(Idx))
+      return;
+    InWorklist.set(Idx);
+    Worklist.push_back(Idx);
+  };
+
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : llvm::reverse(RPOT))
+    Enqueue(BB);
+  for (BasicBlock *BB : Blocks)
+    Enqueue(BB);
+
+  BitVector NewLiveOut(NumVars);
+  BitVector Tmp(NumVars);
+  while (!Worklist.empty()) {
+    unsigned BBIdx = Worklist.front();
+    Worklist.pop_front();
+    InWorklist.reset(BBIdx);
+    NumVisits++;
+
+    NewLiveOut.reset();
+    for (BasicBlock *Succ : successors(Blocks[BBIdx])) {
+      unsigned SuccIdx = Res.getBlockIndex(Succ);
+      Tmp = Res.LiveOut[SuccIdx];
+      Tmp.reset(Res.VarKill[SuccIdx]);
+      Tmp |= Res.UEVar[SuccIdx];
+      NewLiveOut |= Tmp;
+    }
+
+    if (NewLiveOut != Res.LiveOut[BBIdx]) {
+      Res.LiveOut[BBIdx] = NewLiveOut;
+      for (BasicBlock *Pred : predecessors(Blocks[BBIdx]))
+        Enqueue(Pred);
+    }
+  }
+  addPhaseCount(PassArg, "dataflow", "visited-blocks", NumVisits);
+
+  return Res;
+}
+
+LivenessInfo Liveness::run(Function &F, FunctionAnalysisManager &) {
+  return computeLiveness(F);
+}
+
+PreservedAnalyses LivenessPrinter::run(Function &F,
+                                       FunctionAnalysisManager &FAM) {
+  printResult(OS, F, FAM.getResult<Liveness>(F));
+  return PreservedAnalyses::all();
+}
+
+void LivenessPrinter::printResult(raw_ostream &OS, const Function &F,
+                                  const LivenessInfo &LI) {
+  printLivenessResult(OS, F, LI);
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+AnalysisKey Liveness::Key;
+
+llvm::PassPluginLibraryInfo getLivenessPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "liveness", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<liveness>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, FunctionPassManager &FPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<liveness>") {
+                    FPM.addPass(LivenessPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "FAM.getResult<Liveness>(Function)"
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM) {
+                  FAM.registerPass([&] { return Liveness(); });
+                });
+          }};
+}
+
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getLivenessPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printLivenessResult(raw_ostream &OutS, const Function &F,
+                                const LivenessInfo &LI) {
+  auto printVarSet = [&OutS](const char *Label, const AllocaSetView &VarSet) {
+    OutS << Label << ": ";
+    bool First = true;
+    for (const AllocaInst *AI : VarSet) {
+      if (!First)
+        OutS << " ";
+      OutS << AI->getName();
+      First = false;
+    }
+    OutS << "\n";
+  };
+
+  for (const BasicBlock &BB : F) {
+    OutS << "----- " << BB.getName() << " -----\n";
+    printVarSet("UEVAR", LI.ueVar(&BB));
+    printVarSet("VARKILL", LI.varKill(&BB));
+    printVarSet("LIVEOUT", LI.liveOut(&BB));
+  }
+}
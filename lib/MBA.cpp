@@ -0,0 +1,568 @@
+//==============================================================================
+// FILE:
+//    MBA.cpp
+//
+// DESCRIPTION:
+//    Obfuscation for integer add, sub, and, or and xor instructions through
+//    Mixed Boolean Arithmetic (MBA). Every instruction is substituted based on
+//    one of the following identities (see IDENTITIES below):
+//      a + b == (((a ^ b) + 2 * (a & b)) * c + d) * c^-1 - d * c^-1
+//      a - b == (a + ~b) + 1
+//      a & b == (a + b) - (a | b)
+//      a | b == (a ^ b) + (a & b)
+//      a ^ b == (a | b) - (a & b)
+//    The identity for add is wrapped in an invertible affine function (see
+//    formula (3) in [1]). The constants c and d are picked per width, hence it
+//    is only available for i8, i16, i32 and i64. All the other identities are
+//    valid for any width.
+//
+//    The identities are held in a compile-time table indexed by the opcode and
+//    the width. The instructions are dispatched with a single lookup into that
+//    table during one walk over the function, and the constants of every
+//    identity are only materialised once per type.
+//
+//    Every substitution turns one instruction into a chain of dependent
+//    instructions (up to 8), which hurts in hot loops. In the budget mode
+//    LoopInfo and BlockFrequencyInfo are used to leave hot loops alone and/or
+//    to cap the number of instructions added per function. The coldest
+//    instructions are obfuscated first.
+//
+//    MBAAdd and MBASub are presets of this pass.
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBA.so `\`
+//        -passes="mba" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBA.so `\`
+//        -passes="mba<add;xor;width=32>" <bitcode-file>
+//    Options:
+//      * add, sub, and, or, xor - the operators to obfuscate (all of them if
+//        none is specified)
+//      * width=N - only obfuscate N-bit wide instructions
+//      * hot-loop=N - don't obfuscate instructions in loop blocks that are
+//        executed at least N times per 100 executions of the entry block
+//      * budget=N - add at most N instructions per function
+//    The last two options are also accepted by mba-add and mba-sub.
+//
+//  [1] "Defeating MBA-based Obfuscation" Ninon Eyrolles, Louis Goubin, Marion
+//      Videau
+//  [2] "Hacker's Delight" by Henry S. Warren, Jr.
+//
+// License: MIT
+//==============================================================================
+#include "MBA.h"
+#include "BlockHotness.h"
+#include "PhaseStats.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <iterator>
+#include <numeric>
+#include <optional>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "mba"
+
+STATISTIC(SubstCount, "The # of substituted instructions");
+STATISTIC(NumHotLoopSkipped,
+          "The # of instructions not substituted because they are in hot loops");
+STATISTIC(NumOverBudgetSkipped,
+          "The # of instructions not substituted because of the budget");
+
+//-----------------------------------------------------------------------------
+// IDENTITIES
+//-----------------------------------------------------------------------------
+// Every identity is a short straight-line program. Step N computes
+//    tN = LHS <opcode> RHS
+// where LHS and RHS refer to the operands of the original instruction (a and
+// b), to the result of one of the preceding steps or to one of the constants
+// of the identity. The last step replaces the original instruction.
+struct MBAOperand {
+  enum Kind : uint8_t { A, B, Tmp, Const } K;
+  uint8_t Idx;
+};
+
+static constexpr MBAOperand A = {MBAOperand::A, 0};
+static constexpr MBAOperand B = {MBAOperand::B, 0};
+static constexpr MBAOperand tmp(uint8_t Idx) { return {MBAOperand::Tmp, Idx}; }
+static constexpr MBAOperand cst(uint8_t Idx) { return {MBAOperand::Const, Idx}; }
+
+struct MBAStep {
+  Instruction::BinaryOps Opcode;
+  MBAOperand LHS;
+  MBAOperand RHS;
+};
+
+struct MBAIdentity {
+  Instruction::BinaryOps Opcode;
+  // The bit-width that this identity is valid for (0 = any)
+  unsigned Width;
+  const MBAStep *Steps;
+  unsigned NumSteps;
+  // The constants are truncated (or sign-extended) to the width of the
+  // instruction that's rewritten
+  const uint64_t *Constants;
+  unsigned NumConstants;
+};
+
+// The inverse of C modulo 2^64 (C must be odd). Every Newton iteration doubles
+// the number of correct bits, starting with 3 (C * C == 1 mod 8).
+static constexpr uint64_t getInverse(uint64_t C) {
+  uint64_t X = C;
+  for (unsigned I = 0; I < 5; I++)
+    X *= 2 - C * X;
+  return X;
+}
+
+// The constants for the add identity: {2, c, d, c^-1, -d * c^-1}. This
+// works for any width <= 64, as the inverse modulo 2^64 truncates to the
+// inverse modulo 2^N.
+static constexpr std::array<uint64_t, 5> getAffineConstants(uint64_t C,
+                                                            uint64_t D) {
+  return {2, C, D, getInverse(C), 0 - D * getInverse(C)};
+}
+
+// a + b == (((a ^ b) + 2 * (a & b)) * c + d) * c^-1 - d * c^-1
+static constexpr MBAStep AddSteps[] = {
+    {Instruction::Xor, A, B},               // t0 = a ^ b
+    {Instruction::And, A, B},               // t1 = a & b
+    {Instruction::Mul, cst(0), tmp(1)},     // t2 = 2 * t1
+    {Instruction::Add, tmp(0), tmp(2)},     // t3 = t0 + t2
+    {Instruction::Mul, cst(1), tmp(3)},     // t4 = c * t3
+    {Instruction::Add, cst(2), tmp(4)},     // t5 = d + t4
+    {Instruction::Mul, cst(3), tmp(5)},     // t6 = c^-1 * t5
+    {Instruction::Add, cst(4), tmp(6)}};    // t7 = -d * c^-1 + t6
+// For i8 these are the constants from [1]: 39, 23, 151, 111
+static constexpr auto AddConstants8 = getAffineConstants(39, 23);
+static constexpr auto AddConstants16 = getAffineConstants(0x6f8b, 0x1d3f);
+static constexpr auto AddConstants32 =
+    getAffineConstants(0x2c1b3c6d, 0x297a2d39);
+static constexpr auto AddConstants64 =
+    getAffineConstants(0x9e3779b97f4a7c15, 0x2545f4914f6cdd1d);
+static_assert(static_cast<uint8_t>(AddConstants8[3]) == 151 &&
+                  static_cast<uint8_t>(AddConstants8[4]) == 111,
+              "Unexpected constants for the 8-bit add identity");
+static_assert(AddConstants64[1] * AddConstants64[3] == 1,
+              "Invalid inverse for the 64-bit add identity");
+
+// a - b == (a + ~b) + 1
+static constexpr MBAStep SubSteps[] = {
+    {Instruction::Xor, B, cst(0)},          // t0 = ~b
+    {Instruction::Add, A, tmp(0)},          // t1 = a + t0
+    {Instruction::Add, tmp(1), cst(1)}};    // t2 = t1 + 1
+static constexpr uint64_t SubConstants[] = {~0ULL, 1};
+
+// a & b == (a + b) - (a | b)
+static constexpr MBAStep AndSteps[] = {
+    {Instruction::Add, A, B},               // t0 = a + b
+    {Instruction::Or, A, B},                // t1 = a | b
+    {Instruction::Sub, tmp(0), tmp(1)}};    // t2 = t0 - t1
+
+// a | b == (a ^ b) + (a & b)
+static constexpr MBAStep OrSteps[] = {
+    {Instruction::Xor, A, B},               // t0 = a ^ b
+    {Instruction::And, A, B},               // t1 = a & b
+    {Instruction::Add, tmp(0), tmp(1)}};    // t2 = t0 + t1
+
+// a ^ b == (a | b) - (a & b)
+static constexpr MBAStep XorSteps[] = {
+    {Instruction::Or, A, B},                // t0 = a | b
+    {Instruction::And, A, B},               // t1 = a & b
+    {Instruction::Sub, tmp(0), tmp(1)}};    // t2 = t0 - t1
+
+#define MBA_STEPS(Steps) Steps, std::size(Steps)
+#define MBA_CONSTANTS(Constants) Constants.data(), Constants.size()
+
+static constexpr MBAIdentity Identities[] = {
+    {Instruction::Add, 8, MBA_STEPS(AddSteps), MBA_CONSTANTS(AddConstants8)},
+    {Instruction::Add, 16, MBA_STEPS(AddSteps), MBA_CONSTANTS(AddConstants16)},
+    {Instruction::Add, 32, MBA_STEPS(AddSteps), MBA_CONSTANTS(AddConstants32)},
+    {Instruction::Add, 64, MBA_STEPS(AddSteps), MBA_CONSTANTS(AddConstants64)},
+    {Instruction::Sub, 0, MBA_STEPS(SubSteps), SubConstants,
+     std::size(SubConstants)},
+    {Instruction::And, 0, MBA_STEPS(AndSteps), nullptr, 0},
+    {Instruction::Or, 0, MBA_STEPS(OrSteps), nullptr, 0},
+    {Instruction::Xor, 0, MBA_STEPS(XorSteps), nullptr, 0}};
+
+#undef MBA_STEPS
+#undef MBA_CONSTANTS
+
+// Returns the identity for Opcode that's dedicated to Width or, if there's
+// none, the one that's valid for any width (nullptr if neither exists)
+static constexpr const MBAIdentity *findIdentity(Instruction::BinaryOps Opcode,
+                                                 unsigned Width) {
+  const MBAIdentity *Generic = nullptr;
+  for (const MBAIdentity &Id : Identities) {
+    if (Id.Opcode != Opcode)
+      continue;
+    if (Id.Width == Width)
+      return &Id;
+    if (Id.Width == 0)
+      Generic = &Id;
+  }
+  return Generic;
+}
+
+static_assert(findIdentity(Instruction::Add, 8) == &Identities[0],
+              "The add identity for i8 must be the one from [1]");
+static_assert(!findIdentity(Instruction::Add, 0),
+              "The add identity is only defined for i8, i16, i32 and i64");
+
+// The opcodes corresponding to MBA::Operator (in the order of the bits)
+static constexpr Instruction::BinaryOps OperatorOpcodes[] = {
+    Instruction::Add, Instruction::Sub, Instruction::And, Instruction::Or,
+    Instruction::Xor};
+// The widths with dedicated identities. The last class covers all the other
+// widths.
+static constexpr unsigned ClassWidths[] = {8, 16, 32, 64, 0};
+
+static int getOperatorIdx(unsigned Opcode) {
+  switch (Opcode) {
+  case Instruction::Add:
+    return 0;
+  case Instruction::Sub:
+    return 1;
+  case Instruction::And:
+    return 2;
+  case Instruction::Or:
+    return 3;
+  case Instruction::Xor:
+    return 4;
+  default:
+    return -1;
+  }
+}
+
+static unsigned getWidthClass(unsigned Width) {
+  switch (Width) {
+  case 8:
+    return 0;
+  case 16:
+    return 1;
+  case 32:
+    return 2;
+  case 64:
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// MBA Implementation
+//-----------------------------------------------------------------------------
+MBA::MBA(Options Opts) : Opts(Opts) {
+  static_assert(std::size(OperatorOpcodes) == std::tuple_size<
+                                                  decltype(Dispatch)>::value,
+                "Every operator needs a row in the dispatch table");
+  static_assert(std::size(ClassWidths) == NumWidthClasses,
+                "Every width class needs a column in the dispatch table");
+
+  for (unsigned Op = 0; Op < std::size(OperatorOpcodes); Op++) {
+    if (!(Opts.Operators & (1 << Op)))
+      continue;
+    for (unsigned WC = 0; WC < NumWidthClasses; WC++)
+      Dispatch[Op][WC] = findIdentity(OperatorOpcodes[Op], ClassWidths[WC]);
+  }
+}
+
+const MBAIdentity *MBA::getIdentity(const BinaryOperator &BinOp) const {
+  // Skip vectors and any other non-integer types
+  auto *Ty = dyn_cast<IntegerType>(BinOp.getType());
+  if (!Ty)
+    return nullptr;
+
+  unsigned Width = Ty->getBitWidth();
+  if (Opts.Width && Width != Opts.Width)
+    return nullptr;
+
+  int Op = getOperatorIdx(BinOp.getOpcode());
+  if (Op < 0)
+    return nullptr;
+
+  return Dispatch[Op][getWidthClass(Width)];
+}
+
+ArrayRef<Constant *> MBA::getConstants(const MBAIdentity &Id, Type *Ty) {
+  // Types are owned by the context, so the cache is only valid for as long as
+  // the context (which is the same for all functions in a pipeline) is
+  if (&Ty->getContext() != CachedCtx) {
+    ConstantCache.clear();
+    CachedCtx = &Ty->getContext();
+  }
+
+  auto &Constants = ConstantCache[{&Id, Ty}];
+  if (Constants.empty()) {
+    unsigned Width = Ty->getIntegerBitWidth();
+    for (unsigned Idx = 0; Idx < Id.NumConstants; Idx++)
+      Constants.push_back(ConstantInt::get(
+          Ty, APInt(64, Id.Constants[Idx]).sextOrTrunc(Width)));
+  }
+  return Constants;
+}
+
+void MBA::rewrite(BinaryOperator &BinOp, const MBAIdentity &Id) {
+  ArrayRef<Constant *> Constants = getConstants(Id, BinOp.getType());
+  SmallVector<Value *, 8> Tmps;
+
+  auto GetOperand = [&](MBAOperand Operand) -> Value * {
+    switch (Operand.K) {
+    case MBAOperand::A:
+      return BinOp.getOperand(0);
+    case MBAOperand::B:
+      return BinOp.getOperand(1);
+    case MBAOperand::Tmp:
+      return Tmps[Operand.Idx];
+    case MBAOperand::Const:
+      return Constants[Operand.Idx];
+    }
+    llvm_unreachable("Unknown MBA operand");
+  };
+
+  // A uniform API for creating instructions and inserting
+  // them into basic blocks
+  IRBuilder<> Builder(&BinOp);
+  for (const MBAStep &Step : ArrayRef<MBAStep>(Id.Steps, Id.NumSteps - 1))
+    Tmps.push_back(Builder.CreateBinOp(Step.Opcode, GetOperand(Step.LHS),
+                                       GetOperand(Step.RHS)));
+
+  // The last step is not inserted, it replaces BinOp instead
+  const MBAStep &Last = Id.Steps[Id.NumSteps - 1];
+  Instruction *NewInst = BinaryOperator::Create(
+      Last.Opcode, GetOperand(Last.LHS), GetOperand(Last.RHS));
+
+  // The following is visible only if you pass -debug on the command line
+  // *and* you have an assert build.
+  LLVM_DEBUG(dbgs() << BinOp << " -> " << *NewInst << "\n");
+
+  ReplaceInstWithInst(&BinOp, NewInst);
+
+  // Update the statistics
+  ++SubstCount;
+}
+
+bool MBA::runOnBasicBlock(BasicBlock &BB) {
+  bool Changed = false;
+
+  // The new instructions are inserted before the one that's being replaced,
+  // hence they are never visited
+  for (Instruction &Inst : make_early_inc_range(BB)) {
+    // Skip non-binary (e.g. unary or compare) instructions
+    auto *BinOp = dyn_cast<BinaryOperator>(&Inst);
+    if (!BinOp)
+      continue;
+
+    const MBAIdentity *Id = getIdentity(*BinOp);
+    if (!Id)
+      continue;
+
+    rewrite(*BinOp, *Id);
+    Changed = true;
+  }
+  return Changed;
+}
+
+void MBA::collectCandidates(Function &F,
+                            SmallVectorImpl<Candidate> &Candidates) const {
+  for (auto &BB : F)
+    for (Instruction &Inst : BB)
+      if (auto *BinOp = dyn_cast<BinaryOperator>(&Inst))
+        if (const MBAIdentity *Id = getIdentity(*BinOp))
+          Candidates.emplace_back(BinOp, Id);
+}
+
+bool MBA::rewriteCandidates(ArrayRef<Candidate> Candidates) {
+  for (auto &[BinOp, Id] : Candidates)
+    rewrite(*BinOp, *Id);
+  return !Candidates.empty();
+}
+
+bool MBA::runWithBudget(Function &F, const LoopInfo &LI,
+                        const BlockFrequencyInfo &BFI) {
+  struct Candidate {
+    BinaryOperator *BinOp;
+    const MBAIdentity *Id;
+    uint64_t Freq;
+  };
+  SmallVector<Candidate, 16> Candidates;
+
+  uint64_t EntryFreq = BFI.getEntryFreq().getFrequency();
+  for (auto &BB : F) {
+    uint64_t Freq = BFI.getBlockFreq(&BB).getFrequency();
+    bool IsHotLoop = Opts.HotLoop && LI.getLoopFor(&BB) &&
+                     isAtLeastPercentOfEntry(Freq, EntryFreq, Opts.HotLoop);
+
+    for (Instruction &Inst : BB) {
+      auto *BinOp = dyn_cast<BinaryOperator>(&Inst);
+      if (!BinOp)
+        continue;
+
+      const MBAIdentity *Id = getIdentity(*BinOp);
+      if (!Id)
+        continue;
+
+      if (IsHotLoop) {
+        ++NumHotLoopSkipped;
+        continue;
+      }
+      Candidates.push_back({BinOp, Id, Freq});
+    }
+  }
+
+  // Spend the budget on the coldest instructions first. Ties are kept in
+  // program order.
+  SmallVector<bool, 16> Selected(Candidates.size(), true);
+  if (Opts.Budget) {
+    SmallVector<unsigned, 16> Order(Candidates.size());
+    std::iota(Order.begin(), Order.end(), 0);
+    llvm::stable_sort(Order, [&Candidates](unsigned A, unsigned B) {
+      return Candidates[A].Freq < Candidates[B].Freq;
+    });
+
+    unsigned Budget = Opts.Budget;
+    for (unsigned Idx : Order) {
+      // Every substitution replaces one instruction with NumSteps
+      unsigned Cost = Candidates[Idx].Id->NumSteps - 1;
+      if (Cost > Budget) {
+        Selected[Idx] = false;
+        ++NumOverBudgetSkipped;
+        continue;
+      }
+      Budget -= Cost;
+    }
+  }
+
+  // Substitute in program order, so that the output doesn't depend on the
+  // frequencies more than necessary
+  bool Changed = false;
+  for (unsigned Idx = 0; Idx < Candidates.size(); Idx++) {
+    if (!Selected[Idx])
+      continue;
+    rewrite(*Candidates[Idx].BinOp, *Candidates[Idx].Id);
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool MBA::runOnFunction(Function &F, const LoopInfo *LI,
+                        const BlockFrequencyInfo *BFI) {
+  if (Opts.isBudgeted()) {
+    assert(LI && BFI && "LoopInfo and BlockFrequencyInfo are required");
+    return runWithBudget(F, *LI, *BFI);
+  }
+
+  bool Changed = false;
+  for (auto &BB : F)
+    Changed |= runOnBasicBlock(BB);
+  return Changed;
+}
+
+PreservedAnalyses MBA::run(llvm::Function &F,
+                           llvm::FunctionAnalysisManager &FAM) {
+  // The analyses are only needed (and hence only computed) in the budget mode
+  const LoopInfo *LI = nullptr;
+  const BlockFrequencyInfo *BFI = nullptr;
+  if (Opts.isBudgeted()) {
+    LI = &FAM.getResult<LoopAnalysis>(F);
+    BFI = &FAM.getResult<BlockFrequencyAnalysis>(F);
+  }
+
+  bool Changed;
+  {
+    PhaseTimer T(DEBUG_TYPE, "rewrite");
+    unsigned NumInstsBefore =
+        arePhaseStatsEnabled() ? F.getInstructionCount() : 0;
+    Changed = runOnFunction(F, LI, BFI);
+    if (Changed && arePhaseStatsEnabled())
+      addPhaseCount(DEBUG_TYPE, "rewrite", "added-instructions",
+                    F.getInstructionCount() - NumInstsBefore);
+  }
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+bool MBA::parseBudgetOption(StringRef Option, Options &Opts) {
+  if (Option.consume_front("hot-loop="))
+    return !Option.getAsInteger(10, Opts.HotLoop);
+  if (Option.consume_front("budget="))
+    return !Option.getAsInteger(10, Opts.Budget);
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+// Parses the options of mba, e.g. `mba<add;xor;width=32;budget=100>`. Returns nothing
+// if Name is not a valid mba pipeline element.
+static std::optional<MBA> parseMBA(StringRef Name) {
+  if (!Name.consume_front("mba"))
+    return std::nullopt;
+
+  if (Name.empty())
+    return MBA();
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  MBA::Options Opts;
+  unsigned Operators = 0;
+  SmallVector<StringRef, 4> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options) {
+    unsigned Operator = StringSwitch<unsigned>(Option)
+                            .Case("add", MBA::Add)
+                            .Case("sub", MBA::Sub)
+                            .Case("and", MBA::And)
+                            .Case("or", MBA::Or)
+                            .Case("xor", MBA::Xor)
+                            .Default(0);
+    if (Operator) {
+      Operators |= Operator;
+      continue;
+    }
+
+    if (Option.consume_front("width=")) {
+      if (Option.getAsInteger(10, Opts.Width))
+        return std::nullopt;
+    } else if (!MBA::parseBudgetOption(Option, Opts)) {
+      return std::nullopt;
+    }
+  }
+  if (Operators)
+    Opts.Operators = Operators;
+
+  return MBA(Opts);
+}
+
+llvm::PassPluginLibraryInfo getMBAPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "mba", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, FunctionPassManager &FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (auto Pass = parseMBA(Name)) {
+                    FPM.addPass(std::move(*Pass));
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getMBAPluginInfo();
+}
+#endif
@@ -6,12 +6,15 @@
 //    This pass performs a substitution for 8-bit integer add
 //    instruction based on this Mixed Boolean-Airthmetic expression:
 //      a + b == (((a ^ b) + 2 * (a & b)) * 39 + 23) * 151 + 111
-//    See formula (3) in [1].
+//    See formula (3) in [1]. This is a preset of the MBA pass (see MBA.cpp).
 //
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBAAdd.so `\`
 //        -passes=-"mba-add" <bitcode-file>
 //      The command line option is not available for the new PM
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBAAdd.so `\`
+//        -passes="mba-add<hot-loop=50;budget=100>" <bitcode-file>
+//    The options (see MBA.cpp) limit the substitutions in hot code.
 //
 //  
 // [1] "Defeating MBA-based Obfuscation" Ninon Eyrolles, Louis Goubin, Marion
@@ -21,121 +24,70 @@
 //==============================================================================
 #include "MBAAdd.h"
 
-#include "llvm/ADT/Statistic.h"
-#include "llvm/IR/IRBuilder.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
-#include <random>
+#include <optional>
 
 using namespace llvm;
 
-#define DEBUG_TYPE "mba-add"
-
-STATISTIC(SubstCount, "The # of substituted instructions");
-
 //-----------------------------------------------------------------------------
 // MBAAdd Implementation
 //-----------------------------------------------------------------------------
-bool MBAAdd::runOnBasicBlock(BasicBlock &BB) {
-  bool Changed = false;
-  
-  // Loop over all instructions in the block. Replacing instructions requires
-  // iterators, hence a for-range loop wouldn't be suitable
-  for (auto Inst = BB.begin(), IE = BB.end(); Inst != IE; ++Inst) {
-    // Skip non-binary (e.g. unary or compare) instructions
-    auto *BinOp = dyn_cast<BinaryOperator>(Inst);
-    if (!BinOp)
-      continue;
-
-    // Skip instructions other than add
-    if (BinOp->getOpcode() != Instruction::Add)
-      continue;
-
-    // Skip if the result is not 8-bit wide (this implies that the operands are
-    // also 8-bit wide)
-    if (!BinOp->getType()->isIntegerTy() ||
-        !(BinOp->getType()->getIntegerBitWidth() == 8))
-      continue;
-
-    // A uniform API for creating instructions and inserting
-    // them into basic blocks
-    IRBuilder<> Builder(BinOp);
-
-    // Constants used in building the instruction for substitution
-    auto Val39 = ConstantInt::get(BinOp->getType(), 39);
-    auto Val151 = ConstantInt::get(BinOp->getType(), 151);
-    auto Val23 = ConstantInt::get(BinOp->getType(), 23);
-    auto Val2 = ConstantInt::get(BinOp->getType(), 2);
-    auto Val111 = ConstantInt::get(BinOp->getType(), 111);
-
-    // Build an instruction representing `(((a ^ b) + 2 * (a & b)) * 39 + 23) *
-    // 151 + 111`
-    Instruction *NewInst =
-        // E = e5 + 111
-        BinaryOperator::CreateAdd(
-            Val111,
-            // e5 = e4 * 151
-            Builder.CreateMul(
-                Val151,
-                // e4 = e2 + 23
-                Builder.CreateAdd(
-                    Val23,
-                    // e3 = e2 * 39
-                    Builder.CreateMul(
-                        Val39,
-                        // e2 = e0 + e1
-                        Builder.CreateAdd(
-                            // e0 = a ^ b
-                            Builder.CreateXor(BinOp->getOperand(0),
-                                              BinOp->getOperand(1)),
-                            // e1 = 2 * (a & b)
-                            Builder.CreateMul(
-                                Val2, Builder.CreateAnd(BinOp->getOperand(0),
-                                                        BinOp->getOperand(1))))
-                    ) // e3 = e2 * 39
-                ) // e4 = e2 + 23
-            ) // e5 = e4 * 151
-        ); // E = e5 + 111
-
-    // The following is visible only if you pass -debug on the command line
-    // *and* you have an assert build.
-    LLVM_DEBUG(dbgs() << *BinOp << " -> " << *NewInst << "\n");
+// The substitution is implemented by the MBA engine (see MBA.cpp), which
+// holds the identity above as the one for 8-bit add.
+static MBA::Options getPresetOptions(MBA::Options Opts) {
+  Opts.Operators = MBA::Add;
+  Opts.Width = 8;
+  return Opts;
+}
 
-    // Replace `(a + b)` (original instructions) with `(((a ^ b) + 2 * (a & b))
-    // * 39 + 23) * 151 + 111` (the new instruction)
-    ReplaceInstWithInst(&BB, Inst, NewInst);
-    Changed = true;
+MBAAdd::MBAAdd(MBA::Options Opts) : Engine(getPresetOptions(Opts)) {}
 
-    // Update the statistics
-    ++SubstCount;
-  }
-  return Changed;
+bool MBAAdd::runOnBasicBlock(BasicBlock &BB) {
+  return Engine.runOnBasicBlock(BB);
 }
 
 PreservedAnalyses MBAAdd::run(llvm::Function &F,
-                              llvm::FunctionAnalysisManager &) {
-  bool Changed = false;
-
-  for (auto &BB : F) {
-    Changed |= runOnBasicBlock(BB);
-  }
-  return (Changed ? llvm::PreservedAnalyses::none()
-                  : llvm::PreservedAnalyses::all());
+                              llvm::FunctionAnalysisManager &FAM) {
+  return Engine.run(F, FAM);
 }
 
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses the (budget) options of mba-add, e.g.
+// `mba-add<hot-loop=50;budget=100>`. Returns nothing if Name is not a valid
+// mba-add pipeline element.
+static std::optional<MBAAdd> parseMBAAdd(StringRef Name) {
+  if (!Name.consume_front("mba-add"))
+    return std::nullopt;
+
+  if (Name.empty())
+    return MBAAdd();
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  MBA::Options Opts;
+  SmallVector<StringRef, 2> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options)
+    if (!MBA::parseBudgetOption(Option, Opts))
+      return std::nullopt;
+
+  return MBAAdd(Opts);
+}
+
 llvm::PassPluginLibraryInfo getMBAAddPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "mba-add", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, FunctionPassManager &FPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "mba-add") {
-                    FPM.addPass(MBAAdd());
+                  if (auto Pass = parseMBAAdd(Name)) {
+                    FPM.addPass(std::move(*Pass));
                     return true;
                   }
                   return false;
@@ -143,7 +95,9 @@ llvm::PassPluginLibraryInfo getMBAAddPluginInfo() {
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getMBAAddPluginInfo();
 }
+#endif
@@ -7,11 +7,15 @@
 //    (MBA). This pass performs an instruction substitution based on this
 //    equality:
 //      a - b == (a + ~b) + 1
-//    See formula 2.2 (j) in [1].
+//    See formula 2.2 (j) in [1]. This is a preset of the MBA pass (see
+//    MBA.cpp).
 //
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBASub.so `\`
 //        -passes=-"mba-sub" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libMBASub.so `\`
+//        -passes="mba-sub<hot-loop=50;budget=100>" <bitcode-file>
+//    The options (see MBA.cpp) limit the substitutions in hot code.
 //
 //  [1] "Hacker's Delight" by Henry S. Warren, Jr.
 //
@@ -19,87 +23,70 @@
 //==============================================================================
 #include "MBASub.h"
 
-#include "llvm/ADT/Statistic.h"
-#include "llvm/IR/IRBuilder.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
-#include <random>
+#include <optional>
 
 using namespace llvm;
 
-#define DEBUG_TYPE "mba-sub"
-
-STATISTIC(SubstCount, "The # of substituted instructions");
-
 //-----------------------------------------------------------------------------
 // MBASub Implementaion
 //-----------------------------------------------------------------------------
-bool MBASub::runOnBasicBlock(BasicBlock &BB) {
-  bool Changed = false;
-
-  // Loop over all instructions in the block. Replacing instructions requires
-  // iterators, hence a for-range loop wouldn't be suitable.
-  for (auto Inst = BB.begin(), IE = BB.end(); Inst != IE; ++Inst) {
-
-    // Skip non-binary (e.g. unary or compare) instruction.
-    auto *BinOp = dyn_cast<BinaryOperator>(Inst);
-    if (!BinOp)
-      continue;
-
-    /// Skip instructions other than integer sub.
-    unsigned Opcode = BinOp->getOpcode();
-    if (Opcode != Instruction::Sub || !BinOp->getType()->isIntegerTy())
-      continue;
-
-    // A uniform API for creating instructions and inserting
-    // them into basic blocks.
-    IRBuilder<> Builder(BinOp);
-
-    // Create an instruction representing (a + ~b) + 1
-    Instruction *NewValue = BinaryOperator::CreateAdd(
-        Builder.CreateAdd(BinOp->getOperand(0),
-                          Builder.CreateNot(BinOp->getOperand(1))),
-        ConstantInt::get(BinOp->getType(), 1));
-
-    // The following is visible only if you pass -debug on the command line
-    // *and* you have an assert build.
-    LLVM_DEBUG(dbgs() << *BinOp << " -> " << *NewValue << "\n");
+// The substitution is implemented by the MBA engine (see MBA.cpp), which
+// holds the identity above as the one for sub.
+static MBA::Options getPresetOptions(MBA::Options Opts) {
+  Opts.Operators = MBA::Sub;
+  Opts.Width = 0;
+  return Opts;
+}
 
-    // Replace `(a - b)` (original instructions) with `(a + ~b) + 1`
-    // (the new instruction)
-    ReplaceInstWithInst(&BB, Inst, NewValue);
-    Changed = true;
+MBASub::MBASub(MBA::Options Opts) : Engine(getPresetOptions(Opts)) {}
 
-    // Update the statistics
-    ++SubstCount;
-  }
-  return Changed;
+bool MBASub::runOnBasicBlock(BasicBlock &BB) {
+  return Engine.runOnBasicBlock(BB);
 }
 
 PreservedAnalyses MBASub::run(llvm::Function &F,
-                              llvm::FunctionAnalysisManager &) {
-  bool Changed = false;
-
-  for (auto &BB : F) {
-    Changed |= runOnBasicBlock(BB);
-  }
-  return (Changed ? llvm::PreservedAnalyses::none()
-                  : llvm::PreservedAnalyses::all());
+                              llvm::FunctionAnalysisManager &FAM) {
+  return Engine.run(F, FAM);
 }
 
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses the (budget) options of mba-sub, e.g.
+// `mba-sub<hot-loop=50;budget=100>`. Returns nothing if Name is not a valid
+// mba-sub pipeline element.
+static std::optional<MBASub> parseMBASub(StringRef Name) {
+  if (!Name.consume_front("mba-sub"))
+    return std::nullopt;
+
+  if (Name.empty())
+    return MBASub();
+
+  if (!Name.consume_front("<") || !Name.consume_back(">"))
+    return std::nullopt;
+
+  MBA::Options Opts;
+  SmallVector<StringRef, 2> Options;
+  SplitString(Name, Options, ";");
+  for (StringRef Option : Options)
+    if (!MBA::parseBudgetOption(Option, Opts))
+      return std::nullopt;
+
+  return MBASub(Opts);
+}
+
 llvm::PassPluginLibraryInfo getMBASubPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "mba-sub", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, FunctionPassManager &FPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "mba-sub") {
-                    FPM.addPass(MBASub());
+                  if (auto Pass = parseMBASub(Name)) {
+                    FPM.addPass(std::move(*Pass));
                     return true;
                   }
                   return false;
@@ -107,7 +94,9 @@ llvm::PassPluginLibraryInfo getMBASubPluginInfo() {
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getMBASubPluginInfo();
 }
+#endif
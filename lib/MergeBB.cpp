@@ -18,12 +18,37 @@
 //  Only qualifying basic blocks are merged. The edge(s) from (potentially
 //  multiple) BB0 to BB1, must be one of the following instructions:
 //    * conditional branch
-//    * unconditional branch, and
+//    * unconditional branch
 //    * switch
-//  For the edges from BB1 to BBsucc and BB2 to BBsucc, only unconditional
-//  branch instructions are allowed. Finally, BB1 is identical to BB2 iff all
-//  instructions in BB1 are identical to the instructions in BB2. For finer
-//  details please consult the implementation.
+//    * indirect branch (the address of BB1 is replaced with the address of
+//      BB2, hence it must not be used for anything other than the address
+//      operand of indirectbr - otherwise the addresses of two different
+//      labels would compare equal), and
+//    * invoke, provided that BB1 is the normal destination
+//  The same applies to the edges into BB2. For the edges from BB1 to BBsucc
+//  and BB2 to BBsucc, only unconditional branch instructions are allowed.
+//  BB1 and BB2 must not contain PHI nodes and for every PHI node in BBsucc,
+//  the values coming from BB1 and BB2 must either be identical or be
+//  corresponding instructions in BB1 and BB2. Finally, BB1 is identical to
+//  BB2 iff all instructions in BB1 are identical to the instructions in BB2.
+//  For finer details please consult the implementation.
+//
+//  By default, every block is visited once and the merged blocks are only
+//  deleted at the end. Merging BB1 into BB2 redirects the predecessors of BB1
+//  to BB2, which might make these predecessors identical, i.e. mergeable.
+//  With `merge-bb<fixed-point>` these are revisited (via a worklist) until no
+//  more blocks can be merged.
+//
+//  Successors can have thousands of predecessors (e.g. in switch-heavy code),
+//  so BB1 is not compared against all of them. Instead, the predecessors of
+//  every successor are bucketed by a structural hash (opcodes, types and
+//  operands of their instructions, and the values passed to the PHI nodes in
+//  the successor). Only blocks with identical hashes are compared
+//  instruction-by-instruction.
+//
+//  The summaries, the search for the blocks to merge and the rewrite (i.e.
+//  updating the branches and deleting the merged blocks) are timed and
+//  counted separately, see PhaseStats.h.
 //
 //  This pass will to some extent revert the modifications introduced by
 //  DuplicateBB. The qualifying clones (lt-clone-1-BBId and lt-clone-2-BBid)
@@ -34,11 +59,17 @@
 // USAGE:
 //    $ opt -load-pass-plugin <BUILD_DIR>/lib/libMergeBB.so `\`
 //      -passes=merge-bb -S <bitcode-file>
+//    or, to iterate to a fixed point:
+//    $ opt -load-pass-plugin <BUILD_DIR>/lib/libMergeBB.so `\`
+//      -passes="merge-bb<fixed-point>" -S <bitcode-file>
 //
 // License: MIT
 //=============================================================================
 #include "MergeBB.h"
+#include "PhaseStats.h"
 
+#include "llvm/ADT/Hashing.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
@@ -48,6 +79,8 @@
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Debug.h"
 
+#include <optional>
+
 using namespace llvm;
 
 #define DEBUG_TYPE "MergeBB"
@@ -55,19 +88,26 @@ using namespace llvm;
 STATISTIC(NumDedupBBs, "Number of basic blocks merged");
 STATISTIC(OverallNumOfUpdatedBranchTargets, "Number of updated branch targets");
 
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "merge-bb";
+
 //-----------------------------------------------------------------------------
 // MergeBB Implementation
 //-----------------------------------------------------------------------------
 bool MergeBB::canRemoveInst(const Instruction *Inst) {
   assert(Inst->hasOneUse() && "Inst needs to have exactly one use");
 
-  auto *PNUse = dyn_cast<PHINode>(*Inst->user_begin());
+  const Use &InstUse = *Inst->use_begin();
+  auto *PNUse = dyn_cast<PHINode>(InstUse.getUser());
   auto *Succ = Inst->getParent()->getTerminator()->getSuccessor(0);
-  auto *User = cast<Instruction>(*Inst->user_begin());
+  auto *User = cast<Instruction>(InstUse.getUser());
 
+  // Check the incoming block of this particular use rather than looking up
+  // the incoming value for Inst's block - the latter is linear in the number
+  // of predecessors of Succ.
   bool SameParentBB = (User->getParent() == Inst->getParent());
   bool UsedInPhi = (PNUse && PNUse->getParent() == Succ &&
-                    PNUse->getIncomingValueForBlock(Inst->getParent()) == Inst);
+                    PNUse->getIncomingBlock(InstUse) == Inst->getParent());
 
   return UsedInPhi || SameParentBB;
 }
@@ -79,6 +119,11 @@ bool MergeBB::canMergeInstructions(ArrayRef<Instruction *> Insts) {
   if (!Inst1->isSameOperationAs(Inst2))
     return false;
 
+  // Merging blocks with PHI nodes would require updating the PHI nodes in the
+  // retained block with the incoming blocks of the erased one
+  if (isa<PHINode>(Inst1))
+    return false;
+
   // Each instruction must have exactly zero or one use.
   bool HasUse = !Inst1->user_empty();
   for (auto *I : Insts) {
@@ -93,6 +138,14 @@ bool MergeBB::canMergeInstructions(ArrayRef<Instruction *> Insts) {
   if (HasUse) {
     if (!canRemoveInst(Inst1) || !canRemoveInst(Inst2))
       return false;
+
+    // Values passed to PHI nodes in the successor must flow into the same PHI
+    // node, otherwise the PHI nodes would be swapped for the predecessors of
+    // Inst1's block
+    const User *User1 = *Inst1->user_begin();
+    const User *User2 = *Inst2->user_begin();
+    if ((isa<PHINode>(User1) || isa<PHINode>(User2)) && User1 != User2)
+      return false;
   }
 
   // Make sure that Inst1 and Inst2 have identical operands.
@@ -106,77 +159,200 @@ bool MergeBB::canMergeInstructions(ArrayRef<Instruction *> Insts) {
   return true;
 }
 
-// Get the number of non-debug instructions in BB
-static unsigned getNumNonDbgInstrInBB(BasicBlock *BB) {
-  unsigned Count = 0;
-  for (Instruction &Instr : *BB)
-    if (!isa<DbgInfoIntrinsic>(Instr))
-      Count++;
-  return Count;
+bool MergeBB::isSupportedPredecessor(const BasicBlock *Pred,
+                                     const BasicBlock *BB) {
+  const Instruction *Term = Pred->getTerminator();
+  if (isa<BranchInst>(Term) || isa<SwitchInst>(Term) ||
+      isa<IndirectBrInst>(Term))
+    return true;
+
+  // The unwind destination is an EH pad and can only be replaced with another
+  // EH pad
+  if (auto *Invoke = dyn_cast<InvokeInst>(Term))
+    return Invoke->getUnwindDest() != BB;
+
+  return false;
+}
+
+bool MergeBB::hasEscapingAddress(const BasicBlock *BB) {
+  if (!BB->hasAddressTaken())
+    return false;
+
+  BlockAddress *BA = BlockAddress::lookup(BB);
+  return BA && !llvm::all_of(BA->uses(), [](const Use &U) {
+    return isa<IndirectBrInst>(U.getUser()) && U.getOperandNo() == 0;
+  });
 }
 
-unsigned MergeBB::updateBranchTargets(BasicBlock *BBToErase, BasicBlock *BBToRetain) {
-  SmallVector<BasicBlock *, 8> BBToUpdate(predecessors(BBToErase));
+BlockSummaryMap MergeBB::summarizeBlocks(Function &F) {
+  BlockSummaryMap Summaries;
+  for (BasicBlock &BB : F) {
+    BlockSummary &Summary = Summaries[&BB];
+    Summary.HasSupportedPreds =
+        llvm::all_of(predecessors(&BB), [&BB](const BasicBlock *Pred) {
+          return isSupportedPredecessor(Pred, &BB);
+        });
+    Summary.HasEscapingAddress = hasEscapingAddress(&BB);
+
+    hash_code Hash = 0;
+    for (Instruction &Instr : BB) {
+      if (isa<DbgInfoIntrinsic>(Instr))
+        continue;
+      Summary.NumNonDbgInsts++;
+      if (Instr.isTerminator())
+        continue;
+
+      Summary.LastNonDbgInst = &Instr;
+      Hash = hash_combine(Hash, Instr.getOpcode(), Instr.getType(),
+                          Instr.getNumOperands());
+      for (const Value *Opnd : Instr.operands())
+        Hash = hash_combine(Hash, Opnd);
+    }
+    Summary.InstsHash = Hash;
+  }
+  return Summaries;
+}
+
+// Get the summary of BB
+static const BlockSummary &getSummary(const BlockSummaryMap &Summaries,
+                                      const BasicBlock *BB) {
+  auto It = Summaries.find(BB);
+  assert(It != Summaries.end() && "Block has not been summarized");
+  return It->second;
+}
+
+// Returns true if InVal is an instruction defined in BB
+static bool isDefinedIn(const Value *InVal, const BasicBlock *BB) {
+  auto *InInst = dyn_cast_or_null<Instruction>(InVal);
+  return InInst && InInst->getParent() == BB;
+}
+
+uint64_t MergeBB::getStructuralHash(const BlockSummaryMap &Summaries,
+                                    const BasicBlock *BB,
+                                    ArrayRef<Value *> InVals) {
+  hash_code Hash = getSummary(Summaries, BB).InstsHash;
+
+  // Values defined in BB can only be matched with values defined in the other
+  // block, so these are hashed by position rather than by identity
+  for (const Value *InVal : InVals) {
+    if (isDefinedIn(InVal, BB))
+      Hash = hash_combine(Hash, true);
+    else
+      Hash = hash_combine(Hash, false, InVal);
+  }
+  return Hash;
+}
+
+// Returns the values that BB passes to the PHI nodes in its successor
+static ArrayRef<Value *> getIncomingValues(const MergeCandidates &Candidates,
+                                           const BasicBlock *BB) {
+  auto It = Candidates.IncomingValues.find(BB);
+  if (It == Candidates.IncomingValues.end())
+    return {};
+  return It->second;
+}
+
+// Collects the predecessors of BBSucc and buckets them by their structural
+// hash
+static MergeCandidates
+computeMergeCandidates(const BlockSummaryMap &Summaries, BasicBlock *BBSucc) {
+  MergeCandidates Res;
+  unsigned PHIIdx = 0;
+  for (const PHINode &PN : BBSucc->phis()) {
+    for (unsigned Idx = 0, E = PN.getNumIncomingValues(); Idx != E; ++Idx) {
+      // Blocks with multiple edges into BBSucc pass the same value along
+      // every edge, so record the first one only
+      auto &InVals = Res.IncomingValues[PN.getIncomingBlock(Idx)];
+      if (InVals.size() == PHIIdx)
+        InVals.push_back(PN.getIncomingValue(Idx));
+    }
+    PHIIdx++;
+  }
 
+  for (BasicBlock *Pred : predecessors(BBSucc)) {
+    // Skip the blocks that have already been merged
+    if (!Summaries.count(Pred))
+      continue;
+    uint64_t Hash = MergeBB::getStructuralHash(
+        Summaries, Pred, getIncomingValues(Res, Pred));
+    Res.Buckets[Hash].push_back(Pred);
+  }
+
+  return Res;
+}
+
+unsigned MergeBB::updateBranchTargets(BasicBlock *BBToErase, BasicBlock *BBToRetain) {
   LLVM_DEBUG(dbgs() << "DEDUP BB: merging duplicated blocks ("
                     << BBToErase->getName() << " into " << BBToRetain->getName()
                     << ")\n");
 
+  // The terminators of the predecessors of BBToErase are branches
+  // (conditional or unconditional), switch statements, indirect branches or
+  // invokes. Replace the targets that are BBToErase with BBToRetain. Visit
+  // the uses of BBToErase rather than all the operands of these terminators -
+  // a switch can have thousands of targets.
   unsigned UpdatedTargetsCount = 0;
-  for (BasicBlock *BB0 : BBToUpdate) {
-    // The terminator is either a branch (conditional or unconditional) or a
-    // switch statement. One of its targets should be BBToErase. Replace
-    // that target with BBToRetain.
-    Instruction *Term = BB0->getTerminator();
-    for (unsigned OpIdx = 0, NumOpnds = Term->getNumOperands();
-         OpIdx != NumOpnds; ++OpIdx) {
-      if (Term->getOperand(OpIdx) == BBToErase) {
-        Term->setOperand(OpIdx, BBToRetain);
-        UpdatedTargetsCount++;
-      }
-    }
+  for (Use &U : llvm::make_early_inc_range(BBToErase->uses())) {
+    auto *Term = dyn_cast<Instruction>(U.getUser());
+    if (!Term || !Term->isTerminator())
+      continue;
+
+    U.set(BBToRetain);
+    UpdatedTargetsCount++;
   }
 
+  // Indirect branches jump to the address of BBToErase, which has to become
+  // the address of BBToRetain. That's only done if the address is used by
+  // indirectbr and nothing else (see hasEscapingAddress).
+  if (BlockAddress *BA = BlockAddress::lookup(BBToErase))
+    BA->replaceAllUsesWith(BlockAddress::get(BBToRetain));
+
   return UpdatedTargetsCount;
 }
 
-bool MergeBB::mergeDuplicatedBlock(BasicBlock *BB1,
-                                   SmallPtrSet<BasicBlock *, 8> &DeleteList) {
+BasicBlock *MergeBB::mergeDuplicatedBlock(
+    BasicBlock *BB1, SmallPtrSet<BasicBlock *, 8> &DeleteList,
+    MergeCandidatesMap &Candidates, BlockSummaryMap &Summaries,
+    SmallVectorImpl<BasicBlock *> *RedirectedPreds) {
   // Do not optimize the entry block
   if (BB1 == &BB1->getParent()->getEntryBlock())
-    return false;
+    return nullptr;
 
   // Only merge CFG edges of unconditional branch
   BranchInst *BB1Term = dyn_cast<BranchInst>(BB1->getTerminator());
   if (!(BB1Term && BB1Term->isUnconditional()))
-    return false;
+    return nullptr;
 
-  // Do not optimize non-branch and non-switch CFG edges (to keep things
-  // relatively simple)
-  for (auto *B : predecessors(BB1))
-    if (!(isa<BranchInst>(B->getTerminator()) ||
-          isa<SwitchInst>(B->getTerminator())))
-      return false;
+  // Do not optimize CFG edges that can't be redirected (e.g. the unwind edges
+  // of invokes)
+  const BlockSummary &BB1Summary = getSummary(Summaries, BB1);
+  if (!BB1Summary.HasSupportedPreds)
+    return nullptr;
+
+  // Do not merge blocks whose address could be stored or compared - the
+  // address of BB1 would become the address of BB2
+  if (BB1Summary.HasEscapingAddress)
+    return nullptr;
 
   BasicBlock *BBSucc = BB1Term->getSuccessor(0);
 
-  BasicBlock::iterator II = BBSucc->begin();
-  const PHINode *PN = dyn_cast<PHINode>(II);
-  Value *InValBB1 = nullptr;
-  Instruction *InInstBB1 = nullptr;
-  BBSucc->getFirstNonPHI();
-  if (nullptr != PN) {
-    // Do not optimize if multiple PHI instructions exist in the successor (to
-    // keep things relatively simple)
-    if (++II != BBSucc->end() && isa<PHINode>(II))
-      return false;
+  auto CandidatesIt = Candidates.find(BBSucc);
+  if (CandidatesIt == Candidates.end())
+    CandidatesIt =
+        Candidates
+            .try_emplace(BBSucc, computeMergeCandidates(Summaries, BBSucc))
+            .first;
+  const MergeCandidates &SuccCandidates = CandidatesIt->second;
+  ArrayRef<Value *> InValsBB1 = getIncomingValues(SuccCandidates, BB1);
 
-    InValBB1 = PN->getIncomingValueForBlock(BB1);
-    InInstBB1 = dyn_cast<Instruction>(InValBB1);
-  }
+  // Only the blocks with the same hash as BB1 can be identical to BB1
+  auto BucketIt = SuccCandidates.Buckets.find(
+      getStructuralHash(Summaries, BB1, InValsBB1));
+  if (BucketIt == SuccCandidates.Buckets.end())
+    return nullptr;
+
+  for (BasicBlock *BB2 : BucketIt->second) {
 
-  unsigned BB1NumInst = getNumNonDbgInstrInBB(BB1);
-  for (auto *BB2 : predecessors(BBSucc)) {
     // Do not optimize the entry block
     if (BB2 == &BB2->getParent()->getEntryBlock())
       continue;
@@ -186,13 +362,6 @@ bool MergeBB::mergeDuplicatedBlock(BasicBlock *BB1,
     if (!(BB2Term && BB2Term->isUnconditional()))
       continue;
 
-    // Do not optimize non-branch and non-switch CFG edges (to keep things
-    // relatively simple)
-    for (auto *B : predecessors(BB2))
-      if (!(isa<BranchInst>(B->getTerminator()) ||
-            isa<SwitchInst>(B->getTerminator())))
-        continue;
-
     // Skip basic blocks that have already been marked for merging
     if (DeleteList.end() != DeleteList.find(BB2))
       continue;
@@ -201,28 +370,38 @@ bool MergeBB::mergeDuplicatedBlock(BasicBlock *BB1,
     if (BB2 == BB1)
       continue;
 
+    // Do not optimize CFG edges that can't be redirected
+    const BlockSummary &BB2Summary = getSummary(Summaries, BB2);
+    if (!BB2Summary.HasSupportedPreds)
+      continue;
+
     // BB1 and BB2 are definitely different if the number of instructions is
     // not identical
-    if (BB1NumInst != getNumNonDbgInstrInBB(BB2))
+    if (BB1Summary.NumNonDbgInsts != BB2Summary.NumNonDbgInsts)
       continue;
 
-    // Control flow can be merged if incoming values to the PHI node
-    // at the successor are same values or both defined in the BBs to merge.
+    // Control flow can be merged if, for every PHI node at the successor, the
+    // incoming values are same values or both defined in the BBs to merge.
     // For the latter case, canMergeInstructions executes further analysis.
-    if (nullptr != PN) {
-      Value *InValBB2 = PN->getIncomingValueForBlock(BB2);
-      Instruction *InInstBB2 = dyn_cast<Instruction>(InValBB2);
-
-      bool areValuesSimilar = (InValBB1 == InValBB2);
-      bool bothValuesDefinedInParent =
-          ((InInstBB1 && InInstBB1->getParent() == BB1) &&
-           (InInstBB2 && InInstBB2->getParent() == BB2));
-      if (!areValuesSimilar && !bothValuesDefinedInParent)
-        continue;
+    ArrayRef<Value *> InValsBB2 = getIncomingValues(SuccCandidates, BB2);
+    if (InValsBB1.size() != InValsBB2.size())
+      continue;
+
+    bool AreInValsMergeable = true;
+    for (unsigned Idx = 0, E = InValsBB1.size(); Idx != E; ++Idx) {
+      bool areValuesSimilar = (InValsBB1[Idx] == InValsBB2[Idx]);
+      bool bothValuesDefinedInParent = (isDefinedIn(InValsBB1[Idx], BB1) &&
+                                        isDefinedIn(InValsBB2[Idx], BB2));
+      if (!areValuesSimilar && !bothValuesDefinedInParent) {
+        AreInValsMergeable = false;
+        break;
+      }
     }
+    if (!AreInValsMergeable)
+      continue;
 
     // Finally, check that all instructions in BB1 and BB2 are identical
-    LockstepReverseIterator LRI(BB1, BB2);
+    LockstepReverseIterator LRI(BB1, BB2, &Summaries);
     while (LRI.isValid() && canMergeInstructions(*LRI)) {
       --LRI;
     }
@@ -231,33 +410,112 @@ bool MergeBB::mergeDuplicatedBlock(BasicBlock *BB1,
     if (LRI.isValid())
       continue;
 
-    // It is safe to de-duplicate - do so.
+    // It is safe to de-duplicate - do so. Remember the predecessors of BB1
+    // first, skipping the blocks that have been merged already (these still
+    // branch to their original successors).
+    PhaseTimer T(PassArg, "rewrite");
+    SmallVector<BasicBlock *, 4> BB1Preds;
+    for (BasicBlock *Pred : predecessors(BB1))
+      if (!DeleteList.count(Pred))
+        BB1Preds.push_back(Pred);
     unsigned UpdatedTargets = updateBranchTargets(BB1, BB2);
     assert(UpdatedTargets && "No branch target was updated");
     OverallNumOfUpdatedBranchTargets += UpdatedTargets;
+    addPhaseCount(PassArg, "rewrite", "updated-targets", UpdatedTargets);
     DeleteList.insert(BB1);
+    Summaries.erase(BB1);
     NumDedupBBs++;
 
-    return true;
+    // The predecessors of BB1 are now predecessors of BB2. Add them to the
+    // merge candidates for BB2 (if these have been computed already).
+    auto BB2CandidatesIt = Candidates.find(BB2);
+    if (BB2CandidatesIt != Candidates.end()) {
+      MergeCandidates &BB2Candidates = BB2CandidatesIt->second;
+      for (BasicBlock *Pred : BB1Preds) {
+        uint64_t Hash = getStructuralHash(
+            Summaries, Pred, getIncomingValues(BB2Candidates, Pred));
+        BB2Candidates.Buckets[Hash].push_back(Pred);
+      }
+    }
+
+    if (RedirectedPreds)
+      RedirectedPreds->append(BB1Preds.begin(), BB1Preds.end());
+
+    return BB2;
   }
 
-  return false;
+  return nullptr;
 }
 
 PreservedAnalyses MergeBB::run(llvm::Function &Func,
                                llvm::FunctionAnalysisManager &) {
+  BlockSummaryMap Summaries;
+  {
+    PhaseTimer T(PassArg, "summarize");
+    Summaries = summarizeBlocks(Func);
+    addPhaseCount(PassArg, "summarize", "blocks", Summaries.size());
+  }
+
+  return (runOnFunction(Func, Summaries) ? llvm::PreservedAnalyses::none()
+                                         : llvm::PreservedAnalyses::all());
+}
+
+bool MergeBB::runOnFunction(Function &Func, BlockSummaryMap &Summaries) {
   bool Changed = false;
   SmallPtrSet<BasicBlock *, 8> DeleteList;
-  for (auto &BB : Func) {
-    Changed |= mergeDuplicatedBlock(&BB, DeleteList);
+  MergeCandidatesMap Candidates;
+
+  // The merges themselves are timed as "rewrite" (see mergeDuplicatedBlock)
+  std::optional<PhaseTimer> SearchTimer(std::in_place, PassArg, "search");
+  uint64_t NumVisited = 0;
+  if (!FixedPoint) {
+    for (auto &BB : Func) {
+      NumVisited++;
+      Changed |= (nullptr !=
+                  mergeDuplicatedBlock(&BB, DeleteList, Candidates, Summaries));
+    }
+  } else {
+    // Visit the blocks in layout order first. Whenever BB is merged into
+    // another block, the predecessors of BB are revisited - these now share
+    // a successor with the predecessors of the retained block and might have
+    // become mergeable.
+    SmallVector<BasicBlock *, 32> Worklist;
+    SmallPtrSet<BasicBlock *, 32> InWorklist;
+    for (BasicBlock &BB : llvm::reverse(Func)) {
+      Worklist.push_back(&BB);
+      InWorklist.insert(&BB);
+    }
+
+    while (!Worklist.empty()) {
+      BasicBlock *BB = Worklist.pop_back_val();
+      InWorklist.erase(BB);
+      if (DeleteList.count(BB))
+        continue;
+
+      NumVisited++;
+      SmallVector<BasicBlock *, 4> RedirectedPreds;
+      if (!mergeDuplicatedBlock(BB, DeleteList, Candidates, Summaries,
+                                &RedirectedPreds))
+        continue;
+
+      Changed = true;
+      for (BasicBlock *Pred : RedirectedPreds)
+        if (InWorklist.insert(Pred).second)
+          Worklist.push_back(Pred);
+    }
   }
 
+  addPhaseCount(PassArg, "search", "visited-blocks", NumVisited);
+  addPhaseCount(PassArg, "search", "successors", Candidates.size());
+  SearchTimer.reset();
+
+  PhaseTimer T(PassArg, "rewrite");
   for (BasicBlock *BB : DeleteList) {
     DeleteDeadBlock(BB);
   }
+  addPhaseCount(PassArg, "rewrite", "merged-blocks", DeleteList.size());
 
-  return (Changed ? llvm::PreservedAnalyses::none()
-                  : llvm::PreservedAnalyses::all());
+  return Changed;
 }
 
 //-----------------------------------------------------------------------------
@@ -273,22 +531,28 @@ llvm::PassPluginLibraryInfo getMergeBBPluginInfo() {
                     FPM.addPass(MergeBB());
                     return true;
                   }
+                  if (Name == "merge-bb<fixed-point>") {
+                    FPM.addPass(MergeBB(/*FixedPoint=*/true));
+                    return true;
+                  }
                   return false;
                 });
           }};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getMergeBBPluginInfo();
 }
+#endif
 
 //------------------------------------------------------------------------------
 // Helper data structures
 //------------------------------------------------------------------------------
-LockstepReverseIterator::LockstepReverseIterator(BasicBlock *BB1In,
-                                                 BasicBlock *BB2In)
-    : BB1(BB1In), BB2(BB2In), Fail(false) {
+LockstepReverseIterator::LockstepReverseIterator(
+    BasicBlock *BB1In, BasicBlock *BB2In, const BlockSummaryMap *Summaries)
+    : BB1(BB1In), BB2(BB2In), Summaries(Summaries), Fail(false) {
   Insts.clear();
 
   Instruction *InstBB1 = getLastNonDbgInst(BB1);
@@ -304,6 +568,12 @@ LockstepReverseIterator::LockstepReverseIterator(BasicBlock *BB1In,
 }
 
 Instruction *LockstepReverseIterator::getLastNonDbgInst(BasicBlock *BB) {
+  if (Summaries) {
+    auto It = Summaries->find(BB);
+    assert(It != Summaries->end() && "Block has not been summarized");
+    return It->second.LastNonDbgInst;
+  }
+
   Instruction *Inst = BB->getTerminator();
 
   do {
@@ -6,6 +6,14 @@
 //    Visits all instructions in a function and counts how many times every
 //    LLVM IR opcode was used. Prints the output to stderr.
 //
+//    The counts are kept in a dense array indexed by the opcode, so counting
+//    doesn't involve any hashing. The opcode names are only looked up when
+//    printing.
+//
+//    The module-level variant merges the histograms of all functions (which
+//    are computed in parallel) and can also print them as JSON or CSV. See
+//    tools/StaticMain.cpp for aggregating the results over many modules.
+//
 //    This example demonstrates how to insert your pass at one of the
 //    predefined extension points, e.g. whenever the vectoriser is run (i.e. via
 //    `registerVectorizerStartEPCallback` for the new PM).
@@ -15,19 +23,43 @@
 //      opt -load-pass-plugin libOpcodeCounter.dylib `\`
 //        -passes="print<opcode-counter>" `\`
 //        -disable-output <input-llvm-file>
-//    2. Automatically through an optimisation pipeline - new PM
+//    2. Automatically through an optimisation pipeline - new PM (only with
+//       libOpcodeCounter, not with libLLVMTutor or LLVMTutorStatic)
 //      opt -load-pass-plugin libOpcodeCounter.dylib --passes='default<O1>' `\`
 //        -disable-output <input-llvm-file>
+//    3. As one tab-separated record per opcode (see ResultPrinter.h):
+//      opt -load-pass-plugin libOpcodeCounter.dylib `\`
+//        -passes="print<opcode-counter;format=compact>" `\`
+//        -disable-output <input-llvm-file>
+//    4. For the whole module (format is one of text, json or csv):
+//      opt -load-pass-plugin libOpcodeCounter.dylib `\`
+//        -passes="print<module-opcode-counter;format=json>" `\`
+//        -disable-output <input-llvm-file>
 //
 // License: MIT
 //=============================================================================
 #include "OpcodeCounter.h"
+#include "PhaseStats.h"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+#include <algorithm>
+#include <optional>
+#include <vector>
 
 using namespace llvm;
 
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "opcode-counter";
+
 // Pretty-prints the result of this analysis
 static void printOpcodeCounterResult(llvm::raw_ostream &,
                               const ResultOpcodeCounter &OC);
@@ -37,32 +69,81 @@ static void printOpcodeCounterResult(llvm::raw_ostream &,
 //-----------------------------------------------------------------------------
 llvm::AnalysisKey OpcodeCounter::Key;
 
-OpcodeCounter::Result OpcodeCounter::generateOpcodeMap(llvm::Function &Func) {
-  OpcodeCounter::Result OpcodeMap;
+unsigned OpcodeHistogram::total() const {
+  unsigned Total = 0;
+  for (unsigned Opcode : UsedOpcodes)
+    Total += Counts[Opcode];
+  return Total;
+}
 
-  for (auto &BB : Func) {
-    for (auto &Inst : BB) {
-      StringRef Name = Inst.getOpcodeName();
+unsigned OpcodeHistogram::lookup(StringRef OpcodeName) const {
+  // Only the opcodes that were used can have a non-zero count
+  for (unsigned Opcode : UsedOpcodes)
+    if (OpcodeName == Instruction::getOpcodeName(Opcode))
+      return Counts[Opcode];
+  return 0;
+}
 
-      if (OpcodeMap.find(Name) == OpcodeMap.end()) {
-        OpcodeMap[Inst.getOpcodeName()] = 1;
-      } else {
-        OpcodeMap[Inst.getOpcodeName()]++;
-      }
-    }
+void OpcodeHistogram::merge(const OpcodeHistogram &Other) {
+  for (unsigned Opcode : Other.UsedOpcodes) {
+    if (Counts[Opcode] == 0)
+      UsedOpcodes.push_back(Opcode);
+    Counts[Opcode] += Other.Counts[Opcode];
   }
+}
+
+ResultOpcodeCounter OpcodeHistogram::toOpcodeMap() const {
+  ResultOpcodeCounter OpcodeMap;
+
+  for (unsigned Opcode : UsedOpcodes)
+    OpcodeMap[Instruction::getOpcodeName(Opcode)] = Counts[Opcode];
 
   return OpcodeMap;
 }
 
+OpcodeCounter::Result OpcodeCounter::generateHistogram(llvm::Function &Func) {
+  OpcodeCounter::Result Histogram;
+
+  for (auto &BB : Func)
+    for (auto &Inst : BB)
+      Histogram.add(Inst);
+
+  return Histogram;
+}
+
+ResultOpcodeCounter OpcodeCounter::generateOpcodeMap(llvm::Function &Func) {
+  return generateHistogram(Func).toOpcodeMap();
+}
+
 OpcodeCounter::Result OpcodeCounter::run(llvm::Function &Func,
                                          llvm::FunctionAnalysisManager &) {
-  return generateOpcodeMap(Func);
+  PhaseTimer T(PassArg, "function");
+  Result Histogram = generateHistogram(Func);
+  addPhaseCount(PassArg, "function", "instructions", Histogram.total());
+  return Histogram;
 }
 
 PreservedAnalyses OpcodeCounterPrinter::run(Function &Func,
                                             FunctionAnalysisManager &FAM) {
-  auto &OpcodeMap = FAM.getResult<OpcodeCounter>(Func);
+  printResult(OS, Func, FAM.getResult<OpcodeCounter>(Func), Format);
+  return PreservedAnalyses::all();
+}
+
+void OpcodeCounterPrinter::printResult(raw_ostream &OS, const Function &Func,
+                                       const OpcodeHistogram &Histogram,
+                                       ResultFormat Format) {
+  if (Format == ResultFormat::Compact) {
+    // In the order of first use - unlike for the table, there's no need to
+    // build the opcode map
+    ResultStream OutS(OS, Func.getParent());
+    for (unsigned Opcode : Histogram.usedOpcodes())
+      OutS.record("opcode-counter")
+          .field(Func)
+          .field(Instruction::getOpcodeName(Opcode))
+          .field(Histogram.lookup(Opcode))
+          .endRecord();
+    return;
+  }
 
   // In the legacy PM, the following string is printed automatically by the
   // pass manager. For the sake of consistency, we're adding this here so that
@@ -70,56 +151,169 @@ PreservedAnalyses OpcodeCounterPrinter::run(Function &Func,
   OS << "Printing analysis 'OpcodeCounter Pass' for function '"
      << Func.getName() << "':\n";
 
-  printOpcodeCounterResult(OS, OpcodeMap);
+  printOpcodeCounterResult(OS, Histogram.toOpcodeMap());
+}
+
+//-----------------------------------------------------------------------------
+// ModuleOpcodeCounter implementation
+//-----------------------------------------------------------------------------
+llvm::AnalysisKey ModuleOpcodeCounter::Key;
+
+ModuleOpcodeCounter::Result ModuleOpcodeCounter::countOpcodes(Module &M) {
+  std::vector<Function *> Functions;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  // Every thread is given a contiguous chunk of functions. Small modules are
+  // not worth the overhead of spawning threads.
+  constexpr size_t MinFunctionsPerChunk = 16;
+  size_t NumChunks =
+      std::min<size_t>(hardware_concurrency().compute_thread_count(),
+                       Functions.size() / MinFunctionsPerChunk);
+  NumChunks = std::max<size_t>(NumChunks, 1);
+  size_t ChunkSize = divideCeil(Functions.size(), NumChunks);
+
+  auto CountChunk = [&Functions, ChunkSize](size_t Chunk) {
+    OpcodeHistogram Histogram;
+    size_t End = std::min(Functions.size(), (Chunk + 1) * ChunkSize);
+    for (size_t Idx = Chunk * ChunkSize; Idx < End; Idx++)
+      Histogram.merge(OpcodeCounter().generateHistogram(*Functions[Idx]));
+    return Histogram;
+  };
+
+  if (NumChunks == 1)
+    return CountChunk(0);
+
+  // The analysis only reads the IR, so the functions can be visited
+  // concurrently. Every worker writes to its own slot, so no locking is
+  // required.
+  std::vector<OpcodeHistogram> Partial(NumChunks);
+  {
+    DefaultThreadPool Pool(hardware_concurrency(NumChunks));
+    for (size_t Chunk = 0; Chunk < NumChunks; Chunk++)
+      Pool.async([&, Chunk] { Partial[Chunk] = CountChunk(Chunk); });
+    Pool.wait();
+  }
+
+  OpcodeHistogram Histogram;
+  for (const OpcodeHistogram &Chunk : Partial)
+    Histogram.merge(Chunk);
+  return Histogram;
+}
+
+ModuleOpcodeCounter::Result
+ModuleOpcodeCounter::run(llvm::Module &M, llvm::ModuleAnalysisManager &) {
+  // Not in countOpcodes - the timers must not be used by the worker threads
+  PhaseTimer T(PassArg, "module");
+  Result Histogram = countOpcodes(M);
+  addPhaseCount(PassArg, "module", "instructions", Histogram.total());
+  return Histogram;
+}
+
+PreservedAnalyses ModuleOpcodeCounterPrinter::run(Module &M,
+                                                  ModuleAnalysisManager &MAM) {
+  auto &Histogram = MAM.getResult<ModuleOpcodeCounter>(M);
+
+  if (Format == OpcodeStatsFormat::Text)
+    OS << "Printing analysis 'OpcodeCounter Pass' for module '"
+       << M.getName() << "':\n";
+
+  printOpcodeHistogram(OS, Histogram, M.getName(), Format);
   return PreservedAnalyses::all();
 }
 
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses `print<module-opcode-counter>` and
+// `print<module-opcode-counter;format=F>`. Returns nothing if Name is neither.
+static std::optional<OpcodeStatsFormat>
+parseModulePrinterFormat(StringRef Name) {
+  if (!Name.consume_front("print<module-opcode-counter") ||
+      !Name.consume_back(">"))
+    return std::nullopt;
+
+  if (Name.empty())
+    return OpcodeStatsFormat::Text;
+
+  if (!Name.consume_front(";format="))
+    return std::nullopt;
+
+  return StringSwitch<std::optional<OpcodeStatsFormat>>(Name)
+      .Case("text", OpcodeStatsFormat::Text)
+      .Case("json", OpcodeStatsFormat::JSON)
+      .Case("csv", OpcodeStatsFormat::CSV)
+      .Default(std::nullopt);
+}
+
+// Registers everything apart from the extension point (see #3 below)
+static void registerOpcodeCounter(PassBuilder &PB) {
+  // #1 REGISTRATION FOR "opt -passes=print<opcode-counter>"
+  // Register OpcodeCounterPrinter so that it can be used when
+  // specifying pass pipelines with `-passes=`.
+  PB.registerPipelineParsingCallback(
+      [&](StringRef Name, FunctionPassManager &FPM,
+          ArrayRef<PassBuilder::PipelineElement>) {
+        if (auto Format = parsePrinterName(Name, "opcode-counter")) {
+          FPM.addPass(OpcodeCounterPrinter(llvm::errs(), *Format));
+          return true;
+        }
+        return false;
+      });
+  // #2 REGISTRATION FOR "opt -passes=print<module-opcode-counter>"
+  PB.registerPipelineParsingCallback(
+      [&](StringRef Name, ModulePassManager &MPM,
+          ArrayRef<PassBuilder::PipelineElement>) {
+        if (auto Format = parseModulePrinterFormat(Name)) {
+          MPM.addPass(ModuleOpcodeCounterPrinter(llvm::errs(), *Format));
+          return true;
+        }
+        return false;
+      });
+  // #4 REGISTRATION FOR "FAM.getResult<OpcodeCounter>(Func)"
+  // Register OpcodeCounter as an analysis pass. This is required so that
+  // OpcodeCounterPrinter (or any other pass) can request the results
+  // of OpcodeCounter.
+  PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM) {
+    FAM.registerPass([&] { return OpcodeCounter(); });
+  });
+  // #5 REGISTRATION FOR "MAM.getResult<ModuleOpcodeCounter>(M)"
+  PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager &MAM) {
+    MAM.registerPass([&] { return ModuleOpcodeCounter(); });
+  });
+}
+
+// Used when OpcodeCounter is bundled with the other passes, i.e. by
+// libLLVMTutor and by the tools that link LLVMTutorStatic (through
+// Extension.def). These don't add OpcodeCounterPrinter to the optimisation
+// pipelines - only loading libOpcodeCounter does that (see #3 below).
 llvm::PassPluginLibraryInfo getOpcodeCounterPluginInfo() {
-  return {
-    LLVM_PLUGIN_API_VERSION, "OpcodeCounter", LLVM_VERSION_STRING,
-        [](PassBuilder &PB) {
-          // #1 REGISTRATION FOR "opt -passes=print<opcode-counter>"
-          // Register OpcodeCounterPrinter so that it can be used when
-          // specifying pass pipelines with `-passes=`.
-          PB.registerPipelineParsingCallback(
-              [&](StringRef Name, FunctionPassManager &FPM,
-                  ArrayRef<PassBuilder::PipelineElement>) {
-                if (Name == "print<opcode-counter>") {
-                  FPM.addPass(OpcodeCounterPrinter(llvm::errs()));
-                  return true;
-                }
-                return false;
-              });
-          // #2 REGISTRATION FOR "-O{1|2|3|s}"
-          // Register OpcodeCounterPrinter as a step of an existing pipeline.
-          // The insertion point is specified by using the
-          // 'registerVectorizerStartEPCallback' callback. To be more precise,
-          // using this callback means that OpcodeCounterPrinter will be called
-          // whenever the vectoriser is used (i.e. when using '-O{1|2|3|s}'.
-          PB.registerVectorizerStartEPCallback(
-              [](llvm::FunctionPassManager &PM,
-                 llvm::OptimizationLevel Level) {
-                PM.addPass(OpcodeCounterPrinter(llvm::errs()));
-              });
-          // #3 REGISTRATION FOR "FAM.getResult<OpcodeCounter>(Func)"
-          // Register OpcodeCounter as an analysis pass. This is required so that
-          // OpcodeCounterPrinter (or any other pass) can request the results
-          // of OpcodeCounter.
-          PB.registerAnalysisRegistrationCallback(
-              [](FunctionAnalysisManager &FAM) {
-                FAM.registerPass([&] { return OpcodeCounter(); });
-              });
-          }
-        };
+  return {LLVM_PLUGIN_API_VERSION, "OpcodeCounter", LLVM_VERSION_STRING,
+          registerOpcodeCounter};
 }
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
-  return getOpcodeCounterPluginInfo();
+  return {LLVM_PLUGIN_API_VERSION, "OpcodeCounter", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            registerOpcodeCounter(PB);
+            // #3 REGISTRATION FOR "-O{1|2|3|s}"
+            // Register OpcodeCounterPrinter as a step of an existing pipeline.
+            // The insertion point is specified by using the
+            // 'registerVectorizerStartEPCallback' callback. To be more
+            // precise, using this callback means that OpcodeCounterPrinter
+            // will be called whenever the vectoriser is used (i.e. when using
+            // '-O{1|2|3|s}'.
+            PB.registerVectorizerStartEPCallback(
+                [](llvm::FunctionPassManager &PM,
+                   llvm::OptimizationLevel Level) {
+                  PM.addPass(OpcodeCounterPrinter(llvm::errs()));
+                });
+          }};
 }
+#endif
 
 //------------------------------------------------------------------------------
 // Helper functions - implementation
@@ -135,10 +329,41 @@ static void printOpcodeCounterResult(raw_ostream &OutS,
   OutS << format("%-20s %-10s\n", str1, str2);
   OutS << "-------------------------------------------------"
                << "\n";
-  for (auto &Inst : OpcodeMap) {
-    OutS << format("%-20s %-10lu\n", Inst.first().str().c_str(),
-                           Inst.second);
-  }
+  for (auto &Inst : OpcodeMap)
+    OutS << left_justify(Inst.first(), 20) << format(" %-10u\n", Inst.second);
   OutS << "-------------------------------------------------"
                << "\n\n";
 }
+
+void printOpcodeHistogram(raw_ostream &OS, const OpcodeHistogram &Histogram,
+                          StringRef Name, OpcodeStatsFormat Format) {
+  if (Format == OpcodeStatsFormat::Text) {
+    printOpcodeCounterResult(OS, Histogram.toOpcodeMap());
+    return;
+  }
+
+  // Sort by name, so that the output is easy to diff
+  SmallVector<std::pair<StringRef, unsigned>, 16> Opcodes;
+  for (unsigned Opcode : Histogram.usedOpcodes())
+    Opcodes.emplace_back(Instruction::getOpcodeName(Opcode),
+                         Histogram.lookup(Opcode));
+  llvm::sort(Opcodes);
+
+  if (Format == OpcodeStatsFormat::CSV) {
+    OS << "name,opcode,count\n";
+    for (auto &Opcode : Opcodes)
+      OS << Name << "," << Opcode.first << "," << Opcode.second << "\n";
+    return;
+  }
+
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    J.attribute("name", Name);
+    J.attribute("instructions", Histogram.total());
+    J.attributeObject("opcodes", [&] {
+      for (auto &Opcode : Opcodes)
+        J.attribute(Opcode.first, Opcode.second);
+    });
+  });
+  OS << "\n";
+}
@@ -0,0 +1,362 @@
+//==============================================================================
+// FILE:
+//    ParallelFunctions.cpp
+//
+// DESCRIPTION:
+//    Runs function-local llvm-tutor passes (see createParallelFunctionPass for
+//    the list) over the functions of a module on a thread pool. None of these
+//    passes carries any state from one function to another, so the functions
+//    can be processed independently.
+//
+//    However, all functions in a module share one LLVMContext, which is not
+//    thread-safe: creating (or merely using) a constant updates the uniquing
+//    tables and the use-lists that are shared by all functions. Hence every
+//    pass is split into a plan that only reads the IR and runs concurrently
+//    (e.g. the dominator tree, the RIV analysis and the selection of the
+//    blocks for DuplicateBB, or the block summaries for MergeBB) and an apply
+//    that modifies the IR on the calling thread (see ParallelFunctionPass).
+//    Only the plans are parallel - passes that spend most of their time
+//    rewriting the IR (e.g. mba-add) gain little.
+//
+//    The functions are processed in batches (see ParallelFunctions::BatchSize).
+//    Every pass is planned and applied for the whole batch before the next
+//    pass is planned. That gives the same IR as running the passes function
+//    by function: every pass only looks at the function that it runs on. The
+//    output is buffered per function and printed in function order after the
+//    batch, so it's the same as for `function(<passes>)`, no matter how many
+//    threads are used. DuplicateBB seeds its random generator per function
+//    (see DuplicateBB::createRNG), so its output is reproducible too.
+//
+//    The inner passes don't go through the pass instrumentation (e.g.
+//    -print-after-all only sees the adaptor) and they don't use the function
+//    analysis manager. The analyses cached for the modified functions are
+//    invalidated.
+//
+//    Planning and applying are timed and counted (see PhaseStats.h). The
+//    timers of the inner passes are disabled while planning.
+//
+// USAGE:
+//      opt -load-pass-plugin <BUILD_DIR>/lib/libParallelFunctions.so `\`
+//        -passes="parallel<threads=8>(mba-add,duplicate-bb,merge-bb)" `\`
+//        -S <input-llvm-file>
+//    `threads=N` can be omitted (or set to 0), in which case one thread per
+//    hardware thread is used.
+//
+// License: MIT
+//==============================================================================
+#include "ParallelFunctions.h"
+#include "DuplicateBB.h"
+#include "Liveness.h"
+#include "MBA.h"
+#include "MBAAdd.h"
+#include "MBASub.h"
+#include "MergeBB.h"
+#include "OpcodeCounter.h"
+#include "PhaseStats.h"
+#include "RIV.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/RandomNumberGenerator.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+#include <algorithm>
+#include <optional>
+#include <string>
+
+using namespace llvm;
+
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "parallel";
+
+//------------------------------------------------------------------------------
+// The passes
+//------------------------------------------------------------------------------
+namespace {
+// A ParallelFunctionPass that keeps one PlanT per function of the batch. The
+// plan is released as soon as it's applied.
+template <typename PlanT>
+struct PlannedFunctionPass : public ParallelFunctionPass {
+  void startBatch(Module &M, size_t NumFunctions) override {
+    Plans.clear();
+    Plans.resize(NumFunctions);
+  }
+  void plan(Function &F, size_t Idx) override { Plans[Idx] = makePlan(F); }
+  PreservedAnalyses apply(Function &F, size_t Idx, raw_ostream &OS) override {
+    PlanT Plan = std::move(Plans[Idx]);
+    return applyPlan(F, Plan, OS);
+  }
+
+  virtual PlanT makePlan(Function &F) = 0;
+  virtual PreservedAnalyses applyPlan(Function &F, PlanT &Plan,
+                                      raw_ostream &OS) = 0;
+
+  std::vector<PlanT> Plans;
+};
+
+// mba-add and mba-sub: the plan is the list of instructions to rewrite
+struct ParallelMBA : public PlannedFunctionPass<std::vector<MBA::Candidate>> {
+  explicit ParallelMBA(const MBA &Engine) : Engine(Engine) {}
+
+  std::vector<MBA::Candidate> makePlan(Function &F) override {
+    SmallVector<MBA::Candidate, 16> Candidates;
+    Engine.collectCandidates(F, Candidates);
+    return {Candidates.begin(), Candidates.end()};
+  }
+  PreservedAnalyses applyPlan(Function &F, std::vector<MBA::Candidate> &Plan,
+                              raw_ostream &) override {
+    return Engine.rewriteCandidates(Plan) ? PreservedAnalyses::none()
+                                          : PreservedAnalyses::all();
+  }
+
+  MBA Engine;
+};
+
+// merge-bb: the plan is the summary of every block
+struct ParallelMergeBB : public PlannedFunctionPass<BlockSummaryMap> {
+  explicit ParallelMergeBB(bool FixedPoint) : Pass(FixedPoint) {}
+
+  BlockSummaryMap makePlan(Function &F) override {
+    BlockSummaryMap Summaries = MergeBB::summarizeBlocks(F);
+    addPhaseCount("merge-bb", "summarize", "blocks", Summaries.size());
+    return Summaries;
+  }
+  PreservedAnalyses applyPlan(Function &F, BlockSummaryMap &Summaries,
+                              raw_ostream &) override {
+    return Pass.runOnFunction(F, Summaries) ? PreservedAnalyses::none()
+                                            : PreservedAnalyses::all();
+  }
+
+  MergeBB Pass;
+};
+
+// duplicate-bb: the plan is the list of blocks to clone (and their context
+// values). The RIV analysis (and the dominator tree that it requires) are
+// computed while planning.
+struct ParallelDuplicateBB
+    : public PlannedFunctionPass<DuplicateBB::BBToSingleRIVMap> {
+  explicit ParallelDuplicateBB(DuplicateBB Pass) : Pass(std::move(Pass)) {}
+
+  void startBatch(Module &M, size_t NumFunctions) override {
+    PlannedFunctionPass::startBatch(M, NumFunctions);
+    // Shared by all functions, rather than collected by each of them
+    Globals = IntegerGlobals::collectIntegerGlobals(M);
+  }
+  DuplicateBB::BBToSingleRIVMap makePlan(Function &F) override {
+    DominatorTree DT(F);
+    RIV::Result RIVResult =
+        RIV(Pass.Opts.RIVRepr.value_or(RIV::Representation::Flat))
+            .buildRIV(F, DT.getRootNode(), &Globals);
+    DuplicateBB::BBToSingleRIVMap Targets =
+        Pass.findBBsToDuplicate(F, RIVResult, *DuplicateBB::createRNG(F));
+    addPhaseCount("duplicate-bb", "select", "blocks", F.size());
+    addPhaseCount("duplicate-bb", "select", "selected-blocks", Targets.size());
+    return Targets;
+  }
+  PreservedAnalyses applyPlan(Function &F,
+                              DuplicateBB::BBToSingleRIVMap &Targets,
+                              raw_ostream &) override {
+    Pass.duplicateBlocks(Targets);
+    return Targets.empty() ? PreservedAnalyses::all()
+                           : PreservedAnalyses::none();
+  }
+
+  DuplicateBB Pass;
+  IntegerGlobals::Result Globals;
+};
+
+// hello-world (which prints the same as LivenessPrinter, see HelloWorld.cpp)
+// and print<liveness>: the plan is the output
+struct ParallelLivenessPrinter : public PlannedFunctionPass<std::string> {
+  std::string makePlan(Function &F) override {
+    std::string Out;
+    raw_string_ostream OS(Out);
+    LivenessPrinter::printResult(OS, F, Liveness().computeLiveness(F));
+    return Out;
+  }
+  PreservedAnalyses applyPlan(Function &, std::string &Out,
+                              raw_ostream &OS) override {
+    OS << Out;
+    return PreservedAnalyses::all();
+  }
+};
+
+// print<opcode-counter>: the plan is the histogram
+struct ParallelOpcodeCounterPrinter
+    : public PlannedFunctionPass<OpcodeHistogram> {
+  explicit ParallelOpcodeCounterPrinter(ResultFormat Format) : Format(Format) {}
+
+  OpcodeHistogram makePlan(Function &F) override {
+    OpcodeHistogram Histogram = OpcodeCounter().generateHistogram(F);
+    addPhaseCount("opcode-counter", "function", "instructions",
+                  Histogram.total());
+    return Histogram;
+  }
+  PreservedAnalyses applyPlan(Function &F, OpcodeHistogram &Histogram,
+                              raw_ostream &OS) override {
+    OpcodeCounterPrinter::printResult(OS, F, Histogram, Format);
+    return PreservedAnalyses::all();
+  }
+
+  ResultFormat Format;
+};
+} // namespace
+
+std::unique_ptr<ParallelFunctionPass>
+createParallelFunctionPass(StringRef Name) {
+  if (Name == "mba-add")
+    return std::make_unique<ParallelMBA>(MBAAdd().getEngine());
+  if (Name == "mba-sub")
+    return std::make_unique<ParallelMBA>(MBASub().getEngine());
+  if (Name == "merge-bb")
+    return std::make_unique<ParallelMergeBB>(/*FixedPoint=*/false);
+  if (Name == "merge-bb<fixed-point>")
+    return std::make_unique<ParallelMergeBB>(/*FixedPoint=*/true);
+  if (Name == "hello-world" || Name == "print<liveness>")
+    return std::make_unique<ParallelLivenessPrinter>();
+  if (auto Format = parsePrinterName(Name, "opcode-counter"))
+    return std::make_unique<ParallelOpcodeCounterPrinter>(*Format);
+
+  // The profile-guided mode requires BlockFrequencyInfo
+  if (auto Pass = parseDuplicateBB(Name))
+    if (!Pass->Opts.isProfileGuided())
+      return std::make_unique<ParallelDuplicateBB>(std::move(*Pass));
+
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// ParallelFunctions implementation
+//------------------------------------------------------------------------------
+PreservedAnalyses ParallelFunctions::run(Module &M,
+                                         ModuleAnalysisManager &MAM) {
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+  std::vector<Function *> Functions;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  // Without a pool (i.e. with one thread) the plans are made on this thread
+  ThreadPoolStrategy Strategy = hardware_concurrency(NumThreads);
+  unsigned NumWorkers = Strategy.compute_thread_count();
+  std::optional<DefaultThreadPool> Pool;
+  if (NumWorkers > 1 && Functions.size() > 1)
+    Pool.emplace(Strategy);
+
+  auto PlanBatch = [&](ParallelFunctionPass &Pass,
+                       ArrayRef<Function *> Batch) {
+    // More chunks than workers, so that a few big functions don't keep one
+    // worker busy while the others are idle
+    size_t NumChunks = Pool ? std::min<size_t>(Batch.size(), NumWorkers * 8) : 1;
+    size_t ChunkSize = divideCeil(Batch.size(), NumChunks);
+    auto PlanChunk = [&Pass, Batch, ChunkSize](size_t Chunk) {
+      PhaseTimersDisabled NoTimers;
+      size_t End = std::min(Batch.size(), (Chunk + 1) * ChunkSize);
+      for (size_t Idx = Chunk * ChunkSize; Idx < End; Idx++)
+        Pass.plan(*Batch[Idx], Idx);
+    };
+
+    if (!Pool) {
+      PlanChunk(0);
+      return;
+    }
+    for (size_t Chunk = 0; Chunk < NumChunks; Chunk++)
+      Pool->async([&PlanChunk, Chunk] { PlanChunk(Chunk); });
+    Pool->wait();
+  };
+
+  PreservedAnalyses PA = PreservedAnalyses::all();
+  // The output of the functions in the current batch
+  std::vector<std::string> Outputs;
+  for (size_t Begin = 0; Begin < Functions.size(); Begin += BatchSize) {
+    ArrayRef<Function *> Batch = ArrayRef<Function *>(Functions).slice(
+        Begin, std::min(BatchSize, Functions.size() - Begin));
+    Outputs.assign(Batch.size(), std::string());
+
+    for (auto &Pass : Passes) {
+      Pass->startBatch(M, Batch.size());
+      {
+        PhaseTimer T(PassArg, "plan");
+        PlanBatch(*Pass, Batch);
+      }
+
+      PhaseTimer T(PassArg, "apply");
+      for (size_t Idx = 0; Idx < Batch.size(); Idx++) {
+        raw_string_ostream FuncOS(Outputs[Idx]);
+        PreservedAnalyses PassPA = Pass->apply(*Batch[Idx], Idx, FuncOS);
+        FAM.invalidate(*Batch[Idx], PassPA);
+        PA.intersect(std::move(PassPA));
+      }
+    }
+
+    for (const std::string &Out : Outputs)
+      OS << Out;
+    addPhaseCount(PassArg, "plan", "batches");
+  }
+  addPhaseCount(PassArg, "plan", "functions", Functions.size());
+
+  // The analyses of the modified functions have been invalidated above
+  PA.preserveSet<AllAnalysesOn<Function>>();
+  PA.preserve<FunctionAnalysisManagerModuleProxy>();
+  return PA;
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+// Parses `parallel(...)` and `parallel<threads=N>(...)`. Every element of the
+// inner pipeline has to be supported by createParallelFunctionPass. The inner
+// pipeline may be empty - that's how PassBuilder checks whether `parallel` is
+// the name of a module pass.
+static std::optional<ParallelFunctions>
+parseParallelFunctions(StringRef Name,
+                       ArrayRef<PassBuilder::PipelineElement> InnerPipeline) {
+  if (!Name.consume_front("parallel"))
+    return std::nullopt;
+
+  unsigned NumThreads = 0;
+  if (!Name.empty()) {
+    if (!Name.consume_front("<threads=") || !Name.consume_back(">") ||
+        Name.getAsInteger(10, NumThreads))
+      return std::nullopt;
+  }
+
+  ParallelFunctions::PassList Passes;
+  for (const PassBuilder::PipelineElement &Element : InnerPipeline) {
+    if (!Element.InnerPipeline.empty())
+      return std::nullopt;
+    auto Pass = createParallelFunctionPass(Element.Name);
+    if (!Pass)
+      return std::nullopt;
+    Passes.push_back(std::move(Pass));
+  }
+
+  return ParallelFunctions(llvm::errs(), std::move(Passes), NumThreads);
+}
+
+llvm::PassPluginLibraryInfo getParallelFunctionsPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "ParallelFunctions", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement> InnerPipeline) {
+                  if (auto Pass = parseParallelFunctions(Name, InnerPipeline)) {
+                    MPM.addPass(std::move(*Pass));
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getParallelFunctionsPluginInfo();
+}
+#endif
@@ -0,0 +1,249 @@
+//==============================================================================
+// FILE:
+//    PhaseStats.cpp
+//
+// DESCRIPTION:
+//    Implements the phase timers and counters declared in PhaseStats.h. All
+//    the data is kept in one registry that's destroyed (and hence printed)
+//    when LLVM shuts down, i.e. before the options that control the output
+//    (e.g. -time-passes and -info-output-file) are destroyed.
+//
+//    This file is part of every plugin. When multiple plugins are loaded, the
+//    definitions from the plugin that's loaded first are used by all of them
+//    (on Linux). On Darwin every plugin uses its own copy - use the LLVMTutor
+//    plugin instead if the JSON output is required for multiple plugins.
+//
+// License: MIT
+//==============================================================================
+#include "PhaseStats.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
+// Returns the file to write the JSON output to (or nullptr)
+static const char *getJSONPath() {
+  static const char *Path = std::getenv(PhaseStatsEnvVar);
+  return Path;
+}
+
+bool arePhaseStatsEnabled() { return TimePassesIsEnabled || getJSONPath(); }
+
+//------------------------------------------------------------------------------
+// The registry
+//------------------------------------------------------------------------------
+namespace {
+struct PhaseData {
+  std::unique_ptr<Timer> T;
+  // The number of times this phase was timed
+  uint64_t NumRuns = 0;
+  StringMap<uint64_t> Counters;
+};
+
+struct PassData {
+  std::unique_ptr<TimerGroup> Group;
+  // Declared after Group, so that the timers are destroyed first
+  StringMap<PhaseData> Phases;
+};
+
+class PhaseStatsRegistry {
+public:
+  ~PhaseStatsRegistry();
+
+  // Returns the timer for Phase of Pass (creating it, if needed)
+  Timer &startPhase(StringRef Pass, StringRef Phase);
+  void addCount(StringRef Pass, StringRef Phase, StringRef Counter,
+                uint64_t N);
+
+private:
+  PhaseData &getPhase(StringRef Pass, StringRef Phase);
+
+  void printCounters(raw_ostream &OS, StringRef PassName,
+                     const PassData &Pass);
+  void writeJSON(raw_ostream &OS);
+
+  std::mutex Lock;
+  StringMap<PassData> Passes;
+};
+} // namespace
+
+static ManagedStatic<PhaseStatsRegistry> Registry;
+
+// Returns the keys of Map sorted by name, so that the output is stable
+template <typename T>
+static SmallVector<StringRef, 8> getSortedKeys(const StringMap<T> &Map) {
+  SmallVector<StringRef, 8> Keys;
+  for (auto &Entry : Map)
+    Keys.push_back(Entry.getKey());
+  llvm::sort(Keys);
+  return Keys;
+}
+
+PhaseData &PhaseStatsRegistry::getPhase(StringRef PassName,
+                                        StringRef PhaseName) {
+  PassData &Pass = Passes[PassName];
+  if (!Pass.Group)
+    Pass.Group = std::make_unique<TimerGroup>(
+        PassName, ("LLVM-TUTOR: " + PassName + " phases").str());
+
+  PhaseData &Phase = Pass.Phases[PhaseName];
+  if (!Phase.T)
+    Phase.T = std::make_unique<Timer>(PhaseName, PhaseName, *Pass.Group);
+  return Phase;
+}
+
+Timer &PhaseStatsRegistry::startPhase(StringRef Pass, StringRef Phase) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  PhaseData &Data = getPhase(Pass, Phase);
+  Data.NumRuns++;
+  return *Data.T;
+}
+
+void PhaseStatsRegistry::addCount(StringRef Pass, StringRef Phase,
+                                  StringRef Counter, uint64_t N) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  getPhase(Pass, Phase).Counters[Counter] += N;
+}
+
+void PhaseStatsRegistry::printCounters(raw_ostream &OS, StringRef PassName,
+                                       const PassData &Pass) {
+  bool HasCounters = llvm::any_of(
+      Pass.Phases, [](auto &Phase) { return !Phase.second.Counters.empty(); });
+  if (!HasCounters)
+    return;
+
+  // The same layout as the header of TimerGroup::print
+  std::string Title = ("LLVM-TUTOR: " + PassName + " phase counters").str();
+  OS << "===" << std::string(73, '-') << "===\n";
+  OS.indent(Title.size() < 80 ? (80 - Title.size()) / 2 : 0) << Title << "\n";
+  OS << "===" << std::string(73, '-') << "===\n";
+
+  for (StringRef PhaseName : getSortedKeys(Pass.Phases)) {
+    const PhaseData &Phase = Pass.Phases.find(PhaseName)->second;
+    for (StringRef Counter : getSortedKeys(Phase.Counters)) {
+      std::string Name = (PhaseName + "." + Counter).str();
+      OS << format("  %-40s %14llu\n", Name.c_str(),
+                   (unsigned long long)Phase.Counters.lookup(Counter));
+    }
+  }
+  OS << "\n";
+}
+
+void PhaseStatsRegistry::writeJSON(raw_ostream &OS) {
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    for (StringRef PassName : getSortedKeys(Passes)) {
+      const PassData &Pass = Passes.find(PassName)->second;
+      J.attributeObject(PassName, [&] {
+        for (StringRef PhaseName : getSortedKeys(Pass.Phases)) {
+          const PhaseData &Phase = Pass.Phases.find(PhaseName)->second;
+          TimeRecord Time = Phase.T->getTotalTime();
+          J.attributeObject(PhaseName, [&] {
+            J.attribute("runs", Phase.NumRuns);
+            J.attribute("wall", Time.getWallTime());
+            J.attribute("user", Time.getUserTime());
+            J.attribute("sys", Time.getSystemTime());
+            J.attributeObject("counters", [&] {
+              for (StringRef Counter : getSortedKeys(Phase.Counters))
+                J.attribute(Counter, Phase.Counters.lookup(Counter));
+            });
+          });
+        }
+      });
+    }
+  });
+  OS << "\n";
+}
+
+PhaseStatsRegistry::~PhaseStatsRegistry() {
+  if (const char *Path = getJSONPath()) {
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+    if (EC)
+      errs() << "Error writing phase stats to " << Path << ": " << EC.message()
+             << "\n";
+    else
+      writeJSON(OS);
+  }
+
+  if (TimePassesIsEnabled) {
+    auto OS = CreateInfoOutputFile();
+    for (StringRef PassName : getSortedKeys(Passes)) {
+      PassData &Pass = Passes.find(PassName)->second;
+      Pass.Group->print(*OS);
+      printCounters(*OS, PassName, Pass);
+    }
+  }
+
+  // Otherwise the timers would be printed (again) when they're destroyed
+  for (auto &Pass : Passes)
+    Pass.second.Group->clear();
+}
+
+//------------------------------------------------------------------------------
+// PhaseTimer
+//------------------------------------------------------------------------------
+// The innermost running phase on this thread
+static thread_local PhaseTimer *InnermostPhase = nullptr;
+// Set by PhaseTimersDisabled
+static thread_local bool TimersDisabled = false;
+
+PhaseTimer::PhaseTimer(StringRef Pass, StringRef Phase) {
+  if (!arePhaseStatsEnabled() || TimersDisabled)
+    return;
+
+  Timer &PhaseT = Registry->startPhase(Pass, Phase);
+  // Re-entered (e.g. by a recursive pass) - the timer is running already, or
+  // paused by a nested phase. Only count the run.
+  for (PhaseTimer *Running = InnermostPhase; Running; Running = Running->Outer)
+    if (Running->T == &PhaseT)
+      return;
+
+  T = &PhaseT;
+  Outer = InnermostPhase;
+  InnermostPhase = this;
+  if (Outer)
+    Outer->T->stopTimer();
+  T->startTimer();
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (!T)
+    return;
+
+  T->stopTimer();
+  InnermostPhase = Outer;
+  if (Outer)
+    Outer->T->startTimer();
+}
+
+PhaseTimersDisabled::PhaseTimersDisabled() : WereDisabled(TimersDisabled) {
+  TimersDisabled = true;
+}
+
+PhaseTimersDisabled::~PhaseTimersDisabled() { TimersDisabled = WereDisabled; }
+
+//------------------------------------------------------------------------------
+// Counters
+//------------------------------------------------------------------------------
+void addPhaseCount(StringRef Pass, StringRef Phase, StringRef Counter,
+                   uint64_t N) {
+  if (!arePhaseStatsEnabled())
+    return;
+
+  Registry->addCount(Pass, Phase, Counter, N);
+}
@@ -19,12 +19,38 @@
 //    STEP 2:
 //    Compute the RIVs for the entry block (BB_0):
 //      RIV_0 = {input args, global vars}
+//    The global vars are the same for every function in the module, so these
+//    are collected once per module and RIV_0 refers to that list. The list
+//    comes from the IntegerGlobals module analysis if it has already been run
+//    (e.g. through `require<integer-globals>`), and from SharedIntegerGlobals
+//    otherwise.
 //    -------------------------------------------------------------------------
 //    STEP 3: Traverse the CFG and for every BB_M that BB_N dominates,
 //    calculate RIV_M as follows:
 //      RIV_M = {RIV_N, v_N}
 //    -------------------------------------------------------------------------
 //
+//    By default (repr=flat) RIV_M is stored as a full copy of v_N and RIV_N.
+//    That's O(N^2) in the depth of the dominator tree. With repr=chained,
+//    RIV_M is stored as a node that holds only v_N and points to the node for
+//    RIV_N. All children of BB_N share the same node and the full set is only
+//    materialised when iterated over. With repr=bitset, the values in F are
+//    numbered once and RIV_M is a bit vector: a copy of RIV_N's bits with the
+//    bits for v_N set (a word at a time). Again, all children of BB_N share
+//    it. The values are numbered in post-order of the dominator tree (the
+//    globals and the input arguments go last), so that visiting the set bits
+//    gives the same order as the other representations.
+//
+//    The registered analysis (i.e. `FAM.getResult<RIV>`) is always flat. The
+//    other representations are selected by the passes that use RIV, e.g.
+//    `print<riv;repr=bitset>` or `duplicate-bb<riv=chained>`.
+//
+//    Every step is timed (and counted) separately, see PhaseStats.h.
+//
+//    `print<riv>` prints the result as a table, `print<riv;format=compact>` as
+//    one tab-separated record per block (see ResultPrinter.h). Both can be
+//    combined with `repr=...`, e.g. `print<riv;format=compact;repr=chained>`.
+//
 // REFERENCES:
 //    Based on examples from:
 //    "Building, Testing and Debugging a Simple out-of-tree LLVM Pass", Serge
@@ -33,13 +59,18 @@
 // License: MIT
 //=============================================================================
 #include "RIV.h"
+#include "PhaseStats.h"
 
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/Format.h"
 
+#include <algorithm>
 #include <deque>
+#include <optional>
 
 using namespace llvm;
 
@@ -47,16 +78,101 @@ using namespace llvm;
 // being verbose makes it easier to follow.
 using NodeTy = DomTreeNodeBase<llvm::BasicBlock> *;
 // A map that a basic block BB holds a set of pointers to values defined in BB.
-using DefValMapTy = RIV::Result;
+using DefValMapTy =
+    llvm::MapVector<llvm::BasicBlock const *, SmallVector<llvm::Value *, 8>>;
+
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "riv";
+
+// Sets the bits [Begin, End) in Words, a word at a time
+static void setBits(RIVSet::BitWord *Words, size_t Begin, size_t End) {
+  using BitWord = RIVSet::BitWord;
+  constexpr unsigned WordSize = RIVSet::BitWordSize;
+  while (Begin < End) {
+    size_t W = Begin / WordSize;
+    size_t Hi = std::min<size_t>(End - W * WordSize, WordSize);
+    BitWord Mask = ~BitWord(0) << (Begin % WordSize);
+    if (Hi != WordSize)
+      Mask &= (BitWord(1) << Hi) - 1;
+    Words[W] |= Mask;
+    Begin = W * WordSize + Hi;
+  }
+}
+
+// Builds the rank index for Words, i.e. the number of bits set in the words
+// before every word (see RIVSet)
+static const RIVSet::RankWord *buildRanks(const RIVSet::BitWord *Words,
+                                          size_t NumWords,
+                                          BumpPtrAllocator &Alloc) {
+  auto *Ranks = Alloc.Allocate<RIVSet::RankWord>(NumWords);
+  RIVSet::RankWord Rank = 0;
+  for (size_t W = 0; W < NumWords; ++W) {
+    Ranks[W] = Rank;
+    Rank += llvm::popcount(Words[W]);
+  }
+  return Ranks;
+}
 
 // Pretty-prints the result of this analysis
-static void printRIVResult(llvm::raw_ostream &OutS, const RIV::Result &RIVMap);
+static void printRIVResult(ResultStream &OutS, const Function &Func,
+                           const RIV::Result &RIVMap, ResultFormat Format);
+
+//-----------------------------------------------------------------------------
+// IntegerGlobals Implementation
+//-----------------------------------------------------------------------------
+bool IntegerGlobalsInfo::invalidate(Module &M, const PreservedAnalyses &PA,
+                                    ModuleAnalysisManager::Invalidator &) {
+  auto PAC = PA.getChecker<IntegerGlobals>();
+  if (PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Module>>())
+    return false;
+
+  auto It = Globals.begin(), End = Globals.end();
+  for (auto &Global : M.globals()) {
+    if (!Global.getValueType()->isIntegerTy())
+      continue;
+    if (It == End || *It != &Global)
+      return true;
+    ++It;
+  }
+
+  return It != End;
+}
+
+IntegerGlobals::Result IntegerGlobals::collectIntegerGlobals(Module &M) {
+  PhaseTimer T(PassArg, "integer-globals");
+  Result Res;
+  for (auto &Global : M.globals())
+    if (Global.getValueType()->isIntegerTy())
+      Res.Globals.push_back(&Global);
+
+  return Res;
+}
+
+IntegerGlobals::Result IntegerGlobals::run(Module &M,
+                                           ModuleAnalysisManager &) {
+  return collectIntegerGlobals(M);
+}
+
+SharedIntegerGlobals::Result
+SharedIntegerGlobals::run(Function &F, FunctionAnalysisManager &) {
+  Module *M = F.getParent();
+  std::shared_ptr<const IntegerGlobalsInfo> Globals = LastGlobals.lock();
+  if (!Globals || LastModule != M) {
+    Globals = std::make_shared<const IntegerGlobalsInfo>(
+        IntegerGlobals::collectIntegerGlobals(*M));
+    LastModule = M;
+    LastGlobals = Globals;
+  }
+
+  return {std::move(Globals)};
+}
 
 //-----------------------------------------------------------------------------
 // RIV Implementation
 //-----------------------------------------------------------------------------
-RIV::Result RIV::buildRIV(Function &F, NodeTy CFGRoot) {
-  Result ResultMap;
+RIV::Result RIV::buildRIV(Function &F, NodeTy CFGRoot,
+                          const IntegerGlobals::Result *Globals) {
+  Result Res;
 
   // Initialise a double-ended queue that will be used to traverse all BBs in F
   std::deque<NodeTy> BBsToProcess;
@@ -65,58 +181,199 @@ RIV::Result RIV::buildRIV(Function &F, NodeTy CFGRoot) {
   // STEP 1: For every basic block BB compute the set of integer values defined
   // in BB
   DefValMapTy DefinedValuesMap;
-  for (BasicBlock &BB : F) {
-    auto &Values = DefinedValuesMap[&BB];
-    for (Instruction &Inst : BB)
-      if (Inst.getType()->isIntegerTy())
-        Values.insert(&Inst);
+  {
+    PhaseTimer T(PassArg, "step1");
+    uint64_t NumDefs = 0;
+    for (BasicBlock &BB : F) {
+      auto &Values = DefinedValuesMap[&BB];
+      for (Instruction &Inst : BB)
+        if (Inst.getType()->isIntegerTy())
+          Values.push_back(&Inst);
+      NumDefs += Values.size();
+    }
+    addPhaseCount(PassArg, "step1", "blocks", DefinedValuesMap.size());
+    addPhaseCount(PassArg, "step1", "values", NumDefs);
   }
 
   // STEP 2: Compute the RIVs for the entry BB. This will include global
-  // variables and input arguments.
-  auto &EntryBBValues = ResultMap[&F.getEntryBlock()];
-
-  for (auto &Global : F.getParent()->globals())
-    if (Global.getValueType()->isIntegerTy())
-      EntryBBValues.insert(&Global);
+  // variables and input arguments. These are shared by all blocks in F, so
+  // rather than copying them around, they are kept in two nodes at the root of
+  // every chain: first the globals, then the input arguments. The globals are
+  // owned by the IntegerGlobals analysis (if its result is available).
+  std::optional<PhaseTimer> Step2Timer(std::in_place, PassArg, "step2");
+  ArrayRef<Value *> GlobalValues;
+  if (Globals) {
+    GlobalValues = Globals->globals();
+  } else {
+    IntegerGlobals::Result LocalGlobals =
+        IntegerGlobals::collectIntegerGlobals(*F.getParent());
+    GlobalValues = LocalGlobals.globals().copy(Res.Alloc);
+  }
 
+  SmallVector<Value *, 8> ArgValues;
   for (Argument &Arg : F.args())
     if (Arg.getType()->isIntegerTy())
-      EntryBBValues.insert(&Arg);
+      ArgValues.push_back(&Arg);
+
+  auto *ArgsNode = new (Res.Alloc) RIVNode{
+      ArrayRef<Value *>(ArgValues).copy(Res.Alloc), nullptr, ArgValues.size()};
+  auto *RootNode = new (Res.Alloc)
+      RIVNode{GlobalValues, ArgsNode, GlobalValues.size() + ArgsNode->Size};
+  Res.Sets[&F.getEntryBlock()] = RIVSet({}, RootNode);
+
+  // With the bitset representation, every value is given a bit: first the
+  // values defined in the blocks (in post-order of the dominator tree, i.e.
+  // the blocks come before their dominators), then the globals and the input
+  // arguments. BlockBits holds the bits of the values defined in every block.
+  ArrayRef<Value *> Numbering;
+  DenseMap<BasicBlock const *, std::pair<size_t, size_t>> BlockBits;
+  DenseMap<BasicBlock const *, const RIVSet::BitWord *> BitWords;
+  if (Repr == Representation::Bitset) {
+    SmallVector<Value *, 32> Values;
+    for (NodeTy Node : post_order(CFGRoot)) {
+      ArrayRef<Value *> Defs = DefinedValuesMap[Node->getBlock()];
+      BlockBits[Node->getBlock()] = {Values.size(),
+                                     Values.size() + Defs.size()};
+      Values.append(Defs.begin(), Defs.end());
+    }
+    size_t FirstRootBit = Values.size();
+    Values.append(GlobalValues.begin(), GlobalValues.end());
+    Values.append(ArgValues.begin(), ArgValues.end());
+    Numbering = ArrayRef<Value *>(Values).copy(Res.Alloc);
+
+    size_t NumWords = RIVSet::getNumWords(Numbering.size());
+    auto *EntryWords = Res.Alloc.Allocate<RIVSet::BitWord>(NumWords);
+    std::fill_n(EntryWords, NumWords, 0);
+    setBits(EntryWords, FirstRootBit, Numbering.size());
+    BitWords[&F.getEntryBlock()] = EntryWords;
+    Res.Sets[&F.getEntryBlock()] =
+        RIVSet(EntryWords, buildRanks(EntryWords, NumWords, Res.Alloc),
+               Numbering, Numbering.size() - FirstRootBit);
+    addPhaseCount(PassArg, "step2", "bits", Numbering.size());
+  }
+
+  addPhaseCount(PassArg, "step2", "globals", GlobalValues.size());
+  addPhaseCount(PassArg, "step2", "args", ArgValues.size());
+  Step2Timer.reset();
+
+  // With the chained representation, every block is mapped to a node that
+  // holds the values defined in its immediate dominator. With the flat
+  // representation, every block holds a copy of all the values defined in
+  // its dominators.
+  DenseMap<BasicBlock const *, const RIVNode *> Nodes;
+  DenseMap<BasicBlock const *, ArrayRef<Value *>> FlatValues;
+  Nodes[&F.getEntryBlock()] = RootNode;
 
   // STEP 3: Traverse the CFG for every BB in F calculate its RIVs
+  PhaseTimer Step3Timer(PassArg, "step3");
+  // The number of values copied (flat) or the number of nodes (chained) or
+  // bit vectors (bitset) created
+  uint64_t NumCopied = 0, NumNodes = 0;
   while (!BBsToProcess.empty()) {
     auto *Parent = BBsToProcess.back();
     BBsToProcess.pop_back();
 
     // Get the values defined in Parent
-    auto &ParentDefs = DefinedValuesMap[Parent->getBlock()];
-    // Get the RIV set of for Parent
-    // (Since RIVMap is updated on every iteration, its contents are likely to
-    // be moved around when resizing. This means that we need a copy of it
-    // (i.e. a reference is not sufficient).
-    llvm::SmallPtrSet<llvm::Value *, 8> ParentRIVs =
-        ResultMap[Parent->getBlock()];
+    ArrayRef<Value *> ParentDefs = DefinedValuesMap[Parent->getBlock()];
+    // Get the (flat) RIV set for Parent, i.e. all the values reachable in
+    // Parent other than those in RootNode.
+    ArrayRef<Value *> ParentRIVs = FlatValues.lookup(Parent->getBlock());
+
+    // With the chained representation, Parent's values are shared by all of
+    // its children.
+    const RIVNode *ChildNode = nullptr;
+    if (Repr == Representation::Chained && !Parent->isLeaf()) {
+      const RIVNode *ParentNode = Nodes.lookup(Parent->getBlock());
+      ChildNode = new (Res.Alloc) RIVNode{ParentDefs.copy(Res.Alloc),
+                                          ParentNode,
+                                          ParentDefs.size() + ParentNode->Size};
+      NumNodes++;
+    }
+
+    // With the bitset representation, all children of Parent share one bit
+    // vector (and its rank index): Parent's bits plus the bits of the values
+    // defined in Parent.
+    const RIVSet::BitWord *ChildWords = nullptr;
+    const RIVSet::RankWord *ChildRanks = nullptr;
+    size_t ChildSize = 0;
+    if (Repr == Representation::Bitset && !Parent->isLeaf()) {
+      size_t NumWords = RIVSet::getNumWords(Numbering.size());
+      auto *Words = Res.Alloc.Allocate<RIVSet::BitWord>(NumWords);
+      std::copy_n(BitWords.lookup(Parent->getBlock()), NumWords, Words);
+      auto [Begin, End] = BlockBits.lookup(Parent->getBlock());
+      setBits(Words, Begin, End);
+      ChildWords = Words;
+      ChildRanks = buildRanks(Words, NumWords, Res.Alloc);
+      ChildSize = Res.Sets.lookup(Parent->getBlock()).size() + (End - Begin);
+      NumNodes++;
+    }
 
     // Loop over all BBs that Parent dominates and update their RIV sets
     for (NodeTy Child : *Parent) {
       BBsToProcess.push_back(Child);
       auto ChildBB = Child->getBlock();
 
-      // Add values defined in Parent to the current child's set of RIV
-      ResultMap[ChildBB].insert(ParentDefs.begin(), ParentDefs.end());
+      if (Repr == Representation::Chained) {
+        Nodes[ChildBB] = ChildNode;
+        Res.Sets[ChildBB] = RIVSet({}, ChildNode);
+        continue;
+      }
 
-      // Add Parent's set of RIVs to the current child's RIV
-      ResultMap[ChildBB].insert(ParentRIVs.begin(), ParentRIVs.end());
+      if (Repr == Representation::Bitset) {
+        BitWords[ChildBB] = ChildWords;
+        Res.Sets[ChildBB] =
+            RIVSet(ChildWords, ChildRanks, Numbering, ChildSize);
+        continue;
+      }
+
+      // Add values defined in Parent and Parent's set of RIVs to the current
+      // child's RIV
+      size_t NumValues = ParentDefs.size() + ParentRIVs.size();
+      Value **ChildRIVs = Res.Alloc.Allocate<Value *>(NumValues);
+      std::copy(ParentRIVs.begin(), ParentRIVs.end(),
+                std::copy(ParentDefs.begin(), ParentDefs.end(), ChildRIVs));
+      FlatValues[ChildBB] = ArrayRef(ChildRIVs, NumValues);
+      NumCopied += NumValues;
+      Res.Sets[ChildBB] = RIVSet(FlatValues[ChildBB], RootNode);
     }
   }
+  addPhaseCount(PassArg, "step3", "blocks", Res.Sets.size());
+  if (Repr == Representation::Chained)
+    addPhaseCount(PassArg, "step3", "nodes", NumNodes);
+  else if (Repr == Representation::Bitset)
+    addPhaseCount(PassArg, "step3", "bitsets", NumNodes);
+  else
+    addPhaseCount(PassArg, "step3", "copied-values", NumCopied);
+
+  return Res;
+}
 
-  return ResultMap;
+std::optional<RIV::Representation> RIV::parseRepresentation(StringRef Name) {
+  return StringSwitch<std::optional<Representation>>(Name)
+      .Case("flat", Representation::Flat)
+      .Case("chained", Representation::Chained)
+      .Case("bitset", Representation::Bitset)
+      .Default(std::nullopt);
 }
 
 RIV::Result RIV::run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM) {
   DominatorTree *DT = &FAM.getResult<DominatorTreeAnalysis>(F);
-  Result Res = buildRIV(F, DT->getRootNode());
+
+  // Re-use the module's integer globals if they have already been computed
+  // (e.g. via `require<integer-globals>`). In that case this result refers to
+  // them and has to be invalidated together with them. Otherwise the globals
+  // are shared with the other functions through SharedIntegerGlobals.
+  auto &MAMProxy = FAM.getResult<ModuleAnalysisManagerFunctionProxy>(F);
+  auto *Globals = MAMProxy.getCachedResult<IntegerGlobals>(*F.getParent());
+  if (Globals) {
+    MAMProxy.registerOuterAnalysisInvalidation<IntegerGlobals, RIV>();
+    return buildRIV(F, DT->getRootNode(), Globals);
+  }
+
+  std::shared_ptr<const IntegerGlobalsInfo> SharedGlobals =
+      FAM.getResult<SharedIntegerGlobals>(F).Globals;
+  Result Res = buildRIV(F, DT->getRootNode(), SharedGlobals.get());
+  Res.SharedGlobals = std::move(SharedGlobals);
 
   return Res;
 }
@@ -124,9 +381,16 @@ RIV::Result RIV::run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM) {
 PreservedAnalyses RIVPrinter::run(Function &Func,
                                   FunctionAnalysisManager &FAM) {
 
-  auto RIVMap = FAM.getResult<RIV>(Func);
+  // The registered analysis always uses the flat representation. Any other
+  // one is computed here and not cached.
+  std::optional<RIV::Result> OwnRIVMap;
+  if (Repr)
+    OwnRIVMap.emplace(RIV(*Repr).run(Func, FAM));
+  auto &RIVMap = OwnRIVMap ? *OwnRIVMap : FAM.getResult<RIV>(Func);
 
-  printRIVResult(OS, RIVMap);
+  ResultStream OutS(OS, Func.getParent());
+  OutS.incorporateFunction(Func);
+  printRIVResult(OutS, Func, RIVMap, Format);
   return PreservedAnalyses::all();
 }
 
@@ -134,37 +398,76 @@ PreservedAnalyses RIVPrinter::run(Function &Func,
 // New PM Registration
 //-----------------------------------------------------------------------------
 AnalysisKey RIV::Key;
+AnalysisKey IntegerGlobals::Key;
+AnalysisKey SharedIntegerGlobals::Key;
 
 llvm::PassPluginLibraryInfo getRIVPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "riv", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
-            // #1 REGISTRATION FOR "opt -passes=print<riv>"
+            // #1 REGISTRATION FOR "opt -passes=print<riv>" (and
+            // "print<riv;format=compact>", "print<riv;repr=bitset>")
             PB.registerPipelineParsingCallback(
                 [&](StringRef Name, FunctionPassManager &FPM,
                     ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "print<riv>") {
-                    FPM.addPass(RIVPrinter(llvm::errs()));
+                  std::optional<RIV::Representation> Repr;
+                  auto ParseRepr = [&Repr](StringRef Param) {
+                    if (!Param.consume_front("repr="))
+                      return false;
+                    Repr = RIV::parseRepresentation(Param);
+                    return Repr.has_value();
+                  };
+                  if (auto Format = parsePrinterName(Name, "riv", ParseRepr)) {
+                    FPM.addPass(RIVPrinter(llvm::errs(), *Format, Repr));
                     return true;
                   }
                   return false;
                 });
-            // #2 REGISTRATION FOR "FAM.getResult<RIV>(Function)"
+            // #2 REGISTRATION FOR "opt -passes=require<integer-globals>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "require<integer-globals>") {
+                    MPM.addPass(RequireAnalysisPass<IntegerGlobals, Module>());
+                    return true;
+                  }
+                  return false;
+                });
+            // #3 REGISTRATION FOR "FAM.getResult<RIV>(Function)"
             PB.registerAnalysisRegistrationCallback(
                 [](FunctionAnalysisManager &FAM) {
                   FAM.registerPass([&] { return RIV(); });
+                  FAM.registerPass([&] { return SharedIntegerGlobals(); });
+                });
+            // #4 REGISTRATION FOR "MAM.getResult<IntegerGlobals>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return IntegerGlobals(); });
                 });
           }};
 };
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getRIVPluginInfo();
 }
+#endif
 
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
-static void printRIVResult(raw_ostream &OutS, const RIV::Result &RIVMap) {
+static void printRIVResult(ResultStream &OutS, const Function &Func,
+                           const RIV::Result &RIVMap, ResultFormat Format) {
+  if (Format == ResultFormat::Compact) {
+    for (auto const &KV : RIVMap) {
+      OutS.record("riv").field(Func).field(*KV.first);
+      for (auto const *IntegerValue : KV.second)
+        OutS.field(*IntegerValue);
+      OutS.endRecord();
+    }
+    return;
+  }
+
   OutS << "=================================================\n";
   OutS << "LLVM-TUTOR: RIV analysis results\n";
   OutS << "=================================================\n";
@@ -174,18 +477,13 @@ static void printRIVResult(raw_ostream &OutS, const RIV::Result &RIVMap) {
   OutS << format("%-10s %-30s\n", Str1, Str2);
   OutS << "-------------------------------------------------\n";
 
-  const char *EmptyStr = "";
-
+  // The columns below are laid out as "BB %-12s %-30s" and "%-12s %-30s"
   for (auto const &KV : RIVMap) {
-    std::string DummyStr;
-    raw_string_ostream BBIdStream(DummyStr);
-    KV.first->printAsOperand(BBIdStream, false);
-    OutS << format("BB %-12s %-30s\n", BBIdStream.str().c_str(), EmptyStr);
+    OutS << "BB ";
+    OutS.operand(*KV.first).padTo(3 + 12).indent(1 + 30) << "\n";
     for (auto const *IntegerValue : KV.second) {
-      std::string DummyStr;
-      raw_string_ostream InstrStr(DummyStr);
-      IntegerValue->print(InstrStr);
-      OutS << format("%-12s %-30s\n", EmptyStr, InstrStr.str().c_str());
+      OutS.indent(12 + 1);
+      OutS.value(*IntegerValue).padTo(12 + 1 + 30) << "\n";
     }
   }
 
@@ -0,0 +1,48 @@
+//==============================================================================
+// FILE:
+//    ResultPrinter.cpp
+//
+// DESCRIPTION:
+//    Implements the parts of the printer backend (see ResultPrinter.h) that are
+//    shared by all the printer passes.
+//
+// License: MIT
+//==============================================================================
+#include "ResultPrinter.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSwitch.h"
+
+using namespace llvm;
+
+std::optional<ResultFormat>
+parsePrinterName(StringRef Name, StringRef Pass,
+                 function_ref<bool(StringRef)> ParseParam) {
+  if (!Name.consume_front("print<") || !Name.consume_front(Pass) ||
+      !Name.consume_back(">"))
+    return std::nullopt;
+
+  ResultFormat Format = ResultFormat::Text;
+  if (Name.empty())
+    return Format;
+
+  if (!Name.consume_front(";"))
+    return std::nullopt;
+
+  SmallVector<StringRef, 2> Params;
+  Name.split(Params, ';');
+  for (StringRef Param : Params) {
+    if (Param.consume_front("format=")) {
+      auto ParamFormat = StringSwitch<std::optional<ResultFormat>>(Param)
+                             .Case("text", ResultFormat::Text)
+                             .Case("compact", ResultFormat::Compact)
+                             .Default(std::nullopt);
+      if (!ParamFormat)
+        return std::nullopt;
+      Format = *ParamFormat;
+    } else if (!ParseParam || !ParseParam(Param))
+      return std::nullopt;
+  }
+
+  return Format;
+}
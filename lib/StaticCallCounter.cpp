@@ -9,6 +9,26 @@
 //    calls are considered. Calls via functions pointers are not taken into
 //    account.
 //
+//    In the `indirect` mode (`print<static-cc<indirect>>`), the indirect calls
+//    are counted too. The possible targets of an indirect call are taken from
+//    its `!callees` metadata or found by following the called pointer within
+//    the calling function (see FunctionCallCounter in StaticCallCounter.h).
+//    Indirect calls for which that fails are reported as unresolved. The
+//    results are computed per function and cached by the function analysis
+//    manager, so that after a transformation only the functions that it
+//    modified are rescanned.
+//
+//    The `indirect` mode does not use LazyCallGraph or CallGraph, even though
+//    it plays the same role. LazyCallGraph deduplicates the edges (one edge per
+//    caller/callee pair rather than one per call) and only turns direct calls
+//    into call edges, i.e. it neither counts calls nor knows about the targets
+//    in `!callees` metadata. CallGraph keeps one edge per call site, but sends
+//    all indirect calls to its external node. Also, both are module analyses,
+//    so invalidating them means rebuilding them for the whole module
+//    (LazyCallGraph is only updated incrementally from within the CGSCC pass
+//    manager). Instead, FunctionCallCounter counts the calls in one function
+//    and CallGraphCallCounter combines the cached per-function results.
+//
 //    This pass is used in `static`, a tool implemented in tools/StaticMain.cpp
 //    that is a wrapper around StaticCallCounter. `static` allows you to run
 //    StaticCallCounter without `opt`.
@@ -17,52 +37,74 @@
 //      opt -load-pass-plugin libStaticCallCounter.dylib `\`
 //        -passes="print<static-cc>" `\`
 //        -disable-output <input-llvm-file>
+//    or, to include the indirect calls:
+//      opt -load-pass-plugin libStaticCallCounter.dylib `\`
+//        -passes="print<static-cc<indirect>>" `\`
+//        -disable-output <input-llvm-file>
+//    Append `;format=compact` (e.g. `print<static-cc;format=compact>`) for one
+//    tab-separated record per callee instead of a table (see ResultPrinter.h).
 //
 // License: MIT
 //==============================================================================
 #include "StaticCallCounter.h"
+#include "PhaseStats.h"
 
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Format.h"
 
 using namespace llvm;
 
+// The name used for the phase timers and counters
+static constexpr char PassArg[] = "static-cc";
+
 // Pretty-prints the result of this analysis
 static void printStaticCCResult(llvm::raw_ostream &OutS,
-                         const ResultStaticCC &DirectCalls);
+                                const ResultStaticCC &DirectCalls,
+                                ResultFormat Format);
+static void printCallGraphCCResult(llvm::raw_ostream &OutS,
+                                   const ResultCallGraphCC &Calls,
+                                   ResultFormat Format);
 
 //------------------------------------------------------------------------------
 // StaticCallCounter Implementation
 //------------------------------------------------------------------------------
-StaticCallCounter::Result StaticCallCounter::runOnModule(Module &M) {
-  llvm::MapVector<const llvm::Function *, unsigned> Res;
+void StaticCallCounter::countDirectCalls(const Function &Func, Result &Res) {
+  for (auto &BB : Func) {
+    for (auto &Ins : BB) {
+
+      // If this is a call instruction then CB will be not null.
+      auto *CB = dyn_cast<CallBase>(&Ins);
+      if (nullptr == CB) {
+        continue;
+      }
+
+      // If CB is a direct function call then DirectInvoc will be not null.
+      auto DirectInvoc = CB->getCalledFunction();
+      if (nullptr == DirectInvoc) {
+        continue;
+      }
 
-  for (auto &Func : M) {
-    for (auto &BB : Func) {
-      for (auto &Ins : BB) {
-
-        // If this is a call instruction then CB will be not null.
-        auto *CB = dyn_cast<CallBase>(&Ins);
-        if (nullptr == CB) {
-          continue;
-        }
-
-        // If CB is a direct function call then DirectInvoc will be not null.
-        auto DirectInvoc = CB->getCalledFunction();
-        if (nullptr == DirectInvoc) {
-          continue;
-        }
-
-        // We have a direct function call - update the count for the function
-        // being called.
-        auto CallCount = Res.find(DirectInvoc);
-        if (Res.end() == CallCount) {
-          CallCount = Res.insert(std::make_pair(DirectInvoc, 0)).first;
-        }
-        ++CallCount->second;
+      // We have a direct function call - update the count for the function
+      // being called.
+      auto CallCount = Res.find(DirectInvoc);
+      if (Res.end() == CallCount) {
+        CallCount = Res.insert(std::make_pair(DirectInvoc, 0)).first;
       }
+      ++CallCount->second;
     }
   }
+}
+
+StaticCallCounter::Result StaticCallCounter::runOnModule(Module &M) {
+  llvm::MapVector<const llvm::Function *, unsigned> Res;
+
+  for (auto &Func : M)
+    countDirectCalls(Func, Res);
 
   return Res;
 }
@@ -71,21 +113,173 @@ PreservedAnalyses
 StaticCallCounterPrinter::run(Module &M,
                               ModuleAnalysisManager &MAM) {
 
-  auto DirectCalls = MAM.getResult<StaticCallCounter>(M);
+  auto &DirectCalls = MAM.getResult<StaticCallCounter>(M);
 
-  printStaticCCResult(OS, DirectCalls);
+  printStaticCCResult(OS, DirectCalls, Format);
   return PreservedAnalyses::all();
 }
 
 StaticCallCounter::Result
 StaticCallCounter::run(llvm::Module &M, llvm::ModuleAnalysisManager &) {
+  PhaseTimer T(PassArg, "direct");
   return runOnModule(M);
 }
 
+//------------------------------------------------------------------------------
+// FunctionCallCounter/CallGraphCallCounter Implementation
+//------------------------------------------------------------------------------
+void ResultCallGraphCC::merge(const ResultCallGraphCC &Other) {
+  for (auto &[Callee, Counts] : Other.Callees) {
+    CallCounts &MergedCounts = Callees[Callee];
+    MergedCounts.Direct += Counts.Direct;
+    MergedCounts.Indirect += Counts.Indirect;
+  }
+  NumUnresolved += Other.NumUnresolved;
+}
+
+// Returns true if the only users of Alloca are loads from and stores to it
+// (so that every value loaded from Alloca is one of the stored values)
+static bool isOnlyLoadedAndStored(const AllocaInst &Alloca) {
+  return all_of(Alloca.users(), [&Alloca](const User *U) {
+    if (auto *Load = dyn_cast<LoadInst>(U))
+      return Load->isSimple();
+    if (auto *Store = dyn_cast<StoreInst>(U))
+      return Store->isSimple() && Store->getValueOperand() != &Alloca;
+    return false;
+  });
+}
+
+// Adds the functions that V may evaluate to to Targets. Returns false if
+// (some of) the functions are unknown.
+static bool collectTargets(const Value *V, const DataLayout &DL,
+                           SmallPtrSetImpl<const Value *> &Visited,
+                           SmallSetVector<const Function *, 4> &Targets) {
+  V = V->stripPointerCastsAndAliases();
+  // Already visited (only possible for PHI cycles and allocas)
+  if (!Visited.insert(V).second)
+    return true;
+
+  if (auto *F = dyn_cast<Function>(V)) {
+    Targets.insert(F);
+    return true;
+  }
+
+  if (auto *Select = dyn_cast<SelectInst>(V))
+    return collectTargets(Select->getTrueValue(), DL, Visited, Targets) &&
+           collectTargets(Select->getFalseValue(), DL, Visited, Targets);
+
+  if (auto *Phi = dyn_cast<PHINode>(V))
+    return all_of(Phi->incoming_values(), [&](const Value *Incoming) {
+      return collectTargets(Incoming, DL, Visited, Targets);
+    });
+
+  auto *Load = dyn_cast<LoadInst>(V);
+  if (!Load || !Load->isSimple())
+    return false;
+
+  // A load from a constant global at a constant offset, e.g. a vtable slot
+  const Value *Ptr = Load->getPointerOperand();
+  APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+  const Value *Base = Ptr->stripAndAccumulateConstantOffsets(
+      DL, Offset, /*AllowNonInbounds=*/true);
+  if (auto *C = dyn_cast<Constant>(Base)) {
+    Constant *Loaded = ConstantFoldLoadFromConstPtr(
+        const_cast<Constant *>(C), Load->getType(), Offset, DL);
+    return Loaded && collectTargets(Loaded, DL, Visited, Targets);
+  }
+
+  // A load from a local variable, e.g. a function pointer at -O0
+  auto *Alloca = dyn_cast<AllocaInst>(Ptr);
+  if (!Alloca || !isOnlyLoadedAndStored(*Alloca))
+    return false;
+  if (!Visited.insert(Alloca).second)
+    return true;
+  return all_of(Alloca->users(), [&](const User *U) {
+    auto *Store = dyn_cast<StoreInst>(U);
+    return !Store ||
+           collectTargets(Store->getValueOperand(), DL, Visited, Targets);
+  });
+}
+
+ResultCallGraphCC FunctionCallCounter::countCalls(const Function &F) {
+  ResultCallGraphCC Res;
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  for (auto &BB : F) {
+    for (auto &Ins : BB) {
+      auto *CB = dyn_cast<CallBase>(&Ins);
+      if (nullptr == CB || CB->isInlineAsm())
+        continue;
+
+      if (const Function *Callee = CB->getCalledFunction()) {
+        Res.Callees[Callee].Direct++;
+        continue;
+      }
+
+      // `!callees` lists all the possible targets, so there's no need to look
+      // any further
+      SmallSetVector<const Function *, 4> Targets;
+      bool Resolved = false;
+      if (MDNode *Callees = CB->getMetadata(LLVMContext::MD_callees)) {
+        for (const MDOperand &Op : Callees->operands())
+          if (auto *Target = mdconst::dyn_extract_or_null<Function>(Op))
+            Targets.insert(Target);
+        Resolved = true;
+      } else {
+        SmallPtrSet<const Value *, 8> Visited;
+        Resolved =
+            collectTargets(CB->getCalledOperand(), DL, Visited, Targets);
+      }
+
+      if (!Resolved || Targets.empty()) {
+        Res.NumUnresolved++;
+        continue;
+      }
+      for (const Function *Target : Targets)
+        Res.Callees[Target].Indirect++;
+    }
+  }
+
+  return Res;
+}
+
+FunctionCallCounter::Result
+FunctionCallCounter::run(Function &F, FunctionAnalysisManager &) {
+  PhaseTimer T(PassArg, "function");
+  Result Res = countCalls(F);
+  addPhaseCount(PassArg, "function", "functions");
+  addPhaseCount(PassArg, "function", "unresolved-calls", Res.NumUnresolved);
+  return Res;
+}
+
+CallGraphCallCounter::Result
+CallGraphCallCounter::run(Module &M, ModuleAnalysisManager &MAM) {
+  // The FunctionCallCounter results that are still valid are reused, so only
+  // the functions that were modified since the last run are rescanned
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+  // The functions that have to be rescanned are timed as "function"
+  PhaseTimer T(PassArg, "merge");
+  Result Res;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Res.merge(FAM.getResult<FunctionCallCounter>(F));
+
+  return Res;
+}
+
+PreservedAnalyses
+CallGraphCallCounterPrinter::run(Module &M, ModuleAnalysisManager &MAM) {
+  printCallGraphCCResult(OS, MAM.getResult<CallGraphCallCounter>(M), Format);
+  return PreservedAnalyses::all();
+}
+
 //------------------------------------------------------------------------------
 // New PM Registration
 //------------------------------------------------------------------------------
 AnalysisKey StaticCallCounter::Key;
+AnalysisKey FunctionCallCounter::Key;
+AnalysisKey CallGraphCallCounter::Key;
 
 llvm::PassPluginLibraryInfo getStaticCallCounterPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "static-cc", LLVM_VERSION_STRING,
@@ -94,30 +288,60 @@ llvm::PassPluginLibraryInfo getStaticCallCounterPluginInfo() {
             PB.registerPipelineParsingCallback(
                 [&](StringRef Name, ModulePassManager &MPM,
                     ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "print<static-cc>") {
-                    MPM.addPass(StaticCallCounterPrinter(llvm::errs()));
+                  if (auto Format = parsePrinterName(Name, "static-cc")) {
+                    MPM.addPass(
+                        StaticCallCounterPrinter(llvm::errs(), *Format));
+                    return true;
+                  }
+                  if (auto Format =
+                          parsePrinterName(Name, "static-cc<indirect>")) {
+                    MPM.addPass(
+                        CallGraphCallCounterPrinter(llvm::errs(), *Format));
                     return true;
                   }
                   return false;
                 });
             // #2 REGISTRATION FOR "MAM.getResult<StaticCallCounter>(Module)"
+            // and "MAM.getResult<CallGraphCallCounter>(Module)"
             PB.registerAnalysisRegistrationCallback(
                 [](ModuleAnalysisManager &MAM) {
                   MAM.registerPass([&] { return StaticCallCounter(); });
+                  MAM.registerPass([&] { return CallGraphCallCounter(); });
+                });
+            // #3 REGISTRATION FOR "FAM.getResult<FunctionCallCounter>(Func)"
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM) {
+                  FAM.registerPass([&] { return FunctionCallCounter(); });
                 });
           }};
 };
 
+#ifndef LLVM_TUTOR_LINK_INTO_TOOLS
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
   return getStaticCallCounterPluginInfo();
 }
+#endif
 
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
 static void printStaticCCResult(raw_ostream &OutS,
-                                const ResultStaticCC &DirectCalls) {
+                                const ResultStaticCC &DirectCalls,
+                                ResultFormat Format) {
+  if (Format == ResultFormat::Compact) {
+    // The module is only used to number unnamed callees
+    ResultStream OutC(OutS, DirectCalls.empty()
+                                ? nullptr
+                                : DirectCalls.front().first->getParent());
+    for (auto &CallCount : DirectCalls)
+      OutC.record("static-cc")
+          .field(*CallCount.first)
+          .field(CallCount.second)
+          .endRecord();
+    return;
+  }
+
   OutS << "================================================="
        << "\n";
   OutS << "LLVM-TUTOR: static analysis results\n";
@@ -128,11 +352,48 @@ static void printStaticCCResult(raw_ostream &OutS,
   OutS << "-------------------------------------------------"
        << "\n";
 
-  for (auto &CallCount : DirectCalls) {
-    OutS << format("%-20s %-10lu\n", CallCount.first->getName().str().c_str(),
-                   CallCount.second);
-  }
+  for (auto &CallCount : DirectCalls)
+    OutS << left_justify(CallCount.first->getName(), 20)
+         << format(" %-10u\n", CallCount.second);
 
   OutS << "-------------------------------------------------"
        << "\n\n";
 }
+
+static void printCallGraphCCResult(raw_ostream &OutS,
+                                   const ResultCallGraphCC &Calls,
+                                   ResultFormat Format) {
+  if (Format == ResultFormat::Compact) {
+    // The module is only used to number unnamed callees
+    ResultStream OutC(OutS, Calls.Callees.empty()
+                                ? nullptr
+                                : Calls.Callees.front().first->getParent());
+    for (auto &[Callee, Counts] : Calls.Callees)
+      OutC.record("static-cc")
+          .field(*Callee)
+          .field(Counts.Direct)
+          .field(Counts.Indirect)
+          .endRecord();
+    OutC.record("static-cc-unresolved").field(Calls.NumUnresolved).endRecord();
+    return;
+  }
+
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: static analysis results\n";
+  OutS << "=================================================\n";
+  const char *str1 = "NAME";
+  const char *str2 = "#N DIRECT CALLS";
+  const char *str3 = "#N INDIRECT CALLS";
+  OutS << format("%-20s %-16s %-10s\n", str1, str2, str3);
+  OutS << "-------------------------------------------------"
+       << "\n";
+
+  for (auto &[Callee, Counts] : Calls.Callees)
+    OutS << left_justify(Callee->getName(), 20)
+         << format(" %-16u %-10u\n", Counts.Direct, Counts.Indirect);
+
+  OutS << "-------------------------------------------------"
+       << "\n";
+  OutS << "Unresolved indirect calls: " << Calls.NumUnresolved << "\n\n";
+}
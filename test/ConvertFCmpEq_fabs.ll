@@ -0,0 +1,62 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext --passes="convert-fcmp-eq<fabs>" -S %s \
+; RUN:  | FileCheck %s
+; RUN: opt -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext --passes="convert-fcmp-eq<fabs>,loop-vectorize" \
+; RUN:   -force-vector-width=2 -force-vector-interleave=1 -S %s | FileCheck --check-prefix=VEC %s
+; RUN: not opt -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext --passes="convert-fcmp-eq<fast>" -S %s 2>&1 \
+; RUN:  | FileCheck --check-prefix=WRONG %s
+
+; Verify that with the fabs lowering the absolute value of the difference is
+; computed with llvm.fabs (for scalars and vectors alike) and that loops that
+; contain the converted comparisons are vectorized.
+
+define i1 @fcmp_une(double %a, double %b) {
+; CHECK-LABEL: @fcmp_une
+; CHECK-NEXT:  %1 = fsub double %a, %b
+; CHECK-NEXT:  %2 = call double @llvm.fabs.f64(double %1)
+; CHECK-NEXT:  %cmp = fcmp uge double %2, 0x3CB0000000000000
+; CHECK-NEXT:  ret i1 %cmp
+  %cmp = fcmp une double %a, %b
+  ret i1 %cmp
+}
+
+define <4 x i1> @fcmp_oeq_vector(<4 x float> %a, <4 x float> %b) {
+; CHECK-LABEL: @fcmp_oeq_vector
+; CHECK-NEXT:  %1 = fsub <4 x float> %a, %b
+; CHECK-NEXT:  %2 = call <4 x float> @llvm.fabs.v4f32(<4 x float> %1)
+; CHECK-NEXT:  %cmp = fcmp olt <4 x float> %2, <float 0x3E80000000000000, float 0x3E80000000000000, float 0x3E80000000000000, float 0x3E80000000000000>
+; CHECK-NEXT:  ret <4 x i1> %cmp
+  %cmp = fcmp oeq <4 x float> %a, %b
+  ret <4 x i1> %cmp
+}
+
+; Counts the elements that are (almost) equal
+define i64 @count_eq(ptr noalias %a, ptr noalias %b, i64 %n) {
+; VEC-LABEL: @count_eq
+; VEC:       vector.body:
+; VEC:         [[SUB:%.*]] = fsub <2 x double>
+; VEC-NEXT:    [[ABS:%.*]] = call <2 x double> @llvm.fabs.v2f64(<2 x double> [[SUB]])
+; VEC-NEXT:    fcmp olt <2 x double> [[ABS]], <double 0x3CB0000000000000, double 0x3CB0000000000000>
+entry:
+  %empty = icmp eq i64 %n, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %count = phi i64 [ 0, %entry ], [ %count.next, %loop ]
+  %pa = getelementptr inbounds double, ptr %a, i64 %i
+  %pb = getelementptr inbounds double, ptr %b, i64 %i
+  %va = load double, ptr %pa
+  %vb = load double, ptr %pb
+  %eq = fcmp oeq double %va, %vb
+  %inc = zext i1 %eq to i64
+  %count.next = add i64 %count, %inc
+  %i.next = add nuw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %count.next, %loop ]
+  ret i64 %res
+}
+
+; WRONG: unknown pass name 'convert-fcmp-eq<fast>'
@@ -0,0 +1,63 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext --passes=convert-fcmp-eq -S %s \
+; RUN:  | FileCheck %s
+; RUN: opt -load-pass-plugin=%shlibdir/libConvertFCmpEq%shlibext --passes="convert-fcmp-eq<fused>" -S %s -o - \
+; RUN:  | FileCheck --check-prefixes=REPORT,CHECK %s
+
+; Verify that ConvertFCmpEq converts the comparisons of types other than
+; double (using the machine epsilon of the element type) and that the fused
+; mode reports the comparisons before converting them (libFindFCmpEq is not
+; loaded - ConvertFCmpEq is self-contained).
+
+; REPORT-LABEL: Floating-point equality comparisons in "fcmp_half":
+; REPORT-NEXT:    %cmp = fcmp oeq half %a, %b
+; REPORT-LABEL: Floating-point equality comparisons in "fcmp_float":
+; REPORT-NEXT:    %cmp = fcmp une float %a, %b
+; REPORT-NEXT:    %cmp2 = fcmp ueq float %a, %b
+; REPORT-LABEL: Floating-point equality comparisons in "fcmp_vector":
+; REPORT-NEXT:    %cmp = fcmp oeq <2 x double> %a, %b
+; REPORT-LABEL: Floating-point equality comparisons in "fcmp_scalable":
+; REPORT-NEXT:    %cmp = fcmp oeq <vscale x 2 x float> %a, %b
+
+define i1 @fcmp_half(half %a, half %b) {
+; CHECK-LABEL: @fcmp_half
+; CHECK-NEXT:  %1 = fsub half %a, %b
+; CHECK-NEXT:  %2 = bitcast half %1 to i16
+; CHECK-NEXT:  %3 = and i16 %2, 32767
+; CHECK-NEXT:  %4 = bitcast i16 %3 to half
+; CHECK-NEXT:  %cmp = fcmp olt half %4, 0xH1400
+  %cmp = fcmp oeq half %a, %b
+  ret i1 %cmp
+}
+
+define i1 @fcmp_float(float %a, float %b) {
+; CHECK-LABEL: @fcmp_float
+; CHECK-NEXT:  %1 = fsub float %a, %b
+; CHECK-NEXT:  %2 = bitcast float %1 to i32
+; CHECK-NEXT:  %3 = and i32 %2, 2147483647
+; CHECK-NEXT:  %4 = bitcast i32 %3 to float
+; CHECK-NEXT:  %cmp = fcmp uge float %4, 0x3E80000000000000
+; CHECK:       %cmp2 = fcmp ult float %{{[0-9]+}}, 0x3E80000000000000
+  %cmp = fcmp une float %a, %b
+  %cmp2 = fcmp ueq float %a, %b
+  %res = and i1 %cmp, %cmp2
+  ret i1 %res
+}
+
+define <2 x i1> @fcmp_vector(<2 x double> %a, <2 x double> %b) {
+; CHECK-LABEL: @fcmp_vector
+; CHECK-NEXT:  %1 = fsub <2 x double> %a, %b
+; CHECK-NEXT:  %2 = bitcast <2 x double> %1 to <2 x i64>
+; CHECK-NEXT:  %3 = and <2 x i64> %2, <i64 9223372036854775807, i64 9223372036854775807>
+; CHECK-NEXT:  %4 = bitcast <2 x i64> %3 to <2 x double>
+; CHECK-NEXT:  %cmp = fcmp olt <2 x double> %4, <double 0x3CB0000000000000, double 0x3CB0000000000000>
+  %cmp = fcmp oeq <2 x double> %a, %b
+  ret <2 x i1> %cmp
+}
+
+; Scalable vectors are not supported
+define <vscale x 2 x i1> @fcmp_scalable(<vscale x 2 x float> %a, <vscale x 2 x float> %b) {
+; CHECK-LABEL: @fcmp_scalable
+; CHECK-NEXT:  %cmp = fcmp oeq <vscale x 2 x float> %a, %b
+  %cmp = fcmp oeq <vscale x 2 x float> %a, %b
+  ret <vscale x 2 x i1> %cmp
+}
@@ -1,4 +1,5 @@
 ; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes=duplicate-bb -S %s | FileCheck  %s
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes="duplicate-bb<riv=bitset>" -S %s | FileCheck  %s
 
 ; Verify that the output from DuplicateBB is correct, i.e.
 ;   * every addition was duplicated
@@ -0,0 +1,108 @@
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext \
+; RUN:   -passes=duplicate-bb -S %s -o %t.flat.ll
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext \
+; RUN:   -passes="duplicate-bb<riv=chained>" -S %s -o %t.chained.ll
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext \
+; RUN:   -passes="duplicate-bb<riv=bitset>" -S %s -o %t.bitset.ll
+; RUN: diff %t.flat.ll %t.chained.ll
+; RUN: diff %t.flat.ll %t.bitset.ll
+; RUN: FileCheck %s --input-file=%t.bitset.ll
+
+; Verifies that DuplicateBB picks the same context values, no matter how the
+; RIV sets are represented. There are more than 64 integer values, so the bit
+; vectors span two words and the values are also looked up in the second word
+; (see RIVSet::operator[]).
+
+; CHECK-LABEL: define i32 @foo
+; CHECK:       lt-if-then-else-0:
+; CHECK:       lt-if-then-else-4:
+
+define i32 @foo(i32 %a) {
+entry:
+  %e0 = add i32 %a, 0
+  %e1 = add i32 %e0, 1
+  %e2 = add i32 %e1, 2
+  %e3 = add i32 %e2, 3
+  %e4 = add i32 %e3, 4
+  %e5 = add i32 %e4, 5
+  %e6 = add i32 %e5, 6
+  %e7 = add i32 %e6, 7
+  %e8 = add i32 %e7, 8
+  %e9 = add i32 %e8, 9
+  %e10 = add i32 %e9, 10
+  %e11 = add i32 %e10, 11
+  %e12 = add i32 %e11, 12
+  %e13 = add i32 %e12, 13
+  %e14 = add i32 %e13, 14
+  %e15 = add i32 %e14, 15
+  %e16 = add i32 %e15, 16
+  %e17 = add i32 %e16, 17
+  %e18 = add i32 %e17, 18
+  %e19 = add i32 %e18, 19
+  %e20 = add i32 %e19, 20
+  %e21 = add i32 %e20, 21
+  %e22 = add i32 %e21, 22
+  %e23 = add i32 %e22, 23
+  %e24 = add i32 %e23, 24
+  %e25 = add i32 %e24, 25
+  %e26 = add i32 %e25, 26
+  %e27 = add i32 %e26, 27
+  %e28 = add i32 %e27, 28
+  %e29 = add i32 %e28, 29
+  %e30 = add i32 %e29, 30
+  %e31 = add i32 %e30, 31
+  %e32 = add i32 %e31, 32
+  %e33 = add i32 %e32, 33
+  %e34 = add i32 %e33, 34
+  %e35 = add i32 %e34, 35
+  %e36 = add i32 %e35, 36
+  %e37 = add i32 %e36, 37
+  %e38 = add i32 %e37, 38
+  %e39 = add i32 %e38, 39
+  %e40 = add i32 %e39, 40
+  %e41 = add i32 %e40, 41
+  %e42 = add i32 %e41, 42
+  %e43 = add i32 %e42, 43
+  %e44 = add i32 %e43, 44
+  %e45 = add i32 %e44, 45
+  %e46 = add i32 %e45, 46
+  %e47 = add i32 %e46, 47
+  %e48 = add i32 %e47, 48
+  %e49 = add i32 %e48, 49
+  %e50 = add i32 %e49, 50
+  %e51 = add i32 %e50, 51
+  %e52 = add i32 %e51, 52
+  %e53 = add i32 %e52, 53
+  %e54 = add i32 %e53, 54
+  %e55 = add i32 %e54, 55
+  %e56 = add i32 %e55, 56
+  %e57 = add i32 %e56, 57
+  %e58 = add i32 %e57, 58
+  %e59 = add i32 %e58, 59
+  %e60 = add i32 %e59, 60
+  %e61 = add i32 %e60, 61
+  %e62 = add i32 %e61, 62
+  %e63 = add i32 %e62, 63
+  %e64 = add i32 %e63, 64
+  %e65 = add i32 %e64, 65
+  %e66 = add i32 %e65, 66
+  %e67 = add i32 %e66, 67
+  %e68 = add i32 %e67, 68
+  %e69 = add i32 %e68, 69
+  br label %bb1
+
+bb1:
+  %v1 = add i32 %e69, 1
+  br label %bb2
+
+bb2:
+  %v2 = add i32 %v1, 2
+  br label %bb3
+
+bb3:
+  %v3 = add i32 %v2, 3
+  br label %bb4
+
+bb4:
+  ret i32 %v3
+}
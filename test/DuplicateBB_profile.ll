@@ -0,0 +1,64 @@
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes="duplicate-bb<hot=50>" -S %s | FileCheck  %s --check-prefix=HOT
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes="duplicate-bb<budget=2>" -S %s | FileCheck  %s --check-prefix=BUDGET
+; RUN: not opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes="duplicate-bb<hot>" -disable-output %s 2>&1 | FileCheck %s --check-prefix=WRONG
+
+; The profile-guided mode of DuplicateBB. According to the branch weights,
+; %a is executed ~90% of the time, %b ~9% and %c ~1%. Every one of these
+; contains one instruction to duplicate.
+;  * hot=50 - only the blocks executed in at least 50% of the calls to @foo are
+;    duplicated (%entry, %a and %exit, but neither %b nor %c)
+;  * budget=2 - the two hottest blocks that contain instructions are
+;    duplicated (%a and %b, but not %c). %entry and %exit contain only
+;    terminators and don't count towards the budget.
+
+define void @foo(i32 %n, ptr %p) {
+entry:
+  switch i32 %n, label %c [
+    i32 1, label %a
+    i32 2, label %b
+  ], !prof !0
+
+a:
+  store i32 1, ptr %p
+  br label %exit
+
+b:
+  store i32 2, ptr %p
+  br label %exit
+
+c:
+  store i32 3, ptr %p
+  br label %exit
+
+exit:
+  ret void
+}
+
+!0 = !{!"branch_weights", i32 1, i32 90, i32 9}
+
+; HOT-LABEL: @foo
+; HOT-NEXT:  lt-if-then-else-0:
+; HOT:       lt-if-then-else-1:
+; HOT:       lt-clone-1-1:
+; HOT-NEXT:    store i32 1, ptr %p
+; HOT:       lt-clone-2-1:
+; HOT-NEXT:    store i32 1, ptr %p
+; HOT:       {{^}}b:
+; HOT-NEXT:    store i32 2, ptr %p
+; HOT:       {{^}}c:
+; HOT-NEXT:    store i32 3, ptr %p
+; HOT:       lt-if-then-else-2:
+; HOT-NOT:   lt-if-then-else-3
+
+; BUDGET-LABEL: @foo
+; BUDGET-NEXT:  lt-if-then-else-0:
+; BUDGET:       lt-clone-1-1:
+; BUDGET-NEXT:    store i32 1, ptr %p
+; BUDGET:       lt-clone-1-2:
+; BUDGET-NEXT:    store i32 2, ptr %p
+; BUDGET:       {{^}}c:
+; BUDGET-NEXT:    store i32 3, ptr %p
+; BUDGET:       lt-if-then-else-3:
+; BUDGET-NOT:   lt-if-then-else-4
+
+; WRONG: unknown pass name 'duplicate-bb<hot>'
@@ -0,0 +1,44 @@
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes="duplicate-bb<prune-phis>" -rng-seed=1 -S %s | FileCheck  %s
+
+; With `prune-phis`, the original instructions are moved to lt-clone-1 (the
+; values that get PHI nodes pass their names on to these) and only lt-clone-2
+; contains clones. %t is only used within the block, so unlike
+; %u, it doesn't require a PHI node in lt-tail. (The context values are picked
+; at random - with -rng-seed=1, %exit uses %u rather than %t, which would then
+; need a PHI node as well).
+
+define i32 @foo(i32 %a) {
+entry:
+  %t = add i32 %a, 1
+  %u = mul i32 %t, 3
+  br label %exit
+
+exit:
+  ret i32 %u
+}
+
+; CHECK-LABEL: foo
+; CHECK-NEXT:  lt-if-then-else-0:
+; CHECK-NEXT:    %0 = icmp eq i32 %a, 0
+; CHECK-NEXT:    br i1 %0, label %lt-clone-1-0, label %lt-clone-2-0
+
+; CHECK-LABEL: lt-clone-1-0:
+; CHECK-NEXT:    %t = add i32 %a, 1
+; CHECK-NEXT:    %1 = mul i32 %t, 3
+; CHECK-NEXT:    br label %lt-tail-0
+
+; CHECK-LABEL: lt-clone-2-0:
+; CHECK-NEXT:    %2 = add i32 %a, 1
+; CHECK-NEXT:    %3 = mul i32 %2, 3
+; CHECK-NEXT:    br label %lt-tail-0
+
+; CHECK-LABEL: lt-tail-0:
+; CHECK-NEXT:    %u = phi i32 [ %1, %lt-clone-1-0 ], [ %3, %lt-clone-2-0 ]
+; CHECK-NEXT:    br label %lt-if-then-else-1
+
+; CHECK-LABEL: lt-if-then-else-1:
+; CHECK-NEXT:    %4 = icmp eq i32 %u, 0
+; CHECK-NEXT:    br i1 %4, label %lt-clone-1-1, label %lt-clone-2-1
+
+; CHECK-LABEL: lt-tail-1:
+; CHECK-NEXT:    ret i32 %u
@@ -1,5 +1,11 @@
 ; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" %S/Inputs/CallCounterInput.ll -o %t.bin
 ; RUN: lli %t.bin | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<padded>,verify" %S/Inputs/CallCounterInput.ll -o %t.padded.bin
+; RUN: lli %t.padded.bin | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<atomic>,verify" %S/Inputs/CallCounterInput.ll -o %t.atomic.bin
+; RUN: lli %t.atomic.bin | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<padded;per-thread>,verify" %S/Inputs/CallCounterInput.ll -o %t.per-thread.bin
+; RUN: lli %t.per-thread.bin | FileCheck %s
 
 ; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc.c -o - \
 ; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc,verify" -o %t.bin
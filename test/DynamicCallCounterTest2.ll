@@ -4,7 +4,7 @@
 ; is correct.
 
 ; The global variables inserted by the pass
-; CHECK: @CounterFor_foo = common global i32 0, align 4
+; CHECK: @CounterFor_foo = common global i64 0, align 8
 ; CHECK-NEXT: @0 = private unnamed_addr constant [4 x i8] c"foo\00", align 1
 ; CHECK-NEXT: @ResultFormatStrIR = global [14 x i8]
 ; CHECK-NEXT: @ResultHeaderStrIR = global [225 x i8]
@@ -14,9 +14,9 @@
 define void @foo() {
 ; CHECK-LABEL: @foo(
 ; Call-counting instructions inserted by the pass
-; CHECK-NEXT:    [[TMP1:%.*]] = load i32, ptr @CounterFor_foo
-; CHECK-NEXT:    [[TMP2:%.*]] = add i32 1, [[TMP1]]
-; CHECK-NEXT:    store i32 [[TMP2]], ptr @CounterFor_foo
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr @CounterFor_foo
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr @CounterFor_foo
 ; CHECK-NEXT:    ret void
 ;
   ret void
@@ -30,7 +30,7 @@ define void @foo() {
 ; CHECK-NEXT: enter:
 ; CHECK-NEXT:  %0 = call i32 (ptr, ...) @printf
 ; CHECK-SAME: @ResultHeaderStrIR
-; CHECK-NEXT:  %1 = load i32, ptr @CounterFor_foo
+; CHECK-NEXT:  %1 = load i64, ptr @CounterFor_foo
 ; CHECK-NEXT:  %2 = call i32 (ptr, ...) @printf
 ; CHECK-SAME: @ResultFormatStrIR
 ; CHECK-NEXT:  ret void
@@ -0,0 +1,30 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<padded>,verify"  -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter using the padded counter layout
+; and verify that every function is assigned a separate cache line in the
+; counter array.
+
+; CHECK: @CallCounters = common global [2 x [8 x i64]] zeroinitializer, align 64
+; CHECK-NOT: @CounterFor_
+
+declare void @baz()
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr {{.*}}@CallCounters
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr {{.*}}@CallCounters
+; CHECK-NEXT:    call void @baz()
+;
+  call void @baz()
+  ret void
+}
+
+define void @bar() {
+; CHECK-LABEL: @bar(
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr getelementptr inbounds ({{.*}}@CallCounters, {{.*}})
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr getelementptr inbounds ({{.*}}@CallCounters, {{.*}})
+;
+  ret void
+}
@@ -0,0 +1,54 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<atomic>,verify"  -S %s | FileCheck %s --check-prefix=ATOMIC
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<per-thread>,verify"  -S %s | FileCheck %s --check-prefix=PER-THREAD
+; RUN:  not opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<wrong>" -disable-output %s 2>&1 | FileCheck %s --check-prefix=WRONG
+
+; Instrument this file with the thread-safe variants of DynamicCallCounter and
+; verify that the inserted code is correct.
+
+define i32 @foo(i32 %a) {
+  %x = alloca i32
+  store i32 %a, ptr %x
+  %v = load i32, ptr %x
+  ret i32 %v
+}
+
+; ATOMIC-LABEL: @foo(
+; ATOMIC-NEXT:    atomicrmw add ptr @CounterFor_foo, i64 1 monotonic, align 8
+; ATOMIC-NEXT:    %x = alloca i32
+
+; All thread-local counters are held in one array
+; PER-THREAD: @LocalCallCounters = internal thread_local global [1 x i64] zeroinitializer
+; PER-THREAD: @LocalCallCountersRegistered = internal thread_local global i1 false
+; PER-THREAD: @CounterFor_foo = common global i64 0, align 8
+; PER-THREAD: @CallCounterTable = private constant [1 x ptr] [ptr @CounterFor_foo]
+; PER-THREAD: @llvm.global_ctors = {{.*}} @init_local_counters
+
+; The local counter is incremented after the allocas. The first call on every
+; thread registers the thread exit handler.
+; PER-THREAD-LABEL: @foo(
+; PER-THREAD-NEXT:    %x = alloca i32
+; PER-THREAD-NEXT:    [[TMP1:%.*]] = load i64, ptr {{.*}}@LocalCallCounters
+; PER-THREAD-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; PER-THREAD-NEXT:    store i64 [[TMP2]], ptr {{.*}}@LocalCallCounters
+; PER-THREAD-NEXT:    [[REG:%.*]] = load i1, ptr @LocalCallCountersRegistered
+; PER-THREAD-NEXT:    [[NOTREG:%.*]] = xor i1 [[REG]], true
+; PER-THREAD-NEXT:    br i1 [[NOTREG]]
+; PER-THREAD:         call void @register_local_counters()
+; PER-THREAD:         store i32 %a, ptr %x
+
+; PER-THREAD-LABEL: define internal void @register_local_counters()
+; PER-THREAD:         store i1 true, ptr @LocalCallCountersRegistered
+; PER-THREAD:         call i32 @pthread_setspecific({{.*}}, ptr @LocalCallCounters)
+
+; PER-THREAD-LABEL: define internal void @flush_local_counters(
+; PER-THREAD:         atomicrmw add ptr {{.*}} monotonic
+
+; PER-THREAD-LABEL: define internal void @init_local_counters()
+; PER-THREAD:         call i32 @pthread_key_create(ptr @LocalCallCountersKey, ptr @flush_local_counters)
+
+; The local counters of the main thread are flushed before printing
+; PER-THREAD-LABEL: define void @printf_wrapper()
+; PER-THREAD-NEXT:  enter:
+; PER-THREAD-NEXT:    call void @flush_local_counters(ptr null)
+
+; WRONG: unknown pass name 'dynamic-cc<wrong>'
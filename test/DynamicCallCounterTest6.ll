@@ -0,0 +1,33 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<binary>,verify" %S/Inputs/CallCounterInput.ll -o %t.bin
+; RUN: rm -f %t.prof
+; RUN: env DYNAMIC_CC_PROFILE_FILE=%t.prof lli %t.bin | count 0
+; RUN: ../bin/dynamic-cc-reader %t.prof | FileCheck %s --check-prefix=ID
+; RUN: ../bin/dynamic-cc-reader -sort=count -top=2 %t.prof | FileCheck %s --check-prefix=TOP2
+; RUN: ../bin/dynamic-cc-reader -sort=name %t.prof | FileCheck %s --check-prefix=NAME
+
+; The per-thread mode has to flush the counters of the main thread first
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<per-thread;binary>,verify" %S/Inputs/CallCounterInput.ll -o %t.per-thread.bin
+; RUN: env DYNAMIC_CC_PROFILE_FILE=%t.per-thread.prof lli %t.per-thread.bin
+; RUN: ../bin/dynamic-cc-reader %t.per-thread.prof | FileCheck %s --check-prefix=ID
+
+; RUN: not ../bin/dynamic-cc-reader %s 2>&1 | FileCheck %s --check-prefix=INVALID
+
+; Instrument CallCounterInput.ll with DynamicCallCounter so that it writes a
+; binary profile, run it and verify the profile with dynamic-cc-reader.
+
+; ID:      foo                  13
+; ID-NEXT: bar                  2
+; ID-NEXT: fez                  1
+; ID-NEXT: main                 1
+
+; TOP2:      NAME
+; TOP2:      foo                  13
+; TOP2-NEXT: bar                  2
+; TOP2-NOT:  {{fez|main}}
+
+; NAME:      bar                  2
+; NAME-NEXT: fez                  1
+; NAME-NEXT: foo                  13
+; NAME-NEXT: main                 1
+
+; INVALID: invalid or unsupported profile
@@ -0,0 +1,83 @@
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<skip-small=2>,verify" -S %s | FileCheck %s --check-prefix=SKIP-IR
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<skip-small=2>,verify" %s -o %t.skip.bin
+; RUN: lli %t.skip.bin | FileCheck %s --check-prefix=SKIP
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<sample=4>,verify" -S %s | FileCheck %s --check-prefix=SAMPLE-IR
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<sample=4>,verify" %s -o %t.sample.bin
+; RUN: lli %t.sample.bin | FileCheck %s --check-prefix=SAMPLE
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<padded;atomic;sample=4>,verify" %s -o %t.sample-atomic.bin
+; RUN: lli %t.sample-atomic.bin | FileCheck %s --check-prefix=SAMPLE
+; RUN: not opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<per-thread;sample=4>" -disable-output %s 2>&1 | FileCheck %s --check-prefix=WRONG
+; RUN: not opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<sample=0>" -disable-output %s 2>&1 | FileCheck %s --check-prefix=WRONG-ZERO
+
+; Instrument this file with the low-overhead variants of DynamicCallCounter,
+; verify that the inserted code is correct and that running the instrumented
+; module gives the expected results. The calls made by this module:
+;   * inc - 15,
+;   * loop - 2,
+;   * main - 1.
+
+; `inc` is small and has a direct call site, hence it is not instrumented.
+; `main` is small too, but is never called directly.
+; SKIP-IR-NOT: @CounterFor_inc
+; SKIP-IR-LABEL: define i32 @inc(
+; SKIP-IR-NEXT:    %r = add i32 %x, 1
+; SKIP-IR-LABEL: define i32 @loop(
+; SKIP-IR-NEXT:  entry:
+; SKIP-IR-NEXT:    load i64, ptr @CounterFor_loop
+; SKIP-IR-LABEL: define i32 @main(
+; SKIP-IR-NEXT:    load i64, ptr @CounterFor_main
+
+; SKIP-NOT: inc
+; SKIP-DAG: loop                 2
+; SKIP-DAG: main                 1
+
+; SAMPLE-IR: @CallCountdowns = internal thread_local global [3 x i32] zeroinitializer
+
+; The shared counter is only updated when the countdown reaches 0
+; SAMPLE-IR-LABEL: define i32 @inc(
+; SAMPLE-IR-NEXT:    [[COUNTDOWN:%.*]] = load i32, ptr {{.*}}@CallCountdowns
+; SAMPLE-IR-NEXT:    [[IS_SAMPLE:%.*]] = icmp eq i32 [[COUNTDOWN]], 0
+; SAMPLE-IR-NEXT:    [[DEC:%.*]] = sub i32 [[COUNTDOWN]], 1
+; SAMPLE-IR-NEXT:    [[NEXT:%.*]] = select i1 [[IS_SAMPLE]], i32 3, i32 [[DEC]]
+; SAMPLE-IR-NEXT:    store i32 [[NEXT]], ptr {{.*}}@CallCountdowns
+; SAMPLE-IR-NEXT:    br i1 [[IS_SAMPLE]], label %[[THEN:.*]], label %[[CONT:.*]], !prof
+; SAMPLE-IR:       [[THEN]]:
+; SAMPLE-IR-NEXT:    [[COUNT:%.*]] = load i64, ptr @CounterFor_inc
+; SAMPLE-IR-NEXT:    [[INC:%.*]] = add i64 4, [[COUNT]]
+; SAMPLE-IR-NEXT:    store i64 [[INC]], ptr @CounterFor_inc
+; SAMPLE-IR-NEXT:    br label %[[CONT]]
+; SAMPLE-IR:       [[CONT]]:
+; SAMPLE-IR-NEXT:    %r = add i32 %x, 1
+
+; The counts are rounded up to a multiple of the sampling period
+; SAMPLE-DAG: inc                  16
+; SAMPLE-DAG: loop                 4
+; SAMPLE-DAG: main                 4
+
+; WRONG: unknown pass name 'dynamic-cc<per-thread;sample=4>'
+; WRONG-ZERO: unknown pass name 'dynamic-cc<sample=0>'
+
+define i32 @inc(i32 %x) {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @loop(i32 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %i.next = call i32 @inc(i32 %i)
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %body
+
+exit:
+  ret i32 %i.next
+}
+
+define i32 @main() {
+  %a = call i32 @loop(i32 10)
+  %b = call i32 @loop(i32 5)
+  ret i32 0
+}
@@ -0,0 +1,35 @@
+//========================================================================
+// FILE:
+//    PhaseStatsNesting.cpp
+//
+// DESCRIPTION:
+//    A test driver for PhaseStats (see PhaseStats.h) that re-enters a running
+//    phase, directly and through another phase. None of the passes nests a
+//    phase inside itself, hence this driver (used by PhaseStats_nested.ll).
+//
+// USAGE:
+//      LLVM_TUTOR_PHASE_STATS=<json-file> <BUILD/DIR>/bin/phase-stats-nesting
+//
+// License: MIT
+//========================================================================
+#include "PhaseStats.h"
+
+#include "llvm/Support/ManagedStatic.h"
+
+int main() {
+  // The stats are written when LLVM shuts down
+  llvm::llvm_shutdown_obj SDO;
+
+  PhaseTimer Outer("nesting", "outer");
+  {
+    // Re-entered while running
+    PhaseTimer Same("nesting", "outer");
+    PhaseTimer Inner("nesting", "inner");
+    // Re-entered while paused by "inner"
+    PhaseTimer Again("nesting", "outer");
+    addPhaseCount("nesting", "outer", "nested", 2);
+  }
+  addPhaseCount("nesting", "outer", "nested", 1);
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="duplicate-bb,merge-bb,mba-add,verify" -S %s \
+; RUN:  | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="print<static-cc>,function(print<opcode-counter>,hello-world)" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=PRINT
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext \
+; RUN:   -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="duplicate-bb<riv=bitset>,merge-bb,mba-add,verify" -S %s \
+; RUN:  | FileCheck %s
+
+; Verifies that libLLVMTutor registers the passes and the analyses from all the
+; other plugins, i.e. that passes from different plugins (and passes that
+; require analyses from other plugins, e.g. duplicate-bb requires RIV) can be
+; mixed in one pipeline with only one plugin loaded. libLLVMTutor can also be
+; loaded together with the plugins that it bundles.
+
+; DuplicateBB duplicated the entry block (its RIV set is not empty), MergeBB
+; merged the two copies back, and MBAAdd obfuscated the 8-bit add
+; CHECK-LABEL: define i8 @foo(
+; CHECK-NEXT:  lt-if-then-else-0:
+; CHECK:       lt-clone-2-0:
+; CHECK-NEXT:    xor i8 %a, %b
+; CHECK:         mul i8 39,
+; CHECK:       lt-tail-0:
+
+; PRINT:      NAME                 #N DIRECT CALLS
+; PRINT-NEXT: ---
+; PRINT-NEXT: foo                  1
+; PRINT:      Printing analysis 'OpcodeCounter Pass' for function 'foo':
+; PRINT:      add                  1
+; PRINT:      UEVAR:
+; PRINT:      Printing analysis 'OpcodeCounter Pass' for function 'bar':
+; PRINT:      call                 1
+; PRINT:      UEVAR:
+
+define i8 @foo(i8 %a, i8 %b) {
+  %r = add i8 %a, %b
+  ret i8 %r
+}
+
+define i8 @bar(i8 %a) {
+  %r = call i8 @foo(i8 %a, i8 %a)
+  ret i8 %r
+}
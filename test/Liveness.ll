@@ -0,0 +1,47 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libLiveness%shlibext -passes="print<liveness>" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libLiveness%shlibext -load-pass-plugin %shlibdir/libMergeBB%shlibext \
+; RUN:    -passes="print<liveness>,merge-bb,print<liveness>" -debug-pass-manager -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=CACHED
+
+; Verifies that the result from the Liveness pass for the following function
+; is correct. %b is only defined on one of the paths to %if.end, hence it's
+; live on exit from %entry.
+
+define i32 @foo(i32 %a) {
+entry:
+  %a.addr = alloca i32
+  %b = alloca i32
+  store i32 %a, ptr %a.addr
+  %cmp = icmp sgt i32 %a, 0
+  br i1 %cmp, label %if.then, label %if.end
+
+if.then:
+  %0 = load i32, ptr %a.addr
+  store i32 %0, ptr %b
+  br label %if.end
+
+if.end:
+  %1 = load i32, ptr %b
+  ret i32 %1
+}
+
+; CHECK-LABEL: ----- entry -----
+; CHECK-NEXT: UEVAR:{{ *$}}
+; CHECK-NEXT: VARKILL: a.addr
+; CHECK-NEXT: LIVEOUT: a.addr b
+; CHECK-LABEL: ----- if.then -----
+; CHECK-NEXT: UEVAR: a.addr
+; CHECK-NEXT: VARKILL: b
+; CHECK-NEXT: LIVEOUT: b
+; CHECK-LABEL: ----- if.end -----
+; CHECK-NEXT: UEVAR: b
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
+
+; There's nothing to merge here, so MergeBB preserves all analyses and the
+; second printer re-uses the cached result.
+; CACHED: Running analysis: Liveness on foo
+; CACHED: Running pass: MergeBB on foo
+; CACHED-NOT: Running analysis: Liveness on foo
+; CACHED: Running pass: LivenessPrinter on foo
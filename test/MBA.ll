@@ -0,0 +1,108 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libMBA%shlibext -passes="mba" -S %s \
+; RUN:  | FileCheck %s
+; RUN: opt -load-pass-plugin=%shlibdir/libMBA%shlibext -passes="mba<xor;width=32>" -S %s \
+; RUN:  | FileCheck --check-prefix=XOR32 %s
+; RUN: not opt -load-pass-plugin=%shlibdir/libMBA%shlibext -passes="mba<mul>" -S %s 2>&1 \
+; RUN:  | FileCheck --check-prefix=WRONG %s
+
+; Verifies that the MBA engine picks the identity that corresponds to the
+; opcode and the width of every instruction:
+;    a + b == (((a ^ b) + 2 * (a & b)) * c + d) * c^-1 - d * c^-1
+;    a - b == (a + ~b) + 1
+;    a & b == (a + b) - (a | b)
+;    a | b == (a ^ b) + (a & b)
+;    a ^ b == (a | b) - (a & b)
+; The constants c and d for add depend on the width.
+
+define i16 @add_i16(i16 %a, i16 %b) {
+  %r = add i16 %a, %b
+  ret i16 %r
+}
+
+; CHECK-LABEL: @add_i16
+; CHECK-DAG:   [[XOR:%[0-9]+]] = xor i16 %a, %b
+; CHECK-DAG:   [[AND:%[0-9]+]] = and i16 %a, %b
+; CHECK-DAG:   [[MUL:%[0-9]+]] = mul i16 2, [[AND]]
+; CHECK:       [[REG_1:%[0-9]+]] = add i16 [[XOR]], [[MUL]]
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = mul i16 28555, [[REG_1]]
+; CHECK-NEXT:  [[REG_3:%[0-9]+]] = add i16 7487, [[REG_2]]
+; CHECK-NEXT:  [[REG_4:%[0-9]+]] = mul i16 16419, [[REG_3]]
+; CHECK-NEXT:  %r = add i16 16483, [[REG_4]]
+; CHECK-NEXT:  ret i16 %r
+
+define i64 @add_i64(i64 %a, i64 %b) {
+  %r = add i64 %a, %b
+  ret i64 %r
+}
+
+; CHECK-LABEL: @add_i64
+; CHECK:       [[REG_1:%[0-9]+]] = add i64 {{%[0-9]+}}, {{%[0-9]+}}
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = mul i64 -7046029254386353131, [[REG_1]]
+; CHECK-NEXT:  [[REG_3:%[0-9]+]] = add i64 2685821657736338717, [[REG_2]]
+; CHECK-NEXT:  [[REG_4:%[0-9]+]] = mul i64 -1018231460777725123, [[REG_3]]
+; CHECK-NEXT:  %r = add i64 -4770116112023009001, [[REG_4]]
+
+; There's no add identity for i7, but all the other identities are valid for
+; any width
+define i7 @add_i7(i7 %a, i7 %b) {
+  %r = add i7 %a, %b
+  ret i7 %r
+}
+
+; CHECK-LABEL: @add_i7
+; CHECK-NEXT:  %r = add i7 %a, %b
+; CHECK-NEXT:  ret i7 %r
+
+define i128 @sub_i128(i128 %a, i128 %b) {
+  %r = sub i128 %a, %b
+  ret i128 %r
+}
+
+; CHECK-LABEL: @sub_i128
+; CHECK-NEXT:  [[REG_1:%[0-9]+]] = xor i128 %b, -1
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = add i128 %a, [[REG_1]]
+; CHECK-NEXT:  %r = add i128 [[REG_2]], 1
+
+define i8 @and_i8(i8 %a, i8 %b) {
+  %r = and i8 %a, %b
+  ret i8 %r
+}
+
+; CHECK-LABEL: @and_i8
+; CHECK-NEXT:  [[REG_1:%[0-9]+]] = add i8 %a, %b
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = or i8 %a, %b
+; CHECK-NEXT:  %r = sub i8 [[REG_1]], [[REG_2]]
+
+define i16 @or_i16(i16 %a, i16 %b) {
+  %r = or i16 %a, %b
+  ret i16 %r
+}
+
+; CHECK-LABEL: @or_i16
+; CHECK-NEXT:  [[REG_1:%[0-9]+]] = xor i16 %a, %b
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = and i16 %a, %b
+; CHECK-NEXT:  %r = add i16 [[REG_1]], [[REG_2]]
+
+define i32 @xor_i32(i32 %a, i32 %b) {
+  %r = xor i32 %a, %b
+  ret i32 %r
+}
+
+; CHECK-LABEL: @xor_i32
+; CHECK-NEXT:  [[REG_1:%[0-9]+]] = or i32 %a, %b
+; CHECK-NEXT:  [[REG_2:%[0-9]+]] = and i32 %a, %b
+; CHECK-NEXT:  %r = sub i32 [[REG_1]], [[REG_2]]
+
+; XOR32-LABEL: @add_i16
+; XOR32-NEXT:  %r = add i16 %a, %b
+; XOR32-LABEL: @and_i8
+; XOR32-NEXT:  %r = and i8 %a, %b
+; XOR32-LABEL: @or_i16
+; XOR32-NEXT:  %r = or i16 %a, %b
+; XOR32-LABEL: @xor_i32
+; XOR32-NEXT:  [[REG_1:%[0-9]+]] = or i32 %a, %b
+; XOR32-NEXT:  [[REG_2:%[0-9]+]] = and i32 %a, %b
+; XOR32-NEXT:  %r = sub i32 [[REG_1]], [[REG_2]]
+; XOR32-NEXT:  ret i32 %r
+
+; WRONG: unknown pass name 'mba<mul>'
@@ -0,0 +1,54 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext -passes="mba-add<hot-loop=100>" -S %s \
+; RUN:  | FileCheck --check-prefix=HOT %s
+; RUN: opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext -passes="mba-add<budget=14>" -S %s \
+; RUN:  | FileCheck --check-prefix=BUDGET %s
+; RUN: opt -load-pass-plugin=%shlibdir/libMBA%shlibext -passes="mba<hot-loop=100>" -S %s \
+; RUN:  | FileCheck --check-prefix=MBA %s
+; RUN: not opt -load-pass-plugin=%shlibdir/libMBAAdd%shlibext -passes="mba-add<budget>" -S %s 2>&1 \
+; RUN:  | FileCheck --check-prefix=WRONG %s
+
+; Verifies the budget mode of the MBA passes. The loop is executed ~32 times
+; per execution of the entry block, so:
+;  * with hot-loop=100 none of the instructions inside the loop is obfuscated
+;  * with budget=14 (every 8-bit add substitution adds 7 instructions) only
+;    the two adds outside of the loop (i.e. the coldest ones) are obfuscated
+
+define i8 @kernel(i8 %a, i8 %b, i32 %n) {
+entry:
+  %pre = add i8 %a, %b
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i8 [ %pre, %entry ], [ %acc.next, %loop ]
+  %acc.next = add i8 %acc, %b
+  %i.next = add i32 %i, 1
+  %cmp = icmp slt i32 %i.next, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  %post = add i8 %acc.next, %a
+  ret i8 %post
+}
+
+; HOT-LABEL: entry:
+; HOT:         %pre = add i8 111, {{%[0-9]+}}
+; HOT-LABEL: loop:
+; HOT:         %acc.next = add i8 %acc, %b
+; HOT-LABEL: exit:
+; HOT:         %post = add i8 111, {{%[0-9]+}}
+
+; BUDGET-LABEL: entry:
+; BUDGET:         %pre = add i8 111, {{%[0-9]+}}
+; BUDGET-LABEL: loop:
+; BUDGET:         %acc.next = add i8 %acc, %b
+; BUDGET-LABEL: exit:
+; BUDGET:         %post = add i8 111, {{%[0-9]+}}
+
+; MBA-LABEL: loop:
+; MBA-NEXT:    %i = phi i32
+; MBA-NEXT:    %acc = phi i8
+; MBA-NEXT:    %acc.next = add i8 %acc, %b
+; MBA-NEXT:    %i.next = add i32 %i, 1
+
+; WRONG: unknown pass name 'mba-add<budget>'
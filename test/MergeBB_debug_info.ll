@@ -0,0 +1,49 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck  %s
+
+; Debug intrinsics are ignored when comparing blocks: %if.then and %if.else
+; are identical modulo the debug info and are merged.
+
+define i32 @foo(i32 %x, i32 %y) !dbg !6 {
+entry:
+  %cmp = icmp eq i32 %x, 19
+  br i1 %cmp, label %if.then, label %if.else
+
+if.then:
+  call void @llvm.dbg.value(metadata i32 %x, metadata !9, metadata !DIExpression()), !dbg !10
+  %add1 = add i32 %y, 1
+  call void @llvm.dbg.value(metadata i32 %add1, metadata !9, metadata !DIExpression()), !dbg !10
+  br label %exit
+
+if.else:
+  %add2 = add i32 %y, 1
+  call void @llvm.dbg.value(metadata i32 %add2, metadata !9, metadata !DIExpression()), !dbg !10
+  br label %exit
+
+exit:
+  %r = phi i32 [ %add1, %if.then ], [ %add2, %if.else ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: @foo
+; CHECK:         br i1 %cmp, label %if.else, label %if.else
+; CHECK-NOT:   if.then:
+; CHECK-LABEL: if.else:
+; CHECK:         %add2 = add i32 %y, 1
+; CHECK-LABEL: exit:
+; CHECK-NEXT:    ret i32 %add2
+
+declare void @llvm.dbg.value(metadata, metadata, metadata)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "llvm-tutor", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "input.c", directory: "/")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = !DISubroutineType(types: !2)
+!6 = distinct !DISubprogram(name: "foo", scope: !1, file: !1, line: 1, type: !5, scopeLine: 1, spFlags: DISPFlagDefinition, unit: !0, retainedNodes: !2)
+!7 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!9 = !DILocalVariable(name: "v", scope: !6, file: !1, line: 2, type: !7)
+!10 = !DILocation(line: 2, column: 1, scope: !6)
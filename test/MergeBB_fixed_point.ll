@@ -0,0 +1,64 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck  %s --check-prefix=ONCE
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes="merge-bb<fixed-point>" -S %s | FileCheck  %s --check-prefix=FIXED-POINT
+
+; %a.1 and %b.1 are identical and are merged. Only then %a.0 and %b.0 become
+; identical (both branch to the retained block). This is only picked up when
+; iterating to a fixed point.
+
+define i32 @foo(i32 %x) {
+entry:
+  switch i32 %x, label %c [
+    i32 1, label %a.0
+    i32 2, label %b.0
+  ]
+
+a.0:
+  br label %a.1
+
+b.0:
+  br label %b.1
+
+a.1:
+  br label %exit
+
+b.1:
+  br label %exit
+
+c:
+  br label %exit
+
+exit:
+  %r = phi i32 [ 1, %a.1 ], [ 1, %b.1 ], [ 2, %c ]
+  ret i32 %r
+}
+
+; ONCE-LABEL: @foo
+; ONCE:         switch i32 %x, label %c [
+; ONCE-NEXT:      i32 1, label %a.0
+; ONCE-NEXT:      i32 2, label %b.0
+; ONCE-NEXT:    ]
+; ONCE-LABEL: a.0:
+; ONCE-NEXT:    br label %b.1
+; ONCE-LABEL: b.0:
+; ONCE-NEXT:    br label %b.1
+; ONCE-NOT:   a.1:
+; ONCE-LABEL: b.1:
+; ONCE-NEXT:    br label %exit
+; ONCE-LABEL: exit:
+; ONCE-NEXT:    %r = phi i32 [ 1, %b.1 ], [ 2, %c ]
+
+; Which of %a.0 and %b.0 is retained depends on the order in which the
+; predecessors of the retained block are revisited
+; FIXED-POINT-LABEL: @foo
+; FIXED-POINT:         switch i32 %x, label %c [
+; FIXED-POINT-NEXT:      i32 1, label %[[KEPT:[ab]\.0]]
+; FIXED-POINT-NEXT:      i32 2, label %[[KEPT]]
+; FIXED-POINT-NEXT:    ]
+; FIXED-POINT-EMPTY:
+; FIXED-POINT-NEXT:  [[KEPT]]:
+; FIXED-POINT-NEXT:    br label %b.1
+; FIXED-POINT-EMPTY:
+; FIXED-POINT-NEXT:  b.1:
+; FIXED-POINT-NEXT:    br label %exit
+; FIXED-POINT-LABEL: exit:
+; FIXED-POINT-NEXT:    %r = phi i32 [ 1, %b.1 ], [ 2, %c ]
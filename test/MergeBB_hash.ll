@@ -0,0 +1,72 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck  %s
+
+; The successor (%exit) has many predecessors of different shapes. These are
+; bucketed by their structural hash and only the blocks within one bucket are
+; compared with one another (e.g. %add.N are never compared with %mul.N).
+
+define i32 @foo(i32 %x, i32 %y) {
+entry:
+  switch i32 %x, label %default [
+    i32 1, label %add.1
+    i32 2, label %mul.1
+    i32 3, label %add.2
+    i32 4, label %mul.2
+    i32 5, label %add.3
+    i32 6, label %sub
+  ]
+
+add.1:
+  %a1 = add i32 %y, 1
+  br label %exit
+
+mul.1:
+  %m1 = mul i32 %y, 3
+  br label %exit
+
+add.2:
+  %a2 = add i32 %y, 1
+  br label %exit
+
+mul.2:
+  %m2 = mul i32 %y, 3
+  br label %exit
+
+add.3:
+  %a3 = add i32 %y, 1
+  br label %exit
+
+sub:
+  %s = sub i32 %y, 1
+  br label %exit
+
+default:
+  br label %exit
+
+exit:
+  %r = phi i32 [ %a1, %add.1 ], [ %m1, %mul.1 ], [ %a2, %add.2 ], [ %m2, %mul.2 ], [ %a3, %add.3 ], [ %s, %sub ], [ 0, %default ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: @foo
+; CHECK:         switch i32 %x, label %default [
+; CHECK-NEXT:      i32 1, label %add.3
+; CHECK-NEXT:      i32 2, label %mul.2
+; CHECK-NEXT:      i32 3, label %add.3
+; CHECK-NEXT:      i32 4, label %mul.2
+; CHECK-NEXT:      i32 5, label %add.3
+; CHECK-NEXT:      i32 6, label %sub
+; CHECK-NEXT:    ]
+
+; CHECK-NOT:   add.1:
+; CHECK-NOT:   mul.1:
+; CHECK-NOT:   add.2:
+
+; CHECK-LABEL: mul.2:
+; CHECK-NEXT:    %m2 = mul i32 %y, 3
+; CHECK-LABEL: add.3:
+; CHECK-NEXT:    %a3 = add i32 %y, 1
+; CHECK-LABEL: sub:
+; CHECK-NEXT:    %s = sub i32 %y, 1
+; CHECK-LABEL: default:
+; CHECK-LABEL: exit:
+; CHECK-NEXT:    %r = phi i32 [ %m2, %mul.2 ], [ %a3, %add.3 ], [ %s, %sub ], [ 0, %default ]
@@ -0,0 +1,118 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck  %s
+
+; Predecessors terminated with indirectbr and invoke. The normal (but not the
+; unwind) destinations of invokes can be merged. For indirect branches, the
+; block addresses are updated as well - provided that these are only used by
+; indirectbr. Otherwise the addresses of two different labels would compare
+; equal.
+
+declare void @bar()
+declare i32 @__gxx_personality_v0(...)
+
+@targets = constant [3 x ptr] [ptr blockaddress(@indirect, %a), ptr blockaddress(@indirect, %b), ptr blockaddress(@indirect, %c)]
+
+; %a and %b are identical, but their addresses are stored in a table (and could
+; e.g. be compared), so these are not merged
+define i32 @indirect(i32 %idx) {
+entry:
+  %gep = getelementptr [3 x ptr], ptr @targets, i32 0, i32 %idx
+  %target = load ptr, ptr %gep
+  indirectbr ptr %target, [label %a, label %b, label %c]
+
+a:
+  br label %exit
+
+b:
+  br label %exit
+
+c:
+  br label %exit
+
+exit:
+  %r = phi i32 [ 1, %a ], [ 1, %b ], [ 2, %c ]
+  ret i32 %r
+}
+
+; CHECK: @targets = constant [3 x ptr] [ptr blockaddress(@indirect, %a), ptr blockaddress(@indirect, %b), ptr blockaddress(@indirect, %c)]
+
+; CHECK-LABEL: define i32 @indirect
+; CHECK:         indirectbr ptr %target, [label %a, label %b, label %c]
+; CHECK:       {{^}}a:
+; CHECK:       exit:
+; CHECK-NEXT:    %r = phi i32 [ 1, %a ], [ 1, %b ], [ 2, %c ]
+
+; The addresses of %a and %b are only used by indirectbr, so %a is merged into
+; %b (and blockaddress(@indirect_direct, %a) becomes
+; blockaddress(@indirect_direct, %b))
+define i32 @indirect_direct(i1 %c) {
+entry:
+  br i1 %c, label %jump.a, label %jump.b
+
+jump.a:
+  indirectbr ptr blockaddress(@indirect_direct, %a), [label %a]
+
+jump.b:
+  indirectbr ptr blockaddress(@indirect_direct, %b), [label %b]
+
+a:
+  br label %exit
+
+b:
+  br label %exit
+
+exit:
+  %r = phi i32 [ 1, %a ], [ 1, %b ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: define i32 @indirect_direct
+; CHECK:       jump.a:
+; CHECK-NEXT:    indirectbr ptr blockaddress(@indirect_direct, %b), [label %b]
+; CHECK:       jump.b:
+; CHECK-NEXT:    indirectbr ptr blockaddress(@indirect_direct, %b), [label %b]
+; CHECK-NOT:   {{^}}a:
+; CHECK:       exit:
+; CHECK-NEXT:    ret i32 1
+
+; %normal.1 is merged into %normal.2. The landing pads are kept.
+define i32 @invoke(i1 %c) personality ptr @__gxx_personality_v0 {
+entry:
+  br i1 %c, label %call.1, label %call.2
+
+call.1:
+  invoke void @bar() to label %normal.1 unwind label %lpad.1
+
+call.2:
+  invoke void @bar() to label %normal.2 unwind label %lpad.2
+
+normal.1:
+  br label %exit
+
+normal.2:
+  br label %exit
+
+lpad.1:
+  %lp.1 = landingpad { ptr, i32 } cleanup
+  br label %exit
+
+lpad.2:
+  %lp.2 = landingpad { ptr, i32 } cleanup
+  br label %exit
+
+exit:
+  %r = phi i32 [ 0, %normal.1 ], [ 0, %normal.2 ], [ 1, %lpad.1 ], [ 1, %lpad.2 ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: @invoke
+; CHECK:       call.1:
+; CHECK-NEXT:    invoke void @bar()
+; CHECK-NEXT:      to label %normal.2 unwind label %lpad.1
+; CHECK:       call.2:
+; CHECK-NEXT:    invoke void @bar()
+; CHECK-NEXT:      to label %normal.2 unwind label %lpad.2
+; CHECK-NOT:   normal.1:
+; CHECK:       lpad.1:
+; CHECK:       lpad.2:
+; CHECK:       exit:
+; CHECK-NEXT:    %r = phi i32 [ 0, %normal.2 ], [ 1, %lpad.1 ], [ 1, %lpad.2 ]
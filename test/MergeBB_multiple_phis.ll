@@ -0,0 +1,136 @@
+; RUN: opt -load-pass-plugin %shlibdir/libMergeBB%shlibext -passes=merge-bb -S %s | FileCheck  %s
+
+; The successors have multiple PHI nodes. Blocks are merged only if, for every
+; PHI node, the incoming values are identical or are corresponding
+; instructions in the two blocks.
+
+; %a.1 is merged into %b.1 - the incoming values are identical for both PHI
+; nodes. %c.1 differs from %b.1 in the value passed to %q, so it's kept.
+define i32 @same_values(i32 %x, i32 %y) {
+entry:
+  switch i32 %x, label %c.1 [
+    i32 1, label %a.1
+    i32 2, label %b.1
+  ]
+
+a.1:
+  br label %exit
+
+b.1:
+  br label %exit
+
+c.1:
+  br label %exit
+
+exit:
+  %p = phi i32 [ 10, %a.1 ], [ 10, %b.1 ], [ 10, %c.1 ]
+  %q = phi i32 [ %y, %a.1 ], [ %y, %b.1 ], [ 20, %c.1 ]
+  %r = add i32 %p, %q
+  ret i32 %r
+}
+
+; CHECK-LABEL: @same_values
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    switch i32 %x, label %c.1 [
+; CHECK-NEXT:      i32 1, label %b.1
+; CHECK-NEXT:      i32 2, label %b.1
+; CHECK-NEXT:    ]
+; CHECK-NOT:   a.1:
+; CHECK:       exit:
+; CHECK-NEXT:    %q = phi i32 [ %y, %b.1 ], [ 20, %c.1 ]
+; CHECK-NEXT:    %r = add i32 10, %q
+
+; %a.2 is merged into %b.2 - every PHI node receives the corresponding
+; instruction from both blocks. (The PHI nodes are left with one incoming
+; value each and are folded away.)
+define i32 @local_values(i1 %c, i32 %y) {
+entry:
+  br i1 %c, label %a.2, label %b.2
+
+a.2:
+  %a.add = add i32 %y, 1
+  %a.mul = mul i32 %y, 3
+  br label %exit
+
+b.2:
+  %b.add = add i32 %y, 1
+  %b.mul = mul i32 %y, 3
+  br label %exit
+
+exit:
+  %p = phi i32 [ %a.add, %a.2 ], [ %b.add, %b.2 ]
+  %q = phi i32 [ %a.mul, %a.2 ], [ %b.mul, %b.2 ]
+  %r = sub i32 %p, %q
+  ret i32 %r
+}
+
+; CHECK-LABEL: @local_values
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    br i1 %c, label %b.2, label %b.2
+; CHECK-NOT:   a.2:
+; CHECK:       exit:
+; CHECK-NEXT:    %r = sub i32 %b.add, %b.mul
+
+; The instructions in %a.3 and %b.3 are identical, but flow into different PHI
+; nodes (%b.3 passes the sum to %q rather than to %p), so these are not merged.
+define i32 @swapped_values(i1 %c, i32 %y) {
+entry:
+  br i1 %c, label %a.3, label %b.3
+
+a.3:
+  %a.add = add i32 %y, 1
+  %a.mul = mul i32 %y, 3
+  br label %exit
+
+b.3:
+  %b.add = add i32 %y, 1
+  %b.mul = mul i32 %y, 3
+  br label %exit
+
+exit:
+  %p = phi i32 [ %a.add, %a.3 ], [ %b.mul, %b.3 ]
+  %q = phi i32 [ %a.mul, %a.3 ], [ %b.add, %b.3 ]
+  %r = sub i32 %p, %q
+  ret i32 %r
+}
+
+; CHECK-LABEL: @swapped_values
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    br i1 %c, label %a.3, label %b.3
+; CHECK:       b.3:
+; CHECK:       exit:
+; CHECK-NEXT:    %p = phi i32 [ %a.add, %a.3 ], [ %b.mul, %b.3 ]
+; CHECK-NEXT:    %q = phi i32 [ %a.mul, %a.3 ], [ %b.add, %b.3 ]
+
+; %a.4 and %b.4 contain PHI nodes, so these are not merged (the PHI node in
+; the retained block would have to be updated with new incoming blocks).
+define i32 @phis_in_blocks(i1 %c, i1 %d) {
+entry:
+  br i1 %c, label %p.1, label %p.2
+
+p.1:
+  br i1 %d, label %a.4, label %b.4
+
+p.2:
+  br i1 %d, label %a.4, label %b.4
+
+a.4:
+  %a.phi = phi i32 [ 0, %p.1 ], [ 1, %p.2 ]
+  br label %exit
+
+b.4:
+  %b.phi = phi i32 [ 0, %p.1 ], [ 1, %p.2 ]
+  br label %exit
+
+exit:
+  %r = phi i32 [ 5, %a.4 ], [ 5, %b.4 ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: @phis_in_blocks
+; CHECK:       a.4:
+; CHECK-NEXT:    %a.phi = phi i32 [ 0, %p.1 ], [ 1, %p.2 ]
+; CHECK:       b.4:
+; CHECK-NEXT:    %b.phi = phi i32 [ 0, %p.1 ], [ 1, %p.2 ]
+; CHECK:       exit:
+; CHECK-NEXT:    %r = phi i32 [ 5, %a.4 ], [ 5, %b.4 ]
@@ -1,5 +1,7 @@
 ; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<opcode-counter>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
 ; RUN:   | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<opcode-counter;format=compact>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck %s --check-prefix=COMPACT
 
 ;------------------------------------------------------------------------------
 ; EXPECTED OUTPUT
@@ -25,3 +27,19 @@
 ; CHECK-NEXT: alloca               2
 ; CHECK-NEXT: store                4
 ; CHECK-NEXT: icmp                 1
+
+; In the compact format the opcodes are listed in the order of their first use
+; COMPACT-NOT:  Printing analysis
+; COMPACT:      opcode-counter @foo ret 1
+; COMPACT-NEXT: opcode-counter @bar call 1
+; COMPACT-NEXT: opcode-counter @bar ret 1
+; COMPACT-NEXT: opcode-counter @fez call 1
+; COMPACT-NEXT: opcode-counter @fez ret 1
+; COMPACT-NEXT: opcode-counter @main alloca 2
+; COMPACT-NEXT: opcode-counter @main store 4
+; COMPACT-NEXT: opcode-counter @main call 4
+; COMPACT-NEXT: opcode-counter @main br 4
+; COMPACT-NEXT: opcode-counter @main load 2
+; COMPACT-NEXT: opcode-counter @main icmp 1
+; COMPACT-NEXT: opcode-counter @main add 1
+; COMPACT-NEXT: opcode-counter @main ret 1
@@ -6,9 +6,14 @@
 ; RUN:   | FileCheck %s
 ; RUN:  opt -disable-verify -debug-pass-manager -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes='default<Os>' %s -disable-output 2>&1\
 ; RUN:   | FileCheck %s
+; RUN:  opt -disable-verify -debug-pass-manager -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes='default<O2>' %s -disable-output 2>&1\
+; RUN:   | FileCheck %s --check-prefix=BUNDLED --implicit-check-not=OpcodeCounterPrinter
 
 ; CHECK: Running pass: OpcodeCounterPrinter on foo
 
+; Only libOpcodeCounter adds OpcodeCounterPrinter to the pipelines
+; BUNDLED: Running pass: {{.*}} on foo
+
 define void @foo() {
   ret void
 }
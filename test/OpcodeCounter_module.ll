@@ -0,0 +1,50 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<module-opcode-counter>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<module-opcode-counter;format=json>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck --check-prefix=JSON %s
+; RUN:  opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<module-opcode-counter;format=csv>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck --check-prefix=CSV %s
+; RUN:  not opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<module-opcode-counter;format=xml>" %S/Inputs/CallCounterInput.ll -disable-output 2>&1\
+; RUN:   | FileCheck --check-prefix=WRONG %s
+
+; Test the module-level OpcodeCounter analysis, i.e. the opcodes of all the
+; functions in the module added together. The JSON and CSV outputs are sorted
+; by opcode name.
+
+;------------------------------------------------------------------------------
+; EXPECTED OUTPUT
+;------------------------------------------------------------------------------
+
+; CHECK: Printing analysis 'OpcodeCounter Pass' for module
+; CHECK: load                 2
+; CHECK-NEXT: br                   4
+; CHECK-NEXT: icmp                 1
+; CHECK-NEXT: add                  1
+; CHECK-NEXT: ret                  4
+; CHECK-NEXT: call                 6
+; CHECK-NEXT: alloca               2
+; CHECK-NEXT: store                4
+
+; JSON:      "instructions": 24,
+; JSON-NEXT: "opcodes": {
+; JSON-NEXT:   "add": 1,
+; JSON-NEXT:   "alloca": 2,
+; JSON-NEXT:   "br": 4,
+; JSON-NEXT:   "call": 6,
+; JSON-NEXT:   "icmp": 1,
+; JSON-NEXT:   "load": 2,
+; JSON-NEXT:   "ret": 4,
+; JSON-NEXT:   "store": 4
+; JSON-NEXT: }
+
+; CSV:      name,opcode,count
+; CSV-NEXT: {{.*}}CallCounterInput.ll,add,1
+; CSV-NEXT: {{.*}}CallCounterInput.ll,alloca,2
+; CSV-NEXT: {{.*}}CallCounterInput.ll,br,4
+; CSV-NEXT: {{.*}}CallCounterInput.ll,call,6
+; CSV-NEXT: {{.*}}CallCounterInput.ll,icmp,1
+; CSV-NEXT: {{.*}}CallCounterInput.ll,load,2
+; CSV-NEXT: {{.*}}CallCounterInput.ll,ret,4
+; CSV-NEXT: {{.*}}CallCounterInput.ll,store,4
+
+; WRONG: unknown pass name 'print<module-opcode-counter;format=xml>'
@@ -0,0 +1,96 @@
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes="function(hello-world,mba-add,merge-bb,duplicate-bb,print<opcode-counter>)" \
+; RUN:   -S %s -o %t.seq.ll 2> %t.seq.txt
+; RUN: opt -load-pass-plugin %shlibdir/libParallelFunctions%shlibext \
+; RUN:   -passes="parallel<threads=1>(hello-world,mba-add,merge-bb,duplicate-bb,print<opcode-counter>)" \
+; RUN:   -S %s -o %t.1.ll 2> %t.1.txt
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes="parallel<threads=4>(hello-world,mba-add,merge-bb,duplicate-bb,print<opcode-counter>)" \
+; RUN:   -S %s -o %t.4.ll 2> %t.4.txt
+; RUN: diff %t.seq.ll %t.1.ll
+; RUN: diff %t.seq.ll %t.4.ll
+; RUN: diff %t.seq.txt %t.1.txt
+; RUN: diff %t.seq.txt %t.4.txt
+; RUN: FileCheck %s --input-file=%t.4.ll --check-prefix=IR
+; RUN: FileCheck %s --input-file=%t.4.txt --check-prefix=OUT
+
+; libParallelFunctions can be loaded together with the plugins that it uses
+; (and with libLLVMTutor). The representation of the RIV sets doesn't change
+; the selected blocks.
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext \
+; RUN:   -passes="function(duplicate-bb)" -S %s -o %t.dbb.seq.ll
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libParallelFunctions%shlibext \
+; RUN:   -passes="require<integer-globals>,parallel<threads=4>(duplicate-bb<riv=bitset>)" -S %s -o %t.dbb.riv.ll
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -load-pass-plugin %shlibdir/libParallelFunctions%shlibext \
+; RUN:   -passes="parallel<threads=4>(duplicate-bb<riv=chained>)" -S %s -o %t.dbb.tutor.ll
+; RUN: diff %t.dbb.seq.ll %t.dbb.riv.ll
+; RUN: diff %t.dbb.seq.ll %t.dbb.tutor.ll
+
+; Only the supported passes (with the supported options) can be used
+; RUN: not opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes="parallel(riv)" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=WRONG-PASS
+; RUN: not opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes="parallel(duplicate-bb<hot=50>)" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=WRONG-PASS
+; RUN: not opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext \
+; RUN:   -passes="parallel<threads=x>(merge-bb)" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=WRONG-THREADS
+
+; The parallel adaptor produces the same IR and the same output as running the
+; passes function by function, no matter how many threads are used. Every
+; function is given its own random generator and block counter by
+; DuplicateBB, so every function gets its own lt-if-then-else-0.
+
+; IR-LABEL: define i8 @add
+; IR:       lt-if-then-else-0:
+; IR:         xor i8
+; IR-LABEL: define i32 @merge
+; IR-NOT:     bb2:
+; IR:       lt-if-then-else-0:
+; IR-LABEL: define void @locals
+; IR:       lt-if-then-else-0:
+
+; OUT:      ----- entry -----
+; OUT:      Printing analysis 'OpcodeCounter Pass' for function 'add':
+; OUT-NEXT: =====
+; OUT:      ----- bb2 -----
+; OUT:      Printing analysis 'OpcodeCounter Pass' for function 'merge':
+; OUT:      ----- entry -----
+; OUT-NEXT: UEVAR:
+; OUT-NEXT: VARKILL: x
+; OUT:      Printing analysis 'OpcodeCounter Pass' for function 'locals':
+
+; WRONG-PASS: invalid use of 'parallel' pass as module pipeline
+; WRONG-THREADS: unknown pipeline name 'parallel<threads=x>'
+
+define i8 @add(i8 %a, i8 %b) {
+entry:
+  %r = add i8 %a, %b
+  ret i8 %r
+}
+
+define i32 @merge(i32 %a, i32 %b) {
+entry:
+  %c = icmp eq i32 %a, 0
+  br i1 %c, label %bb1, label %bb2
+
+bb1:
+  %x = add i32 %a, %b
+  br label %exit
+
+bb2:
+  %y = add i32 %a, %b
+  br label %exit
+
+exit:
+  %r = phi i32 [ %x, %bb1 ], [ %y, %bb2 ]
+  ret i32 %r
+}
+
+define void @locals(i32 %a) {
+entry:
+  %x = alloca i32
+  store i32 %a, ptr %x
+  ret void
+}
@@ -0,0 +1,94 @@
+; RUN: rm -f %t.json
+; RUN: env LLVM_TUTOR_PHASE_STATS=%t.json opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="merge-bb,duplicate-bb" -disable-output %s 2>&1 \
+; RUN:  | count 0
+; RUN: FileCheck %s --check-prefix=JSON < %t.json
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="merge-bb,duplicate-bb" -disable-output -time-passes %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=TIMERS
+; RUN: opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="merge-bb,duplicate-bb" -disable-output %s 2>&1 \
+; RUN:  | count 0
+
+; Verifies the phase timers and counters (see PhaseStats.h): MergeBB merges
+; %bb1 into %bb2, then DuplicateBB duplicates the 3 remaining blocks (the RIV
+; analysis that it requires is timed too). Without -time-passes or
+; LLVM_TUTOR_PHASE_STATS nothing is reported.
+
+; The passes and the phases are sorted by name
+; JSON:      "duplicate-bb": {
+; JSON-NEXT:   "clone": {
+; JSON-NEXT:     "runs": 1,
+; JSON-NEXT:     "wall": {{.*}},
+; JSON-NEXT:     "user": {{.*}},
+; JSON-NEXT:     "sys": {{.*}},
+; JSON-NEXT:     "counters": {
+; JSON-NEXT:       "cloned-instructions": 2
+; JSON-NEXT:     }
+; JSON-NEXT:   },
+; JSON-NEXT:   "select": {
+; JSON:          "counters": {
+; JSON-NEXT:       "blocks": 3,
+; JSON-NEXT:       "selected-blocks": 3
+; JSON:      "merge-bb": {
+; JSON-NEXT:   "rewrite": {
+; JSON-NEXT:     "runs": 2,
+; JSON:          "counters": {
+; JSON-NEXT:       "merged-blocks": 1,
+; JSON-NEXT:       "updated-targets": 1
+; JSON:        "search": {
+; JSON:          "counters": {
+; JSON-NEXT:       "successors": 1,
+; JSON-NEXT:       "visited-blocks": 4
+; JSON:        "summarize": {
+; JSON:          "counters": {
+; JSON-NEXT:       "blocks": 4
+; JSON:      "riv": {
+; JSON-NEXT:   "integer-globals": {
+; JSON-NEXT:     "runs": 1,
+; JSON:        "step1": {
+; JSON:          "counters": {
+; JSON-NEXT:       "blocks": 3,
+; JSON-NEXT:       "values": 2
+; JSON:        "step2": {
+; JSON:          "counters": {
+; JSON-NEXT:       "args": 2,
+; JSON-NEXT:       "globals": 0
+; JSON:        "step3": {
+; JSON:          "counters": {
+; JSON-NEXT:       "blocks": 3,
+; JSON-NEXT:       "copied-values": 3
+
+; The timers are sorted by time
+; TIMERS:     LLVM-TUTOR: duplicate-bb phases
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  clone
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  select
+; TIMERS:     LLVM-TUTOR: duplicate-bb phase counters
+; TIMERS:       clone.cloned-instructions 2
+; TIMERS-NEXT:  select.blocks 3
+; TIMERS-NEXT:  select.selected-blocks 3
+; TIMERS:     LLVM-TUTOR: merge-bb phases
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  rewrite
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  search
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  summarize
+; TIMERS:     LLVM-TUTOR: merge-bb phase counters
+; TIMERS:     LLVM-TUTOR: riv phases
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  step1
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  step2
+; TIMERS-DAG: {{[0-9.]+}} ({{.*}})  step3
+; TIMERS:     LLVM-TUTOR: riv phase counters
+
+define i32 @foo(i32 %a, i32 %b) {
+entry:
+  %c = icmp eq i32 %a, 0
+  br i1 %c, label %bb1, label %bb2
+
+bb1:
+  %x = add i32 %a, %b
+  br label %exit
+
+bb2:
+  %y = add i32 %a, %b
+  br label %exit
+
+exit:
+  %r = phi i32 [ %x, %bb1 ], [ %y, %bb2 ]
+  ret i32 %r
+}
@@ -0,0 +1,19 @@
+; RUN: rm -f %t.json
+; RUN: env LLVM_TUTOR_PHASE_STATS=%t.json ../bin/phase-stats-nesting
+; RUN: FileCheck %s < %t.json
+
+; Verifies that a phase can be re-entered while it's running (see
+; Inputs/PhaseStatsNesting.cpp). Every entry is counted as a run, but only the
+; outermost one is timed.
+
+; CHECK:      "nesting": {
+; CHECK-NEXT:   "inner": {
+; CHECK-NEXT:     "runs": 1,
+; CHECK:        "outer": {
+; CHECK-NEXT:     "runs": 3,
+; CHECK-NEXT:     "wall": {{[0-9.e-]+}},
+; CHECK-NEXT:     "user": {{[0-9.e-]+}},
+; CHECK-NEXT:     "sys": {{[0-9.e-]+}},
+; CHECK-NEXT:     "counters": {
+; CHECK-NEXT:       "nested": 3
+; CHECK-NEXT:     }
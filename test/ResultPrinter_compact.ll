@@ -0,0 +1,36 @@
+; RUN: opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv;format=compact>" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --strict-whitespace --check-prefix=RIV
+; RUN: opt -load-pass-plugin %shlibdir/libOpcodeCounter%shlibext -passes="print<opcode-counter;format=compact>" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --strict-whitespace --check-prefix=OPCODES
+; RUN: opt -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext -passes="print<static-cc;format=compact>" -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --strict-whitespace --check-prefix=STATIC-CC
+
+; Verifies that in the compact format the names of functions, blocks and values
+; are printed as in textual IR, i.e. quoted and escaped if required. A record
+; always has exactly one tab between two fields (the CHECK lines contain tabs).
+
+; RIV:      riv	@"two words"	%entry	%"x\09y"{{$}}
+; RIV-NEXT: riv	@"two words"	%"exit block"	%"a b"	%"x\09y"{{$}}
+; RIV-NEXT: riv	@caller	%entry{{$}}
+
+; OPCODES:      opcode-counter	@"two words"	add	1{{$}}
+; OPCODES-NEXT: opcode-counter	@"two words"	br	1{{$}}
+; OPCODES-NEXT: opcode-counter	@"two words"	ret	1{{$}}
+; OPCODES-NEXT: opcode-counter	@caller	call	1{{$}}
+
+; STATIC-CC: static-cc	@"two words"	1{{$}}
+
+define i32 @"two words"(i32 %"x\09y") {
+entry:
+  %"a b" = add i32 %"x\09y", 1
+  br label %"exit block"
+
+"exit block":
+  ret i32 %"a b"
+}
+
+define void @caller() {
+entry:
+  %r = call i32 @"two words"(i32 1)
+  ret void
+}
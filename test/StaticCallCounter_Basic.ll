@@ -1,8 +1,14 @@
 ; RUN:  opt -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext -passes="print<static-cc>" -disable-output \
 ; RUN:   %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext -passes="print<static-cc;format=compact>" -disable-output \
+; RUN:   %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s --check-prefix=COMPACT
 
 ; Test StaticCallCounter when run through opt using - basic function calls
 
 ; CHECK: foo                  3
 ; CHECK: bar                  2
 ; CHECK: fez                  1
+
+; COMPACT:      static-cc @foo 3
+; COMPACT-NEXT: static-cc @bar 2
+; COMPACT-NEXT: static-cc @fez 1
@@ -0,0 +1,74 @@
+; RUN: opt -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext -passes="print<static-cc<indirect>>" -disable-output %s 2>&1 | FileCheck %s
+; RUN: opt -load-pass-plugin %shlibdir/libStaticCallCounter%shlibext -passes="print<static-cc<indirect>>,function(mem2reg),print<static-cc<indirect>>" \
+; RUN:   -debug-pass-manager -disable-output %s 2>&1 | FileCheck %s --check-prefix=CACHE
+
+; Verifies that in the `indirect` mode StaticCallCounter resolves the targets
+; of indirect calls via:
+;   * `!callees` metadata,
+;   * selects,
+;   * loads from constant globals (vtables),
+;   * loads from local variables,
+; and that an indirect call with N possible targets counts as one (indirect)
+; call to each of them.
+
+; CHECK:      NAME                 #N DIRECT CALLS  #N INDIRECT CALLS
+; CHECK-NEXT: ---
+; CHECK-NEXT: impl_b               1                3
+; CHECK-NEXT: impl_a               0                3
+; CHECK-NEXT: ---
+; CHECK-NEXT: Unresolved indirect calls: 1
+
+; Only the function modified by mem2reg (via_alloca) is rescanned
+; CACHE:      Running analysis: CallGraphCallCounter on [module]
+; CACHE:      Running analysis: FunctionCallCounter on via_alloca
+; CACHE:      Running analysis: FunctionCallCounter on unknown
+; CACHE:      Invalidating analysis: FunctionCallCounter on via_alloca
+; CACHE:      Running analysis: CallGraphCallCounter on [module]
+; CACHE-NOT:  Running analysis: FunctionCallCounter on {{impl_a|impl_b|via_vtable|via_callees|via_select|unknown}}
+; CACHE:      Running analysis: FunctionCallCounter on via_alloca
+; CACHE-NOT:  Running analysis: FunctionCallCounter
+
+@vtable = internal constant [2 x ptr] [ptr @impl_a, ptr @impl_b]
+
+define internal i32 @impl_a(i32 %x) {
+  ret i32 %x
+}
+
+define internal i32 @impl_b(i32 %x) {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @via_vtable(i32 %x) {
+  %slot = getelementptr inbounds [2 x ptr], ptr @vtable, i64 0, i64 1
+  %fp = load ptr, ptr %slot
+  %r = call i32 %fp(i32 %x)
+  ret i32 %r
+}
+
+define i32 @via_callees(ptr %fp, i32 %x) {
+  %r = call i32 %fp(i32 %x), !callees !0
+  ret i32 %r
+}
+
+define i32 @via_select(i1 %c, i32 %x) {
+  %fp = select i1 %c, ptr @impl_a, ptr @impl_b
+  %r = call i32 %fp(i32 %x)
+  ret i32 %r
+}
+
+define i32 @via_alloca(i32 %x) {
+  %p = alloca ptr
+  store ptr @impl_a, ptr %p
+  %fp = load ptr, ptr %p
+  %r = call i32 %fp(i32 %x)
+  %d = call i32 @impl_b(i32 %r)
+  ret i32 %d
+}
+
+define i32 @unknown(ptr %fp, i32 %x) {
+  %r = call i32 %fp(i32 %x)
+  ret i32 %r
+}
+
+!0 = !{ptr @impl_a, ptr @impl_b}
@@ -1,15 +1,25 @@
 ; RUN:  opt -load-pass-plugin  %shlibdir/libHelloWorld%shlibext -passes=hello-world -disable-output 2>&1 %s\
 ; RUN:   | FileCheck %s
 
-; Test 'hello-world' when run through opt (both new and legacy PMs)
-; CHECK: (llvm-tutor) Hello from: foo
-; CHECK-NEXT: (llvm-tutor)   number of arguments: 1
-; CHECK-NEXT: (llvm-tutor) Hello from: bar
-; CHECK-NEXT: (llvm-tutor)   number of arguments: 2
-; CHECK-NEXT: (llvm-tutor) Hello from: fez
-; CHECK-NEXT: (llvm-tutor)   number of arguments: 3
-; CHECK-NEXT: (llvm-tutor) Hello from: main
-; CHECK-NEXT: (llvm-tutor)   number of arguments: 2
+; Test 'hello-world' when only libHelloWorld is loaded (the plugin is
+; self-contained). None of the functions below has any allocas, so all the sets
+; are empty.
+; CHECK:      -----  -----
+; CHECK-NEXT: UEVAR:{{ *$}}
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
+; CHECK-NEXT: -----  -----
+; CHECK-NEXT: UEVAR:{{ *$}}
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
+; CHECK-NEXT: -----  -----
+; CHECK-NEXT: UEVAR:{{ *$}}
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
+; CHECK-NEXT: -----  -----
+; CHECK-NEXT: UEVAR:{{ *$}}
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
 
 define i32 @foo(i32) {
   %2 = shl nsw i32 %0, 1
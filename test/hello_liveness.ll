@@ -0,0 +1,88 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libHelloWorld%shlibext -passes=hello-world -disable-output 2>&1 %s \
+; RUN:   | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libHelloWorld%shlibext -passes=hello-world -disable-output %s 2> %t.hello
+; RUN:  opt -load-pass-plugin %shlibdir/libLiveness%shlibext -passes="print<liveness>" -disable-output %s 2> %t.liveness
+; RUN:  diff %t.hello %t.liveness
+
+; Verify the liveness sets computed by 'hello-world' for a simple loop. %tmp is
+; only ever defined (and then immediately used) inside the loop body, so it's
+; never live-out. The 'dead' block is unreachable, but its sets are still
+; computed and printed. The output is the same as for print<liveness>.
+
+; CHECK-LABEL: ----- entry -----
+; CHECK-NEXT: UEVAR:{{ *$}}
+; CHECK-NEXT: VARKILL: n.addr i sum
+; CHECK-NEXT: LIVEOUT: n.addr i sum
+; CHECK-LABEL: ----- for.cond -----
+; CHECK-NEXT: UEVAR: n.addr i
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT: n.addr i sum
+; CHECK-LABEL: ----- for.body -----
+; CHECK-NEXT: UEVAR: i sum
+; CHECK-NEXT: VARKILL: sum tmp
+; CHECK-NEXT: LIVEOUT: n.addr i sum
+; CHECK-LABEL: ----- for.inc -----
+; CHECK-NEXT: UEVAR: i
+; CHECK-NEXT: VARKILL: i
+; CHECK-NEXT: LIVEOUT: n.addr i sum
+; CHECK-LABEL: ----- for.end -----
+; CHECK-NEXT: UEVAR: sum
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
+; CHECK-LABEL: ----- dead -----
+; CHECK-NEXT: UEVAR: tmp
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT: n.addr i sum
+; CHECK-LABEL: -----  -----
+; CHECK-NEXT: UEVAR: x
+; CHECK-NEXT: VARKILL:{{ *$}}
+; CHECK-NEXT: LIVEOUT:{{ *$}}
+
+define i32 @foo(i32 %n) {
+entry:
+  %n.addr = alloca i32
+  %i = alloca i32
+  %sum = alloca i32
+  %tmp = alloca i32
+  store i32 %n, ptr %n.addr
+  store i32 0, ptr %sum
+  store i32 0, ptr %i
+  br label %for.cond
+
+for.cond:
+  %0 = load i32, ptr %i
+  %1 = load i32, ptr %n.addr
+  %cmp = icmp slt i32 %0, %1
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %2 = load i32, ptr %sum
+  %3 = load i32, ptr %i
+  %add = add nsw i32 %2, %3
+  store i32 %add, ptr %tmp
+  %4 = load i32, ptr %tmp
+  store i32 %4, ptr %sum
+  br label %for.inc
+
+for.inc:
+  %5 = load i32, ptr %i
+  %inc = add nsw i32 %5, 1
+  store i32 %inc, ptr %i
+  br label %for.cond
+
+for.end:
+  %6 = load i32, ptr %sum
+  ret i32 %6
+
+dead:
+  %7 = load i32, ptr %tmp
+  br label %for.cond
+}
+
+define void @bar() {
+  %x = alloca i32
+  %1 = alloca i32
+  store i32 1, ptr %1
+  %2 = load i32, ptr %x
+  ret void
+}
@@ -0,0 +1,111 @@
+; RUN: opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;buffer=4;ids=%t.ir.ids>,verify" -S %s \
+; RUN:  | FileCheck %s
+; RUN: FileCheck %s --check-prefix=IDS < %t.ir.ids
+
+; Record a trace (with a buffer of 2 records, so that it's flushed a few times)
+; and print it with inject-func-call-reader
+; RUN: opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;buffer=2;ids=%t.ids>,verify" %S/Inputs/CallCounterInput.ll -o %t.bin
+; RUN: rm -f %t.trace
+; RUN: env INJECT_FUNC_CALL_TRACE_FILE=%t.trace lli %t.bin | count 0
+; RUN: ../bin/inject-func-call-reader %t.trace %t.ids | FileCheck %s --check-prefix=TRACE
+; RUN: ../bin/inject-func-call-reader -summary %t.trace %t.ids | FileCheck %s --check-prefix=SUMMARY
+
+; The same, but with timestamps
+; RUN: opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;timestamps;ids=%t.ts.ids>,verify" %S/Inputs/CallCounterInput.ll -o %t.ts.bin
+; RUN: env INJECT_FUNC_CALL_TRACE_FILE=%t.ts.trace lli %t.ts.bin | count 0
+; RUN: ../bin/inject-func-call-reader -summary %t.ts.trace %t.ts.ids | FileCheck %s --check-prefix=SUMMARY
+
+; A trace can only be printed with the ID table of the module it was recorded
+; with
+; RUN: not ../bin/inject-func-call-reader %t.trace %t.ir.ids 2>&1 | FileCheck %s --check-prefix=MISMATCH
+
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;buffer=3>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=WRONG
+
+; Verify that in the tracing mode InjectFuncCall injects the code that appends
+; a record to the trace buffer, rather than calls to printf.
+
+; CHECK-NOT: @printf
+; CHECK: @TraceBuffer = internal thread_local global { i32, i32, [4 x { i32, i32, i64 }] } zeroinitializer, align 8
+; CHECK: @llvm.global_ctors = appending global {{.*}} @open_trace
+; CHECK: @llvm.global_dtors = appending global {{.*}} @close_trace
+
+; CHECK-LABEL: define i32 @foo(
+; CHECK-NEXT:    [[N:%[0-9]+]] = load i64, ptr @TraceNumRecords
+; CHECK-NEXT:    [[IDX:%[0-9]+]] = and i64 [[N]], 3
+; CHECK-NEXT:    [[EMPTY_OR_FULL:%[0-9]+]] = icmp eq i64 [[IDX]], 0
+; CHECK-NEXT:    br i1 [[EMPTY_OR_FULL]], label %[[SLOW:[0-9]+]], label %[[FAST:[0-9]+]], !prof
+; CHECK:       [[SLOW]]:
+; CHECK-NEXT:    call void @trace_slow_path(i64 [[N]])
+; CHECK:       [[FAST]]:
+; CHECK-NEXT:    [[REC:%[0-9]+]] = getelementptr inbounds {{.*}} @TraceBuffer, i32 0, i32 2, i64 [[IDX]]
+; CHECK-NEXT:    [[ID:%[0-9]+]] = getelementptr inbounds {{.*}} [[REC]], i32 0, i32 0
+; CHECK-NEXT:    store i32 0, ptr [[ID]]
+; CHECK-NEXT:    [[ARGS:%[0-9]+]] = getelementptr inbounds {{.*}} [[REC]], i32 0, i32 1
+; CHECK-NEXT:    store i32 1, ptr [[ARGS]]
+; CHECK-NEXT:    [[TS:%[0-9]+]] = getelementptr inbounds {{.*}} [[REC]], i32 0, i32 2
+; CHECK-NEXT:    store i64 0, ptr [[TS]]
+; CHECK-NEXT:    [[NEXT:%[0-9]+]] = add i64 [[IDX]], 1
+; CHECK-NEXT:    store i64 [[NEXT]], ptr @TraceNumRecords
+; CHECK-NEXT:    shl nsw i32 %0, 1
+
+; The static allocas stay in the entry block
+; CHECK-LABEL: define i32 @bar(
+; CHECK-NEXT:    %a = alloca i32
+; CHECK-NEXT:    load i64, ptr @TraceNumRecords
+; CHECK:         store i32 1, ptr
+; CHECK-NEXT:    getelementptr
+; CHECK-NEXT:    store i32 2, ptr
+
+; The functions of the runtime are not instrumented
+; CHECK-LABEL: define internal void @trace_slow_path(
+; CHECK-NOT:     @trace_slow_path
+; The thread key is created before the trace file is opened, i.e. also when
+; that fails (trace_slow_path sets it for every new thread regardless)
+; CHECK-LABEL: define internal void @open_trace(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    call i32 @pthread_key_create(ptr @TraceThreadKey, ptr @flush_trace_buffer)
+; CHECK-NEXT:    call ptr @getenv(
+; CHECK-NOT:     @trace_slow_path
+
+; IDS:      inject-func-call-ids 1 0x{{[0-9a-f]+}}
+; IDS-NEXT: 0 foo
+; IDS-NEXT: 1 bar
+; IDS-NOT:  {{.}}
+
+; TRACE:      THREAD     NAME                 #N ARGS
+; TRACE-NEXT: ---
+; TRACE-NEXT: 1          main                 0
+; TRACE-NEXT: 1          foo                  0
+; TRACE-NEXT: 1          bar                  0
+; TRACE-NEXT: 1          foo                  0
+; TRACE-NEXT: 1          fez                  0
+; TRACE-NEXT: 1          bar                  0
+; TRACE-NEXT: 1          foo                  0
+
+; SUMMARY:      THREAD     NAME                 #N CALLS
+; SUMMARY-NEXT: ---
+; SUMMARY-NEXT: 1          foo                  13
+; SUMMARY-NEXT: 1          bar                  2
+; SUMMARY-NEXT: 1          fez                  1
+; SUMMARY-NEXT: 1          main                 1
+; SUMMARY-EMPTY:
+
+; MISMATCH: Error reading trace file: {{.*}}: invalid trace or trace/ID table mismatch
+
+; WRONG: unknown pass name 'inject-func-call<trace;buffer=3>'
+
+declare void @external(i32)
+
+define i32 @foo(i32) {
+  %2 = shl nsw i32 %0, 1
+  ret i32 %2
+}
+
+define i32 @bar(i32, i32) {
+  %a = alloca i32
+  store i32 %0, ptr %a
+  %3 = call i32 @foo(i32 %1)
+  call void @external(i32 %3)
+  ret i32 %3
+}
@@ -1,6 +1,8 @@
 ; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="require<integer-globals>,function(print<riv>)" -disable-output %s 2>&1 | FileCheck %s
 
-; Verifies that RIV correctly captures global variables.
+; Verifies that RIV correctly captures global variables, both when these are
+; collected by RIV itself and when they come from the IntegerGlobals analysis.
 
 @var = global i32 123
 
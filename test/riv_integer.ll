@@ -1,8 +1,12 @@
 ; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv;repr=chained>" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv;repr=bitset>" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv;format=compact>" -disable-output %s 2>&1 | FileCheck %s --check-prefix=COMPACT
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>" -disable-output %s 2>&1 | FileCheck %s --check-prefix=WIDE --strict-whitespace
 
 ; Verifies that the result from the RIV pass for the following module is
 ; correct. Note that all values are integers and should be included in the
-; results.
+; results. The output doesn't depend on how the sets are represented.
 
 define i32 @foo(i32 %a, i32 %b, i32 %c) {
 entry:
@@ -70,3 +74,15 @@ if.end8:                                          ; preds = %entry, %if.then2, %
 ; CHECK-NEXT:        i32 %a
 ; CHECK-NEXT:        i32 %b
 ; CHECK-NEXT:        i32 %c
+
+; A value that's wider than its column (30 characters) is not followed by a
+; space, i.e. the table is laid out exactly as with `%-30s`
+; WIDE: {{^}}               %cmp1 = icmp eq i32 %mul, %div{{$}}
+
+; In the compact format, there's one (tab-separated) record per block
+; COMPACT-NOT:  LLVM-TUTOR
+; COMPACT:      riv @foo %entry %a %b %c
+; COMPACT-NEXT: riv @foo %if.then %add %cmp %a %b %c
+; COMPACT-NEXT: riv @foo %if.end8 %add %cmp %a %b %c
+; COMPACT-NEXT: riv @foo %if.then2 %mul %div %cmp1 %add %cmp %a %b %c
+; COMPACT-NEXT: riv @foo %if.else %mul %div %cmp1 %add %cmp %a %b %c
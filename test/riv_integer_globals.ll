@@ -0,0 +1,84 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="require<integer-globals>,function(print<riv>)" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="require<integer-globals>,function(print<riv;repr=chained>)" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="require<integer-globals>,function(print<riv;repr=bitset>)" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="require<integer-globals>,function(print<riv>)" -debug-pass-manager -disable-output %s 2>&1 | FileCheck %s --check-prefix=ONCE
+; Without require<integer-globals> the globals are shared too (see
+; SharedIntegerGlobals in RIV.h), including by DuplicateBB
+; RUN:  rm -f %t.json %t.dup.json
+; RUN:  env LLVM_TUTOR_PHASE_STATS=%t.json opt -load-pass-plugin %shlibdir/libRIV%shlibext -passes="print<riv>" -disable-output %s 2>&1 | FileCheck %s
+; RUN:  FileCheck %s --check-prefix=SHARED < %t.json
+; RUN:  env LLVM_TUTOR_PHASE_STATS=%t.dup.json opt -load-pass-plugin %shlibdir/libRIV%shlibext -load-pass-plugin %shlibdir/libDuplicateBB%shlibext -passes="duplicate-bb" -disable-output %s
+; RUN:  FileCheck %s --check-prefix=SHARED < %t.dup.json
+; ... until a module pass drops the function analyses (DynamicCallCounter adds
+; integer globals)
+; RUN:  rm -f %t.mod.json
+; RUN:  env LLVM_TUTOR_PHASE_STATS=%t.mod.json opt -load-pass-plugin %shlibdir/libLLVMTutor%shlibext -passes="function(print<riv>),dynamic-cc,function(print<riv>)" -disable-output %s 2>&1 | FileCheck %s --check-prefix=RECOLLECT
+; RUN:  FileCheck %s --check-prefix=RECOLLECT-JSON < %t.mod.json
+
+; Verifies that the integer globals are computed once per module and shared
+; by all functions. Only integer globals are included and they are listed in
+; module order, before the input arguments.
+
+@a = global i32 1
+@f = global float 1.0
+@b = global i64 2
+
+define i32 @foo(i32 %x) {
+entry:
+  %cmp = icmp eq i32 %x, 0
+  br i1 %cmp, label %if.then, label %if.end
+
+if.then:
+  %add = add i32 %x, 1
+  br label %if.end
+
+if.end:
+  ret i32 0
+}
+
+define void @bar(i8 %y) {
+  ret void
+}
+
+; CHECK-LABEL: BB %entry
+; CHECK-NEXT:        i32 1
+; CHECK-NEXT:        i64 2
+; CHECK-NEXT:        i32 %x
+; CHECK-LABEL: BB %if.then
+; CHECK-NEXT:          %cmp = icmp eq i32 %x, 0
+; CHECK-NEXT:        i32 1
+; CHECK-NEXT:        i64 2
+; CHECK-NEXT:        i32 %x
+; CHECK-LABEL: BB %if.end
+; CHECK-NEXT:          %cmp = icmp eq i32 %x, 0
+; CHECK-NEXT:        i32 1
+; CHECK-NEXT:        i64 2
+; CHECK-NEXT:        i32 %x
+; CHECK-LABEL: BB %0
+; CHECK-NEXT:        i32 1
+; CHECK-NEXT:        i64 2
+; CHECK-NEXT:        i8 %y
+
+; ONCE:     Running analysis: IntegerGlobals
+; ONCE-NOT: Running analysis: IntegerGlobals
+
+; SHARED:      "riv": {
+; SHARED-NEXT:   "integer-globals": {
+; SHARED-NEXT:     "runs": 1,
+; SHARED:        "step2": {
+; SHARED:          "counters": {
+; SHARED-NEXT:       "args": 2,
+; SHARED-NEXT:       "globals": 4
+
+; RECOLLECT-LABEL: BB %entry
+; RECOLLECT-NEXT:        i32 1
+; RECOLLECT-NEXT:        i64 2
+; RECOLLECT-NEXT:        i32 %x
+; RECOLLECT-LABEL: BB %enter
+; RECOLLECT-NEXT:        i32 1
+; RECOLLECT-NEXT:        i64 2
+; RECOLLECT-NEXT:        @CounterFor_foo = common global i64 0
+; RECOLLECT-NEXT:        @CounterFor_bar = common global i64 0
+
+; RECOLLECT-JSON:      "integer-globals": {
+; RECOLLECT-JSON-NEXT:   "runs": 2,
@@ -0,0 +1,23 @@
+; RUN: ../bin/static -opcodes -format=csv -j 1 %S/Inputs/CallCounterInput.ll %S/Inputs/FCmpEqInput.ll %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+; RUN: ../bin/static -opcodes -format=csv -j 4 %S/Inputs/CallCounterInput.ll %S/Inputs/FCmpEqInput.ll %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+; RUN: ../bin/static -opcodes -format=csv -lazy %S/Inputs/CallCounterInput.ll %S/Inputs/FCmpEqInput.ll %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+
+; Test the opcode statistics printed by static for multiple input files. The
+; counts are added together across all the input files and the output doesn't
+; depend on the number of threads.
+
+; CHECK:      name,opcode,count
+; CHECK-NEXT: total,add,2
+; CHECK-NEXT: total,alloca,4
+; CHECK-NEXT: total,br,13
+; CHECK-NEXT: total,call,15
+; CHECK-NEXT: total,fadd,4
+; CHECK-NEXT: total,fcmp,3
+; CHECK-NEXT: total,fdiv,3
+; CHECK-NEXT: total,fmul,2
+; CHECK-NEXT: total,icmp,2
+; CHECK-NEXT: total,load,5
+; CHECK-NEXT: total,phi,3
+; CHECK-NEXT: total,ret,11
+; CHECK-NEXT: total,store,8
+; CHECK-NEXT: total,zext,1
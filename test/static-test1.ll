@@ -1,6 +1,8 @@
 ; RUN: ../bin/static %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+; RUN: opt %S/Inputs/CallCounterInput.ll -o %t.bc
+; RUN: ../bin/static -lazy %t.bc 2>&1 | FileCheck %s
 
-; Test StaticCallCounter when run via static.
+; Test StaticCallCounter when run via static (also with lazy bitcode loading).
 
 ; CHECK: foo                  3
 ; CHECK: bar                  2
@@ -0,0 +1,14 @@
+; RUN: ../bin/static -j 1 %S/Inputs/CallCounterInput.ll %S/Inputs/FCmpEqInput.ll %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+; RUN: ../bin/static -j 4 %S/Inputs/CallCounterInput.ll %S/Inputs/FCmpEqInput.ll %S/Inputs/CallCounterInput.ll 2>&1 | FileCheck %s
+; RUN: echo %S/Inputs/CallCounterInput.ll %S/Inputs/FCmpEqInput.ll %S/Inputs/CallCounterInput.ll > %t.rsp
+; RUN: ../bin/static -j 4 @%t.rsp 2>&1 | FileCheck %s
+
+; Test StaticCallCounter when run via static on multiple input files. The
+; results are merged (by function name) and the order in which the functions
+; are printed doesn't depend on the number of threads.
+
+; CHECK:      foo                  6
+; CHECK-NEXT: bar                  4
+; CHECK-NEXT: fez                  2
+; CHECK-NEXT: sqrt_impl            1
+; CHECK-NEXT: sqrt                 2
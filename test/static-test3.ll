@@ -0,0 +1,25 @@
+; RUN: cp %s %t.ll
+; RUN: ../bin/static -j 2 %s %t.ll 2>&1 | FileCheck %s
+
+; Test StaticCallCounter when run via static on multiple input files that
+; define internal functions with the same name. These are different functions,
+; so they are reported separately (prefixed with the input file). Functions
+; with external linkage are still merged by name.
+
+; CHECK:      {{^.*}}static-test3.ll:helper 1
+; CHECK-NEXT: run                  2
+; CHECK-NEXT: {{^.*}}static-test3.ll.tmp.ll:helper 1
+
+define internal void @helper() {
+  ret void
+}
+
+define void @run() {
+  call void @helper()
+  ret void
+}
+
+define void @entry() {
+  call void @run()
+  ret void
+}
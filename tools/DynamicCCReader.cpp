@@ -0,0 +1,176 @@
+//========================================================================
+// FILE:
+//    DynamicCCReader.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that prints the binary profiles generated by
+//    programs instrumented with DynamicCallCounter (i.e. with
+//    `-passes=dynamic-cc<binary>`). The format of the profiles is documented
+//    in DynamicCallCounter.h.
+//
+// USAGE:
+//    # First, instrument and run a program:
+//      opt -load-pass-plugin <BUILD/DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes="dynamic-cc<binary>" <input-llvm-file> -o instrumented.bin
+//      DYNAMIC_CC_PROFILE_FILE=<profile-file> lli instrumented.bin
+//    # Now you can print the profile as follows:
+//      <BUILD/DIR>/bin/dynamic-cc-reader [-sort=count] [-top=N] <profile-file>
+//
+// License: MIT
+//========================================================================
+#include "DynamicCallCounter.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cinttypes>
+#include <cstring>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory ReaderCategory{"dynamic-cc reader options"};
+
+static cl::opt<std::string> InputProfile{cl::Positional,
+                                         cl::desc{"<Profile to print>"},
+                                         cl::value_desc{"profile filename"},
+                                         cl::init(""),
+                                         cl::Required,
+                                         cl::cat{ReaderCategory}};
+
+enum class SortOrder { ID, Count, Name };
+
+static cl::opt<SortOrder> SortBy{
+    "sort", cl::desc{"How to order the functions"}, cl::init(SortOrder::ID),
+    cl::values(clEnumValN(SortOrder::ID, "id",
+                          "In the order in which they were defined"),
+               clEnumValN(SortOrder::Count, "count",
+                          "By the number of calls (in descending order)"),
+               clEnumValN(SortOrder::Name, "name", "By name")),
+    cl::cat{ReaderCategory}};
+
+static cl::opt<unsigned> TopN{
+    "top", cl::desc{"Only print the first N functions (0 = print all)"},
+    cl::value_desc{"N"}, cl::init(0), cl::cat{ReaderCategory}};
+
+//===----------------------------------------------------------------------===//
+// dynamic-cc-reader - implementation
+//===----------------------------------------------------------------------===//
+struct FunctionProfile {
+  StringRef Name;
+  uint64_t Count;
+};
+
+// Parses the profile in Buffer into Functions. Returns false if Buffer does
+// not hold a valid profile. Function names refer to Buffer.
+static bool parseProfile(StringRef Buffer,
+                         SmallVectorImpl<FunctionProfile> &Functions) {
+  dynamic_cc::ProfileHeader Header;
+  if (Buffer.size() < sizeof(Header))
+    return false;
+  std::memcpy(&Header, Buffer.data(), sizeof(Header));
+
+  if (Header.Magic != dynamic_cc::ProfileMagic ||
+      Header.Version != dynamic_cc::ProfileVersion)
+    return false;
+
+  // Guard against overflow in the size calculation below
+  uint64_t CountsOffset = sizeof(Header);
+  uint64_t MaxNumFunctions = (Buffer.size() - CountsOffset) / sizeof(uint64_t);
+  if (Header.NumFunctions > MaxNumFunctions)
+    return false;
+
+  uint64_t NamesOffset = CountsOffset + Header.NumFunctions * sizeof(uint64_t);
+  if (Buffer.size() - NamesOffset != Header.NamesSize)
+    return false;
+
+  StringRef Names = Buffer.substr(NamesOffset);
+  for (uint64_t Idx = 0; Idx < Header.NumFunctions; Idx++) {
+    size_t NameEnd = Names.find('\0');
+    if (NameEnd == StringRef::npos)
+      return false;
+
+    uint64_t Count;
+    std::memcpy(&Count,
+                Buffer.data() + CountsOffset + Idx * sizeof(uint64_t),
+                sizeof(Count));
+    Functions.push_back({Names.take_front(NameEnd), Count});
+    Names = Names.drop_front(NameEnd + 1);
+  }
+
+  return Names.empty();
+}
+
+static void printProfile(raw_ostream &OutS,
+                         ArrayRef<FunctionProfile> Functions) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: dynamic analysis results\n";
+  OutS << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "#N DIRECT CALLS";
+  OutS << format("%-20s %-10s\n", Str1, Str2);
+  OutS << "-------------------------------------------------"
+       << "\n";
+
+  for (auto &Function : Functions)
+    OutS << format("%-20s %-10" PRIu64 "\n", Function.Name.str().c_str(),
+                   Function.Count);
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(ReaderCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Prints the binary profiles generated by "
+                              "programs instrumented with dynamic-cc\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  auto BufferOrErr = MemoryBuffer::getFile(InputProfile, /*IsText=*/false,
+                                           /*RequiresNullTerminator=*/false);
+  if (!BufferOrErr) {
+    errs() << "Error reading profile file: " << InputProfile << ": "
+           << BufferOrErr.getError().message() << "\n";
+    return -1;
+  }
+
+  SmallVector<FunctionProfile, 16> Functions;
+  if (!parseProfile((*BufferOrErr)->getBuffer(), Functions)) {
+    errs() << "Error reading profile file: " << InputProfile
+           << ": invalid or unsupported profile\n";
+    return -1;
+  }
+
+  // Stable sorts, so that ties are kept in the order of definition
+  if (SortBy == SortOrder::Count)
+    llvm::stable_sort(Functions, [](const auto &A, const auto &B) {
+      return A.Count > B.Count;
+    });
+  else if (SortBy == SortOrder::Name)
+    llvm::stable_sort(Functions, [](const auto &A, const auto &B) {
+      return A.Name < B.Name;
+    });
+
+  ArrayRef<FunctionProfile> ToPrint = Functions;
+  if (TopN != 0 && TopN < ToPrint.size())
+    ToPrint = ToPrint.take_front(TopN);
+
+  printProfile(outs(), ToPrint);
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+//========================================================================
+// FILE:
+//    InjectFuncCallReader.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that prints the traces generated by programs
+//    instrumented with InjectFuncCall in the tracing mode (i.e. with
+//    `-passes=inject-func-call<trace>`). The trace and the ID table formats
+//    are documented in InjectFuncCall.h.
+//
+// USAGE:
+//    # First, instrument and run a program:
+//      opt -load-pass-plugin <BUILD/DIR>/lib/libInjectFuncCall.so `\`
+//        -passes="inject-func-call<trace;ids=<ids-file>>" <input-llvm-file> `\`
+//        -o instrumented.bin
+//      INJECT_FUNC_CALL_TRACE_FILE=<trace-file> lli instrumented.bin
+//    # Now you can print the trace as follows:
+//      <BUILD/DIR>/bin/inject-func-call-reader [-summary] <trace-file> `\`
+//        <ids-file>
+//
+// License: MIT
+//========================================================================
+#include "InjectFuncCall.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+#include <map>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory ReaderCategory{"inject-func-call reader options"};
+
+static cl::opt<std::string> InputTrace{cl::Positional,
+                                       cl::desc{"<Trace to print>"},
+                                       cl::value_desc{"trace filename"},
+                                       cl::init(""),
+                                       cl::Required,
+                                       cl::cat{ReaderCategory}};
+
+static cl::opt<std::string> InputIDTable{cl::Positional,
+                                         cl::desc{"<ID table>"},
+                                         cl::value_desc{"ID table filename"},
+                                         cl::init(""),
+                                         cl::Required,
+                                         cl::cat{ReaderCategory}};
+
+static cl::opt<bool> Summary{
+    "summary",
+    cl::desc{"Only print the number of calls to every function (per thread)"},
+    cl::init(false), cl::cat{ReaderCategory}};
+
+//===----------------------------------------------------------------------===//
+// inject-func-call-reader - implementation
+//===----------------------------------------------------------------------===//
+// Parses the ID table in Buffer into FuncNames (indexed by function ID).
+// Returns false if Buffer does not hold a valid table. Function names refer to
+// Buffer.
+static bool parseIDTable(StringRef Buffer, uint64_t &ModuleHash,
+                         SmallVectorImpl<StringRef> &FuncNames) {
+  SmallVector<StringRef, 16> Lines;
+  SplitString(Buffer, Lines, "\n");
+  if (Lines.empty())
+    return false;
+
+  // inject-func-call-ids <version> <module hash>
+  SmallVector<StringRef, 3> Header;
+  SplitString(Lines[0], Header, " ");
+  uint64_t Version;
+  if (Header.size() != 3 || Header[0] != inject_func_call::IDTableMagic ||
+      Header[1].getAsInteger(10, Version) ||
+      Version != inject_func_call::TraceVersion ||
+      Header[2].getAsInteger(0, ModuleHash))
+    return false;
+
+  // <function ID> <function name>
+  for (StringRef Line : drop_begin(Lines)) {
+    auto [ID, Name] = Line.split(' ');
+    uint64_t FuncID;
+    if (ID.getAsInteger(10, FuncID) || FuncID != FuncNames.size() ||
+        Name.empty())
+      return false;
+    FuncNames.push_back(Name);
+  }
+
+  return true;
+}
+
+// Parses the trace in Buffer and prints it to OutS (or, with -summary, the
+// number of calls to every function). Returns false if Buffer does not hold a
+// valid trace for the ID table (ModuleHash, FuncNames).
+static bool printTrace(raw_ostream &OutS, StringRef Buffer,
+                       uint64_t ModuleHash, ArrayRef<StringRef> FuncNames) {
+  inject_func_call::TraceHeader Header;
+  if (Buffer.size() < sizeof(Header))
+    return false;
+  std::memcpy(&Header, Buffer.data(), sizeof(Header));
+
+  if (Header.Magic != inject_func_call::TraceMagic ||
+      Header.Version != inject_func_call::TraceVersion ||
+      Header.ModuleHash != ModuleHash)
+    return false;
+  bool HasTimestamps = Header.Flags & inject_func_call::TraceHasTimestamps;
+
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: inject-func-call trace\n";
+  OutS << "=================================================\n";
+  const char *Str1 = "THREAD";
+  const char *Str2 = "TIMESTAMP";
+  const char *Str3 = "NAME";
+  const char *Str4 = Summary ? "#N CALLS" : "#N ARGS";
+  if (HasTimestamps && !Summary)
+    OutS << format("%-10s %-20s %-20s %-10s\n", Str1, Str2, Str3, Str4);
+  else
+    OutS << format("%-10s %-20s %-10s\n", Str1, Str3, Str4);
+  OutS << "-------------------------------------------------"
+       << "\n";
+
+  // (thread ID, function ID) -> the number of calls
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> Calls;
+
+  StringRef Blocks = Buffer.drop_front(sizeof(Header));
+  while (!Blocks.empty()) {
+    inject_func_call::TraceBlockHeader Block;
+    if (Blocks.size() < sizeof(Block))
+      return false;
+    std::memcpy(&Block, Blocks.data(), sizeof(Block));
+    Blocks = Blocks.drop_front(sizeof(Block));
+
+    uint64_t BlockSize =
+        uint64_t(Block.NumRecords) * sizeof(inject_func_call::TraceRecord);
+    if (Blocks.size() < BlockSize)
+      return false;
+
+    for (uint32_t Idx = 0; Idx < Block.NumRecords; Idx++) {
+      inject_func_call::TraceRecord Record;
+      std::memcpy(&Record, Blocks.data() + Idx * sizeof(Record),
+                  sizeof(Record));
+      if (Record.FuncID >= FuncNames.size())
+        return false;
+
+      StringRef Name = FuncNames[Record.FuncID];
+      if (Summary)
+        Calls[{Block.ThreadID, Record.FuncID}]++;
+      else if (HasTimestamps)
+        OutS << format("%-10u %-20lu %-20s %-10u\n", Block.ThreadID,
+                       Record.Timestamp, Name.str().c_str(), Record.NumArgs);
+      else
+        OutS << format("%-10u %-20s %-10u\n", Block.ThreadID,
+                       Name.str().c_str(), Record.NumArgs);
+    }
+    Blocks = Blocks.drop_front(BlockSize);
+  }
+
+  for (auto &[Key, Count] : Calls)
+    OutS << format("%-10u %-20s %-10lu\n", Key.first,
+                   FuncNames[Key.second].str().c_str(), Count);
+
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(ReaderCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Prints the traces generated by programs "
+                              "instrumented with inject-func-call<trace>\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  auto IDTableOrErr = MemoryBuffer::getFile(InputIDTable, /*IsText=*/true);
+  if (!IDTableOrErr) {
+    errs() << "Error reading ID table: " << InputIDTable << ": "
+           << IDTableOrErr.getError().message() << "\n";
+    return -1;
+  }
+
+  uint64_t ModuleHash;
+  SmallVector<StringRef, 16> FuncNames;
+  if (!parseIDTable((*IDTableOrErr)->getBuffer(), ModuleHash, FuncNames)) {
+    errs() << "Error reading ID table: " << InputIDTable
+           << ": invalid or unsupported ID table\n";
+    return -1;
+  }
+
+  auto TraceOrErr = MemoryBuffer::getFile(InputTrace, /*IsText=*/false,
+                                          /*RequiresNullTerminator=*/false);
+  if (!TraceOrErr) {
+    errs() << "Error reading trace file: " << InputTrace << ": "
+           << TraceOrErr.getError().message() << "\n";
+    return -1;
+  }
+
+  if (!printTrace(outs(), (*TraceOrErr)->getBuffer(), ModuleHash,
+                  FuncNames)) {
+    errs() << "Error reading trace file: " << InputTrace
+           << ": invalid trace or trace/ID table mismatch\n";
+    return -1;
+  }
+
+  return 0;
+}
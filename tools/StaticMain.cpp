@@ -7,23 +7,41 @@
 //    in the source code) in the input LLVM file. Internally it uses the
 //    StaticCallCounter pass.
 //
+//    With `-opcodes`, it prints the opcode statistics (see OpcodeCounter.h)
+//    aggregated over all the input files instead, e.g. for a whole build tree.
+//
 // USAGE:
 //    # First, generate an LLVM file:
 //      clang -emit-llvm <input-file> -c -o <output-llvm-file>
 //    # Now you can run this tool as follows:
 //      <BUILD/DIR>/bin/static <output-llvm-file>
+//    # Or, for many input files (optionally listed in a response file):
+//      <BUILD/DIR>/bin/static -j <N> <llvm-file-1> <llvm-file-2> ...
+//      <BUILD/DIR>/bin/static -j <N> @<response-file>
+//    # Use lazy bitcode loading (e.g. for large LTO bitcode files):
+//      <BUILD/DIR>/bin/static -lazy <output-llvm-file>
+//    # Aggregate the opcode statistics (format is one of text, json or csv):
+//      <BUILD/DIR>/bin/static -opcodes -format=json -j <N> @<response-file>
 //
 // License: MIT
 //========================================================================
+#include "OpcodeCounter.h"
 #include "StaticCallCounter.h"
 
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <string>
+#include <utility>
+#include <vector>
+
 using namespace llvm;
 
 //===----------------------------------------------------------------------===//
@@ -31,12 +49,38 @@ using namespace llvm;
 //===----------------------------------------------------------------------===//
 static cl::OptionCategory CallCounterCategory{"call counter options"};
 
-static cl::opt<std::string> InputModule{cl::Positional,
-                                        cl::desc{"<Module to analyze>"},
-                                        cl::value_desc{"bitcode filename"},
-                                        cl::init(""),
-                                        cl::Required,
-                                        cl::cat{CallCounterCategory}};
+static cl::list<std::string> InputModules{cl::Positional,
+                                          cl::desc{"<Modules to analyze>"},
+                                          cl::value_desc{"bitcode filenames"},
+                                          cl::OneOrMore,
+                                          cl::cat{CallCounterCategory}};
+
+static cl::opt<unsigned> NumThreads{
+    "j",
+    cl::desc{"Number of threads used to analyse multiple input files (0 = "
+             "use all available hardware threads)"},
+    cl::value_desc{"N"}, cl::init(0), cl::cat{CallCounterCategory}};
+
+static cl::opt<bool> LazyLoad{
+    "lazy",
+    cl::desc{"Load bitcode lazily and materialise one function at a time "
+             "(reduces peak memory usage for large bitcode files)"},
+    cl::init(false), cl::cat{CallCounterCategory}};
+
+static cl::opt<bool> PrintOpcodes{
+    "opcodes",
+    cl::desc{"Print the opcode statistics (aggregated over all input files) "
+             "instead of the direct calls"},
+    cl::init(false), cl::cat{CallCounterCategory}};
+
+static cl::opt<OpcodeStatsFormat> Format{
+    "format", cl::desc{"The output format for -opcodes"},
+    cl::init(OpcodeStatsFormat::Text),
+    cl::values(clEnumValN(OpcodeStatsFormat::Text, "text", "A table"),
+               clEnumValN(OpcodeStatsFormat::JSON, "json", "JSON"),
+               clEnumValN(OpcodeStatsFormat::CSV, "csv",
+                          "CSV (name,opcode,count)")),
+    cl::cat{CallCounterCategory}};
 
 //===----------------------------------------------------------------------===//
 // static - implementation
@@ -61,6 +105,181 @@ static void countStaticCalls(Module &M) {
   MPM.run(M, MAM);
 }
 
+// The result for one of many input modules. As every module is parsed into a
+// separate LLVMContext, functions are identified by name rather than by
+// `Function *` (the names of functions with local linkage are prefixed with
+// the input file).
+struct ModuleResult {
+  bool Failed = false;
+  std::string ErrorMsg;
+  std::vector<std::pair<std::string, unsigned>> DirectCalls;
+  // Only populated with -opcodes. Opcodes don't depend on the LLVMContext.
+  OpcodeHistogram Opcodes;
+};
+
+// Counts the direct calls in a lazily loaded module. Every function is
+// materialised, analysed and then dropped again, so that at most one function
+// body is held in memory at any given time.
+static Error countStaticCallsLazily(Module &M, ResultStaticCC &DirectCalls) {
+  for (Function &F : M) {
+    if (Error E = F.materialize())
+      return E;
+    if (F.isDeclaration())
+      continue;
+
+    StaticCallCounter::countDirectCalls(F, DirectCalls);
+    F.deleteBody();
+  }
+
+  return Error::success();
+}
+
+// Parses (or lazily loads) InputFile. On failure, returns null and records
+// the error in Res.
+static std::unique_ptr<Module> loadInputFile(const std::string &InputFile,
+                                             LLVMContext &Ctx,
+                                             ModuleResult &Res) {
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = LazyLoad
+                                  ? getLazyIRFileModule(InputFile, Err, Ctx)
+                                  : parseIRFile(InputFile, Err, Ctx);
+
+  if (!M) {
+    Res.Failed = true;
+    raw_string_ostream ErrStream(Res.ErrorMsg);
+    Err.print("static", ErrStream);
+  }
+  return M;
+}
+
+static void countStaticCallsInFile(const std::string &InputFile,
+                                   ModuleResult &Res) {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M = loadInputFile(InputFile, Ctx, Res);
+  if (!M)
+    return;
+
+  ResultStaticCC DirectCalls;
+  if (!LazyLoad) {
+    DirectCalls = StaticCallCounter().runOnModule(*M);
+  } else if (Error E = countStaticCallsLazily(*M, DirectCalls)) {
+    Res.Failed = true;
+    Res.ErrorMsg = "static: " + InputFile + ": error: " +
+                   toString(std::move(E)) + "\n";
+    return;
+  }
+
+  // Functions with local linkage from different input files are different
+  // functions, even if their names match. Qualify them with the file name, so
+  // that they are not merged.
+  bool QualifyLocals = InputModules.size() > 1;
+  for (auto &CallCount : DirectCalls) {
+    const Function *F = CallCount.first;
+    std::string Name = F->getName().str();
+    if (QualifyLocals && F->hasLocalLinkage())
+      Name = InputFile + ":" + Name;
+    Res.DirectCalls.emplace_back(std::move(Name), CallCount.second);
+  }
+}
+
+// Counts the opcodes in InputFile. The input files are already processed in
+// parallel, hence the functions are visited sequentially (rather than via
+// ModuleOpcodeCounter).
+static void countOpcodesInFile(const std::string &InputFile,
+                               ModuleResult &Res) {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M = loadInputFile(InputFile, Ctx, Res);
+  if (!M)
+    return;
+
+  for (Function &F : *M) {
+    if (Error E = F.materialize()) {
+      Res.Failed = true;
+      Res.ErrorMsg = "static: " + InputFile + ": error: " +
+                     toString(std::move(E)) + "\n";
+      return;
+    }
+    if (F.isDeclaration())
+      continue;
+
+    Res.Opcodes.merge(OpcodeCounter().generateHistogram(F));
+    if (LazyLoad)
+      F.deleteBody();
+  }
+}
+
+// Analyses every input file (in parallel) with Analyse and reports the files
+// that couldn't be read. Returns false if there were any.
+static bool
+analyseInputFiles(ArrayRef<std::string> InputFiles,
+                  void (*Analyse)(const std::string &, ModuleResult &),
+                  std::vector<ModuleResult> &Results) {
+  // Every worker writes to its own slot, so no locking is required
+  Results.resize(InputFiles.size());
+  {
+    DefaultThreadPool Pool(hardware_concurrency(NumThreads));
+    for (size_t Idx = 0, E = InputFiles.size(); Idx != E; ++Idx)
+      Pool.async([&, Idx] { Analyse(InputFiles[Idx], Results[Idx]); });
+    Pool.wait();
+  }
+
+  bool Failed = false;
+  for (size_t Idx = 0, E = InputFiles.size(); Idx != E; ++Idx) {
+    if (Results[Idx].Failed) {
+      errs() << "Error reading bitcode file: " << InputFiles[Idx] << "\n";
+      errs() << Results[Idx].ErrorMsg;
+      Failed = true;
+    }
+  }
+  return !Failed;
+}
+
+static int printOpcodeStats(ArrayRef<std::string> InputFiles) {
+  std::vector<ModuleResult> Results;
+  if (!analyseInputFiles(InputFiles, countOpcodesInFile, Results))
+    return -1;
+
+  // Merge the results in the order in which the files were specified
+  OpcodeHistogram Opcodes;
+  for (const ModuleResult &Res : Results)
+    Opcodes.merge(Res.Opcodes);
+
+  printOpcodeHistogram(errs(), Opcodes, "total", Format);
+  return 0;
+}
+
+static int printStaticCallStats(ArrayRef<std::string> InputFiles) {
+  std::vector<ModuleResult> Results;
+  if (!analyseInputFiles(InputFiles, countStaticCallsInFile, Results))
+    return -1;
+
+  // Merge the results in the order in which the files were specified
+  MapVector<StringRef, unsigned> DirectCalls;
+  for (const ModuleResult &Res : Results)
+    for (auto &CallCount : Res.DirectCalls)
+      DirectCalls[CallCount.first] += CallCount.second;
+
+  // Print the aggregated results (same format as StaticCallCounterPrinter)
+  errs() << "================================================="
+         << "\n";
+  errs() << "LLVM-TUTOR: static analysis results\n";
+  errs() << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "#N DIRECT CALLS";
+  errs() << format("%-20s %-10s\n", Str1, Str2);
+  errs() << "-------------------------------------------------"
+         << "\n";
+
+  for (auto &CallCount : DirectCalls)
+    errs() << format("%-20s %-10u\n", CallCount.first.str().c_str(),
+                     CallCount.second);
+
+  errs() << "-------------------------------------------------"
+         << "\n\n";
+
+  return 0;
+}
+
 //===----------------------------------------------------------------------===//
 // Main driver code.
 //===----------------------------------------------------------------------===//
@@ -76,10 +295,22 @@ int main(int Argc, char **Argv) {
   //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
   llvm_shutdown_obj SDO;
 
+  if (PrintOpcodes)
+    return printOpcodeStats(InputModules);
+
+  // Many input files (note that response files are expanded by
+  // cl::ParseCommandLineOptions) or lazy loading. The function bodies are
+  // dropped after the analysis in the latter case, hence the results have to
+  // be gathered before the module is printed. Either way, that's what the
+  // multi-file driver does.
+  if (InputModules.size() > 1 || LazyLoad)
+    return printStaticCallStats(InputModules);
+
   // Parse the IR file passed on the command line.
   SMDiagnostic Err;
   LLVMContext Ctx;
-  std::unique_ptr<Module> M = parseIRFile(InputModule.getValue(), Err, Ctx);
+  const std::string &InputModule = InputModules.front();
+  std::unique_ptr<Module> M = parseIRFile(InputModule, Err, Ctx);
 
   if (!M) {
     errs() << "Error reading bitcode file: " << InputModule << "\n";
@@ -15,6 +15,10 @@
 #   Thanks to static regisration, you don't have to load the plugin with e.g.
 #   `-load`.
 #
+#   To link all the passes into your own tool instead, configure llvm-tutor
+#   with -DLT_LINK_INTO_TOOLS=ON (see "Dynamic vs Static Plugins" in
+#   README.md).
+#
 #  USAGE:
 #    export $LLVM_DIR=<llvm-project/source/dir>
 #    cd <llvm-tutor/source/dir>